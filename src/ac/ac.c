@@ -4,6 +4,8 @@
 #include "capwap_dtls.h"
 #include "capwap_socket.h"
 #include "ac_wlans.h"
+#include "ac_stationcache.h"
+#include "ac_packets.h"
 
 #include <libconfig.h>
 
@@ -38,6 +40,72 @@ static int ac_stations_item_cmp(const void* key1, const void* key2) {
 	return memcmp(key1, key2, MACADDRESS_EUI48_LENGTH);
 }
 
+/* */
+static unsigned long ac_sessionsaddress_item_gethash(const void* key, unsigned long hashsize) {
+	return (capwap_address_hash((union sockaddr_capwap*)key, 1) % hashsize);
+}
+
+/* */
+static const void* ac_sessionsaddress_item_getkey(const void* data) {
+	return (const void*)&((struct ac_session_t*)data)->dtls.peeraddr;
+}
+
+/* */
+static int ac_sessionsaddress_item_cmp(const void* key1, const void* key2) {
+	return capwap_address_cmp((union sockaddr_capwap*)key1, (union sockaddr_capwap*)key2, 1);
+}
+
+/* The data channel uses other port of WTP, only IP address */
+static unsigned long ac_sessionsdatachannel_item_gethash(const void* key, unsigned long hashsize) {
+	return (capwap_address_hash((union sockaddr_capwap*)key, 0) % hashsize);
+}
+
+/* */
+static int ac_sessionsdatachannel_item_cmp(const void* key1, const void* key2) {
+	return capwap_address_cmp((union sockaddr_capwap*)key1, (union sockaddr_capwap*)key2, 0);
+}
+
+/* */
+static unsigned long ac_sessionswtpid_item_gethash(const void* key, unsigned long hashsize) {
+	unsigned long hash = 5381;
+	const unsigned char* wtpid = (const unsigned char*)key;
+
+	while (*wtpid) {
+		hash = ((hash << 5) + hash) ^ *wtpid++;
+	}
+
+	return (hash % hashsize);
+}
+
+/* */
+static const void* ac_sessionswtpid_item_getkey(const void* data) {
+	return (const void*)((struct ac_session_t*)data)->wtpid;
+}
+
+/* */
+static int ac_sessionswtpid_item_cmp(const void* key1, const void* key2) {
+	return strcmp((const char*)key1, (const char*)key2);
+}
+
+/* */
+static unsigned long ac_sessionssessionid_item_gethash(const void* key, unsigned long hashsize) {
+	uint32_t value[4];
+
+	/* Session id is random, fold it */
+	memcpy(value, ((struct capwap_sessionid_element*)key)->id, sizeof(value));
+	return ((unsigned long)(value[0] ^ value[1] ^ value[2] ^ value[3]) % hashsize);
+}
+
+/* */
+static const void* ac_sessionssessionid_item_getkey(const void* data) {
+	return (const void*)&((struct ac_session_t*)data)->sessionid;
+}
+
+/* */
+static int ac_sessionssessionid_item_cmp(const void* key1, const void* key2) {
+	return memcmp(key1, key2, sizeof(struct capwap_sessionid_element));
+}
+
 /* */
 static unsigned long ac_ifdatachannel_item_gethash(const void* key, unsigned long hashsize) {
 	return ((*(unsigned long*)key) % AC_IFDATACHANNEL_HASH_SIZE);
@@ -117,6 +185,33 @@ static int ac_init(void) {
 	g_ac.sessions = capwap_list_create();
 	g_ac.sessionsthread = capwap_list_create();
 	capwap_rwlock_init(&g_ac.sessionslock);
+	capwap_lock_init(&g_ac.sessionsreleasinglock);
+	capwap_event_init(&g_ac.sessionsreleasingevent);
+	g_ac.sessionsengine = AC_SESSIONS_ENGINE_THREAD;
+	g_ac.sessionsworkers = 0;
+	g_ac.handshakesthreads = 0;
+	g_ac.handshakesconcurrent = AC_DEFAULT_HANDSHAKES_CONCURRENT;
+	g_ac.netshardscount = 1;
+
+	g_ac.sessionsaddress = capwap_hash_create(AC_SESSIONS_HASH_SIZE);
+	g_ac.sessionsaddress->item_gethash = ac_sessionsaddress_item_gethash;
+	g_ac.sessionsaddress->item_getkey = ac_sessionsaddress_item_getkey;
+	g_ac.sessionsaddress->item_cmp = ac_sessionsaddress_item_cmp;
+
+	g_ac.sessionswtpid = capwap_hash_create(AC_SESSIONS_HASH_SIZE);
+	g_ac.sessionswtpid->item_gethash = ac_sessionswtpid_item_gethash;
+	g_ac.sessionswtpid->item_getkey = ac_sessionswtpid_item_getkey;
+	g_ac.sessionswtpid->item_cmp = ac_sessionswtpid_item_cmp;
+
+	g_ac.sessionssessionid = capwap_hash_create(AC_SESSIONS_HASH_SIZE);
+	g_ac.sessionssessionid->item_gethash = ac_sessionssessionid_item_gethash;
+	g_ac.sessionssessionid->item_getkey = ac_sessionssessionid_item_getkey;
+	g_ac.sessionssessionid->item_cmp = ac_sessionssessionid_item_cmp;
+
+	g_ac.sessionsdatachannel = capwap_hash_create(AC_SESSIONS_HASH_SIZE);
+	g_ac.sessionsdatachannel->item_gethash = ac_sessionsdatachannel_item_gethash;
+	g_ac.sessionsdatachannel->item_getkey = ac_sessionsaddress_item_getkey;
+	g_ac.sessionsdatachannel->item_cmp = ac_sessionsdatachannel_item_cmp;
 
 	/* Stations */
 	g_ac.authstations = capwap_hash_create(AC_STATIONS_HASH_SIZE);
@@ -137,6 +232,15 @@ static int ac_init(void) {
 
 	/* Backend */
 	g_ac.availablebackends = capwap_array_create(sizeof(struct ac_http_soap_server*), 0, 0);
+	g_ac.backendpoolconnections = SOAP_PROTOCOL_POOL_MAX_CONNECTIONS;
+	g_ac.backendpoolreserved = SOAP_PROTOCOL_POOL_RESERVED_CONNECTIONS;
+	g_ac.stationcachesize = AC_DEFAULT_STATIONCACHE_SIZE;
+	g_ac.stationcachetimeout = AC_DEFAULT_STATIONCACHE_TIMEOUT;
+	g_ac.stationcachedeniedtimeout = AC_DEFAULT_STATIONCACHE_DENIED_TIMEOUT;
+	ac_stationcache_init();
+
+	/* Packets */
+	ac_packets_init();
 
 	return 1;
 }
@@ -169,7 +273,18 @@ static void ac_destroy(void) {
 	/* Sessions */
 	capwap_list_free(g_ac.sessions);
 	capwap_list_free(g_ac.sessionsthread);
+	ASSERT(g_ac.sessionsaddress->count == 0);
+	capwap_hash_free(g_ac.sessionsaddress);
+	ASSERT(g_ac.sessionswtpid->count == 0);
+	capwap_hash_free(g_ac.sessionswtpid);
+	ASSERT(g_ac.sessionssessionid->count == 0);
+	capwap_hash_free(g_ac.sessionssessionid);
+	ASSERT(g_ac.sessionsdatachannel->count == 0);
+	capwap_hash_free(g_ac.sessionsdatachannel);
 	capwap_rwlock_destroy(&g_ac.sessionslock);
+	ASSERT(g_ac.sessionsreleasing == 0);
+	capwap_lock_destroy(&g_ac.sessionsreleasinglock);
+	capwap_event_destroy(&g_ac.sessionsreleasingevent);
 	ac_msgqueue_free();
 
 	/* Data Channel Interfaces */
@@ -196,7 +311,11 @@ static void ac_destroy(void) {
 	}
 
 	capwap_array_free(g_ac.availablebackends);
+	ac_stationcache_free();
 	capwap_list_free(g_ac.addrlist);
+
+	/* Packets */
+	ac_packets_free();
 }
 
 /* Help */
@@ -467,6 +586,27 @@ static int ac_parsing_configuration_1_0(config_t* config) {
 		g_ac.dfa.wtpfallback.mode = ((configBool != 0) ? CAPWAP_WTP_FALLBACK_ENABLED : CAPWAP_WTP_FALLBACK_DISABLED);
 	}
 
+	/* Set sessions engine of AC */
+	if (config_lookup_string(config, "application.sessions.engine", &configString) == CONFIG_TRUE) {
+		if (!strcmp(configString, "thread")) {
+			g_ac.sessionsengine = AC_SESSIONS_ENGINE_THREAD;
+		} else if (!strcmp(configString, "workers")) {
+			g_ac.sessionsengine = AC_SESSIONS_ENGINE_WORKERS;
+		} else {
+			log_printf(LOG_ERR, "Invalid configuration file, unknown application.sessions.engine value");
+			return 0;
+		}
+	}
+
+	if (config_lookup_int(config, "application.sessions.workers", &configInt) == CONFIG_TRUE) {
+		if ((configInt >= 0) && (configInt <= AC_SESSIONS_MAX_WORKERS)) {
+			g_ac.sessionsworkers = (unsigned long)configInt;
+		} else {
+			log_printf(LOG_ERR, "Invalid configuration file, invalid application.sessions.workers value");
+			return 0;
+		}
+	}
+
 	/* Set DTLS of WTP */
 	if (config_lookup_bool(config, "application.dtls.enable", &configBool) == CONFIG_TRUE) {
 		if (configBool != 0) {
@@ -488,6 +628,54 @@ static int ac_parsing_configuration_1_0(config_t* config) {
 				}
 			}
 
+			/* Set DTLS version and cipher suites of AC */
+			dtlsparam.version = CAPWAP_DTLS_VERSION_ANY;
+			if (config_lookup_string(config, "application.dtls.version", &configString) == CONFIG_TRUE) {
+				if (!strcmp(configString, "any")) {
+					dtlsparam.version = CAPWAP_DTLS_VERSION_ANY;
+				} else if (!strcmp(configString, "1.2")) {
+					dtlsparam.version = CAPWAP_DTLS_VERSION_1_2;
+				} else if (!strcmp(configString, "1.0")) {
+					dtlsparam.version = CAPWAP_DTLS_VERSION_1_0;
+				} else {
+					log_printf(LOG_ERR, "Invalid configuration file, unknown application.dtls.version value");
+					return 0;
+				}
+			}
+
+			/* Set DTLS session cache of AC */
+			dtlsparam.sessioncache.size = AC_DEFAULT_DTLS_SESSIONCACHE_SIZE;
+			dtlsparam.sessioncache.timeout = AC_DEFAULT_DTLS_SESSIONCACHE_TIMEOUT;
+			if (config_lookup_int(config, "application.dtls.sessioncache.size", &configInt) == CONFIG_TRUE) {
+				if (configInt >= 0) {
+					dtlsparam.sessioncache.size = (unsigned long)configInt;
+				} else {
+					log_printf(LOG_ERR, "Invalid configuration file, invalid application.dtls.sessioncache.size value");
+					return 0;
+				}
+			}
+
+			if (config_lookup_int(config, "application.dtls.sessioncache.timeout", &configInt) == CONFIG_TRUE) {
+				if (configInt > 0) {
+					dtlsparam.sessioncache.timeout = (long)configInt;
+				} else {
+					log_printf(LOG_ERR, "Invalid configuration file, invalid application.dtls.sessioncache.timeout value");
+					return 0;
+				}
+			}
+
+			if (config_lookup_string(config, "application.dtls.sessioncache.file", &configString) == CONFIG_TRUE) {
+				if (strlen(configString) > 0) {
+					dtlsparam.sessioncache.file = capwap_duplicate_string(configString);
+				}
+			}
+
+			if (config_lookup_string(config, "application.dtls.ciphers", &configString) == CONFIG_TRUE) {
+				if (strlen(configString) > 0) {
+					dtlsparam.ciphers = capwap_duplicate_string(configString);
+				}
+			}
+
 			/* Set DTLS configuration of AC */
 			if (dtlsparam.mode == CAPWAP_DTLS_MODE_CERTIFICATE) {
 				if (config_lookup_string(config, "application.dtls.x509.calist", &configString) == CONFIG_TRUE) {
@@ -567,12 +755,38 @@ static int ac_parsing_configuration_1_0(config_t* config) {
 				}
 			}
 
+			if (dtlsparam.sessioncache.file) {
+				capwap_free(dtlsparam.sessioncache.file);
+			}
+
+			if (dtlsparam.ciphers) {
+				capwap_free(dtlsparam.ciphers);
+			}
+
 			if (!g_ac.enabledtls) {
 				return 0;
 			}
 		}
 	}
 
+	if (config_lookup_int(config, "application.dtls.handshakes.threads", &configInt) == CONFIG_TRUE) {
+		if ((configInt >= 0) && (configInt <= AC_HANDSHAKES_MAX_THREADS)) {
+			g_ac.handshakesthreads = (unsigned long)configInt;
+		} else {
+			log_printf(LOG_ERR, "Invalid configuration file, invalid application.dtls.handshakes.threads value");
+			return 0;
+		}
+	}
+
+	if (config_lookup_int(config, "application.dtls.handshakes.concurrent", &configInt) == CONFIG_TRUE) {
+		if (configInt >= 0) {
+			g_ac.handshakesconcurrent = (unsigned long)configInt;
+		} else {
+			log_printf(LOG_ERR, "Invalid configuration file, invalid application.dtls.handshakes.concurrent value");
+			return 0;
+		}
+	}
+
 	/* Set interface binding of AC */
 	if (config_lookup_string(config, "application.network.binding", &configString) == CONFIG_TRUE) {
 		if (strlen(configString) > (IFNAMSIZ - 1)) {
@@ -593,6 +807,16 @@ static int ac_parsing_configuration_1_0(config_t* config) {
 		}
 	}
 
+	/* Set control sockets shards of AC */
+	if (config_lookup_int(config, "application.network.shards", &configInt) == CONFIG_TRUE) {
+		if ((configInt >= 0) && (configInt <= AC_MAX_NETWORK_SHARDS)) {
+			g_ac.netshardscount = (unsigned long)configInt;
+		} else {
+			log_printf(LOG_ERR, "Invalid configuration file, invalid application.network.shards value");
+			return 0;
+		}
+	}
+
 	/* Set transport of AC */
 	if (config_lookup_string(config, "application.network.transport", &configString) == CONFIG_TRUE) {
 		if (!strcmp(configString, "udp")) {
@@ -618,6 +842,57 @@ static int ac_parsing_configuration_1_0(config_t* config) {
 		}
 	}
 
+	if (config_lookup_int(config, "backend.pool.connections", &configInt) == CONFIG_TRUE) {
+		if (configInt > 0) {
+			g_ac.backendpoolconnections = (unsigned long)configInt;
+		} else {
+			log_printf(LOG_ERR, "Invalid configuration file, invalid backend.pool.connections value");
+			return 0;
+		}
+	}
+
+	if (config_lookup_int(config, "backend.pool.reserved", &configInt) == CONFIG_TRUE) {
+		if (configInt > 0) {
+			g_ac.backendpoolreserved = (unsigned long)configInt;
+		} else {
+			log_printf(LOG_ERR, "Invalid configuration file, invalid backend.pool.reserved value");
+			return 0;
+		}
+	}
+
+	/* The SOAP calls of sessions need at least a connection not reserved */
+	if (g_ac.backendpoolreserved >= g_ac.backendpoolconnections) {
+		log_printf(LOG_ERR, "Invalid configuration file, backend.pool.reserved must be less than backend.pool.connections");
+		return 0;
+	}
+
+	if (config_lookup_int(config, "backend.stationcache.size", &configInt) == CONFIG_TRUE) {
+		if (configInt >= 0) {
+			g_ac.stationcachesize = (unsigned long)configInt;
+		} else {
+			log_printf(LOG_ERR, "Invalid configuration file, invalid backend.stationcache.size value");
+			return 0;
+		}
+	}
+
+	if (config_lookup_int(config, "backend.stationcache.timeout", &configInt) == CONFIG_TRUE) {
+		if (configInt > 0) {
+			g_ac.stationcachetimeout = (long)configInt;
+		} else {
+			log_printf(LOG_ERR, "Invalid configuration file, invalid backend.stationcache.timeout value");
+			return 0;
+		}
+	}
+
+	if (config_lookup_int(config, "backend.stationcache.deniedtimeout", &configInt) == CONFIG_TRUE) {
+		if (configInt > 0) {
+			g_ac.stationcachedeniedtimeout = (long)configInt;
+		} else {
+			log_printf(LOG_ERR, "Invalid configuration file, invalid backend.stationcache.deniedtimeout value");
+			return 0;
+		}
+	}
+
 	configSetting = config_lookup(config, "backend.server");
 	if (configSetting) {
 		int count = config_setting_length(configSetting);
@@ -637,6 +912,10 @@ static int ac_parsing_configuration_1_0(config_t* config) {
 						return 0;
 					}
 
+					/* Connection pool */
+					server->maxconnections = (int)g_ac.backendpoolconnections;
+					server->reservedconnections = (int)g_ac.backendpoolreserved;
+
 					/* HTTPS params */
 					if (server->protocol == SOAP_HTTPS_PROTOCOL) {
 						char* calist = NULL;
@@ -774,14 +1053,66 @@ static int ac_load_configuration(int argc, char** argv) {
 	return result;	
 }
 
+/* Bind the other sockets of control channel on the same address of g_ac.net */
+static int ac_configure_netshards(void) {
+	long cpus;
+	unsigned long i;
+
+	/* Number of shards */
+	if (!g_ac.netshardscount) {
+		cpus = sysconf(_SC_NPROCESSORS_ONLN);
+		g_ac.netshardscount = ((cpus > 0) ? (unsigned long)cpus : 1);
+		if (g_ac.netshardscount > AC_MAX_NETWORK_SHARDS) {
+			g_ac.netshardscount = AC_MAX_NETWORK_SHARDS;
+		}
+	}
+
+	if (g_ac.netshardscount < 2) {
+		return 0;
+	}
+
+	/* */
+	g_ac.netshards = (struct capwap_network*)capwap_alloc(sizeof(struct capwap_network) * (g_ac.netshardscount - 1));
+	for (i = 0; i < (g_ac.netshardscount - 1); i++) {
+		capwap_network_init(&g_ac.netshards[i]);
+	}
+
+	for (i = 0; i < (g_ac.netshardscount - 1); i++) {
+		struct capwap_network* net = &g_ac.netshards[i];
+
+		memcpy(&net->localaddr, &g_ac.net.localaddr, sizeof(union sockaddr_capwap));
+		strcpy(net->bindiface, g_ac.net.bindiface);
+		net->reuseport = 1;
+
+		if (capwap_bind_sockets(net)) {
+			return -1;
+		}
+	}
+
+	/* Keep every WTP on the same shard, without steering the kernel use the 4-tuple hash */
+	if (capwap_bind_reuseport_steering(&g_ac.net, (int)g_ac.netshardscount)) {
+		log_printf(LOG_WARNING, "Unable to steer control sockets shards by peer address, use kernel hash");
+	}
+
+	log_printf(LOG_INFO, "Bind %lu control sockets shards", g_ac.netshardscount);
+	return 0;
+}
+
 /* Init AC */
 static int ac_configure(void) {
 	/* Bind control channel to any address */
+	g_ac.net.reuseport = ((g_ac.netshardscount != 1) ? 1 : 0);
 	if (capwap_bind_sockets(&g_ac.net)) {
 		log_printf(LOG_EMERG, "Cannot bind address");
 		return AC_ERROR_NETWORK;
 	}
 
+	/* Bind control channel shards */
+	if (g_ac.net.reuseport && ac_configure_netshards()) {
+		log_printf(LOG_EMERG, "Cannot bind control sockets shards");
+		return AC_ERROR_NETWORK;
+	}
+
 	/* Detect local address */
 	capwap_interface_list(&g_ac.net, g_ac.addrlist);
 
@@ -794,6 +1125,17 @@ static void ac_close(void) {
 	
 	/* Close socket */
 	capwap_close_sockets(&g_ac.net);
+
+	if (g_ac.netshards) {
+		unsigned long i;
+
+		for (i = 0; i < (g_ac.netshardscount - 1); i++) {
+			capwap_close_sockets(&g_ac.netshards[i]);
+		}
+
+		capwap_free(g_ac.netshards);
+		g_ac.netshards = NULL;
+	}
 }
 
 /* Check is valid binding */
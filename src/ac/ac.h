@@ -23,6 +23,28 @@
 
 #define AC_DEFAULT_MAXSTATION				128
 #define AC_DEFAULT_MAXSESSIONS				128
+#define AC_SESSIONS_HASH_SIZE				16384
+
+/* Sessions engine */
+#define AC_SESSIONS_ENGINE_THREAD			0
+#define AC_SESSIONS_ENGINE_WORKERS			1
+#define AC_SESSIONS_MAX_WORKERS				256
+
+/* DTLS handshake pool */
+#define AC_HANDSHAKES_MAX_THREADS			256
+#define AC_DEFAULT_HANDSHAKES_CONCURRENT	64
+
+/* DTLS session cache */
+#define AC_DEFAULT_DTLS_SESSIONCACHE_SIZE		1024
+#define AC_DEFAULT_DTLS_SESSIONCACHE_TIMEOUT	3600
+
+/* Station authorization cache */
+#define AC_DEFAULT_STATIONCACHE_SIZE			4096
+#define AC_DEFAULT_STATIONCACHE_TIMEOUT			300
+#define AC_DEFAULT_STATIONCACHE_DENIED_TIMEOUT	30
+
+/* Control sockets shards */
+#define AC_MAX_NETWORK_SHARDS				64
 
 #define VLAN_MAX							4096
 
@@ -117,6 +139,8 @@ struct ac_t {
 	struct ac_state dfa;
 	struct capwap_network net;
 	struct capwap_list* addrlist;
+	unsigned long netshardscount;						/* Number of SO_REUSEPORT control sockets, g_ac.net is the first */
+	struct capwap_network* netshards;					/* Control sockets served by the shard dispatchers */
 	unsigned short mtu;
 
 	struct capwap_array* binding;
@@ -133,8 +157,21 @@ struct ac_t {
 	/* Sessions */
 	struct capwap_list* sessions;
 	struct capwap_list* sessionsthread;
+	struct capwap_hash* sessionsaddress;				/* Index of g_ac.sessions by WTP address */
+	struct capwap_hash* sessionswtpid;					/* Index of g_ac.sessions by WTP id */
+	struct capwap_hash* sessionssessionid;				/* Index of g_ac.sessions by Session id */
+	struct capwap_hash* sessionsdatachannel;			/* Index by WTP IP address of the sessions which establish the data channel */
 	capwap_rwlock_t sessionslock;
 
+	/* Sessions destroyed by owner which wait the release of last reference */
+	unsigned long sessionsreleasing;
+	capwap_lock_t sessionsreleasinglock;
+	capwap_event_t sessionsreleasingevent;
+
+	/* Sessions engine */
+	int sessionsengine;
+	unsigned long sessionsworkers;						/* Number of worker threads, 0 for the number of online CPUs */
+
 	/* Authorative Stations */
 	struct capwap_hash* authstations;
 	capwap_rwlock_t authstationslock;
@@ -146,11 +183,18 @@ struct ac_t {
 	/* Dtls */
 	int enabledtls;
 	struct capwap_dtls_context dtlscontext;
+	unsigned long handshakesthreads;					/* Number of handshake threads, 0 for the number of online CPUs */
+	unsigned long handshakesconcurrent;					/* Max sessions into DTLS handshake, 0 for unlimited */
 
 	/* Backend Management */
 	char* backendacid;
 	char* backendversion;
 	struct capwap_array* availablebackends;
+	unsigned long backendpoolconnections;				/* Max connections of pool with every server */
+	unsigned long backendpoolreserved;					/* Connections reserved to Backend Management Thread */
+	unsigned long stationcachesize;						/* Max number of cached station authorizations, 0 disable cache */
+	long stationcachetimeout;							/* Lifetime in seconds of authorization */
+	long stationcachedeniedtimeout;						/* Lifetime in seconds of denied authorization */
 };
 
 /* AC session thread */
@@ -3,6 +3,7 @@
 #include "ac_backend.h"
 #include "ac_soap.h"
 #include "ac_session.h"
+#include "ac_stationcache.h"
 
 /* */
 #define AC_BACKEND_WAIT_TIMEOUT							10000
@@ -36,6 +37,19 @@ static struct ac_http_soap_server* ac_backend_get_server(void) {
 	return *(struct ac_http_soap_server**)capwap_array_get_item_pointer(g_ac.availablebackends, g_ac_backend.activebackend);
 }
 
+/* The requests of Backend Management Thread use the reserved slots of pool,
+   the SOAP calls of sessions can not starve the control connection */
+static struct ac_http_soap_request* ac_backend_prepare_request(struct ac_soap_request* request, struct ac_http_soap_server* server) {
+	struct ac_http_soap_request* soaprequest;
+
+	soaprequest = ac_soapclient_prepare_request(request, server);
+	if (soaprequest) {
+		soaprequest->reserved = 1;
+	}
+
+	return soaprequest;
+}
+
 /* */
 static int ac_backend_parsing_closewtpsession_event(const char* idevent, struct json_object* jsonparams) {
 	int result = -1;
@@ -67,11 +81,12 @@ static int ac_backend_parsing_closewtpsession_event(const char* idevent, struct
 
 		/* Async close session */
 		log_printf(LOG_DEBUG, "Receive close wtp session for WTP %s", session->wtpid);
-		ac_session_send_action(session, AC_SESSION_ACTION_CLOSE, 0, NULL, 0);
+		if (ac_session_send_action(session, AC_SESSION_ACTION_CLOSE, 0, NULL, 0)) {
+			result = 0;
+		}
 
 		/* */
 		ac_session_release_reference(session);
-		result = 0;
 	}
 
 	return result;
@@ -139,8 +154,9 @@ static int ac_backend_parsing_resetwtp_event(const char* idevent, struct json_ob
 
 			/* Notify Action */
 			log_printf(LOG_DEBUG, "Receive reset request for WTP %s", session->wtpid);
-			ac_session_send_action(session, AC_SESSION_ACTION_RESET_WTP, 0, (void*)reset, length);
-			result = 0;
+			if (ac_session_send_action(session, AC_SESSION_ACTION_RESET_WTP, 0, (void*)reset, length)) {
+				result = 0;
+			}
 
 			/* */
 			capwap_free(reset);
@@ -290,12 +306,13 @@ static int ac_backend_parsing_addwlan_event(const char* idevent, struct json_obj
 
 		/* Notify Action */
 		log_printf(LOG_DEBUG, "Receive AddWLAN request for WTP %s with SSID: %s", session->wtpid, addwlan->ssid);
-		ac_session_send_action(session, AC_SESSION_ACTION_ADDWLAN, 0, (void*)addwlan, length);
+		if (ac_session_send_action(session, AC_SESSION_ACTION_ADDWLAN, 0, (void*)addwlan, length)) {
+			result = 0;
+		}
 
 		/* */
 		ac_session_release_reference(session);
 		capwap_free(addwlan);
-		result = 0;
 	}
 
 	return result;
@@ -315,6 +332,45 @@ static int ac_backend_parsing_deletewlan_event(const char* idevent, struct json_
 	return result;
 }
 
+/* */
+static int ac_backend_parsing_invalidatestation_event(const char* idevent, struct json_object* jsonparams) {
+	const char* ssid = NULL;
+	uint8_t* station = NULL;
+	uint8_t address[MACADDRESS_EUI48_LENGTH];
+	struct json_object* jsonelement;
+
+	/* Params InvalidateStation Action, without params all the authorizations are invalidated
+		{
+			Station: [string],
+			SSID: [string]
+		}
+	*/
+
+	/* Station */
+	jsonelement = compat_json_object_object_get(jsonparams, "Station");
+	if (jsonelement) {
+		if ((json_object_get_type(jsonelement) != json_type_string) || !capwap_scanf_macaddress(address, json_object_get_string(jsonelement), MACADDRESS_EUI48_LENGTH)) {
+			return -1;
+		}
+
+		station = address;
+	}
+
+	/* SSID */
+	jsonelement = compat_json_object_object_get(jsonparams, "SSID");
+	if (jsonelement) {
+		if (json_object_get_type(jsonelement) != json_type_string) {
+			return -1;
+		}
+
+		ssid = json_object_get_string(jsonelement);
+	}
+
+	/* The event is complete without session */
+	log_printf(LOG_DEBUG, "Invalidated %lu station authorizations", ac_stationcache_invalidate(ssid, station));
+	return 1;
+}
+
 /* */
 static int ac_backend_soap_update_event(const char* idevent, int status) {
 	int result = 0;
@@ -338,7 +394,7 @@ static int ac_backend_soap_update_event(const char* idevent, int status) {
 			ac_soapclient_add_param(request, "xs:string", "idsession", g_ac_backend.backendsessionid);
 			ac_soapclient_add_param(request, "xs:string", "idevent", idevent);
 			ac_soapclient_add_param(request, "xs:int", "status", capwap_itoa(status, buffer));
-			g_ac_backend.soaprequest = ac_soapclient_prepare_request(request, server);
+			g_ac_backend.soaprequest = ac_backend_prepare_request(request, server);
 		}
 	}
 
@@ -394,7 +450,7 @@ static int ac_backend_soap_getconfiguration(void) {
 		request = ac_soapclient_create_request("getConfiguration", SOAP_NAMESPACE_URI);
 		if (request) {
 			ac_soapclient_add_param(request, "xs:string", "idsession", g_ac_backend.backendsessionid);
-			g_ac_backend.soaprequest = ac_soapclient_prepare_request(request, server);
+			g_ac_backend.soaprequest = ac_backend_prepare_request(request, server);
 		}
 	}
 
@@ -460,7 +516,7 @@ static int ac_backend_soap_join(int forcereset) {
 			ac_soapclient_add_param(request, "xs:string", "idac", g_ac.backendacid);
 			ac_soapclient_add_param(request, "xs:string", "version", g_ac.backendversion);
 			ac_soapclient_add_param(request, "xs:boolean", "forcereset", (forcereset ? "true" : "false"));
-			g_ac_backend.soaprequest = ac_soapclient_prepare_request(request, server);
+			g_ac_backend.soaprequest = ac_backend_prepare_request(request, server);
 		}
 	}
 
@@ -480,13 +536,8 @@ static int ac_backend_soap_join(int forcereset) {
 		struct ac_soap_response* response = ac_soapclient_recv_response(g_ac_backend.soaprequest);
 		if (response) {
 			/* Get join result */
-			if ((response->responsecode == HTTP_RESULT_OK) && response->xmlResponseReturn) {
-				xmlChar* xmlResult = xmlNodeGetContent(response->xmlResponseReturn);
-				if (xmlStrlen(xmlResult)) {
-					g_ac_backend.backendsessionid = capwap_duplicate_string((const char*)xmlResult);
-				}
-
-				xmlFree(xmlResult);
+			if ((response->responsecode == HTTP_RESULT_OK) && response->returnvalue && *response->returnvalue) {
+				g_ac_backend.backendsessionid = capwap_duplicate_string(response->returnvalue);
 			}
 
 			/* */
@@ -555,10 +606,12 @@ static int ac_backend_parsing_event(struct json_object* jsonitem) {
 						result = ac_backend_parsing_updatewlan_event(idevent, jsonvalue);
 					} else if (!strcmp(action, "DeleteWLAN")) {
 						result = ac_backend_parsing_deletewlan_event(idevent, jsonvalue);
+					} else if (!strcmp(action, "InvalidateStation")) {
+						result = ac_backend_parsing_invalidatestation_event(idevent, jsonvalue);
 					}
 
 					/* Notify result action */
-					ac_backend_soap_update_event(idevent, (!result ? SOAP_EVENT_STATUS_RUNNING : SOAP_EVENT_STATUS_GENERIC_ERROR));
+					ac_backend_soap_update_event(idevent, (!result ? SOAP_EVENT_STATUS_RUNNING : ((result > 0) ? SOAP_EVENT_STATUS_COMPLETE : SOAP_EVENT_STATUS_GENERIC_ERROR)));
 				}
 			}
 		}
@@ -588,7 +641,7 @@ static int ac_backend_soap_waitevent(void) {
 		request = ac_soapclient_create_request("waitBackendEvent", SOAP_NAMESPACE_URI);
 		if (request) {
 			ac_soapclient_add_param(request, "xs:string", "idsession", g_ac_backend.backendsessionid);
-			g_ac_backend.soaprequest = ac_soapclient_prepare_request(request, server);
+			g_ac_backend.soaprequest = ac_backend_prepare_request(request, server);
 
 			/* Change result timeout */
 			g_ac_backend.soaprequest->responsetimeout = SOAP_PROTOCOL_RESPONSE_WAIT_EVENT_TIMEOUT;
@@ -677,7 +730,7 @@ static void ac_backend_soap_leave(void) {
 	request = ac_soapclient_create_request("leaveBackend", SOAP_NAMESPACE_URI);
 	if (request) {
 		ac_soapclient_add_param(request, "xs:string", "idsession", g_ac_backend.backendsessionid);
-		g_ac_backend.soaprequest = ac_soapclient_prepare_request(request, server);
+		g_ac_backend.soaprequest = ac_backend_prepare_request(request, server);
 	}
 
 	capwap_lock_exit(&g_ac_backend.lock);
@@ -732,6 +785,9 @@ static void ac_backend_run(void) {
 				capwap_free(g_ac_backend.backendsessionid);
 				g_ac_backend.backendsessionid = NULL;
 
+				/* The invalidation events can be lost, the stations will be authorized again */
+				ac_stationcache_invalidate(NULL, NULL);
+
 				/* Change backend */
 				g_ac_backend.activebackend = (g_ac_backend.activebackend + 1) % g_ac.availablebackends->count;
 			}
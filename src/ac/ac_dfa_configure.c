@@ -32,8 +32,12 @@ static void ac_dfa_state_configure_set_radio_configuration(struct ac_session_t*
 }
 
 /* */
-static struct ac_soap_response* ac_dfa_state_configure_parsing_request(struct ac_session_t* session, struct capwap_parsed_packet* packet) {
+static void ac_dfa_state_configure_complete(struct ac_session_t* session, struct ac_soap_response* response, void* context);
+
+/* */
+static int ac_dfa_state_configure_parsing_request(struct ac_session_t* session, struct capwap_parsed_packet* packet) {
 	int i;
+	int result;
 	const char* jsonmessage;
 	char* base64confstatus;
 	struct json_object* jsonarray;
@@ -43,7 +47,6 @@ static struct ac_soap_response* ac_dfa_state_configure_parsing_request(struct ac
 	struct capwap_statisticstimer_element* statisticstimer;
 	struct capwap_wtprebootstat_element* wtprebootstat;
 	struct capwap_wtpstaticipaddress_element* wtpstaticipaddress;
-	struct ac_soap_response* response;
 	unsigned short binding = GET_WBID_HEADER(packet->rxmngpacket->header);
 
 	/* Create SOAP request with JSON param
@@ -213,24 +216,20 @@ static struct ac_soap_response* ac_dfa_state_configure_parsing_request(struct ac
 	/* Binding message */
 	if (binding == CAPWAP_WIRELESS_BINDING_IEEE80211) {
 		struct ac_json_ieee80211_wtpradio wtpradio;
-		struct capwap_list_item* search = packet->messages->first;
 
 		/* Reording message by radioid and management */
 		ac_json_ieee80211_init(&wtpradio);
 
-		while (search) {
-			struct capwap_message_element_itemlist* messageelement = (struct capwap_message_element_itemlist*)search->item;
+		for (i = 0; i < packet->count; i++) {
+			struct capwap_message_element_itemlist* messageelement = &packet->elements[i];
 
 			/* Parsing only IEEE 802.11 message element */
 			if (IS_80211_MESSAGE_ELEMENTS(messageelement->id)) {
 				if (!ac_json_ieee80211_parsingmessageelement(&wtpradio, messageelement)) {
 					json_object_put(jsonparam);
-					return NULL;
+					return 0;
 				}
 			}
-
-			/* Next */
-			search = search->next;
 		}
 
 		/* Generate JSON tree */
@@ -246,14 +245,14 @@ static struct ac_soap_response* ac_dfa_state_configure_parsing_request(struct ac
 	base64confstatus = capwap_alloc(AC_BASE64_ENCODE_LENGTH(strlen(jsonmessage)));
 	ac_base64_string_encode(jsonmessage, base64confstatus);
 
-	/* Send message */
-	response = ac_soap_configurestatuswtpsession(session, session->wtpid, base64confstatus);
+	/* Send message, the configuration continues on completion */
+	result = ac_soap_configurestatuswtpsession(session, ac_dfa_state_configure_complete, session->wtpid, base64confstatus);
 
 	/* Free JSON */
 	json_object_put(jsonparam);
 	capwap_free(base64confstatus);
 
-	return response;
+	return result;
 }
 
 /* */
@@ -711,24 +710,18 @@ static uint32_t ac_dfa_state_configure_create_response(struct ac_session_t* sess
 }
 
 /* */
-void ac_dfa_state_configure(struct ac_session_t* session, struct capwap_parsed_packet* packet) {
-	struct ac_soap_response* response;
+static void ac_dfa_state_configure_send_response(struct ac_session_t* session, struct capwap_parsed_packet* packet, struct ac_soap_response* response) {
 	struct capwap_header_data capwapheader;
 	struct capwap_packet_txmng* txmngpacket;
 	uint32_t result = CAPWAP_RESULTCODE_FAILURE;
 
-	ASSERT(session != NULL);
-	ASSERT(packet != NULL);
-
 	/* Create response */
 	capwap_header_init(&capwapheader, CAPWAP_RADIOID_NONE, GET_WBID_HEADER(packet->rxmngpacket->header));
 	txmngpacket = capwap_packet_txmng_create_ctrl_message(&capwapheader, CAPWAP_CONFIGURATION_STATUS_RESPONSE, packet->rxmngpacket->ctrlmsg.seq, session->mtu);
 
-	/* Parsing request and add message element for respone message */
-	response = ac_dfa_state_configure_parsing_request(session, packet);
+	/* Add message element for respone message */
 	if (response) {
 		result = ac_dfa_state_configure_create_response(session, packet, response, txmngpacket);
-		ac_soapclient_free_response(response);
 	}
 
 	/* With error add result code message element */
@@ -770,3 +763,29 @@ void ac_dfa_state_configure(struct ac_session_t* session, struct capwap_parsed_p
 		ac_session_teardown(session);
 	}
 }
+
+/* Completion of configureStatusWTPSession */
+static void ac_dfa_state_configure_complete(struct ac_session_t* session, struct ac_soap_response* response, void* context) {
+	struct capwap_parsed_packet packet;
+
+	if (ac_session_resume_request(session, &packet)) {
+		ac_dfa_state_configure_send_response(session, &packet, response);
+		ac_session_release_request(session, &packet);
+	} else {
+		ac_session_release_request(session, &packet);
+		ac_session_teardown(session);
+	}
+}
+
+/* */
+void ac_dfa_state_configure(struct ac_session_t* session, struct capwap_parsed_packet* packet) {
+	ASSERT(session != NULL);
+	ASSERT(packet != NULL);
+
+	/* Parsing request, the response is sent on completion of Backend request */
+	if (ac_dfa_state_configure_parsing_request(session, packet)) {
+		ac_session_suspend_request(session);
+	} else {
+		ac_dfa_state_configure_send_response(session, packet, NULL);
+	}
+}
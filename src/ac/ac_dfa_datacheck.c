@@ -6,15 +6,18 @@
 #include <json-c/json.h>
 
 /* */
-static struct ac_soap_response* ac_dfa_state_datacheck_parsing_request(struct ac_session_t* session, struct capwap_parsed_packet* packet) {
+static void ac_dfa_state_datacheck_complete(struct ac_session_t* session, struct ac_soap_response* response, void* context);
+
+/* */
+static int ac_dfa_state_datacheck_parsing_request(struct ac_session_t* session, struct capwap_parsed_packet* packet) {
 	int i;
+	int result;
 	const char* jsonmessage;
 	char* base64confstatus;
 	struct capwap_array* elemarray;
 	struct json_object* jsonarray;
 	struct json_object* jsonparam;
 	struct json_object* jsonhash;
-	struct ac_soap_response* response;
 	struct capwap_resultcode_element* resultcode;
 	unsigned short binding = GET_WBID_HEADER(packet->rxmngpacket->header);
 
@@ -82,24 +85,20 @@ static struct ac_soap_response* ac_dfa_state_datacheck_parsing_request(struct ac
 	/* Binding message */
 	if (binding == CAPWAP_WIRELESS_BINDING_IEEE80211) {
 		struct ac_json_ieee80211_wtpradio wtpradio;
-		struct capwap_list_item* search = packet->messages->first;
 
 		/* Reording message by radioid and management */
 		ac_json_ieee80211_init(&wtpradio);
 
-		while (search) {
-			struct capwap_message_element_itemlist* messageelement = (struct capwap_message_element_itemlist*)search->item;
+		for (i = 0; i < packet->count; i++) {
+			struct capwap_message_element_itemlist* messageelement = &packet->elements[i];
 
 			/* Parsing only IEEE 802.11 message element */
 			if (IS_80211_MESSAGE_ELEMENTS(messageelement->id)) {
 				if (!ac_json_ieee80211_parsingmessageelement(&wtpradio, messageelement)) {
 					json_object_put(jsonparam);
-					return NULL;
+					return 0;
 				}
 			}
-
-			/* Next */
-			search = search->next;
 		}
 
 		/* Generate JSON tree */
@@ -115,14 +114,14 @@ static struct ac_soap_response* ac_dfa_state_datacheck_parsing_request(struct ac
 	base64confstatus = capwap_alloc(AC_BASE64_ENCODE_LENGTH(strlen(jsonmessage)));
 	ac_base64_string_encode(jsonmessage, base64confstatus);
 
-	/* Send message */
-	response = ac_soap_changestatewtpsession(session, session->wtpid, base64confstatus);
+	/* Send message, the response is created on completion */
+	result = ac_soap_changestatewtpsession(session, ac_dfa_state_datacheck_complete, session->wtpid, base64confstatus);
 
 	/* Free JSON */
 	json_object_put(jsonparam);
 	capwap_free(base64confstatus);
 
-	return response;
+	return result;
 }
 
 /* */
@@ -150,28 +149,23 @@ static uint32_t ac_dfa_state_datacheck_create_response(struct ac_session_t* sess
 }
 
 /* */
-void ac_dfa_state_datacheck(struct ac_session_t* session, struct capwap_parsed_packet* packet) {
-	struct ac_soap_response* response;
+static void ac_dfa_state_datacheck_send_response(struct ac_session_t* session, struct capwap_parsed_packet* packet, struct ac_soap_response* response) {
 	struct capwap_header_data capwapheader;
 	struct capwap_packet_txmng* txmngpacket;
 	uint32_t result = CAPWAP_RESULTCODE_FAILURE;
 
-	ASSERT(session != NULL);
-	ASSERT(packet != NULL);
-
 	/* Create response */
 	capwap_header_init(&capwapheader, CAPWAP_RADIOID_NONE, GET_WBID_HEADER(packet->rxmngpacket->header));
 	txmngpacket = capwap_packet_txmng_create_ctrl_message(&capwapheader, CAPWAP_CHANGE_STATE_EVENT_RESPONSE, packet->rxmngpacket->ctrlmsg.seq, session->mtu);
 
-	/* Parsing request and add message element for respone message */
-	response = ac_dfa_state_datacheck_parsing_request(session, packet);
+	/* Add message element for respone message */
 	if (response) {
 		result = ac_dfa_state_datacheck_create_response(session, packet, response, txmngpacket);
-		ac_soapclient_free_response(response);
 
 		/* Create data session */
 		if (CAPWAP_RESULTCODE_OK(result)) {
-			if (ac_kmod_new_datasession(&session->sessionid, (uint8_t)session->binding, session->mtu)) {
+			/* Without clear data channel the WTP must use the DTLS data channel */
+			if (ac_kmod_new_datasession(&session->sessionid, (uint8_t)session->binding, session->mtu, ((g_ac.descriptor.dtlspolicy & CAPWAP_ACDESC_CLEAR_DATA_CHANNEL_ENABLED) ? 0 : AC_KMOD_FLAGS_DTLS_DATA_CHANNEL))) {
 				result = CAPWAP_RESULTCODE_FAILURE;
 			}
 		}
@@ -217,3 +211,29 @@ void ac_dfa_state_datacheck(struct ac_session_t* session, struct capwap_parsed_p
 		ac_session_teardown(session);
 	}
 }
+
+/* Completion of changeStateWTPSession */
+static void ac_dfa_state_datacheck_complete(struct ac_session_t* session, struct ac_soap_response* response, void* context) {
+	struct capwap_parsed_packet packet;
+
+	if (ac_session_resume_request(session, &packet)) {
+		ac_dfa_state_datacheck_send_response(session, &packet, response);
+		ac_session_release_request(session, &packet);
+	} else {
+		ac_session_release_request(session, &packet);
+		ac_session_teardown(session);
+	}
+}
+
+/* */
+void ac_dfa_state_datacheck(struct ac_session_t* session, struct capwap_parsed_packet* packet) {
+	ASSERT(session != NULL);
+	ASSERT(packet != NULL);
+
+	/* Parsing request, the response is sent on completion of Backend request */
+	if (ac_dfa_state_datacheck_parsing_request(session, packet)) {
+		ac_session_suspend_request(session);
+	} else {
+		ac_dfa_state_datacheck_send_response(session, packet, NULL);
+	}
+}
@@ -9,35 +9,31 @@
 
 /* */
 static int ac_dfa_state_join_check_authorizejoin(struct ac_session_t* session, struct ac_soap_response* response) {
-	xmlChar* xmlResult;
-
-	if ((response->responsecode != HTTP_RESULT_OK) || !response->xmlResponseReturn) {
+	if ((response->responsecode != HTTP_RESULT_OK) || !response->returnvalue) {
 		/* TODO: check return failed code */
 		return CAPWAP_RESULTCODE_JOIN_FAILURE_UNKNOWN_SOURCE;
 	}
 
 	// Check return value
-	xmlResult = xmlNodeGetContent(response->xmlResponseReturn);
-	if (!xmlResult) {
-		return CAPWAP_RESULTCODE_JOIN_FAILURE_UNKNOWN_SOURCE;
-	} else if (xmlStrcmp(xmlResult, (const xmlChar *)"true")) {
-		xmlFree(xmlResult);
+	if (strcmp(response->returnvalue, "true")) {
 		return CAPWAP_RESULTCODE_JOIN_FAILURE_UNKNOWN_SOURCE;
 	}
 
-	xmlFree(xmlResult);
 	return CAPWAP_RESULTCODE_SUCCESS;
 }
 
 /* */
-static struct ac_soap_response* ac_dfa_state_join_parsing_request(struct ac_session_t* session, struct capwap_parsed_packet* packet) {
+static void ac_dfa_state_join_complete(struct ac_session_t* session, struct ac_soap_response* response, void* context);
+
+/* */
+static int ac_dfa_state_join_parsing_request(struct ac_session_t* session, struct capwap_parsed_packet* packet) {
 	int i;
+	int result;
 	const char* jsonmessage;
 	char* base64confstatus;
 	struct json_object* jsonarray;
 	struct json_object* jsonparam;
 	struct json_object* jsonhash;
-	struct ac_soap_response* response;
 	struct capwap_location_element* location;
 	struct capwap_wtpboarddata_element* wtpboarddata;
 	struct capwap_wtpdescriptor_element* wtpdescriptor;
@@ -231,24 +227,20 @@ static struct ac_soap_response* ac_dfa_state_join_parsing_request(struct ac_sess
 	/* Binding message */
 	if (binding == CAPWAP_WIRELESS_BINDING_IEEE80211) {
 		struct ac_json_ieee80211_wtpradio wtpradio;
-		struct capwap_list_item* search = packet->messages->first;
 
 		/* Reording message by radioid and management */
 		ac_json_ieee80211_init(&wtpradio);
 
-		while (search) {
-			struct capwap_message_element_itemlist* messageelement = (struct capwap_message_element_itemlist*)search->item;
+		for (i = 0; i < packet->count; i++) {
+			struct capwap_message_element_itemlist* messageelement = &packet->elements[i];
 
 			/* Parsing only IEEE 802.11 message element */
 			if (IS_80211_MESSAGE_ELEMENTS(messageelement->id)) {
 				if (!ac_json_ieee80211_parsingmessageelement(&wtpradio, messageelement)) {
 					json_object_put(jsonparam);
-					return NULL;
+					return 0;
 				}
 			}
-
-			/* Next */
-			search = search->next;
 		}
 
 		/* Generate JSON tree */
@@ -306,14 +298,14 @@ static struct ac_soap_response* ac_dfa_state_join_parsing_request(struct ac_sess
 	base64confstatus = capwap_alloc(AC_BASE64_ENCODE_LENGTH(strlen(jsonmessage)));
 	ac_base64_string_encode(jsonmessage, base64confstatus);
 
-	/* Send message */
-	response = ac_soap_joinwtpsession(session, session->wtpid, base64confstatus);
+	/* Send message, the join continues on completion */
+	result = ac_soap_joinwtpsession(session, ac_dfa_state_join_complete, session->wtpid, base64confstatus);
 
 	/* Free JSON */
 	json_object_put(jsonparam);
 	capwap_free(base64confstatus);
 
-	return response;
+	return result;
 }
 
 /* */
@@ -554,14 +546,119 @@ static uint32_t ac_dfa_state_join_create_response(struct ac_session_t* session,
 }
 
 /* */
-void ac_dfa_state_join(struct ac_session_t* session, struct capwap_parsed_packet* packet) {
-	unsigned short binding;
-	struct ac_soap_response* response;
+static void ac_dfa_state_join_send_response(struct ac_session_t* session, struct capwap_parsed_packet* packet, struct ac_soap_response* response, uint32_t code) {
 	struct capwap_header_data capwapheader;
 	struct capwap_packet_txmng* txmngpacket;
+	struct capwap_resultcode_element resultcode = { .code = code };
+
+	/* Create response */
+	capwap_header_init(&capwapheader, CAPWAP_RADIOID_NONE, GET_WBID_HEADER(packet->rxmngpacket->header));
+	txmngpacket = capwap_packet_txmng_create_ctrl_message(&capwapheader, CAPWAP_JOIN_RESPONSE, packet->rxmngpacket->ctrlmsg.seq, session->mtu);
+
+	/* */
+	if (response && CAPWAP_RESULTCODE_OK(resultcode.code)) {
+		resultcode.code = ac_dfa_state_join_create_response(session, packet, response, txmngpacket);
+	}
+
+	/* Add always result code message element */
+	capwap_packet_txmng_add_message_element(txmngpacket, CAPWAP_ELEMENT_RESULTCODE, &resultcode);
+
+	/* Join response complete, get fragment packets */
+	ac_free_reference_last_response(session);
+	capwap_packet_txmng_get_fragment_packets(txmngpacket, session->responsefragmentpacket, session->fragmentid);
+	if (session->responsefragmentpacket->count > 1) {
+		session->fragmentid++;
+	}
+
+	/* Free packets manager */
+	capwap_packet_txmng_free(txmngpacket);
+
+	/* Save remote sequence number */
+	session->remotetype = packet->rxmngpacket->ctrlmsg.type;
+	session->remoteseqnumber = packet->rxmngpacket->ctrlmsg.seq;
+
+	/* Send Join response to WTP */
+	if (capwap_crypt_sendto_fragmentpacket(&session->dtls, session->responsefragmentpacket)) {
+		if (CAPWAP_RESULTCODE_OK(resultcode.code)) {
+			ac_dfa_change_state(session, CAPWAP_POSTJOIN_STATE);
+			capwap_timeout_set(session->timeout, session->idtimercontrol, AC_JOIN_INTERVAL, ac_dfa_teardown_timeout, session, NULL);
+		} else {
+			ac_session_teardown(session);
+		}
+	} else {
+		/* Error to send packets */
+		log_printf(LOG_DEBUG, "Warning: error to send join response packet");
+		ac_session_teardown(session);
+	}
+}
+
+/* Completion of joinWTPSession */
+static void ac_dfa_state_join_complete(struct ac_session_t* session, struct ac_soap_response* response, void* context) {
+	struct capwap_parsed_packet packet;
+
+	if (ac_session_resume_request(session, &packet)) {
+		ac_dfa_state_join_send_response(session, &packet, response, CAPWAP_RESULTCODE_SUCCESS);
+		ac_session_release_request(session, &packet);
+	} else {
+		ac_session_release_request(session, &packet);
+		ac_session_teardown(session);
+	}
+}
+
+/* Completion of authorizeWTPSession */
+static void ac_dfa_state_join_authorize_complete(struct ac_session_t* session, struct ac_soap_response* response, void* context) {
+	char* wtpid;
+	struct capwap_parsed_packet packet;
+	struct capwap_sessionid_element* sessionid;
+	struct capwap_wtpboarddata_element* wtpboarddata;
+	uint32_t code = CAPWAP_RESULTCODE_JOIN_FAILURE_UNKNOWN_SOURCE;
+
+	if (!ac_session_resume_request(session, &packet)) {
+		ac_session_release_request(session, &packet);
+		ac_session_teardown(session);
+		return;
+	}
+
+	/* */
+	if (response) {
+		code = ac_dfa_state_join_check_authorizejoin(session, response);
+	}
+
+	if (CAPWAP_RESULTCODE_OK(code)) {
+		sessionid = (struct capwap_sessionid_element*)capwap_get_message_element_data(&packet, CAPWAP_ELEMENT_SESSIONID);
+		wtpboarddata = (struct capwap_wtpboarddata_element*)capwap_get_message_element_data(&packet, CAPWAP_ELEMENT_WTPBOARDDATA);
+
+		/* The WTP Id or Session Id can be taken by another session during the authorization */
+		wtpid = ac_get_printable_wtpid(wtpboarddata);
+		if (wtpid && !ac_session_set_identity(session, wtpid, sessionid)) {
+			session->binding = GET_WBID_HEADER(packet.rxmngpacket->header);
+
+			/* Request configuration of Backend for complete join, the response is sent on completion.
+			   Without the request the WTP join without the configuration of Backend */
+			if (ac_dfa_state_join_parsing_request(session, &packet)) {
+				capwap_free_parsed_packet(&packet);
+				return;
+			}
+		} else {
+			log_printf(LOG_INFO, "WTP Id %s or Session Id already used in another session", (wtpid ? wtpid : ""));
+			code = CAPWAP_RESULTCODE_JOIN_FAILURE_ID_ALREADY_IN_USE;
+			if (wtpid) {
+				capwap_free(wtpid);
+			}
+		}
+	}
+
+	/* */
+	ac_dfa_state_join_send_response(session, &packet, NULL, code);
+	ac_session_release_request(session, &packet);
+}
+
+/* */
+void ac_dfa_state_join(struct ac_session_t* session, struct capwap_parsed_packet* packet) {
+	unsigned short binding;
 	struct capwap_sessionid_element* sessionid;
 	struct capwap_wtpboarddata_element* wtpboarddata;
-	struct capwap_resultcode_element resultcode = { .code = CAPWAP_RESULTCODE_FAILURE };
+	uint32_t code = CAPWAP_RESULTCODE_FAILURE;
 
 	ASSERT(session != NULL);
 	ASSERT(packet != NULL);
@@ -581,25 +678,21 @@ void ac_dfa_state_join(struct ac_session_t* session, struct capwap_parsed_packet
 				/* Get printable WTPID */
 				wtpid = ac_get_printable_wtpid(wtpboarddata);
 				if (wtpid && !ac_has_wtpid(wtpid)) {
-					/* Request authorization of Backend for complete join */
-					response = ac_soap_authorizewtpsession(session, wtpid);
-					if (response) {
-						resultcode.code = ac_dfa_state_join_check_authorizejoin(session, response);
-						ac_soapclient_free_response(response);
-					} else {
-						resultcode.code = CAPWAP_RESULTCODE_JOIN_FAILURE_UNKNOWN_SOURCE;
+					/* Request authorization of Backend for complete join, the join request
+					   is suspended until the completion */
+					if (ac_soap_authorizewtpsession(session, ac_dfa_state_join_authorize_complete, wtpid)) {
+						ac_session_suspend_request(session);
+						capwap_free(wtpid);
+						return;
 					}
+
+					code = CAPWAP_RESULTCODE_JOIN_FAILURE_UNKNOWN_SOURCE;
 				} else {
 					log_printf(LOG_INFO, "WTP Id %s already used in another session", wtpid);
-					resultcode.code = CAPWAP_RESULTCODE_JOIN_FAILURE_UNKNOWN_SOURCE;
+					code = CAPWAP_RESULTCODE_JOIN_FAILURE_UNKNOWN_SOURCE;
 				}
 
-				/* */
-				if (CAPWAP_RESULTCODE_OK(resultcode.code)) {
-					session->wtpid = wtpid;
-					memcpy(&session->sessionid, sessionid, sizeof(struct capwap_sessionid_element));
-					session->binding = binding;
-				} else if (wtpid) {
+				if (wtpid) {
 					capwap_free(wtpid);
 				}
 			} else {
@@ -608,58 +701,17 @@ void ac_dfa_state_join(struct ac_session_t* session, struct capwap_parsed_packet
 				capwap_sessionid_printf(sessionid, sessionname);
 				log_printf(LOG_INFO, "Session Id %s already used in another session", sessionname);
 
-				resultcode.code = CAPWAP_RESULTCODE_JOIN_FAILURE_ID_ALREADY_IN_USE;
+				code = CAPWAP_RESULTCODE_JOIN_FAILURE_ID_ALREADY_IN_USE;
 			}
 		} else {
-			resultcode.code = CAPWAP_RESULTCODE_MSG_UNEXPECTED_INVALID_CURRENT_STATE;
+			code = CAPWAP_RESULTCODE_MSG_UNEXPECTED_INVALID_CURRENT_STATE;
 		}
 	} else {
-		resultcode.code = CAPWAP_RESULTCODE_JOIN_FAILURE_BINDING_NOT_SUPPORTED;
+		code = CAPWAP_RESULTCODE_JOIN_FAILURE_BINDING_NOT_SUPPORTED;
 	}
 
-	/* Create response */
-	capwap_header_init(&capwapheader, CAPWAP_RADIOID_NONE, binding);
-	txmngpacket = capwap_packet_txmng_create_ctrl_message(&capwapheader, CAPWAP_JOIN_RESPONSE, packet->rxmngpacket->ctrlmsg.seq, session->mtu);
-
 	/* */
-	if (CAPWAP_RESULTCODE_OK(resultcode.code)) {
-		response = ac_dfa_state_join_parsing_request(session, packet);
-		if (response) {
-			resultcode.code = ac_dfa_state_join_create_response(session, packet, response, txmngpacket);
-			ac_soapclient_free_response(response);
-		}
-	}
-
-	/* Add always result code message element */
-	capwap_packet_txmng_add_message_element(txmngpacket, CAPWAP_ELEMENT_RESULTCODE, &resultcode);
-
-	/* Join response complete, get fragment packets */
-	ac_free_reference_last_response(session);
-	capwap_packet_txmng_get_fragment_packets(txmngpacket, session->responsefragmentpacket, session->fragmentid);
-	if (session->responsefragmentpacket->count > 1) {
-		session->fragmentid++;
-	}
-
-	/* Free packets manager */
-	capwap_packet_txmng_free(txmngpacket);
-
-	/* Save remote sequence number */
-	session->remotetype = packet->rxmngpacket->ctrlmsg.type;
-	session->remoteseqnumber = packet->rxmngpacket->ctrlmsg.seq;
-
-	/* Send Join response to WTP */
-	if (capwap_crypt_sendto_fragmentpacket(&session->dtls, session->responsefragmentpacket)) {
-		if (CAPWAP_RESULTCODE_OK(resultcode.code)) {
-			ac_dfa_change_state(session, CAPWAP_POSTJOIN_STATE);
-			capwap_timeout_set(session->timeout, session->idtimercontrol, AC_JOIN_INTERVAL, ac_dfa_teardown_timeout, session, NULL);
-		} else {
-			ac_session_teardown(session);
-		}
-	} else {
-		/* Error to send packets */
-		log_printf(LOG_DEBUG, "Warning: error to send join response packet");
-		ac_session_teardown(session);
-	}
+	ac_dfa_state_join_send_response(session, packet, NULL, code);
 }
 
 /* */
@@ -6,33 +6,10 @@
 #include "ac_wlans.h"
 
 /* */
-static int receive_echo_request(struct ac_session_t* session, struct capwap_parsed_packet* packet) {
-	int validsession = 0;
-	struct ac_soap_response* response;
+static void send_echo_response(struct ac_session_t* session, struct capwap_parsed_packet* packet) {
 	struct capwap_header_data capwapheader;
 	struct capwap_packet_txmng* txmngpacket;
 
-	/* Check session */
-	response = ac_soap_checkwtpsession(session, session->wtpid);
-	if (response) {
-		if ((response->responsecode == HTTP_RESULT_OK) && response->xmlResponseReturn) {
-			xmlChar* xmlResult = xmlNodeGetContent(response->xmlResponseReturn);
-			if (xmlResult) {
-				if (!xmlStrcmp(xmlResult, (const xmlChar *)"true")) {
-					validsession = 1;
-				}
-
-				xmlFree(xmlResult);
-			}
-		}
-
-		ac_soapclient_free_response(response);
-	}
-
-	if (!validsession) {
-		return -1;
-	}
-
 	/* Create response */
 	capwap_header_init(&capwapheader, CAPWAP_RADIOID_NONE, GET_WBID_HEADER(packet->rxmngpacket->header));
 	txmngpacket = capwap_packet_txmng_create_ctrl_message(&capwapheader, CAPWAP_ECHO_RESPONSE, packet->rxmngpacket->ctrlmsg.seq, session->mtu);
@@ -67,8 +44,42 @@ static int receive_echo_request(struct ac_session_t* session, struct capwap_pars
 		/* Response is already created and saved. When receive a re-request, DFA autoresponse */
 		log_printf(LOG_DEBUG, "Warning: error to send echo response packet");
 	}
+}
+
+/* Completion of checkWTPSession */
+static void receive_echo_request_complete(struct ac_session_t* session, struct ac_soap_response* response, void* context) {
+	int validsession = 0;
+	struct capwap_parsed_packet packet;
 
-	return 0;
+	/* Check session */
+	if (response && (response->responsecode == HTTP_RESULT_OK) && response->returnvalue) {
+		if (!strcmp(response->returnvalue, "true")) {
+			validsession = 1;
+		}
+	}
+
+	/* Without a valid session the WTP is disconnected */
+	if (ac_session_resume_request(session, &packet) && validsession) {
+		send_echo_response(session, &packet);
+		ac_session_release_request(session, &packet);
+		capwap_timeout_set(session->timeout, session->idtimercontrol, AC_MAX_ECHO_INTERVAL, ac_dfa_teardown_timeout, session, NULL);
+	} else {
+		ac_session_release_request(session, &packet);
+		ac_session_teardown(session);
+	}
+}
+
+/* */
+static void receive_echo_request(struct ac_session_t* session, struct capwap_parsed_packet* packet) {
+	if (session->soapcall) {
+		/* Only one call with completion for session, the WTP retransmits the request */
+		log_printf(LOG_DEBUG, "Discarded Echo Request while waiting the backend");
+	} else if (ac_soap_checkwtpsession(session, receive_echo_request_complete, session->wtpid)) {
+		/* The response is sent on completion of Backend request */
+		ac_session_suspend_request(session);
+	} else {
+		ac_session_teardown(session);
+	}
 }
 
 /* */
@@ -262,12 +273,7 @@ void ac_dfa_state_run(struct ac_session_t* session, struct capwap_parsed_packet*
 				}
 #endif
 
-				if (!receive_echo_request(session, packet)) {
-					capwap_timeout_set(session->timeout, session->idtimercontrol, AC_MAX_ECHO_INTERVAL, ac_dfa_teardown_timeout, session, NULL);
-				} else {
-					ac_session_teardown(session);
-				}
-
+				receive_echo_request(session, packet);
 				break;
 			}
 
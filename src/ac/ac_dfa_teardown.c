@@ -7,12 +7,9 @@
 void ac_dfa_state_teardown(struct ac_session_t* session) {
 	ASSERT(session != NULL);
 
-	// Notify teardown session
+	// Notify teardown session, without waiting the response of Backend
 	if (session->wtpid) {
-		struct ac_soap_response* response = ac_soap_teardownwtpsession(session, session->wtpid);
-		if (response) {
-			ac_soapclient_free_response(response);
-		}
+		ac_soap_teardownwtpsession(session, session->wtpid);
 	}
 
 	/* Defered free resource */
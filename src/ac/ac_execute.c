@@ -4,6 +4,10 @@
 #include "ac_discovery.h"
 #include "ac_backend.h"
 #include "ac_wlans.h"
+#include "ac_workers.h"
+#include "ac_timers.h"
+#include "ac_handshakes.h"
+#include "ac_packets.h"
 
 #include <signal.h>
 
@@ -14,9 +18,21 @@
 #define AC_RECV_NOERROR_KMODEVENT			-1002
 #define AC_RECV_NOERROR_BACKENDNOCONNECT	-1003
 
+#define AC_RECV_BATCH_SIZE					32
+
+#define AC_NETSHARD_WAIT_TIMEOUT			1000
+
 #define AC_IFACE_MAX_INDEX					256
 #define AC_IFACE_NAME						"capwap%lu"
 
+/* Dispatcher of a control socket shard */
+struct ac_netshard {
+	pthread_t threadid;
+	struct capwap_network* net;
+};
+
+static struct ac_netshard* g_ac_netshards;
+
 /* */
 static void ac_close_sessions(void);
 
@@ -168,17 +184,18 @@ static int ac_recvmsgqueue(int fd, struct ac_session_msgqueue_item_t* item) {
 static void ac_session_msgqueue_parsing_item(struct ac_session_msgqueue_item_t* item) {
 	switch (item->message) {
 		case AC_MESSAGE_QUEUE_CLOSE_THREAD: {
-			struct capwap_list_item* search = g_ac.sessionsthread->first;
+			struct capwap_list_item* search;
+
+			/* The threads list is shared with the shard dispatchers */
+			capwap_rwlock_wrlock(&g_ac.sessionslock);
+
+			search = g_ac.sessionsthread->first;
 			while (search != NULL) {
 				struct ac_session_thread_t* sessionthread = (struct ac_session_thread_t*)search->item;
 				ASSERT(sessionthread != NULL);
 
 				if (sessionthread->threadid == item->message_close_thread.threadid) {
-					void* dummy;
-
-					/* Clean thread resource */
-					pthread_join(sessionthread->threadid, &dummy);
-					capwap_itemlist_free(capwap_itemlist_remove(g_ac.sessionsthread, search));
+					capwap_itemlist_remove(g_ac.sessionsthread, search);
 					break;
 				}
 
@@ -186,6 +203,16 @@ static void ac_session_msgqueue_parsing_item(struct ac_session_msgqueue_item_t*
 				search = search->next;
 			}
 
+			capwap_rwlock_unlock(&g_ac.sessionslock);
+
+			/* Clean thread resource */
+			if (search) {
+				void* dummy;
+
+				pthread_join(((struct ac_session_thread_t*)search->item)->threadid, &dummy);
+				capwap_itemlist_free(search);
+			}
+
 			break;
 		}
 
@@ -213,7 +240,7 @@ static void ac_session_msgqueue_parsing_item(struct ac_session_msgqueue_item_t*
 static void ac_wait_terminate_allsessions(void) {
 	struct ac_session_msgqueue_item_t item;
 
-	/* Wait that list is empty */
+	/* Wait that list is empty, the shard dispatchers are already stopped */
 	while (g_ac.sessionsthread->count > 0) {
 		log_printf(LOG_DEBUG, "Waiting for %d session terminate", g_ac.sessionsthread->count);
 
@@ -232,6 +259,22 @@ static void ac_wait_terminate_allsessions(void) {
 	log_printf(LOG_DEBUG, "Close all sessions");
 }
 
+/* */
+static void ac_wait_release_allsessions(void) {
+	capwap_lock_enter(&g_ac.sessionsreleasinglock);
+
+	while (g_ac.sessionsreleasing > 0) {
+		log_printf(LOG_DEBUG, "Waiting for release %lu sessions", g_ac.sessionsreleasing);
+
+		capwap_event_reset(&g_ac.sessionsreleasingevent);
+		capwap_lock_exit(&g_ac.sessionsreleasinglock);
+		capwap_event_wait(&g_ac.sessionsreleasingevent);
+		capwap_lock_enter(&g_ac.sessionsreleasinglock);
+	}
+
+	capwap_lock_exit(&g_ac.sessionsreleasinglock);
+}
+
 /* Initialize message queue */
 int ac_msgqueue_init(void) {
 	if (socketpair(AF_LOCAL, SOCK_DGRAM, 0, g_ac.fdmsgsessions)) {
@@ -286,19 +329,44 @@ int ac_msgqueue_close_allsessions(void) {
 }
 
 /* */
-static int ac_recvfrom(struct ac_fds* fds, void* buffer, int* size, union sockaddr_capwap* fromaddr, union sockaddr_capwap* toaddr) {
+static int ac_wait_recvready(struct pollfd* fds, int fdscount, int timeout) {
+	int i;
+	int readysocket;
+
+	ASSERT(fds);
+	ASSERT(fdscount > 0);
+
+	/* Wait event */
+	readysocket = poll(fds, fdscount, timeout);
+	if (readysocket > 0) {
+		for (i = 0; i < fdscount; i++) {
+			if (fds[i].revents & POLLIN) {
+				return i;
+			} else if (fds[i].revents & (POLLHUP | POLLERR | POLLNVAL)) {
+				return CAPWAP_RECV_ERROR_SOCKET;
+			}
+		}
+	} else if (!readysocket) {
+		return CAPWAP_RECV_ERROR_TIMEOUT;
+	} else if (errno == EINTR) {
+		return CAPWAP_RECV_ERROR_INTR;
+	}
+
+	return CAPWAP_RECV_ERROR_SOCKET;
+}
+
+/* Wait and receive a batch of packets */
+static int ac_recvfrom(struct ac_fds* fds, struct capwap_recv_batch* batch, int timeout) {
 	int index;
 
 	ASSERT(fds);
 	ASSERT(fds->fdspoll != NULL);
 	ASSERT(fds->fdstotalcount > 0);
-	ASSERT(buffer != NULL);
-	ASSERT(size != NULL);
-	ASSERT(*size > 0);
-	ASSERT(fromaddr != NULL);
+	ASSERT(batch != NULL);
 
 	/* Wait packet */
-	index = capwap_wait_recvready(fds->fdspoll, fds->fdstotalcount, NULL);
+	batch->count = 0;
+	index = ac_wait_recvready(fds->fdspoll, fds->fdstotalcount, timeout);
 	if (index < 0) {
 		return index;
 	} else if ((fds->kmodeventsstartpos >= 0) && (index >= fds->kmodeventsstartpos)) {
@@ -325,51 +393,72 @@ static int ac_recvfrom(struct ac_fds* fds, void* buffer, int* size, union sockad
 		ac_session_msgqueue_parsing_item(&item);
 		return AC_RECV_NOERROR_MSGQUEUE;
 	} else if (!ac_backend_isconnect()) {
+		/* Without Backend the packets are dropped. Read them anyway, a socket
+		   left ready would wake up poll at once and spin the dispatcher */
+		if (capwap_recvfrom_batch(fds->fdspoll[index].fd, batch) < 0) {
+			return CAPWAP_RECV_ERROR_SOCKET;
+		}
+
+		if (batch->count > 0) {
+			log_printf(LOG_DEBUG, "Backend not connected, %d packets dropped", batch->count);
+		}
+
+		batch->count = 0;
 		return AC_RECV_NOERROR_BACKENDNOCONNECT;
 	}
 
-	/* Receive packet */
-	if (capwap_recvfrom(fds->fdspoll[index].fd, buffer, size, fromaddr, toaddr)) {
+	/* Receive packets */
+	if (capwap_recvfrom_batch(fds->fdspoll[index].fd, batch) < 0) {
 		return CAPWAP_RECV_ERROR_SOCKET;
 	}
 
 	return index;
 }
 
-/* Add packet to session */
+/* Wake up session to process packets, actions or expired timers */
+void ac_session_wakeup(struct ac_session_t* session) {
+	if (session->worker) {
+		ac_workers_schedule_session(session);
+	} else {
+		capwap_event_signal(&session->waitpacket);
+	}
+}
+
+/* */
 static void ac_session_add_packet(struct ac_session_t* session, char* buffer, int size, int plainbuffer) {
-	struct capwap_list_item* item;
 	struct ac_packet* packet;
 
 	ASSERT(session != NULL);
 	ASSERT(buffer != NULL);
 	ASSERT(size > 0);
 
+	/* Reserve packet slot, discard packet if the session is too busy */
+	packet = (struct ac_packet*)capwap_ring_reserve(session->packets);
+	if (!packet) {
+		return;
+	}
+
 	/* Copy packet */
-	item = capwap_itemlist_create(sizeof(struct ac_packet) + size);
-	packet = (struct ac_packet*)item->item;
 	packet->plainbuffer = plainbuffer;
+	packet->length = size;
+	packet->buffer = ac_packets_alloc_buffer(size);
 	memcpy(packet->buffer, buffer, size);
 
-	/* Append to packets list */
-	capwap_lock_enter(&session->sessionlock);
-	capwap_itemlist_insert_after(session->packets, NULL, item);
-	capwap_event_signal(&session->waitpacket);
-	capwap_lock_exit(&session->sessionlock);
+	/* Append to packets queue */
+	capwap_ring_commit(session->packets, packet);
+	ac_session_wakeup(session);
 }
 
-/* Add action to session */
-void ac_session_send_action(struct ac_session_t* session, long action, long param, const void* data, long length) {
-	struct capwap_list_item* item;
+/* Add action to session, the caller must own a reference of session */
+int ac_session_send_action(struct ac_session_t* session, long action, long param, const void* data, long length) {
 	struct ac_session_action* actionsession;
-	struct capwap_list_item* search;
+	struct ac_session_action** item;
 
 	ASSERT(session != NULL);
 	ASSERT(length >= 0);
 
 	/* */
-	item = capwap_itemlist_create(sizeof(struct ac_session_action) + length);
-	actionsession = (struct ac_session_action*)item->item;
+	actionsession = (struct ac_session_action*)capwap_alloc(sizeof(struct ac_session_action) + length);
 	actionsession->action = action;
 	actionsession->param = param;
 	actionsession->length = length;
@@ -378,152 +467,120 @@ void ac_session_send_action(struct ac_session_t* session, long action, long para
 		memcpy(actionsession->data, data, length);
 	}
 
-	/* Validate session before use */
-	capwap_rwlock_rdlock(&g_ac.sessionslock);
-
-	search = g_ac.sessions->first;
-	while (search != NULL) {
-		if (session == (struct ac_session_t*)search->item) {
-			/* Append to actions list */
-			capwap_lock_enter(&session->sessionlock);
-			capwap_itemlist_insert_after(session->action, NULL, item);
-			capwap_event_signal(&session->waitpacket);
-			capwap_lock_exit(&session->sessionlock);
-
-			break;
-		}
+	/* Append to actions queue, the packets received by kernel module cannot use
+	   the slots reserved to the control actions of Backend and stations */
+	if ((action == AC_SESSION_ACTION_RECV_KEEPALIVE) || (action == AC_SESSION_ACTION_RECV_IEEE80211_MGMT_PACKET) || (action == AC_SESSION_ACTION_RECV_DTLS_DATA_CHANNEL)) {
+		item = (struct ac_session_action**)capwap_ring_reserve_limit(session->action, session->action->size - AC_SESSION_ACTIONS_RING_RESERVED);
+	} else {
+		item = (struct ac_session_action**)capwap_ring_reserve(session->action);
+	}
 
-		/* */
-		search = search->next;
+	if (!item) {
+		log_printf(LOG_WARNING, "Unable to queue action %ld, session actions queue is full", action);
+		capwap_free(actionsession);
+		return 0;
 	}
 
-	capwap_rwlock_unlock(&g_ac.sessionslock);
+	*item = actionsession;
+	capwap_ring_commit(session->action, item);
+	ac_session_wakeup(session);
+	return 1;
 }
 
 /* Find AC sessions */
 static struct ac_session_t* ac_search_session_from_wtpaddress(union sockaddr_capwap* address) {
-	struct ac_session_t* result = NULL;
-	struct capwap_list_item* search;
+	struct ac_session_t* session;
 
 	ASSERT(address != NULL);
 
 	capwap_rwlock_rdlock(&g_ac.sessionslock);
 
-	search = g_ac.sessions->first;
-	while (search != NULL) {
-		struct ac_session_t* session = (struct ac_session_t*)search->item;
-		ASSERT(session != NULL);
-		
-		if (!capwap_compare_ip(address, &session->dtls.peeraddr)) {
-			/* Increment session count */
-			capwap_lock_enter(&session->sessionlock);
-			session->count++;
-			capwap_event_signal(&session->changereference);
-			capwap_lock_exit(&session->sessionlock);
-
-			/*  */
-			result = session;
-			break;
-		}
-
-		search = search->next;
+	session = (struct ac_session_t*)capwap_hash_search(g_ac.sessionsaddress, address);
+	if (session) {
+		/* Increment session count */
+		capwap_lock_enter(&session->sessionlock);
+		session->count++;
+		capwap_lock_exit(&session->sessionlock);
 	}
 
 	capwap_rwlock_unlock(&g_ac.sessionslock);
 
-	return result;
+	return session;
 }
 
 /* Find session from wtp id */
 struct ac_session_t* ac_search_session_from_wtpid(const char* wtpid) {
-	struct ac_session_t* result = NULL;
-	struct capwap_list_item* search;
+	struct ac_session_t* session;
 
 	ASSERT(wtpid != NULL);
 
 	capwap_rwlock_rdlock(&g_ac.sessionslock);
 
-	search = g_ac.sessions->first;
-	while (search != NULL) {
-		struct ac_session_t* session = (struct ac_session_t*)search->item;
-		ASSERT(session != NULL);
-		
-		if (session->wtpid && !strcmp(session->wtpid, wtpid)) {
-			/* Increment session count */
-			capwap_lock_enter(&session->sessionlock);
-			session->count++;
-			capwap_event_signal(&session->changereference);
-			capwap_lock_exit(&session->sessionlock);
-
-			/*  */
-			result = session;
-			break;
-		}
-
-		search = search->next;
+	session = (struct ac_session_t*)capwap_hash_search(g_ac.sessionswtpid, wtpid);
+	if (session) {
+		/* Increment session count */
+		capwap_lock_enter(&session->sessionlock);
+		session->count++;
+		capwap_lock_exit(&session->sessionlock);
 	}
 
 	capwap_rwlock_unlock(&g_ac.sessionslock);
 
-	return result;
+	return session;
 }
 
-/* Find session from wtp id */
+/* Find session from session id */
 struct ac_session_t* ac_search_session_from_sessionid(struct capwap_sessionid_element* sessionid) {
-	struct ac_session_t* result = NULL;
-	struct capwap_list_item* search;
+	struct ac_session_t* session;
 
 	ASSERT(sessionid != NULL);
 
 	capwap_rwlock_rdlock(&g_ac.sessionslock);
 
-	search = g_ac.sessions->first;
-	while (search != NULL) {
-		struct ac_session_t* session = (struct ac_session_t*)search->item;
-		ASSERT(session != NULL);
-		
-		if (!memcmp(sessionid, &session->sessionid, sizeof(struct capwap_sessionid_element))) {
-			/* Increment session count */
-			capwap_lock_enter(&session->sessionlock);
-			session->count++;
-			capwap_event_signal(&session->changereference);
-			capwap_lock_exit(&session->sessionlock);
-
-			/*  */
-			result = session;
-			break;
-		}
-
-		search = search->next;
+	session = (struct ac_session_t*)capwap_hash_search(g_ac.sessionssessionid, sessionid);
+	if (session) {
+		/* Increment session count */
+		capwap_lock_enter(&session->sessionlock);
+		session->count++;
+		capwap_lock_exit(&session->sessionlock);
 	}
 
 	capwap_rwlock_unlock(&g_ac.sessionslock);
 
-	return result;
+	return session;
 }
 
-/* */
-int ac_has_sessionid(struct capwap_sessionid_element* sessionid) {
-	int result = 0;
-	struct capwap_list_item* search;
+/* Find the session which wait the DTLS data channel of WTP, the data channel has the
+   same IP address of control channel. The WTPs behind the same NAT address must not
+   establish the data channel at the same time */
+struct ac_session_t* ac_search_session_from_datachannel(union sockaddr_capwap* address) {
+	struct ac_session_t* session;
 
-	ASSERT(sessionid != NULL);
+	ASSERT(address != NULL);
 
 	capwap_rwlock_rdlock(&g_ac.sessionslock);
 
-	search = g_ac.sessions->first;
-	while (search != NULL) {
-		struct ac_session_t* session = (struct ac_session_t*)search->item;
-		ASSERT(session != NULL);
+	session = (struct ac_session_t*)capwap_hash_search(g_ac.sessionsdatachannel, address);
+	if (session) {
+		/* Increment session count */
+		capwap_lock_enter(&session->sessionlock);
+		session->count++;
+		capwap_lock_exit(&session->sessionlock);
+	}
 
-		if (!memcmp(sessionid, &session->sessionid, sizeof(struct capwap_sessionid_element))) {
-			result = 1;
-			break;
-		}
+	capwap_rwlock_unlock(&g_ac.sessionslock);
 
-		search = search->next;
-	}
+	return session;
+}
 
+/* */
+int ac_has_sessionid(struct capwap_sessionid_element* sessionid) {
+	int result;
+
+	ASSERT(sessionid != NULL);
+
+	capwap_rwlock_rdlock(&g_ac.sessionslock);
+	result = (capwap_hash_search(g_ac.sessionssessionid, sessionid) ? 1 : 0);
 	capwap_rwlock_unlock(&g_ac.sessionslock);
 
 	return result;
@@ -531,26 +588,39 @@ int ac_has_sessionid(struct capwap_sessionid_element* sessionid) {
 
 /* */
 int ac_has_wtpid(const char* wtpid) {
-	int result = 0;
-	struct capwap_list_item* search;
+	int result;
 
 	if (!wtpid || !wtpid[0]) {
 		return -1;
 	}
 
 	capwap_rwlock_rdlock(&g_ac.sessionslock);
+	result = (capwap_hash_search(g_ac.sessionswtpid, wtpid) ? 1 : 0);
+	capwap_rwlock_unlock(&g_ac.sessionslock);
 
-	search = g_ac.sessions->first;
-	while (search != NULL) {
-		struct ac_session_t* session = (struct ac_session_t*)search->item;
-		ASSERT(session != NULL);
+	return result;
+}
 
-		if (session->wtpid && !strcmp(session->wtpid, wtpid)) {
-			result = 1;
-			break;
-		}
+/* Assign WTP id and session id to session */
+int ac_session_set_identity(struct ac_session_t* session, char* wtpid, struct capwap_sessionid_element* sessionid) {
+	int result = -1;
 
-		search = search->next;
+	ASSERT(session != NULL);
+	ASSERT(session->wtpid == NULL);
+	ASSERT(wtpid != NULL);
+	ASSERT(sessionid != NULL);
+
+	capwap_rwlock_wrlock(&g_ac.sessionslock);
+
+	/* Check again the unique ids into critical section */
+	if (!capwap_hash_search(g_ac.sessionswtpid, wtpid) && !capwap_hash_search(g_ac.sessionssessionid, sessionid)) {
+		session->wtpid = wtpid;
+		memcpy(&session->sessionid, sessionid, sizeof(struct capwap_sessionid_element));
+
+		/* */
+		capwap_hash_add(g_ac.sessionswtpid, (void*)session);
+		capwap_hash_add(g_ac.sessionssessionid, (void*)session);
+		result = 0;
 	}
 
 	capwap_rwlock_unlock(&g_ac.sessionslock);
@@ -581,8 +651,9 @@ char* ac_get_printable_wtpid(struct capwap_wtpboarddata_element* wtpboarddata) {
 void ac_session_close(struct ac_session_t* session) {
 	capwap_lock_enter(&session->sessionlock);
 	session->running = 0;
-	capwap_event_signal(&session->waitpacket);
 	capwap_lock_exit(&session->sessionlock);
+
+	ac_session_wakeup(session);
 }
 
 /* Close sessions */
@@ -606,7 +677,7 @@ static void ac_close_sessions(void) {
 }
 
 /* Create new session */
-static struct ac_session_t* ac_create_session(int sock, union sockaddr_capwap* fromaddr, union sockaddr_capwap* toaddr) {
+static struct ac_session_t* ac_create_session(int sock, union sockaddr_capwap* fromaddr, union sockaddr_capwap* toaddr, int handshakeslot) {
 	int result;
 	struct capwap_list_item* itemlist;
 	struct ac_session_t* session;
@@ -622,6 +693,7 @@ static struct ac_session_t* ac_create_session(int sock, union sockaddr_capwap* f
 
 	session->itemlist = itemlist;
 	session->running = 1;
+	session->handshakeslot = handshakeslot;
 
 	/* */
 	capwap_crypt_setconnection(&session->dtls, sock, toaddr, fromaddr);
@@ -631,10 +703,9 @@ static struct ac_session_t* ac_create_session(int sock, union sockaddr_capwap* f
 
 	/* */
 	session->count = 2;
-	capwap_event_init(&session->changereference);
 
 	/* */
-	session->timeout = capwap_timeout_init();
+	session->timeout = ac_timers_create_timeout(session);
 	session->idtimercontrol = capwap_timeout_createtimer(session->timeout);
 	session->idtimerkeepalivedead = capwap_timeout_createtimer(session->timeout);
 
@@ -655,21 +726,36 @@ static struct ac_session_t* ac_create_session(int sock, union sockaddr_capwap* f
 	capwap_event_init(&session->waitpacket);
 	capwap_lock_init(&session->sessionlock);
 
-	session->action = capwap_list_create();
-	session->packets = capwap_list_create();
+	session->action = capwap_ring_create(AC_SESSION_ACTIONS_RING_SIZE, sizeof(struct ac_session_action*));
+	session->packets = capwap_ring_create(AC_SESSION_PACKETS_RING_SIZE, sizeof(struct ac_packet));
 	session->requestfragmentpacket = capwap_list_create();
 	session->responsefragmentpacket = capwap_list_create();
 	session->notifyevent = capwap_list_create();
+	session->soapdeferred = capwap_list_create();
+	session->datahandshake = capwap_list_create();
 
 	session->mtu = g_ac.mtu;
 	session->state = CAPWAP_IDLE_STATE;
 
+	/* Bind session to worker */
+	if (g_ac.sessionsengine == AC_SESSIONS_ENGINE_WORKERS) {
+		ac_workers_assign_session(session);
+	}
+
 	/* Update session list */
 	capwap_rwlock_wrlock(&g_ac.sessionslock);
 	capwap_itemlist_insert_after(g_ac.sessions, NULL, itemlist);
+	capwap_hash_add(g_ac.sessionsaddress, (void*)session);
 	capwap_rwlock_unlock(&g_ac.sessionslock);
 
-	/* Create thread */
+	/* Session executed by worker */
+	if (session->worker) {
+		return session;
+	}
+
+	/* Create thread, the sessions are created by all the shard dispatchers so the
+	   threads list is updated before the main dispatcher can receive the close */
+	capwap_rwlock_wrlock(&g_ac.sessionslock);
 	result = pthread_create(&session->threadid, NULL, ac_session_thread, (void*)session);
 	if (!result) {
 		struct ac_session_thread_t* sessionthread;
@@ -681,6 +767,7 @@ static struct ac_session_t* ac_create_session(int sock, union sockaddr_capwap* f
 
 		/* */
 		capwap_itemlist_insert_after(g_ac.sessionsthread, NULL, itemlist);
+		capwap_rwlock_unlock(&g_ac.sessionslock);
 	} else {
 		log_printf(LOG_EMERG, "Unable create session thread, error code %d", result);
 		capwap_exit(CAPWAP_OUT_OF_MEMORY);
@@ -689,15 +776,44 @@ static struct ac_session_t* ac_create_session(int sock, union sockaddr_capwap* f
 	return session;
 }
 
+/* Acquire reference of session only if still active, the memory of session must be valid */
+int ac_session_acquire_reference(struct ac_session_t* session) {
+	int result = 0;
+
+	ASSERT(session != NULL);
+
+	capwap_rwlock_rdlock(&g_ac.sessionslock);
+
+	if (capwap_hash_search(g_ac.sessionsaddress, &session->dtls.peeraddr) == (void*)session) {
+		/* Increment session count */
+		capwap_lock_enter(&session->sessionlock);
+		session->count++;
+		capwap_lock_exit(&session->sessionlock);
+
+		result = 1;
+	}
+
+	capwap_rwlock_unlock(&g_ac.sessionslock);
+
+	return result;
+}
+
 /* Release reference of session */
 void ac_session_release_reference(struct ac_session_t* session) {
+	int release;
+
 	ASSERT(session != NULL);
 
 	capwap_lock_enter(&session->sessionlock);
 	ASSERT(session->count > 0);
 	session->count--;
-	capwap_event_signal(&session->changereference);
+	release = (session->released && !session->count);
 	capwap_lock_exit(&session->sessionlock);
+
+	/* The owner has already destroyed the session, free it with the last reference */
+	if (release) {
+		ac_session_release(session);
+	}
 }
 
 /* Update statistics */
@@ -812,19 +928,186 @@ int ac_execute_update_fdspool(struct ac_fds* fds) {
 }
 
 /* AC running */
-int ac_execute(void) {
-	int result = CAPWAP_SUCCESSFUL;
-
-	int index;
+static void ac_dispatch_packet(int sock, char* buffer, int size, union sockaddr_capwap* fromaddr, union sockaddr_capwap* toaddr) {
 	int check;
-	union sockaddr_capwap fromaddr;
-	union sockaddr_capwap toaddr;
 	struct ac_session_t* session;
 
-	char buffer[CAPWAP_MAX_PACKET_SIZE];
-	int buffersize;
+	/* Search the AC session */
+	session = ac_search_session_from_wtpaddress(fromaddr);
+	if (session) {
+		/* Add packet*/
+		ac_session_add_packet(session, buffer, size, 0);
+
+		/* Release reference */
+		ac_session_release_reference(session);
+	} else {
+		unsigned short sessioncount;
+
+		/* TODO prevent dos attack add filtering ip for multiple error */
+
+		/* Get current session number */
+		capwap_rwlock_rdlock(&g_ac.sessionslock);
+		sessioncount = g_ac.sessions->count;
+		capwap_rwlock_unlock(&g_ac.sessionslock);
+
+		/* */
+		if (ac_backend_isconnect() && (sessioncount < g_ac.descriptor.maxwtp)) {
+			check = capwap_sanity_check(CAPWAP_UNDEF_STATE, buffer, size, g_ac.enabledtls);
+			if (check == CAPWAP_PLAIN_PACKET) {
+				struct capwap_header* header = (struct capwap_header*)buffer;
+
+				/* Accepted only packet without fragmentation */
+				if (!IS_FLAG_F_HEADER(header)) {
+					int headersize = GET_HLEN_HEADER(header) * 4;
+					if (size >= (headersize + sizeof(struct capwap_control_message))) {
+						struct capwap_control_message* control = (struct capwap_control_message*)((char*)buffer + headersize);
+						unsigned long type = ntohl(control->type);
+
+						if (type == CAPWAP_DISCOVERY_REQUEST) {
+							ac_discovery_add_packet(buffer, size, sock, fromaddr);
+						} else if (!g_ac.enabledtls && (type == CAPWAP_JOIN_REQUEST)) {
+							/* Create a new session */
+							session = ac_create_session(sock, fromaddr, toaddr, 0);
+							ac_session_add_packet(session, buffer, size, 1);
+
+							/* Release reference */
+							ac_session_release_reference(session);
+						}
+					}
+				}
+			} else if (check == CAPWAP_DTLS_PACKET) {
+				int result;
+				int responselength;
+				char response[CAPWAP_DTLS_HELLOVERIFYREQUEST_LENGTH];
+
+				/* Before create new session check the cookie of DTLS Client Hello, without keep any state */
+				result = capwap_crypt_verify_clienthello(&((char*)buffer)[sizeof(struct capwap_dtls_header)], size - sizeof(struct capwap_dtls_header), fromaddr, response, &responselength);
+				if (result == CAPWAP_DTLS_CLIENTHELLO_VERIFY) {
+					capwap_sendto(sock, response, responselength, fromaddr);
+				} else if (result == CAPWAP_DTLS_CLIENTHELLO_ACCEPTED) {
+					/* Admission control, the WTP retransmit the Client Hello when a slot is not available */
+					if (ac_handshakes_acquire_slot()) {
+						/* Create a new session */
+						session = ac_create_session(sock, fromaddr, toaddr, 1);
+						ac_session_add_packet(session, buffer, size, 0);
+
+						/* Release reference */
+						ac_session_release_reference(session);
+					} else {
+						log_printf(LOG_DEBUG, "Too many DTLS handshakes in progress, Client Hello dropped");
+					}
+				}
+			}
+		}
+	}
+}
+
+/* Receive and dispatch the packets of a control socket shard */
+static void* ac_netshard_thread(void* param) {
+	int i;
+	int index;
+	struct pollfd fdspoll;
+	struct ac_fds fds;
+	struct capwap_recv_batch* batch;
+	struct ac_netshard* shard = (struct ac_netshard*)param;
+
+	ASSERT(param != NULL);
+
+	/* Poll only the shard socket, messages queue and kernel events are managed by main dispatcher */
+	memset(&fds, 0, sizeof(struct ac_fds));
+	fds.fdsnetworkcount = capwap_network_set_pollfd(shard->net, &fdspoll, 1);
+	fds.fdstotalcount = fds.fdsnetworkcount;
+	fds.fdspoll = &fdspoll;
+	fds.msgqueuestartpos = -1;
+	fds.kmodeventsstartpos = -1;
+
+	/* */
+	batch = capwap_recv_batch_create(AC_RECV_BATCH_SIZE, CAPWAP_MAX_PACKET_SIZE);
+
+	log_printf(LOG_DEBUG, "Control socket shard start");
+
+	while (g_ac.running) {
+		index = ac_recvfrom(&fds, batch, AC_NETSHARD_WAIT_TIMEOUT);
+		if (index >= 0) {
+			for (i = 0; i < batch->count; i++) {
+				struct capwap_recv_packet* packet = &batch->packets[i];
+
+				ac_dispatch_packet(fdspoll.fd, packet->buffer, packet->size, &packet->fromaddr, &packet->toaddr);
+			}
+		} else if (index == CAPWAP_RECV_ERROR_SOCKET) {
+			break;		/* Socket close */
+		}
+	}
+
+	log_printf(LOG_DEBUG, "Control socket shard stop");
+
+	/* */
+	capwap_recv_batch_free(batch);
+
+	/* Thread exit */
+	pthread_exit(NULL);
+	return NULL;
+}
+
+/* */
+static void ac_netshards_stop(void) {
+	void* dummy;
+	unsigned long i;
+
+	if (!g_ac_netshards) {
+		return;
+	}
+
+	/* Dispatchers terminate within AC_NETSHARD_WAIT_TIMEOUT */
+	g_ac.running = 0;
+	for (i = 0; i < (g_ac.netshardscount - 1); i++) {
+		if (g_ac_netshards[i].net) {
+			pthread_join(g_ac_netshards[i].threadid, &dummy);
+		}
+	}
+
+	capwap_free(g_ac_netshards);
+	g_ac_netshards = NULL;
+}
+
+/* Start a dispatcher for every control socket shard, except g_ac.net served by main dispatcher */
+static int ac_netshards_start(void) {
+	int result;
+	unsigned long i;
+
+	if (!g_ac.netshards) {
+		return 1;
+	}
+
+	/* */
+	g_ac_netshards = (struct ac_netshard*)capwap_alloc(sizeof(struct ac_netshard) * (g_ac.netshardscount - 1));
+	memset(g_ac_netshards, 0, sizeof(struct ac_netshard) * (g_ac.netshardscount - 1));
+
+	for (i = 0; i < (g_ac.netshardscount - 1); i++) {
+		g_ac_netshards[i].net = &g_ac.netshards[i];
 
+		result = pthread_create(&g_ac_netshards[i].threadid, NULL, ac_netshard_thread, (void*)&g_ac_netshards[i]);
+		if (result) {
+			log_printf(LOG_ERR, "Unable create control socket shard thread, error code %d", result);
+
+			/* Join only the started dispatchers */
+			g_ac_netshards[i].net = NULL;
+			ac_netshards_stop();
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+/* */
+int ac_execute(void) {
+	int result = CAPWAP_SUCCESSFUL;
+
+	int i;
+	int index;
 	struct ac_fds fds;
+	struct capwap_recv_batch* batch;
 
 	/* Set file descriptor pool */
 	if (ac_execute_init_fdspool(&fds, &g_ac.net, g_ac.fdmsgsessions[1]) <= 0) {
@@ -832,6 +1115,9 @@ int ac_execute(void) {
 		return AC_ERROR_SYSTEM_FAILER;
 	}
 
+	/* */
+	batch = capwap_recv_batch_create(AC_RECV_BATCH_SIZE, CAPWAP_MAX_PACKET_SIZE);
+
 	/* Handler signal */
 	g_ac.running = 1;
 	signal(SIGPIPE, SIG_IGN);
@@ -841,91 +1127,126 @@ int ac_execute(void) {
 	/* Start discovery thread */
 	if (!ac_discovery_start()) {
 		ac_execute_free_fdspool(&fds);
+		capwap_recv_batch_free(batch);
 		log_printf(LOG_DEBUG, "Unable to start discovery thread");
 		return AC_ERROR_SYSTEM_FAILER;
 	}
 
+	/* Start sessions timer service */
+	if (!ac_timers_start()) {
+		ac_execute_free_fdspool(&fds);
+		capwap_recv_batch_free(batch);
+		ac_discovery_stop();
+		log_printf(LOG_ERR, "Unable start sessions timer service");
+		return AC_ERROR_SYSTEM_FAILER;
+	}
+
+	/* Start DTLS handshake pool */
+	if (g_ac.enabledtls && !ac_handshakes_start()) {
+		ac_execute_free_fdspool(&fds);
+		capwap_recv_batch_free(batch);
+		ac_timers_stop();
+		ac_discovery_stop();
+		log_printf(LOG_ERR, "Unable start DTLS handshake pool");
+		return AC_ERROR_SYSTEM_FAILER;
+	}
+
+	/* Start sessions workers */
+	if ((g_ac.sessionsengine == AC_SESSIONS_ENGINE_WORKERS) && !ac_workers_start()) {
+		if (g_ac.enabledtls) {
+			ac_handshakes_stop();
+		}
+
+		ac_execute_free_fdspool(&fds);
+		capwap_recv_batch_free(batch);
+		ac_timers_stop();
+		ac_discovery_stop();
+		log_printf(LOG_ERR, "Unable start sessions workers");
+		return AC_ERROR_SYSTEM_FAILER;
+	}
+
+	/* Start SOAP calls pool */
+	if (!ac_soapcalls_start()) {
+		if (g_ac.sessionsengine == AC_SESSIONS_ENGINE_WORKERS) {
+			ac_workers_stop();
+		}
+
+		if (g_ac.enabledtls) {
+			ac_handshakes_stop();
+		}
+
+		ac_execute_free_fdspool(&fds);
+		capwap_recv_batch_free(batch);
+		ac_timers_stop();
+		ac_discovery_stop();
+		log_printf(LOG_ERR, "Unable start SOAP calls pool");
+		return AC_ERROR_SYSTEM_FAILER;
+	}
+
 	/* Enable Backend Management */
 	if (!ac_backend_start()) {
+		ac_soapcalls_stop();
+		if (g_ac.sessionsengine == AC_SESSIONS_ENGINE_WORKERS) {
+			ac_workers_stop();
+		}
+
+		if (g_ac.enabledtls) {
+			ac_handshakes_stop();
+		}
+
 		ac_execute_free_fdspool(&fds);
+		capwap_recv_batch_free(batch);
+		ac_timers_stop();
 		ac_discovery_stop();
 		log_printf(LOG_ERR, "Unable start backend management");
 		return AC_ERROR_SYSTEM_FAILER;
 	}
 
+	/* Start control sockets shards dispatchers */
+	if (!ac_netshards_start()) {
+		ac_backend_stop();
+		ac_soapcalls_stop();
+		if (g_ac.sessionsengine == AC_SESSIONS_ENGINE_WORKERS) {
+			ac_workers_stop();
+		}
+
+		if (g_ac.enabledtls) {
+			ac_handshakes_stop();
+		}
+
+		ac_execute_free_fdspool(&fds);
+		capwap_recv_batch_free(batch);
+		ac_timers_stop();
+		ac_discovery_stop();
+		ac_backend_free();
+		return AC_ERROR_SYSTEM_FAILER;
+	}
+
 	/* */
 	while (g_ac.running) {
-		/* Receive packet */
-		buffersize = sizeof(buffer);
-		index = ac_recvfrom(&fds, buffer, &buffersize, &fromaddr, &toaddr);
+		/* Receive packets */
+		index = ac_recvfrom(&fds, batch, -1);
 		if (!g_ac.running) {
 			log_printf(LOG_DEBUG, "Closing AC");
 			break;
 		}
-		
+
 		/* */
 		if (index >= 0) {
-			/* Search the AC session */
-			session = ac_search_session_from_wtpaddress(&fromaddr);
-			if (session) {
-				/* Add packet*/
-				ac_session_add_packet(session, buffer, buffersize, 0);
-
-				/* Release reference */
-				ac_session_release_reference(session);
-			} else {
-				unsigned short sessioncount;
-
-				/* TODO prevent dos attack add filtering ip for multiple error */
+			/* Dispatch the whole batch before wait again */
+			for (i = 0; i < batch->count; i++) {
+				struct capwap_recv_packet* packet = &batch->packets[i];
 
-				/* Get current session number */
-				capwap_rwlock_rdlock(&g_ac.sessionslock);
-				sessioncount = g_ac.sessions->count;
-				capwap_rwlock_unlock(&g_ac.sessionslock);
-
-				/* */
-				if (ac_backend_isconnect() && (sessioncount < g_ac.descriptor.maxwtp)) {
-					check = capwap_sanity_check(CAPWAP_UNDEF_STATE, buffer, buffersize, g_ac.enabledtls);
-					if (check == CAPWAP_PLAIN_PACKET) {
-						struct capwap_header* header = (struct capwap_header*)buffer;
-
-						/* Accepted only packet without fragmentation */
-						if (!IS_FLAG_F_HEADER(header)) {
-							int headersize = GET_HLEN_HEADER(header) * 4;
-							if (buffersize >= (headersize + sizeof(struct capwap_control_message))) {
-								struct capwap_control_message* control = (struct capwap_control_message*)((char*)buffer + headersize);
-								unsigned long type = ntohl(control->type);
-
-								if (type == CAPWAP_DISCOVERY_REQUEST) {
-									ac_discovery_add_packet(buffer, buffersize, fds.fdspoll[index].fd, &fromaddr);
-								} else if (!g_ac.enabledtls && (type == CAPWAP_JOIN_REQUEST)) {
-									/* Create a new session */
-									session = ac_create_session(fds.fdspoll[index].fd, &fromaddr, &toaddr);
-									ac_session_add_packet(session, buffer, buffersize, 1);
-
-									/* Release reference */
-									ac_session_release_reference(session);
-								}
-							}
-						}
-					} else if (check == CAPWAP_DTLS_PACKET) {
-						/* Before create new session check if receive DTLS Client Hello */
-						if (capwap_crypt_has_dtls_clienthello(&((char*)buffer)[sizeof(struct capwap_dtls_header)], buffersize - sizeof(struct capwap_dtls_header))) {
-							/* Create a new session */
-							session = ac_create_session(fds.fdspoll[index].fd, &fromaddr, &toaddr);
-							ac_session_add_packet(session, buffer, buffersize, 0);
-
-							/* Release reference */
-							ac_session_release_reference(session);
-						}
-					}
-				}
-			} 
+				ac_dispatch_packet(fds.fdspoll[index].fd, packet->buffer, packet->size, &packet->fromaddr, &packet->toaddr);
+			}
 		} else if (index == CAPWAP_RECV_ERROR_SOCKET) {
 			break;		/* Socket close */
 		}
 	}
 
+	/* Stop control sockets shards dispatchers, no more sessions are created */
+	ac_netshards_stop();
+
 	/* Disable Backend Management */
 	ac_backend_stop();
 
@@ -936,7 +1257,25 @@ int ac_execute(void) {
 	ac_close_sessions();
 
 	/* Wait to terminate all sessions */
-	ac_wait_terminate_allsessions();
+	if (g_ac.sessionsengine == AC_SESSIONS_ENGINE_WORKERS) {
+		ac_workers_stop();
+	} else {
+		ac_wait_terminate_allsessions();
+	}
+
+	/* Wait the sessions still referenced by others threads */
+	ac_wait_release_allsessions();
+
+	/* Stop SOAP calls pool, all sessions are terminated */
+	ac_soapcalls_stop();
+
+	/* Stop DTLS handshake pool, all sessions are terminated */
+	if (g_ac.enabledtls) {
+		ac_handshakes_stop();
+	}
+
+	/* Stop sessions timer service */
+	ac_timers_stop();
 
 	/* Close data channel interfaces */
 	capwap_hash_deleteall(g_ac.ifdatachannel);
@@ -946,5 +1285,6 @@ int ac_execute(void) {
 
 	/* Free file description pool */
 	ac_execute_free_fdspool(&fds);
+	capwap_recv_batch_free(batch);
 	return result;
 }
@@ -0,0 +1,286 @@
+#include "ac.h"
+#include "capwap_dfa.h"
+#include "ac_session.h"
+#include "ac_handshakes.h"
+
+/* Wait of ac_handshakes_cancel while the handshake of session is running */
+#define AC_HANDSHAKES_CANCEL_WAIT				10
+
+/* */
+struct ac_handshake_thread {
+	pthread_t threadid;
+
+	/* Packet buffer of handshake */
+	char buffer[CAPWAP_MAX_PACKET_SIZE];
+};
+
+/* Pool of threads which executes the DTLS handshakes out of the session owner,
+   the expensive public key operations don't block the workers */
+struct ac_handshakes_t {
+	int endthread;
+
+	capwap_event_t wait;
+	capwap_event_t done;
+	capwap_lock_t lock;
+
+	/* Sessions with pending handshake packets */
+	struct ac_session_t* first;
+	struct ac_session_t* last;
+
+	/* */
+	unsigned long count;
+	struct ac_handshake_thread* threads;
+
+	/* Sessions admitted into DTLS handshake */
+	unsigned long concurrent;
+};
+
+static struct ac_handshakes_t g_ac_handshakes;
+
+/* */
+static void ac_handshakes_run(struct ac_handshake_thread* thread) {
+	int result;
+	struct ac_session_t* session;
+
+	capwap_lock_enter(&g_ac_handshakes.lock);
+
+	while (!g_ac_handshakes.endthread) {
+		session = g_ac_handshakes.first;
+		if (session) {
+			/* Remove session from queue, wake up another thread for the next session */
+			g_ac_handshakes.first = session->handshakenext;
+			if (!g_ac_handshakes.first) {
+				g_ac_handshakes.last = NULL;
+			} else {
+				capwap_event_signal(&g_ac_handshakes.wait);
+			}
+
+			session->handshakenext = NULL;
+			session->handshakestatus = AC_HANDSHAKE_RUNNING;
+			capwap_lock_exit(&g_ac_handshakes.lock);
+
+			/* */
+			result = ac_session_dtls_handshake(session, thread->buffer, sizeof(thread->buffer));
+
+			/* The session can not be released until the lock is held, ac_handshakes_cancel wait it */
+			capwap_lock_enter(&g_ac_handshakes.lock);
+			session->handshakeresult = result;
+			session->handshakestatus = AC_HANDSHAKE_DONE;
+			ac_session_wakeup(session);
+			capwap_event_signal(&g_ac_handshakes.done);
+			continue;
+		}
+
+		/* Wait new work */
+		capwap_lock_exit(&g_ac_handshakes.lock);
+		capwap_event_wait(&g_ac_handshakes.wait);
+		capwap_lock_enter(&g_ac_handshakes.lock);
+	}
+
+	/* Wake up the others threads */
+	capwap_event_signal(&g_ac_handshakes.wait);
+	capwap_lock_exit(&g_ac_handshakes.lock);
+}
+
+/* */
+static void* ac_handshakes_thread(void* param) {
+	ASSERT(param != NULL);
+
+	/* */
+	log_printf(LOG_DEBUG, "Handshake thread start");
+	ac_handshakes_run((struct ac_handshake_thread*)param);
+	log_printf(LOG_DEBUG, "Handshake thread stop");
+
+	/* Thread exit */
+	pthread_exit(NULL);
+	return NULL;
+}
+
+/* */
+int ac_handshakes_start(void) {
+	int result;
+	long cpus;
+	unsigned long i;
+
+	memset(&g_ac_handshakes, 0, sizeof(struct ac_handshakes_t));
+
+	/* Number of threads */
+	if (!g_ac.handshakesthreads) {
+		cpus = sysconf(_SC_NPROCESSORS_ONLN);
+		g_ac_handshakes.count = ((cpus > 0) ? (unsigned long)cpus : 1);
+	} else {
+		g_ac_handshakes.count = g_ac.handshakesthreads;
+	}
+
+	/* Init */
+	capwap_event_init(&g_ac_handshakes.wait);
+	capwap_event_init(&g_ac_handshakes.done);
+	capwap_lock_init(&g_ac_handshakes.lock);
+
+	g_ac_handshakes.threads = (struct ac_handshake_thread*)capwap_alloc(sizeof(struct ac_handshake_thread) * g_ac_handshakes.count);
+	memset(g_ac_handshakes.threads, 0, sizeof(struct ac_handshake_thread) * g_ac_handshakes.count);
+
+	for (i = 0; i < g_ac_handshakes.count; i++) {
+		result = pthread_create(&g_ac_handshakes.threads[i].threadid, NULL, ac_handshakes_thread, (void*)&g_ac_handshakes.threads[i]);
+		if (result) {
+			log_printf(LOG_ERR, "Unable create handshake thread, error code %d", result);
+
+			/* Release only the started threads */
+			g_ac_handshakes.count = i;
+			ac_handshakes_stop();
+			return 0;
+		}
+	}
+
+	log_printf(LOG_INFO, "Started %lu DTLS handshake threads, max %lu concurrent handshakes", g_ac_handshakes.count, g_ac.handshakesconcurrent);
+	return 1;
+}
+
+/* */
+void ac_handshakes_stop(void) {
+	void* dummy;
+	unsigned long i;
+
+	/* */
+	capwap_lock_enter(&g_ac_handshakes.lock);
+	g_ac_handshakes.endthread = 1;
+	capwap_lock_exit(&g_ac_handshakes.lock);
+	capwap_event_signal(&g_ac_handshakes.wait);
+
+	/* */
+	for (i = 0; i < g_ac_handshakes.count; i++) {
+		pthread_join(g_ac_handshakes.threads[i].threadid, &dummy);
+	}
+
+	/* Free memory */
+	ASSERT(g_ac_handshakes.first == NULL);
+	capwap_event_destroy(&g_ac_handshakes.wait);
+	capwap_event_destroy(&g_ac_handshakes.done);
+	capwap_lock_destroy(&g_ac_handshakes.lock);
+	capwap_free(g_ac_handshakes.threads);
+
+	memset(&g_ac_handshakes, 0, sizeof(struct ac_handshakes_t));
+}
+
+/* Reserve a handshake slot for a new session, return 0 if the limit is reached */
+int ac_handshakes_acquire_slot(void) {
+	unsigned long concurrent;
+
+	if (!g_ac.handshakesconcurrent) {
+		__atomic_add_fetch(&g_ac_handshakes.concurrent, 1, __ATOMIC_RELAXED);
+		return 1;
+	}
+
+	/* The slots are reserved by all the shard dispatchers */
+	concurrent = __atomic_load_n(&g_ac_handshakes.concurrent, __ATOMIC_RELAXED);
+	while (concurrent < g_ac.handshakesconcurrent) {
+		if (__atomic_compare_exchange_n(&g_ac_handshakes.concurrent, &concurrent, concurrent + 1, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+/* */
+void ac_handshakes_release_slot(void) {
+	ASSERT(__atomic_load_n(&g_ac_handshakes.concurrent, __ATOMIC_RELAXED) > 0);
+
+	__atomic_sub_fetch(&g_ac_handshakes.concurrent, 1, __ATOMIC_RELAXED);
+}
+
+/* Queue the pending handshake packets of session, the session can not read
+   its packets until ac_handshakes_poll return AC_HANDSHAKE_POLL_DONE */
+void ac_handshakes_submit(struct ac_session_t* session) {
+	ASSERT(session != NULL);
+
+	capwap_lock_enter(&g_ac_handshakes.lock);
+	if (session->handshakestatus == AC_HANDSHAKE_IDLE) {
+		session->handshakestatus = AC_HANDSHAKE_QUEUED;
+		session->handshakenext = NULL;
+
+		if (g_ac_handshakes.last) {
+			g_ac_handshakes.last->handshakenext = session;
+		} else {
+			g_ac_handshakes.first = session;
+		}
+
+		g_ac_handshakes.last = session;
+	}
+	capwap_lock_exit(&g_ac_handshakes.lock);
+
+	capwap_event_signal(&g_ac_handshakes.wait);
+}
+
+/* */
+int ac_handshakes_poll(struct ac_session_t* session, int* result) {
+	int poll = AC_HANDSHAKE_POLL_IDLE;
+
+	ASSERT(session != NULL);
+	ASSERT(result != NULL);
+
+	/* Only the sessions into DTLS handshake use the pool */
+	if (!session->handshakeslot && !session->datahandshakeslot) {
+		return AC_HANDSHAKE_POLL_IDLE;
+	}
+
+	capwap_lock_enter(&g_ac_handshakes.lock);
+	if (session->handshakestatus == AC_HANDSHAKE_DONE) {
+		session->handshakestatus = AC_HANDSHAKE_IDLE;
+		*result = session->handshakeresult;
+		poll = AC_HANDSHAKE_POLL_DONE;
+	} else if (session->handshakestatus != AC_HANDSHAKE_IDLE) {
+		poll = AC_HANDSHAKE_POLL_PENDING;
+	}
+	capwap_lock_exit(&g_ac_handshakes.lock);
+
+	return poll;
+}
+
+/* Remove the session from pool, wait the handshake running */
+void ac_handshakes_cancel(struct ac_session_t* session) {
+	struct ac_session_t* prev = NULL;
+	struct ac_session_t* search;
+
+	ASSERT(session != NULL);
+
+	/* Only the sessions into DTLS handshake use the pool */
+	if (!session->handshakeslot && !session->datahandshakeslot) {
+		return;
+	}
+
+	capwap_lock_enter(&g_ac_handshakes.lock);
+
+	if (session->handshakestatus == AC_HANDSHAKE_QUEUED) {
+		search = g_ac_handshakes.first;
+		while (search) {
+			if (search == session) {
+				if (prev) {
+					prev->handshakenext = session->handshakenext;
+				} else {
+					g_ac_handshakes.first = session->handshakenext;
+				}
+
+				if (g_ac_handshakes.last == session) {
+					g_ac_handshakes.last = prev;
+				}
+
+				break;
+			}
+
+			prev = search;
+			search = search->handshakenext;
+		}
+
+		session->handshakenext = NULL;
+	}
+
+	while (session->handshakestatus == AC_HANDSHAKE_RUNNING) {
+		capwap_lock_exit(&g_ac_handshakes.lock);
+		capwap_event_wait_timeout(&g_ac_handshakes.done, AC_HANDSHAKES_CANCEL_WAIT);
+		capwap_lock_enter(&g_ac_handshakes.lock);
+	}
+
+	session->handshakestatus = AC_HANDSHAKE_IDLE;
+	capwap_lock_exit(&g_ac_handshakes.lock);
+}
@@ -0,0 +1,28 @@
+#ifndef __AC_HANDSHAKES_HEADER__
+#define __AC_HANDSHAKES_HEADER__
+
+/* Handshake state of session */
+#define AC_HANDSHAKE_IDLE						0
+#define AC_HANDSHAKE_QUEUED						1
+#define AC_HANDSHAKE_RUNNING					2
+#define AC_HANDSHAKE_DONE						3
+
+/* Return value of ac_handshakes_poll */
+#define AC_HANDSHAKE_POLL_IDLE					0
+#define AC_HANDSHAKE_POLL_PENDING				1
+#define AC_HANDSHAKE_POLL_DONE					2
+
+/* */
+int ac_handshakes_start(void);
+void ac_handshakes_stop(void);
+
+/* Admission control of new DTLS sessions */
+int ac_handshakes_acquire_slot(void);
+void ac_handshakes_release_slot(void);
+
+/* */
+void ac_handshakes_submit(struct ac_session_t* session);
+int ac_handshakes_poll(struct ac_session_t* session, int* result);
+void ac_handshakes_cancel(struct ac_session_t* session);
+
+#endif /* __AC_HANDSHAKES_HEADER__ */
@@ -100,6 +100,40 @@ static int ac_kmod_event_handler(struct genlmsghdr* gnlh, struct nlattr** tb_msg
 			break;
 		}
 
+		case NLSMARTCAPWAP_CMD_RECV_DTLS: {
+			if (tb_msg[NLSMARTCAPWAP_ATTR_ADDRESS] && tb_msg[NLSMARTCAPWAP_ATTR_DATA_FRAME]) {
+				struct ac_session_t* session;
+				struct ac_session_datachannel_packet* datapacket;
+				int length = nla_len(tb_msg[NLSMARTCAPWAP_ATTR_DATA_FRAME]);
+
+				/* */
+				datapacket = (struct ac_session_datachannel_packet*)capwap_alloc(sizeof(struct ac_session_datachannel_packet) + length);
+				memset(&datapacket->peeraddr, 0, sizeof(union sockaddr_capwap));
+				memcpy(&datapacket->peeraddr.ss, nla_data(tb_msg[NLSMARTCAPWAP_ATTR_ADDRESS]), sizeof(struct sockaddr_storage));
+				if (datapacket->peeraddr.ss.ss_family == AF_INET6) {
+					capwap_ipv4_mapped_ipv6(&datapacket->peeraddr);
+				}
+
+				memcpy(datapacket->packet, nla_data(tb_msg[NLSMARTCAPWAP_ATTR_DATA_FRAME]), length);
+
+				/* Before the keys the session is not bound to data channel address */
+				if (tb_msg[NLSMARTCAPWAP_ATTR_SESSION_ID]) {
+					session = ac_search_session_from_sessionid((struct capwap_sessionid_element*)nla_data(tb_msg[NLSMARTCAPWAP_ATTR_SESSION_ID]));
+				} else {
+					session = ac_search_session_from_datachannel(&datapacket->peeraddr);
+				}
+
+				if (session) {
+					ac_session_send_action(session, AC_SESSION_ACTION_RECV_DTLS_DATA_CHANNEL, 0, datapacket, sizeof(struct ac_session_datachannel_packet) + length);
+					ac_session_release_reference(session);
+				}
+
+				capwap_free(datapacket);
+			}
+
+			break;
+		}
+
 		case NLSMARTCAPWAP_CMD_RECV_DATA: {
 			if (tb_msg[NLSMARTCAPWAP_ATTR_SESSION_ID] && tb_msg[NLSMARTCAPWAP_ATTR_DATA_FRAME]) {
 				struct ac_session_t* session = ac_search_session_from_sessionid((struct capwap_sessionid_element*)nla_data(tb_msg[NLSMARTCAPWAP_ATTR_SESSION_ID]));
@@ -278,6 +312,62 @@ int ac_kmod_send_data(struct capwap_sessionid_element* sessionid, uint8_t radioi
 	return result;
 }
 
+/* */
+int ac_kmod_send_dtls(union sockaddr_capwap* peeraddr, struct iovec* iov, int count) {
+	int i;
+	int result;
+	int length = 0;
+	char* frame;
+	struct nlattr* attr;
+	struct nl_msg* msg;
+	struct sockaddr_storage sockaddr;
+
+	ASSERT(peeraddr != NULL);
+	ASSERT(iov != NULL);
+	ASSERT(count > 0);
+
+	/* */
+	for (i = 0; i < count; i++) {
+		length += iov[i].iov_len;
+	}
+
+	/* */
+	msg = nlmsg_alloc_size(NLMSG_HDRLEN + GENL_HDRLEN + nla_total_size(sizeof(struct sockaddr_storage)) + nla_total_size(length));
+	if (!msg) {
+		return -1;
+	}
+
+	/* */
+	memset(&sockaddr, 0, sizeof(struct sockaddr_storage));
+	memcpy(&sockaddr, &peeraddr->ss, sizeof(union sockaddr_capwap));
+
+	genlmsg_put(msg, 0, 0, g_ac.kmodhandle.nlsmartcapwap_id, 0, 0, NLSMARTCAPWAP_CMD_SEND_DTLS, 0);
+	nla_put(msg, NLSMARTCAPWAP_ATTR_ADDRESS, sizeof(struct sockaddr_storage), &sockaddr);
+
+	/* Join the DTLS preamble and record into message */
+	attr = nla_reserve(msg, NLSMARTCAPWAP_ATTR_DATA_FRAME, length);
+	if (!attr) {
+		nlmsg_free(msg);
+		return -1;
+	}
+
+	frame = (char*)nla_data(attr);
+	for (i = 0; i < count; i++) {
+		memcpy(frame, iov[i].iov_base, iov[i].iov_len);
+		frame += iov[i].iov_len;
+	}
+
+	/* */
+	result = ac_kmod_send_and_recv_msg(msg, NULL, NULL);
+	if (result) {
+		log_printf(LOG_ERR, "Unable to send DTLS data channel record: %d", result);
+	}
+
+	/* */
+	nlmsg_free(msg);
+	return (result ? -1 : length);
+}
+
 /* */
 int ac_kmod_isconnected(void) {
 	return (g_ac.kmodhandle.nlsmartcapwap_id ? 1 : 0);
@@ -351,7 +441,7 @@ int ac_kmod_createdatachannel(int family, unsigned short port) {
 }
 
 /* */
-int ac_kmod_new_datasession(struct capwap_sessionid_element* sessionid, uint8_t binding, uint16_t mtu) {
+int ac_kmod_new_datasession(struct capwap_sessionid_element* sessionid, uint8_t binding, uint16_t mtu, uint32_t flags) {
 	int result;
 	struct nl_msg* msg;
 
@@ -369,6 +459,10 @@ int ac_kmod_new_datasession(struct capwap_sessionid_element* sessionid, uint8_t
 	nla_put_u16(msg, NLSMARTCAPWAP_ATTR_BINDING, binding);
 	nla_put_u16(msg, NLSMARTCAPWAP_ATTR_MTU, mtu);
 
+	if (flags & AC_KMOD_FLAGS_DTLS_DATA_CHANNEL) {
+		nla_put_u32(msg, NLSMARTCAPWAP_ATTR_FLAGS, NLSMARTCAPWAP_FLAGS_DTLS_DATA_CHANNEL);
+	}
+
 	/* */
 	result = ac_kmod_send_and_recv_msg(msg, NULL, NULL);
 	if (result) {
@@ -408,6 +502,49 @@ int ac_kmod_delete_datasession(struct capwap_sessionid_element* sessionid) {
 	return result;
 }
 
+/* */
+int ac_kmod_set_dtls_keys(struct capwap_sessionid_element* sessionid, union sockaddr_capwap* peeraddr, struct capwap_dtls_keys* keys) {
+	int result;
+	struct nl_msg* msg;
+	struct sockaddr_storage sockaddr;
+
+	ASSERT(sessionid != NULL);
+	ASSERT(peeraddr != NULL);
+	ASSERT(keys != NULL);
+
+	/* */
+	msg = nlmsg_alloc();
+	if (!msg) {
+		return -1;
+	}
+
+	/* */
+	memset(&sockaddr, 0, sizeof(struct sockaddr_storage));
+	memcpy(&sockaddr, &peeraddr->ss, sizeof(union sockaddr_capwap));
+
+	genlmsg_put(msg, 0, 0, g_ac.kmodhandle.nlsmartcapwap_id, 0, 0, NLSMARTCAPWAP_CMD_SET_DTLS_KEYS, 0);
+	nla_put(msg, NLSMARTCAPWAP_ATTR_SESSION_ID, sizeof(struct capwap_sessionid_element), sessionid);
+	nla_put(msg, NLSMARTCAPWAP_ATTR_ADDRESS, sizeof(struct sockaddr_storage), &sockaddr);
+	nla_put_u8(msg, NLSMARTCAPWAP_ATTR_DTLS_CIPHER, NLSMARTCAPWAP_DTLS_CIPHER_AES_GCM);
+	nla_put_u16(msg, NLSMARTCAPWAP_ATTR_DTLS_EPOCH, keys->epoch);
+	nla_put_u64(msg, NLSMARTCAPWAP_ATTR_DTLS_SEQUENCE, NLSMARTCAPWAP_DTLS_FIRST_SEQUENCE);
+	nla_put(msg, NLSMARTCAPWAP_ATTR_DTLS_RX_KEY, keys->keylength, keys->readkey);
+	nla_put(msg, NLSMARTCAPWAP_ATTR_DTLS_RX_SALT, CAPWAP_DTLS_KEYS_SALT_LENGTH, keys->readsalt);
+	nla_put(msg, NLSMARTCAPWAP_ATTR_DTLS_TX_KEY, keys->keylength, keys->writekey);
+	nla_put(msg, NLSMARTCAPWAP_ATTR_DTLS_TX_SALT, CAPWAP_DTLS_KEYS_SALT_LENGTH, keys->writesalt);
+
+	/* */
+	result = ac_kmod_send_and_recv_msg(msg, NULL, NULL);
+	if (result) {
+		log_printf(LOG_ERR, "Unable to set DTLS data channel keys: %d", result);
+	}
+
+	/* Don't leave the keys into memory */
+	memset(nlmsg_data(nlmsg_hdr(msg)), 0, nlmsg_datalen(nlmsg_hdr(msg)));
+	nlmsg_free(msg);
+	return result;
+}
+
 /* */
 int ac_kmod_addwlan(struct capwap_sessionid_element* sessionid, uint8_t radioid, uint8_t wlanid, const uint8_t* bssid, uint8_t macmode, uint8_t tunnelmode) {
 	int result;
@@ -14,6 +14,7 @@
 /* */
 #define AC_KMOD_FLAGS_TUNNEL_NATIVE					0x00000000
 #define AC_KMOD_FLAGS_TUNNEL_8023					0x00000001
+#define AC_KMOD_FLAGS_DTLS_DATA_CHANNEL				0x00000002
 
 /* */
 struct ac_kmod_handle {
@@ -51,14 +52,16 @@ int ac_kmod_createdatachannel(int family, unsigned short port);
 /* */
 int ac_kmod_send_keepalive(struct capwap_sessionid_element* sessionid);
 int ac_kmod_send_data(struct capwap_sessionid_element* sessionid, uint8_t radioid, uint8_t binding, const uint8_t* data, int length);
+int ac_kmod_send_dtls(union sockaddr_capwap* peeraddr, struct iovec* iov, int count);
 
 /* */
 int ac_kmod_create_iface(const char* ifname, uint16_t mtu);
 int ac_kmod_delete_iface(int ifindex);
 
 /* */
-int ac_kmod_new_datasession(struct capwap_sessionid_element* sessionid, uint8_t binding, uint16_t mtu);
+int ac_kmod_new_datasession(struct capwap_sessionid_element* sessionid, uint8_t binding, uint16_t mtu, uint32_t flags);
 int ac_kmod_delete_datasession(struct capwap_sessionid_element* sessionid);
+int ac_kmod_set_dtls_keys(struct capwap_sessionid_element* sessionid, union sockaddr_capwap* peeraddr, struct capwap_dtls_keys* keys);
 
 /* */
 int ac_kmod_addwlan(struct capwap_sessionid_element* sessionid, uint8_t radioid, uint8_t wlanid, const uint8_t* bssid, uint8_t macmode, uint8_t tunnelmode);
@@ -0,0 +1,86 @@
+#include "ac.h"
+#include "ac_packets.h"
+
+/* The free buffers are linked through their memory */
+struct ac_packets_buffer {
+	struct ac_packets_buffer* next;
+};
+
+/* Free buffers of MTU size, the larger packets use own memory */
+struct ac_packets_t {
+	capwap_lock_t lock;
+
+	struct ac_packets_buffer* free;
+	unsigned long freecount;
+};
+
+static struct ac_packets_t g_ac_packets;
+
+/* */
+#define AC_PACKETS_SLOT_SIZE					((int)g_ac.mtu + AC_PACKETS_SLOT_OVERHEAD)
+
+/* */
+void ac_packets_init(void) {
+	memset(&g_ac_packets, 0, sizeof(struct ac_packets_t));
+	capwap_lock_init(&g_ac_packets.lock);
+}
+
+/* */
+void ac_packets_free(void) {
+	struct ac_packets_buffer* buffer;
+
+	while (g_ac_packets.free) {
+		buffer = g_ac_packets.free;
+		g_ac_packets.free = buffer->next;
+		capwap_free(buffer);
+	}
+
+	capwap_lock_destroy(&g_ac_packets.lock);
+}
+
+/* */
+char* ac_packets_alloc_buffer(int length) {
+	struct ac_packets_buffer* buffer = NULL;
+
+	ASSERT(length > 0);
+
+	if (length > AC_PACKETS_SLOT_SIZE) {
+		return (char*)capwap_alloc(length);
+	}
+
+	/* Reuse a free buffer */
+	capwap_lock_enter(&g_ac_packets.lock);
+
+	if (g_ac_packets.free) {
+		buffer = g_ac_packets.free;
+		g_ac_packets.free = buffer->next;
+		g_ac_packets.freecount--;
+	}
+
+	capwap_lock_exit(&g_ac_packets.lock);
+
+	return (buffer ? (char*)buffer : (char*)capwap_alloc(AC_PACKETS_SLOT_SIZE));
+}
+
+/* */
+void ac_packets_free_buffer(char* buffer, int length) {
+	ASSERT(buffer != NULL);
+	ASSERT(length > 0);
+
+	if (length <= AC_PACKETS_SLOT_SIZE) {
+		capwap_lock_enter(&g_ac_packets.lock);
+
+		if (g_ac_packets.freecount < AC_PACKETS_MAX_FREE) {
+			((struct ac_packets_buffer*)buffer)->next = g_ac_packets.free;
+			g_ac_packets.free = (struct ac_packets_buffer*)buffer;
+			g_ac_packets.freecount++;
+			buffer = NULL;
+		}
+
+		capwap_lock_exit(&g_ac_packets.lock);
+	}
+
+	if (buffer) {
+		capwap_free(buffer);
+	}
+}
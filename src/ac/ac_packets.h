@@ -0,0 +1,17 @@
+#ifndef __AC_PACKETS_HEADER__
+#define __AC_PACKETS_HEADER__
+
+/* Buffers of the packets queued to sessions, sized from the MTU of AC plus
+   the DTLS record overhead and shared by all sessions */
+#define AC_PACKETS_SLOT_OVERHEAD				128
+#define AC_PACKETS_MAX_FREE						1024
+
+/* */
+void ac_packets_init(void);
+void ac_packets_free(void);
+
+/* */
+char* ac_packets_alloc_buffer(int length);
+void ac_packets_free_buffer(char* buffer, int length);
+
+#endif /* __AC_PACKETS_HEADER__ */
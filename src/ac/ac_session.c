@@ -4,17 +4,31 @@
 #include "ac_session.h"
 #include "ac_wlans.h"
 #include "ac_backend.h"
+#include "ac_handshakes.h"
+#include "ac_stationcache.h"
+#include "ac_packets.h"
 #include <arpa/inet.h>
 
 #define AC_NO_ERROR						-1000
 #define AC_ERROR_TIMEOUT				-1001
+#define AC_ERROR_WOULDBLOCK				-1002
+
+/* Context of station authorization, with the generation of cache at request */
+struct ac_session_authorizestation_context {
+	unsigned long generation;
+	struct ac_notify_station_configuration_ieee8011_add_station notify;
+};
+
+/* */
+static void ac_session_action_authorizestation_complete(struct ac_session_t* session, struct ac_soap_response* response, void* context);
 
 /* */
-static struct ac_soap_response* ac_session_action_authorizestation_request(struct ac_session_t* session, uint8_t radioid, uint8_t wlanid, uint8_t* address) {
+static int ac_session_action_authorizestation_request(struct ac_session_t* session, struct ac_notify_station_configuration_ieee8011_add_station* notify) {
+	int result;
 	const char* jsonmessage;
 	char* base64confstatus;
 	struct json_object* jsonparam;
-	struct ac_soap_response* response;
+	struct ac_session_authorizestation_context context;
 	char addrtext[CAPWAP_MACADDRESS_EUI48_BUFFER];
 
 	/* Create SOAP request with JSON param
@@ -29,43 +43,36 @@ static struct ac_soap_response* ac_session_action_authorizestation_request(struc
 	jsonparam = json_object_new_object();
 
 	/* RadioID */
-	json_object_object_add(jsonparam, "RadioID", json_object_new_int((int)radioid));
+	json_object_object_add(jsonparam, "RadioID", json_object_new_int((int)notify->radioid));
 
 	/* WLANID */
-	json_object_object_add(jsonparam, "WLANID", json_object_new_int((int)wlanid));
+	json_object_object_add(jsonparam, "WLANID", json_object_new_int((int)notify->wlanid));
 
 	/* Station */
-	json_object_object_add(jsonparam, "Station", json_object_new_string(capwap_printf_macaddress(addrtext, address, MACADDRESS_EUI48_LENGTH)));
+	json_object_object_add(jsonparam, "Station", json_object_new_string(capwap_printf_macaddress(addrtext, notify->address, MACADDRESS_EUI48_LENGTH)));
 
 	/* Get JSON param and convert base64 */
 	jsonmessage = json_object_to_json_string(jsonparam);
 	base64confstatus = capwap_alloc(AC_BASE64_ENCODE_LENGTH(strlen(jsonmessage)));
 	ac_base64_string_encode(jsonmessage, base64confstatus);
 
-	/* Send message */
-	response = ac_soap_authorizestation(session, session->wtpid, base64confstatus);
+	/* Send message, the station configuration continues on completion */
+	context.generation = ac_stationcache_getgeneration();
+	memcpy(&context.notify, notify, sizeof(struct ac_notify_station_configuration_ieee8011_add_station));
+	result = ac_soap_authorizestation(session, ac_session_action_authorizestation_complete, &context, sizeof(struct ac_session_authorizestation_context), session->wtpid, base64confstatus);
 
 	/* Free JSON */
 	json_object_put(jsonparam);
 	capwap_free(base64confstatus);
 
-	return response;
+	return result;
 }
 
 /* */
-static int ac_session_action_authorizestation_response(struct ac_session_t* session, struct ac_soap_response* response, struct ac_notify_station_configuration_ieee8011_add_station* notify) {
-	int result = -1;
-	int ifindex = -1;
-	uint16_t vlan = 0;
-	struct ac_if_datachannel* datachannel;
-	struct ac_wlan* wlan;
+static int ac_session_action_authorizestation_parse(struct ac_soap_response* response, struct ac_stationcache_decision* decision) {
 	struct json_object* jsonroot;
 	struct json_object* jsonsection;
 	struct json_object* jsonelement;
-	struct capwap_header_data capwapheader;
-	struct capwap_packet_txmng* txmngpacket;
-	struct capwap_addstation_element addstation;
-	struct capwap_80211_station_element station;
 
 	/* Receive SOAP response with JSON result
 		{
@@ -76,114 +83,175 @@ static int ac_session_action_authorizestation_response(struct ac_session_t* sess
 		}
 	*/
 
-	/* */
+	/* Without a valid response the Backend has not taken a decision */
 	jsonroot = ac_soapclient_parse_json_response(response);
 	if (!jsonroot) {
 		return -1;
 	}
 
 	/* */
+	memset(decision, 0, sizeof(struct ac_stationcache_decision));
 	jsonsection = compat_json_object_object_get(jsonroot, "DataChannelInterface");
 	if (jsonsection && (json_object_get_type(jsonsection) == json_type_object)) {
 		jsonelement = compat_json_object_object_get(jsonsection, "Index");
 		if (jsonelement && (json_object_get_type(jsonelement) == json_type_int)) {
-			unsigned long index = (unsigned long)json_object_get_int(jsonelement);
+			decision->authorized = 1;
+			decision->ifdatachannel = (unsigned long)json_object_get_int(jsonelement);
+
+			/* VLAN into WTP for local tunnel mode, or into AC */
+			jsonelement = compat_json_object_object_get(jsonsection, "VLAN");
+			if (jsonelement && (json_object_get_type(jsonelement) == json_type_string)) {
+				const char* wtpvlan = json_object_get_string(jsonelement);
+				if (wtpvlan && (strlen(wtpvlan) < CAPWAP_ADDSTATION_VLAN_MAX_LENGTH)) {
+					strcpy(decision->wtpvlan, wtpvlan);
+				}
+			} else if (jsonelement && (json_object_get_type(jsonelement) == json_type_int)) {
+				int acvlan = json_object_get_int(jsonelement);
+				if ((acvlan > 0) && (acvlan < VLAN_MAX)) {
+					decision->vlan = (uint16_t)acvlan;
+				}
+			}
+		}
+	}
+
+	/* */
+	json_object_put(jsonroot);
+	return 0;
+}
 
-			/* Retrieve interface index */
-			capwap_rwlock_rdlock(&g_ac.ifdatachannellock);
+/* */
+static int ac_session_action_authorizestation_apply(struct ac_session_t* session, const struct ac_stationcache_decision* decision, struct ac_notify_station_configuration_ieee8011_add_station* notify) {
+	int result = -1;
+	int ifindex = -1;
+	uint16_t vlan = 0;
+	unsigned long index;
+	struct ac_if_datachannel* datachannel;
+	struct ac_wlan* wlan;
+	struct capwap_header_data capwapheader;
+	struct capwap_packet_txmng* txmngpacket;
+	struct capwap_addstation_element addstation;
+	struct capwap_80211_station_element station;
+
+	if (!decision->authorized) {
+		return -1;
+	}
+
+	/* Retrieve interface index */
+	index = decision->ifdatachannel;
+	capwap_rwlock_rdlock(&g_ac.ifdatachannellock);
+
+	datachannel = (struct ac_if_datachannel*)capwap_hash_search(g_ac.ifdatachannel, &index);
+	if (datachannel) {
+		ifindex = datachannel->ifindex;
+	}
 
-			datachannel = (struct ac_if_datachannel*)capwap_hash_search(g_ac.ifdatachannel, &index);
-			if (datachannel) {
-				ifindex = datachannel->ifindex;
+	capwap_rwlock_unlock(&g_ac.ifdatachannellock);
+
+	/* Prepare request */
+	if (ifindex >= 0) {
+		wlan = ac_wlans_get_bssid_with_wlanid(session, notify->radioid, notify->wlanid);
+		if (wlan) {
+			memset(&addstation, 0, sizeof(struct capwap_addstation_element));
+			addstation.radioid = notify->radioid;
+			addstation.length = MACADDRESS_EUI48_LENGTH;
+			addstation.address = notify->address;
+			if ((wlan->tunnelmode == CAPWAP_ADD_WLAN_TUNNELMODE_LOCAL) && decision->wtpvlan[0]) {
+				addstation.vlan = (uint8_t*)decision->wtpvlan;
 			}
 
-			capwap_rwlock_unlock(&g_ac.ifdatachannellock);
-
-			/* Prepare request */
-			if (ifindex >= 0) {
-				wlan = ac_wlans_get_bssid_with_wlanid(session, notify->radioid, notify->wlanid);
-				if (wlan) {
-					memset(&addstation, 0, sizeof(struct capwap_addstation_element));
-					addstation.radioid = notify->radioid;
-					addstation.length = MACADDRESS_EUI48_LENGTH;
-					addstation.address = notify->address;
-					if (wlan->tunnelmode == CAPWAP_ADD_WLAN_TUNNELMODE_LOCAL) {
-						jsonelement = compat_json_object_object_get(jsonsection, "VLAN");
-						if (jsonelement && (json_object_get_type(jsonelement) == json_type_string)) {
-							const char* wtpvlan = json_object_get_string(jsonelement);
-							if (wtpvlan && (strlen(wtpvlan) < CAPWAP_ADDSTATION_VLAN_MAX_LENGTH)) {
-								addstation.vlan = (uint8_t*)wtpvlan;		/* Free with jsonroot */
-							}
-						}
-					}
+			/* */
+			memset(&station, 0, sizeof(struct capwap_80211_station_element));
+			station.radioid = notify->radioid;
+			station.associationid = notify->associationid;
+			memcpy(station.address, notify->address, MACADDRESS_EUI48_LENGTH);
+			station.capabilities = notify->capabilities;
+			station.wlanid = notify->wlanid;
+			station.supportedratescount = notify->supportedratescount;
+			memcpy(station.supportedrates, notify->supportedrates, station.supportedratescount);
+
+			/* Build packet */
+			capwap_header_init(&capwapheader, CAPWAP_RADIOID_NONE, session->binding);
+			txmngpacket = capwap_packet_txmng_create_ctrl_message(&capwapheader, CAPWAP_STATION_CONFIGURATION_REQUEST, session->localseqnumber, session->mtu);
+
+			/* Add message element */
+			capwap_packet_txmng_add_message_element(txmngpacket, CAPWAP_ELEMENT_ADDSTATION, &addstation);
+			capwap_packet_txmng_add_message_element(txmngpacket, CAPWAP_ELEMENT_80211_STATION, &station);
+
+			/* CAPWAP_ELEMENT_VENDORPAYLOAD */				/* TODO */
+
+			/* Station Configuration Request complete, get fragment packets */
+			capwap_packet_txmng_get_fragment_packets(txmngpacket, session->requestfragmentpacket, session->fragmentid);
+			if (session->requestfragmentpacket->count > 1) {
+				session->fragmentid++;
+			}
 
-					/* */
-					memset(&station, 0, sizeof(struct capwap_80211_station_element));
-					station.radioid = notify->radioid;
-					station.associationid = notify->associationid;
-					memcpy(station.address, notify->address, MACADDRESS_EUI48_LENGTH);
-					station.capabilities = notify->capabilities;
-					station.wlanid = notify->wlanid;
-					station.supportedratescount = notify->supportedratescount;
-					memcpy(station.supportedrates, notify->supportedrates, station.supportedratescount);
-
-					/* Build packet */
-					capwap_header_init(&capwapheader, CAPWAP_RADIOID_NONE, session->binding);
-					txmngpacket = capwap_packet_txmng_create_ctrl_message(&capwapheader, CAPWAP_STATION_CONFIGURATION_REQUEST, session->localseqnumber, session->mtu);
-
-					/* Add message element */
-					capwap_packet_txmng_add_message_element(txmngpacket, CAPWAP_ELEMENT_ADDSTATION, &addstation);
-					capwap_packet_txmng_add_message_element(txmngpacket, CAPWAP_ELEMENT_80211_STATION, &station);
-
-					/* CAPWAP_ELEMENT_VENDORPAYLOAD */				/* TODO */
-
-					/* Station Configuration Request complete, get fragment packets */
-					capwap_packet_txmng_get_fragment_packets(txmngpacket, session->requestfragmentpacket, session->fragmentid);
-					if (session->requestfragmentpacket->count > 1) {
-						session->fragmentid++;
-					}
+			/* Free packets manager */
+			capwap_packet_txmng_free(txmngpacket);
 
-					/* Free packets manager */
-					capwap_packet_txmng_free(txmngpacket);
-
-					/* Send Station Configuration Request to WTP */
-					if (capwap_crypt_sendto_fragmentpacket(&session->dtls, session->requestfragmentpacket)) {
-						/* Retrive VLAN */
-						if (wlan->tunnelmode != CAPWAP_ADD_WLAN_TUNNELMODE_LOCAL) {
-							jsonelement = compat_json_object_object_get(jsonroot, "DataChannelInterface.VLAN");
-							if (jsonelement && (json_object_get_type(jsonelement) == json_type_int)) {
-								int acvlan = json_object_get_int(jsonelement);
-								if ((acvlan > 0) && (acvlan < VLAN_MAX)) {
-									vlan = (uint16_t)acvlan;
-								}
-							}
-						}
+			/* Send Station Configuration Request to WTP */
+			if (capwap_crypt_sendto_fragmentpacket(&session->dtls, session->requestfragmentpacket)) {
+				/* Retrive VLAN */
+				if (wlan->tunnelmode != CAPWAP_ADD_WLAN_TUNNELMODE_LOCAL) {
+					vlan = decision->vlan;
+				}
 
-						/* Authorize station also into kernel module */
-						if (!ac_kmod_authorize_station(&session->sessionid, addstation.address, ifindex, notify->radioid, notify->wlanid, vlan)) {
-							result = 0;
-							session->retransmitcount = 0;
-							capwap_timeout_set(session->timeout, session->idtimercontrol, AC_RETRANSMIT_INTERVAL, ac_dfa_retransmition_timeout, session, NULL);
-						} else {
-							log_printf(LOG_WARNING, "Unable to authorize station into kernel module data channel");
-							ac_free_reference_last_request(session);
-							ac_session_teardown(session);
-						}
-					} else {
-						log_printf(LOG_DEBUG, "Warning: error to send Station Configuration Request packet");
-						ac_free_reference_last_request(session);
-						ac_session_teardown(session);
-					}
+				/* Authorize station also into kernel module */
+				if (!ac_kmod_authorize_station(&session->sessionid, addstation.address, ifindex, notify->radioid, notify->wlanid, vlan)) {
+					result = 0;
+					session->retransmitcount = 0;
+					capwap_timeout_set(session->timeout, session->idtimercontrol, AC_RETRANSMIT_INTERVAL, ac_dfa_retransmition_timeout, session, NULL);
+				} else {
+					log_printf(LOG_WARNING, "Unable to authorize station into kernel module data channel");
+					ac_free_reference_last_request(session);
+					ac_session_teardown(session);
 				}
+			} else {
+				log_printf(LOG_DEBUG, "Warning: error to send Station Configuration Request packet");
+				ac_free_reference_last_request(session);
+				ac_session_teardown(session);
 			}
 		}
 	}
 
-	/* */
-	json_object_put(jsonroot);
 	return result;
 }
 
+/* */
+static void ac_session_action_authorizestation_complete(struct ac_session_t* session, struct ac_soap_response* response, void* context) {
+	struct ac_wlan* wlan;
+	struct ac_stationcache_decision decision;
+	struct ac_session_authorizestation_context* authorizestation = (struct ac_session_authorizestation_context*)context;
+	struct ac_notify_station_configuration_ieee8011_add_station* notify = &authorizestation->notify;
+
+	if (response && !ac_session_action_authorizestation_parse(response, &decision)) {
+		/* Save the decision of Backend for the reassociation of station */
+		wlan = ac_wlans_get_bssid_with_wlanid(session, notify->radioid, notify->wlanid);
+		if (wlan) {
+			ac_stationcache_set(session->wtpid, wlan->ssid, notify->address, &decision, authorizestation->generation);
+		}
+
+		if (ac_session_action_authorizestation_apply(session, &decision, notify)) {
+			log_printf(LOG_INFO, "Station is not authorized");
+			/* TODO kickoff station */
+		}
+	}
+}
+
+/* */
+static void ac_session_action_runningwtpsession_complete(struct ac_session_t* session, struct ac_soap_response* response, void* context) {
+	if (session->state != CAPWAP_DATA_CHECK_TO_RUN_STATE) {
+		return;
+	}
+
+	/* */
+	if (response && (response->responsecode == HTTP_RESULT_OK)) {
+		ac_dfa_change_state(session, CAPWAP_RUN_STATE);
+		capwap_timeout_set(session->timeout, session->idtimercontrol, AC_MAX_ECHO_INTERVAL, ac_dfa_teardown_timeout, session, NULL);
+	} else {
+		ac_session_teardown(session);
+	}
+}
+
 /* */
 static int ac_session_action_resetwtp(struct ac_session_t* session, struct ac_notify_reset_t* reset) {
 	struct capwap_header_data capwapheader;
@@ -289,7 +357,8 @@ static int ac_session_action_addwlan(struct ac_session_t* session, struct ac_not
 
 /* */
 static int ac_session_action_station_configuration_ieee8011_add_station(struct ac_session_t* session, struct ac_notify_station_configuration_ieee8011_add_station* notify) {
-	struct ac_soap_response* response;
+	struct ac_wlan* wlan;
+	struct ac_stationcache_decision decision;
 
 	ASSERT(session->requestfragmentpacket->count == 0);
 
@@ -298,15 +367,15 @@ static int ac_session_action_station_configuration_ieee8011_add_station(struct a
 		return AC_NO_ERROR;
 	}
 
-	/* Need authorization of Director */
-	response = ac_session_action_authorizestation_request(session, notify->radioid, notify->wlanid, notify->address);
-	if (response) {
-		if (ac_session_action_authorizestation_response(session, response, notify)) {
+	/* Need authorization of Director, the last decision is reused for reassociation of station */
+	wlan = ac_wlans_get_bssid_with_wlanid(session, notify->radioid, notify->wlanid);
+	if (wlan && ac_stationcache_get(session->wtpid, wlan->ssid, notify->address, &decision)) {
+		if (ac_session_action_authorizestation_apply(session, &decision, notify)) {
 			log_printf(LOG_INFO, "Station is not authorized");
 			/* TODO kickoff station */
 		}
-
-		ac_soapclient_free_response(response);
+	} else {
+		ac_session_action_authorizestation_request(session, notify);
 	}
 
 	return AC_NO_ERROR;
@@ -374,6 +443,114 @@ static int ac_session_action_recv_ieee80211_mgmt_packet(struct ac_session_t* ses
 	return AC_NO_ERROR;
 }
 
+/* */
+static int ac_session_datachannel_sendto(struct capwap_dtls* dtls, struct iovec* iov, int count) {
+	/* DTLS records of data channel are sent through kernel module data socket */
+	return ac_kmod_send_dtls(&dtls->peeraddr, iov, count);
+}
+
+/* Close DTLS session of data channel */
+static int ac_session_datachannel_close(struct ac_session_t* session) {
+	capwap_crypt_freesession(&session->datadtls);
+	capwap_list_flush(session->datahandshake);
+
+	if (session->datahandshakeslot) {
+		session->datahandshakeslot = 0;
+		ac_handshakes_release_slot();
+	}
+
+	if (!(g_ac.descriptor.dtlspolicy & CAPWAP_ACDESC_CLEAR_DATA_CHANNEL_ENABLED)) {
+		log_printf(LOG_DEBUG, "DTLS data channel closed");
+		return CAPWAP_ERROR_CLOSE;
+	}
+
+	return AC_NO_ERROR;
+}
+
+/* Result of handshake pool for the records of data channel */
+static int ac_session_datachannel_handshake_done(struct ac_session_t* session, int result) {
+	struct capwap_dtls_keys keys;
+
+	if ((result != CAPWAP_ERROR_CLOSE) && (result != CAPWAP_ERROR_SHUTDOWN) && (session->datadtls.action == CAPWAP_DTLS_ACTION_DATA)) {
+		/* End of handshake, release the admission slot */
+		session->datahandshakeslot = 0;
+		ac_handshakes_release_slot();
+
+		/* */
+		if (!capwap_crypt_exportkeys(&session->datadtls, &keys)) {
+			log_printf(LOG_WARNING, "Unable to offload DTLS data channel, the cipher suite is not supported by kernel module");
+			result = CAPWAP_ERROR_CLOSE;
+		} else {
+			if (ac_kmod_set_dtls_keys(&session->sessionid, &session->datadtls.peeraddr, &keys)) {
+				log_printf(LOG_WARNING, "Unable to set DTLS keys of data channel into kernel module");
+				result = CAPWAP_ERROR_CLOSE;
+			}
+
+			memset(&keys, 0, sizeof(struct capwap_dtls_keys));
+		}
+	}
+
+	/* */
+	if ((result == CAPWAP_ERROR_CLOSE) || (result == CAPWAP_ERROR_SHUTDOWN)) {
+		return ac_session_datachannel_close(session);
+	}
+
+	return AC_NO_ERROR;
+}
+
+/* */
+static int ac_session_action_recv_dtls_datachannel(struct ac_session_t* session, struct ac_session_datachannel_packet* datapacket, long length) {
+	int result;
+	struct capwap_list_item* itemlist;
+
+	/* */
+	length -= sizeof(struct ac_session_datachannel_packet);
+	if ((length <= sizeof(struct capwap_dtls_header)) || !g_ac.enabledtls || !(g_ac.descriptor.dtlspolicy & CAPWAP_ACDESC_DTLS_DATA_CHANNEL_ENABLED)) {
+		return AC_NO_ERROR;
+	}
+
+	/* The handshake of data channel is accepted only while the data channel is being established */
+	if (!session->datadtls.enable) {
+		if ((session->state != CAPWAP_DATA_CHECK_TO_RUN_STATE) || !capwap_crypt_has_dtls_clienthello(datapacket->packet + sizeof(struct capwap_dtls_header), length - sizeof(struct capwap_dtls_header))) {
+			return AC_NO_ERROR;
+		}
+
+		/* Same admission of control channel, the WTP retransmits the ClientHello */
+		if (!ac_handshakes_acquire_slot()) {
+			log_printf(LOG_DEBUG, "Too many concurrent DTLS handshakes, drop ClientHello of data channel");
+			return AC_NO_ERROR;
+		}
+
+		session->datahandshakeslot = 1;
+		capwap_crypt_settransport(&session->datadtls, ac_session_datachannel_sendto, &datapacket->peeraddr);
+		if (!capwap_crypt_createsession(&session->datadtls, &g_ac.dtlscontext) || (capwap_crypt_open(&session->datadtls) == CAPWAP_HANDSHAKE_ERROR)) {
+			log_printf(LOG_DEBUG, "Unable to create DTLS session of data channel");
+			capwap_crypt_freesession(&session->datadtls);
+			session->datahandshakeslot = 0;
+			ac_handshakes_release_slot();
+			return AC_NO_ERROR;
+		}
+	}
+
+	/* The handshake records are consumed by handshake pool */
+	if (session->datahandshakeslot) {
+		itemlist = capwap_itemlist_create(length);
+		memcpy(itemlist->item, datapacket->packet, length);
+		capwap_itemlist_insert_after(session->datahandshake, NULL, itemlist);
+
+		ac_handshakes_submit(session);
+		return AC_NO_ERROR;
+	}
+
+	/* Alert records, the application data is decrypted by kernel module */
+	result = capwap_decrypt_packet(&session->datadtls, datapacket->packet, length, NULL, length);
+	if ((result == CAPWAP_ERROR_CLOSE) || (result == CAPWAP_ERROR_SHUTDOWN)) {
+		return ac_session_datachannel_close(session);
+	}
+
+	return AC_NO_ERROR;
+}
+
 /* */
 static int ac_session_action_execute(struct ac_session_t* session, struct ac_session_action* action) {
 	int result = AC_NO_ERROR;
@@ -406,22 +583,10 @@ static int ac_session_action_execute(struct ac_session_t* session, struct ac_ses
 			//ac_kmod_send_keepalive(&session->sessionid);
 			capwap_timeout_set(session->timeout, session->idtimerkeepalivedead, AC_MAX_DATA_KEEPALIVE_INTERVAL, ac_dfa_teardown_timeout, session, NULL);
 
-			/* */
-			if (session->state == CAPWAP_DATA_CHECK_TO_RUN_STATE) {
-				struct ac_soap_response* response;
-
-				/* Capwap handshake complete, notify event to backend */
-				response = ac_soap_runningwtpsession(session, session->wtpid);
-				if (response) {
-					if (response->responsecode == HTTP_RESULT_OK) {
-						ac_dfa_change_state(session, CAPWAP_RUN_STATE);
-						capwap_timeout_set(session->timeout, session->idtimercontrol, AC_MAX_ECHO_INTERVAL, ac_dfa_teardown_timeout, session, NULL);
-					} else {
-						result = CAPWAP_ERROR_CLOSE;
-					}
-
-					ac_soapclient_free_response(response);
-				} else {
+			/* Capwap handshake complete, notify event to backend. The next keep-alive
+			   doesn't send again the notification while the call is pending */
+			if ((session->state == CAPWAP_DATA_CHECK_TO_RUN_STATE) && !session->soapcall) {
+				if (!ac_soap_runningwtpsession(session, ac_session_action_runningwtpsession_complete, session->wtpid)) {
 					result = CAPWAP_ERROR_CLOSE;
 				}
 			}
@@ -434,6 +599,16 @@ static int ac_session_action_execute(struct ac_session_t* session, struct ac_ses
 			break;
 		}
 
+		case AC_SESSION_ACTION_RECV_DTLS_DATA_CHANNEL: {
+			result = ac_session_action_recv_dtls_datachannel(session, (struct ac_session_datachannel_packet*)action->data, action->length);
+			break;
+		}
+
+		case AC_SESSION_ACTION_SOAP_RESPONSE: {
+			ac_soapcalls_complete(session, *(struct ac_soapcall**)action->data);
+			break;
+		}
+
 		case AC_SESSION_ACTION_NOTIFY_EVENT: {
 			struct capwap_list_item* item;
 
@@ -472,72 +647,165 @@ static int ac_session_action_execute(struct ac_session_t* session, struct ac_ses
 }
 
 /* */
-static int ac_network_read(struct ac_session_t* session, void* buffer, int length) {
+static int ac_session_action_isdeferred(struct ac_session_action* action) {
+	switch (action->action) {
+		case AC_SESSION_ACTION_RESET_WTP:
+		case AC_SESSION_ACTION_ADDWLAN:
+		case AC_SESSION_ACTION_STATION_CONFIGURATION_IEEE80211_ADD_STATION:
+		case AC_SESSION_ACTION_STATION_CONFIGURATION_IEEE80211_DELETE_STATION:
+		case AC_SESSION_ACTION_STATION_ROAMING: {
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+/* */
+static void ac_session_release_packet(struct ac_session_t* session, struct ac_packet* packet) {
+	ac_packets_free_buffer(packet->buffer, packet->length);
+	capwap_ring_release(session->packets);
+}
+
+/* */
+static void ac_session_flush_packets(struct ac_session_t* session) {
+	struct ac_packet* packet;
+
+	while ((packet = (struct ac_packet*)capwap_ring_peek(session->packets)) != NULL) {
+		ac_session_release_packet(session, packet);
+	}
+}
+
+/* */
+static int ac_network_read_nowait(struct ac_session_t* session, void* buffer, int length) {
 	int result = 0;
-	long waittimeout;
-	
+	int handshake;
+	struct ac_packet* packet;
+	struct ac_session_action** item;
+
 	ASSERT(session != NULL);
 	ASSERT(buffer != NULL);
 	ASSERT(length > 0);
 
-	for (;;) {
-		capwap_lock_enter(&session->sessionlock);
+	if (!session->running) {
+		return CAPWAP_ERROR_CLOSE;
+	} else if ((handshake = ac_handshakes_poll(session, &result)) != AC_HANDSHAKE_POLL_IDLE) {
+		if (handshake == AC_HANDSHAKE_POLL_PENDING) {
+			return AC_ERROR_WOULDBLOCK;			/* DTLS session owned by handshake pool */
+		}
 
-		if (!session->running) {
-			capwap_lock_exit(&session->sessionlock);
-			return CAPWAP_ERROR_CLOSE;
-		} else if (!session->requestfragmentpacket->count && (session->action->count > 0)) {
-			struct capwap_list_item* itemaction;
+		/* Handshake of data channel */
+		if (session->datahandshakeslot) {
+			return ac_session_datachannel_handshake_done(session, result);
+		}
 
-			itemaction = capwap_itemlist_remove_head(session->action);
-			capwap_lock_exit(&session->sessionlock);
+		/* Check is handshake complete */
+		if ((result == CAPWAP_ERROR_AGAIN) && (session->dtls.action == CAPWAP_DTLS_ACTION_DATA) && (session->state == CAPWAP_DTLS_CONNECT_STATE)) {
+			ac_dfa_change_state(session, CAPWAP_JOIN_STATE);
+			capwap_timeout_set(session->timeout, session->idtimercontrol, AC_JOIN_INTERVAL, ac_dfa_teardown_timeout, session, NULL);
+		}
 
-			/* */
-			result = ac_session_action_execute(session, (struct ac_session_action*)itemaction->item);
+		return result;
+	} else if (ac_soapcalls_poll(session)) {
+		return 0;
+	} else if (!session->requestfragmentpacket->count && !session->soapcall && session->soapdeferred->first) {
+		struct capwap_list_item* deferred = capwap_itemlist_remove_head(session->soapdeferred);
 
-			/* Free packet */
-			capwap_itemlist_free(itemaction);
-			return result;
-		} else if (session->packets->count > 0) {
-			struct capwap_list_item* itempacket;
-
-			/* Get packet */
-			itempacket = capwap_itemlist_remove_head(session->packets);
-			capwap_lock_exit(&session->sessionlock);
-
-			if (itempacket) {
-				struct ac_packet* packet = (struct ac_packet*)itempacket->item;
-				long packetlength = itempacket->itemsize - sizeof(struct ac_packet);
-				
-				if (!packet->plainbuffer && session->dtls.enable) {
-					int oldaction = session->dtls.action;
-
-					/* Decrypt packet */
-					result = capwap_decrypt_packet(&session->dtls, packet->buffer, packetlength, buffer, length);
-					if (result == CAPWAP_ERROR_AGAIN) {
-						/* Check is handshake complete */
-						if ((oldaction == CAPWAP_DTLS_ACTION_HANDSHAKE) && (session->dtls.action == CAPWAP_DTLS_ACTION_DATA)) {
-							if (session->state == CAPWAP_DTLS_CONNECT_STATE) {
-								ac_dfa_change_state(session, CAPWAP_JOIN_STATE);
-								capwap_timeout_set(session->timeout, session->idtimercontrol, AC_JOIN_INTERVAL, ac_dfa_teardown_timeout, session, NULL);
-							}
-						}
-					}
-				} else {
-					if (packetlength <= length) {
-						memcpy(buffer, packet->buffer, packetlength);
-						result = packetlength;
-					}
-				}
+		/* Execute the action deferred while the SOAP call was pending */
+		result = ac_session_action_execute(session, (struct ac_session_action*)deferred->item);
+
+		capwap_itemlist_free(deferred);
+		return result;
+	} else if (!session->requestfragmentpacket->count && ((item = (struct ac_session_action**)capwap_ring_peek(session->action)) != NULL)) {
+		struct ac_session_action* action = *item;
+
+		capwap_ring_release(session->action);
 
-				/* Free packet */
-				capwap_itemlist_free(itempacket);
+		/* The actions which change the WTP configuration wait the completion of SOAP call */
+		if (session->soapcall && ac_session_action_isdeferred(action)) {
+			capwap_itemlist_insert_after(session->soapdeferred, NULL, capwap_itemlist_create_with_item(action, sizeof(struct ac_session_action) + action->length));
+			return 0;
+		}
+
+		/* */
+		result = ac_session_action_execute(session, action);
+
+		/* Free action */
+		capwap_free(action);
+		return result;
+	} else if ((packet = (struct ac_packet*)capwap_ring_peek(session->packets)) != NULL) {
+		if (!packet->plainbuffer && session->dtls.enable) {
+			if ((session->dtls.action == CAPWAP_DTLS_ACTION_HANDSHAKE) && session->handshakeslot) {
+				/* The handshake packets are consumed by handshake pool */
+				ac_handshakes_submit(session);
+				return AC_ERROR_WOULDBLOCK;
 			}
 
-			return result;
+			/* Decrypt packet */
+			result = capwap_decrypt_packet(&session->dtls, packet->buffer, packet->length, buffer, length);
+		} else {
+			if (packet->length <= length) {
+				memcpy(buffer, packet->buffer, packet->length);
+				result = packet->length;
+			}
 		}
 
-		capwap_lock_exit(&session->sessionlock);
+		/* Free packet */
+		ac_session_release_packet(session, packet);
+		return result;
+	}
+
+	return AC_ERROR_WOULDBLOCK;
+}
+
+/* Consume the DTLS handshake packets of session, called by handshake pool */
+int ac_session_dtls_handshake(struct ac_session_t* session, char* buffer, int length) {
+	int result = CAPWAP_ERROR_AGAIN;
+	struct ac_packet* packet;
+	struct capwap_list_item* itemlist;
+
+	ASSERT(session != NULL);
+	ASSERT(buffer != NULL);
+
+	/* Records of data channel, the session is established by kernel module */
+	if (session->datahandshakeslot) {
+		while ((itemlist = capwap_itemlist_remove_head(session->datahandshake)) != NULL) {
+			result = capwap_decrypt_packet(&session->datadtls, (char*)itemlist->item, itemlist->itemsize, NULL, itemlist->itemsize);
+			capwap_itemlist_free(itemlist);
+
+			if ((result == CAPWAP_ERROR_CLOSE) || (result == CAPWAP_ERROR_SHUTDOWN)) {
+				break;
+			}
+		}
+
+		return result;
+	}
+
+	while ((session->dtls.action == CAPWAP_DTLS_ACTION_HANDSHAKE) && ((packet = (struct ac_packet*)capwap_ring_peek(session->packets)) != NULL)) {
+		if (!packet->plainbuffer) {
+			result = capwap_decrypt_packet(&session->dtls, packet->buffer, packet->length, buffer, length);
+		}
+
+		/* Free packet */
+		ac_session_release_packet(session, packet);
+		if (result != CAPWAP_ERROR_AGAIN) {
+			break;
+		}
+	}
+
+	return result;
+}
+
+/* */
+static int ac_network_read(struct ac_session_t* session, void* buffer, int length) {
+	int result;
+	long waittimeout;
+
+	for (;;) {
+		result = ac_network_read_nowait(session, buffer, length);
+		if (result != AC_ERROR_WOULDBLOCK) {
+			return result;
+		}
 
 		/* Get timeout */
 		waittimeout = capwap_timeout_getcoming(session->timeout);
@@ -649,6 +917,9 @@ static void ac_send_invalid_request(struct ac_session_t* session, uint32_t error
 	capwap_list_free(responsefragmentpacket);
 }
 
+/* */
+static void ac_session_free(struct ac_session_t* session);
+
 /* Release reference of session */
 static void ac_session_destroy(struct ac_session_t* session) {
 #ifdef DEBUG
@@ -662,61 +933,102 @@ static void ac_session_destroy(struct ac_session_t* session) {
 	log_printf(LOG_DEBUG, "Release Session AC %s", sessionname);
 #endif
 
-	/* Release last reference */
+	/* Release owner reference */
 	capwap_lock_enter(&session->sessionlock);
 	session->count--;
 
-	/* Terminate SOAP request pending */
-	if (session->soaprequest) {
-		ac_soapclient_shutdown_request(session->soaprequest);
-	}
-
-	/* Check if all reference is release */
-	while (session->count > 0) {
+	/* Without wait, the session is freed by the thread which releases the last reference */
+	if (session->count > 0) {
 #ifdef DEBUG
-		log_printf(LOG_DEBUG, "Wait for release Session AC %s (count=%d)", sessionname, session->count);
+		log_printf(LOG_DEBUG, "Deferred release Session AC %s (count=%ld)", sessionname, session->count);
 #endif
-		/* */
-		capwap_event_reset(&session->changereference);
-		capwap_lock_exit(&session->sessionlock);
 
-		/* Wait */
-		capwap_event_wait(&session->changereference);
+		session->released = 1;
+
+		capwap_lock_enter(&g_ac.sessionsreleasinglock);
+		g_ac.sessionsreleasing++;
+		capwap_lock_exit(&g_ac.sessionsreleasinglock);
 
-		capwap_lock_enter(&session->sessionlock);
+		capwap_lock_exit(&session->sessionlock);
+		return;
 	}
 
 	capwap_lock_exit(&session->sessionlock);
+	ac_session_free(session);
+}
+
+/* Free session after the release of last reference */
+void ac_session_release(struct ac_session_t* session) {
+	ASSERT(session != NULL);
+	ASSERT(session->released);
+	ASSERT(!session->count);
+
+	/* */
+	ac_session_free(session);
+
+	capwap_lock_enter(&g_ac.sessionsreleasinglock);
+	g_ac.sessionsreleasing--;
+	capwap_event_signal(&g_ac.sessionsreleasingevent);
+	capwap_lock_exit(&g_ac.sessionsreleasinglock);
+}
+
+/* */
+static void ac_session_free(struct ac_session_t* session) {
+	struct ac_session_action** item;
+
+	/* Remove timers from timer service, the session will not be woken up anymore */
+	capwap_timeout_unsetall(session->timeout);
 
 	/* Close data channel */
 	ac_kmod_delete_datasession(&session->sessionid);
 
 	/* Free DTSL Control */
 	capwap_crypt_freesession(&session->dtls);
+	capwap_crypt_freesession(&session->datadtls);
+	if (session->datahandshakeslot) {
+		session->datahandshakeslot = 0;
+		ac_handshakes_release_slot();
+	}
 
 	/* Free resource */
-	while (session->packets->count > 0) {
-		capwap_itemlist_free(capwap_itemlist_remove_head(session->packets));
+	ac_session_flush_packets(session);
+	while ((item = (struct ac_session_action**)capwap_ring_peek(session->action)) != NULL) {
+		if ((*item)->action == AC_SESSION_ACTION_SOAP_RESPONSE) {
+			ac_soapcalls_free(*(struct ac_soapcall**)(*item)->data);
+		}
+
+		capwap_free(*item);
+		capwap_ring_release(session->action);
+	}
+
+	/* Queues statistics */
+	if (capwap_ring_get_dropped(session->packets) || capwap_ring_get_dropped(session->action)) {
+		log_printf(LOG_WARNING, "Session dropped %lu packets and %lu actions, queues high-water mark %lu/%lu packets and %lu/%lu actions", capwap_ring_get_dropped(session->packets), capwap_ring_get_dropped(session->action), capwap_ring_get_highwater(session->packets), session->packets->size, capwap_ring_get_highwater(session->action), session->action->size);
 	}
 
 	/* Free WLANS */
 	ac_wlans_destroy(session);
 
 	/* */
-	capwap_event_destroy(&session->changereference);
 	capwap_event_destroy(&session->waitpacket);
 	capwap_lock_destroy(&session->sessionlock);
-	capwap_list_free(session->action);
-	capwap_list_free(session->packets);
+	capwap_ring_free(session->action);
+	capwap_ring_free(session->packets);
 
 	/* Free fragments packet */
 	if (session->rxmngpacket) {
 		capwap_packet_rxmng_free(session->rxmngpacket);
 	}
 
+	if (session->soappacket) {
+		capwap_packet_rxmng_free(session->soappacket);
+	}
+
 	capwap_list_free(session->requestfragmentpacket);
 	capwap_list_free(session->responsefragmentpacket);
 	capwap_list_free(session->notifyevent);
+	capwap_list_free(session->soapdeferred);
+	capwap_list_free(session->datahandshake);
 	capwap_timeout_free(session->timeout);
 
 	/* Free DFA resource */
@@ -732,154 +1044,234 @@ static void ac_session_destroy(struct ac_session_t* session) {
 }
 
 /* */
-static void ac_session_run(struct ac_session_t* session) {
+static void ac_session_packet(struct ac_session_t* session, char* buffer, int length) {
 	int res;
 	int check;
-	int length;
 	struct capwap_list_item* search;
-	char buffer[CAPWAP_MAX_PACKET_SIZE];
 
 	ASSERT(session != NULL);
+	ASSERT(buffer != NULL);
 
-	/* Configure DFA */
-	if (g_ac.enabledtls) {
-		if (!ac_dtls_setup(session)) {
-			ac_session_teardown(session);			/* Teardown connection */
+	if (length < 0) {
+		if ((length == CAPWAP_ERROR_SHUTDOWN) || (length == CAPWAP_ERROR_CLOSE)) {
+			ac_session_teardown(session);
 		}
-	} else {
-		/* Wait Join request */
-		ac_dfa_change_state(session, CAPWAP_JOIN_STATE);
-		capwap_timeout_set(session->timeout, session->idtimercontrol, AC_JOIN_INTERVAL, ac_dfa_teardown_timeout, session, NULL);
-	}
-
-	while (session->state != CAPWAP_DTLS_TEARDOWN_STATE) {
-		/* Get packet */
-		length = ac_network_read(session, buffer, sizeof(buffer));
-		if (length < 0) {
-			if ((length == CAPWAP_ERROR_SHUTDOWN) || (length == CAPWAP_ERROR_CLOSE)) {
-				ac_session_teardown(session);
+	} else if (length > 0) {
+		/* Check generic capwap packet */
+		check = capwap_sanity_check(CAPWAP_UNDEF_STATE, buffer, length, 0);
+		if (check == CAPWAP_PLAIN_PACKET) {
+			struct capwap_parsed_packet packet;
+
+			/* Defragment management */
+			if (!session->rxmngpacket) {
+				session->rxmngpacket = capwap_packet_rxmng_create_message();
 			}
-		} else if (length > 0) {
-			/* Check generic capwap packet */
-			check = capwap_sanity_check(CAPWAP_UNDEF_STATE, buffer, length, 0);
-			if (check == CAPWAP_PLAIN_PACKET) {
-				struct capwap_parsed_packet packet;
-
-				/* Defragment management */
-				if (!session->rxmngpacket) {
-					session->rxmngpacket = capwap_packet_rxmng_create_message();
-				}
 
-				/* If request, defragmentation packet */
-				check = capwap_packet_rxmng_add_recv_packet(session->rxmngpacket, buffer, length);
-				if (check == CAPWAP_RECEIVE_COMPLETE_PACKET) {
-					/* Receive all fragment */
-					if (capwap_is_request_type(session->rxmngpacket->ctrlmsg.type) && (session->remotetype == session->rxmngpacket->ctrlmsg.type) && (session->remoteseqnumber == session->rxmngpacket->ctrlmsg.seq)) {
-						/* Retransmit response */
-						if (!capwap_crypt_sendto_fragmentpacket(&session->dtls, session->responsefragmentpacket)) {
-							log_printf(LOG_ERR, "Error to resend response packet");
-						} else {
-							log_printf(LOG_DEBUG, "Retrasmitted control packet");
-						}
+			/* If request, defragmentation packet */
+			check = capwap_packet_rxmng_add_recv_packet(session->rxmngpacket, buffer, length);
+			if (check == CAPWAP_RECEIVE_COMPLETE_PACKET) {
+				/* Receive all fragment */
+				if (capwap_is_request_type(session->rxmngpacket->ctrlmsg.type) && (session->remotetype == session->rxmngpacket->ctrlmsg.type) && (session->remoteseqnumber == session->rxmngpacket->ctrlmsg.seq)) {
+					/* Retransmit response */
+					if (!capwap_crypt_sendto_fragmentpacket(&session->dtls, session->responsefragmentpacket)) {
+						log_printf(LOG_ERR, "Error to resend response packet");
 					} else {
-						/* Check message type */
-						res = capwap_check_message_type(session->rxmngpacket);
-						if (res == VALID_MESSAGE_TYPE) {
-							res = capwap_parsing_packet(session->rxmngpacket, &packet);
-							if (res == PARSING_COMPLETE) {
-								int hasrequest = capwap_is_request_type(session->rxmngpacket->ctrlmsg.type);
-
-								/* Validate packet */
-								if (!capwap_validate_parsed_packet(&packet, NULL)) {
-									/* Search into notify event */
-									search = session->notifyevent->first;
-									while (search != NULL) {
-										struct ac_session_notify_event_t* notify = (struct ac_session_notify_event_t*)search->item;
-
-										if (hasrequest && (notify->action == NOTIFY_ACTION_RECEIVE_REQUEST_CONTROLMESSAGE)) {
-											char buffer[4];
-											struct ac_soap_response* response;
-
-											/* */
-											response = ac_soap_updatebackendevent(session, notify->idevent, capwap_itoa(SOAP_EVENT_STATUS_COMPLETE, buffer));
-											if (response) {
-												ac_soapclient_free_response(response);
-											}
-
-											/* Remove notify event */
-											capwap_itemlist_free(capwap_itemlist_remove(session->notifyevent, search));
-											break;
-										} else if (!hasrequest && (notify->action == NOTIFY_ACTION_RECEIVE_RESPONSE_CONTROLMESSAGE)) {
-											char buffer[4];
-											struct ac_soap_response* response;
-											struct capwap_resultcode_element* resultcode;
-
-											/* Check the success of the Request */
-											resultcode = (struct capwap_resultcode_element*)capwap_get_message_element_data(&packet, CAPWAP_ELEMENT_RESULTCODE);
-											response = ac_soap_updatebackendevent(session, notify->idevent, capwap_itoa(((!resultcode || CAPWAP_RESULTCODE_OK(resultcode->code)) ? SOAP_EVENT_STATUS_COMPLETE : SOAP_EVENT_STATUS_GENERIC_ERROR), buffer));
-											if (response) {
-												ac_soapclient_free_response(response);
-											}
-
-											/* Remove notify event */
-											capwap_itemlist_free(capwap_itemlist_remove(session->notifyevent, search));
-											break;
-										}
-
-										search = search->next;
+						log_printf(LOG_DEBUG, "Retrasmitted control packet");
+					}
+				} else if (session->soappacket && capwap_is_request_type(session->rxmngpacket->ctrlmsg.type)) {
+					/* The response of suspended request is sent on completion of SOAP call */
+					log_printf(LOG_DEBUG, "Discarded control request while waiting the backend");
+				} else {
+					/* Check message type */
+					res = capwap_check_message_type(session->rxmngpacket);
+					if (res == VALID_MESSAGE_TYPE) {
+						res = capwap_parsing_packet(session->rxmngpacket, &packet);
+						if (res == PARSING_COMPLETE) {
+							int hasrequest = capwap_is_request_type(session->rxmngpacket->ctrlmsg.type);
+
+							/* Validate packet */
+							if (!capwap_validate_parsed_packet(&packet, NULL)) {
+								/* Search into notify event */
+								search = session->notifyevent->first;
+								while (search != NULL) {
+									struct ac_session_notify_event_t* notify = (struct ac_session_notify_event_t*)search->item;
+
+									if (hasrequest && (notify->action == NOTIFY_ACTION_RECEIVE_REQUEST_CONTROLMESSAGE)) {
+										char buffer[4];
+
+										/* */
+										ac_soap_updatebackendevent(session, notify->idevent, capwap_itoa(SOAP_EVENT_STATUS_COMPLETE, buffer));
+
+										/* Remove notify event */
+										capwap_itemlist_free(capwap_itemlist_remove(session->notifyevent, search));
+										break;
+									} else if (!hasrequest && (notify->action == NOTIFY_ACTION_RECEIVE_RESPONSE_CONTROLMESSAGE)) {
+										char buffer[4];
+										struct capwap_resultcode_element* resultcode;
+
+										/* Check the success of the Request */
+										resultcode = (struct capwap_resultcode_element*)capwap_get_message_element_data(&packet, CAPWAP_ELEMENT_RESULTCODE);
+										ac_soap_updatebackendevent(session, notify->idevent, capwap_itoa(((!resultcode || CAPWAP_RESULTCODE_OK(resultcode->code)) ? SOAP_EVENT_STATUS_COMPLETE : SOAP_EVENT_STATUS_GENERIC_ERROR), buffer));
+
+										/* Remove notify event */
+										capwap_itemlist_free(capwap_itemlist_remove(session->notifyevent, search));
+										break;
 									}
 
-									/* */
-									ac_dfa_execute(session, &packet);
-								} else {
-									log_printf(LOG_DEBUG, "Failed validation parsed control packet");
-									if (capwap_is_request_type(session->rxmngpacket->ctrlmsg.type)) {
-										log_printf(LOG_WARNING, "Missing Mandatory Message Element, send Response Packet with error");
-										ac_send_invalid_request(session, CAPWAP_RESULTCODE_FAILURE_MISSING_MANDATORY_MSG_ELEMENT);
-									}
+									search = search->next;
 								}
+
+								/* */
+								ac_dfa_execute(session, &packet);
 							} else {
-								log_printf(LOG_DEBUG, "Failed parsing packet");
-								if ((res == UNRECOGNIZED_MESSAGE_ELEMENT) && capwap_is_request_type(session->rxmngpacket->ctrlmsg.type)) {
-									log_printf(LOG_WARNING, "Unrecognized Message Element, send Response Packet with error");
-									ac_send_invalid_request(session, CAPWAP_RESULTCODE_FAILURE_UNRECOGNIZED_MESSAGE_ELEMENT);
-									/* TODO: add the unrecognized message element */
+								log_printf(LOG_DEBUG, "Failed validation parsed control packet");
+								if (capwap_is_request_type(session->rxmngpacket->ctrlmsg.type)) {
+									log_printf(LOG_WARNING, "Missing Mandatory Message Element, send Response Packet with error");
+									ac_send_invalid_request(session, CAPWAP_RESULTCODE_FAILURE_MISSING_MANDATORY_MSG_ELEMENT);
 								}
 							}
 						} else {
-							log_printf(LOG_DEBUG, "Invalid message type");
-							if (res == INVALID_REQUEST_MESSAGE_TYPE) {
-								log_printf(LOG_WARNING, "Unexpected Unrecognized Request, send Response Packet with error");
-								ac_send_invalid_request(session, CAPWAP_RESULTCODE_MSG_UNEXPECTED_UNRECOGNIZED_REQUEST);
+							log_printf(LOG_DEBUG, "Failed parsing packet");
+							if ((res == UNRECOGNIZED_MESSAGE_ELEMENT) && capwap_is_request_type(session->rxmngpacket->ctrlmsg.type)) {
+								log_printf(LOG_WARNING, "Unrecognized Message Element, send Response Packet with error");
+								ac_send_invalid_request(session, CAPWAP_RESULTCODE_FAILURE_UNRECOGNIZED_MESSAGE_ELEMENT);
+								/* TODO: add the unrecognized message element */
 							}
 						}
+					} else {
+						log_printf(LOG_DEBUG, "Invalid message type");
+						if (res == INVALID_REQUEST_MESSAGE_TYPE) {
+							log_printf(LOG_WARNING, "Unexpected Unrecognized Request, send Response Packet with error");
+							ac_send_invalid_request(session, CAPWAP_RESULTCODE_MSG_UNEXPECTED_UNRECOGNIZED_REQUEST);
+						}
 					}
+				}
 
-					/* Free memory */
-					capwap_free_parsed_packet(&packet);
-					if (session->rxmngpacket) {
-						capwap_packet_rxmng_free(session->rxmngpacket);
-						session->rxmngpacket = NULL;
-					}
-				} else if (check != CAPWAP_REQUEST_MORE_FRAGMENT) {
-					/* Discard fragments */
-					if (session->rxmngpacket) {
-						capwap_packet_rxmng_free(session->rxmngpacket);
-						session->rxmngpacket = NULL;
-					}
+				/* Free memory */
+				capwap_free_parsed_packet(&packet);
+				if (session->rxmngpacket) {
+					capwap_packet_rxmng_free(session->rxmngpacket);
+					session->rxmngpacket = NULL;
+				}
+			} else if (check != CAPWAP_REQUEST_MORE_FRAGMENT) {
+				/* Discard fragments */
+				if (session->rxmngpacket) {
+					capwap_packet_rxmng_free(session->rxmngpacket);
+					session->rxmngpacket = NULL;
 				}
 			}
 		}
 	}
+}
+
+/* */
+static void ac_session_start(struct ac_session_t* session) {
+	ASSERT(session != NULL);
+
+	/* Configure DFA */
+	if (g_ac.enabledtls) {
+		if (!ac_dtls_setup(session)) {
+			ac_session_teardown(session);			/* Teardown connection */
+		}
+	} else {
+		/* Wait Join request */
+		ac_dfa_change_state(session, CAPWAP_JOIN_STATE);
+		capwap_timeout_set(session->timeout, session->idtimercontrol, AC_JOIN_INTERVAL, ac_dfa_teardown_timeout, session, NULL);
+	}
+}
+
+/* */
+static void ac_session_run(struct ac_session_t* session) {
+	int length;
+	char buffer[CAPWAP_MAX_PACKET_SIZE];
+
+	ASSERT(session != NULL);
+
+	/* */
+	ac_session_start(session);
+	while (session->state != CAPWAP_DTLS_TEARDOWN_STATE) {
+		/* Get packet */
+		length = ac_network_read(session, buffer, sizeof(buffer));
+		ac_session_packet(session, buffer, length);
+	}
 
 	/* Wait teardown timeout before kill session */
 	capwap_timeout_wait(AC_DTLS_SESSION_DELETE_INTERVAL);
+	ac_session_finish(session);
+}
+
+/* Execute all pending work of session without blocking, used by workers engine.
+   Return 1 when the session is ready to be released with ac_session_finish */
+int ac_session_process(struct ac_session_t* session, char* buffer, int length) {
+	int result;
+	unsigned long index;
+
+	ASSERT(session != NULL);
+	ASSERT(buffer != NULL);
+
+	/* */
+	if (session->state == CAPWAP_IDLE_STATE) {
+		ac_session_start(session);
+	}
+
+	while (session->state != CAPWAP_DTLS_TEARDOWN_STATE) {
+		result = ac_network_read_nowait(session, buffer, length);
+		if (result == AC_ERROR_WOULDBLOCK) {
+			if (capwap_timeout_getcoming(session->timeout)) {
+				return 0;
+			}
+
+			/* Timer expired */
+			capwap_timeout_hasexpired(session->timeout);
+		} else {
+			ac_session_packet(session, buffer, result);
+		}
+	}
+
+	/* Wait teardown timeout before kill session */
+	if (!session->idtimerrelease) {
+		capwap_timeout_unsetall(session->timeout);
+		session->idtimerrelease = capwap_timeout_createtimer(session->timeout);
+		capwap_timeout_set(session->timeout, session->idtimerrelease, AC_DTLS_SESSION_DELETE_INTERVAL, NULL, NULL, NULL);
+		return 0;
+	}
+
+	while ((index = capwap_timeout_hasexpired(session->timeout)) != CAPWAP_TIMEOUT_INDEX_NO_SET) {
+		if (index == session->idtimerrelease) {
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+/* */
+void ac_session_finish(struct ac_session_t* session) {
+	ASSERT(session != NULL);
+
+	/* */
 	ac_dfa_state_teardown(session);
 
 	/* Release reference session */
 	ac_session_destroy(session);
 }
 
+/* Index the session by IP address of WTP while the data channel is established, the
+   first session of an IP address receive the data channel */
+static void ac_session_index_datachannel(struct ac_session_t* session, int add) {
+	capwap_rwlock_wrlock(&g_ac.sessionslock);
+
+	if (add) {
+		if (!capwap_hash_search(g_ac.sessionsdatachannel, &session->dtls.peeraddr)) {
+			capwap_hash_add(g_ac.sessionsdatachannel, (void*)session);
+		}
+	} else if (capwap_hash_search(g_ac.sessionsdatachannel, &session->dtls.peeraddr) == (void*)session) {
+		capwap_hash_delete(g_ac.sessionsdatachannel, &session->dtls.peeraddr);
+	}
+
+	capwap_rwlock_unlock(&g_ac.sessionslock);
+}
+
 /* Change WTP state machine */
 void ac_dfa_change_state(struct ac_session_t* session, int state) {
 	struct capwap_list_item* search;
@@ -893,8 +1285,21 @@ void ac_dfa_change_state(struct ac_session_t* session, int state) {
 		log_printf(LOG_DEBUG, "Session AC %s change state from %s to %s", sessionname, capwap_dfa_getname(session->state), capwap_dfa_getname(state));
 #endif
 
+		/* */
+		if (state == CAPWAP_DATA_CHECK_TO_RUN_STATE) {
+			ac_session_index_datachannel(session, 1);
+		} else if (session->state == CAPWAP_DATA_CHECK_TO_RUN_STATE) {
+			ac_session_index_datachannel(session, 0);
+		}
+
 		session->state = state;
 
+		/* End of DTLS handshake, release the admission slot */
+		if (session->handshakeslot && (state != CAPWAP_DTLS_CONNECT_STATE)) {
+			session->handshakeslot = 0;
+			ac_handshakes_release_slot();
+		}
+
 		/* Search into notify event */
 		search = session->notifyevent->first;
 		while (search != NULL) {
@@ -902,13 +1307,9 @@ void ac_dfa_change_state(struct ac_session_t* session, int state) {
 
 			if ((notify->action == NOTIFY_ACTION_CHANGE_STATE) && (notify->session_state == state)) {
 				char buffer[4];
-				struct ac_soap_response* response;
 
 				/* */
-				response = ac_soap_updatebackendevent(session, notify->idevent, capwap_itoa(SOAP_EVENT_STATUS_COMPLETE, buffer));
-				if (response) {
-					ac_soapclient_free_response(response);
-				}
+				ac_soap_updatebackendevent(session, notify->idevent, capwap_itoa(SOAP_EVENT_STATUS_COMPLETE, buffer));
 
 				/* Remove notify event */
 				capwap_itemlist_free(capwap_itemlist_remove(session->notifyevent, search));
@@ -924,14 +1325,35 @@ void ac_dfa_change_state(struct ac_session_t* session, int state) {
 void ac_session_teardown(struct ac_session_t* session) {
 	ASSERT(session != NULL);
 
+	/* Take back the DTLS session from handshake pool */
+	ac_handshakes_cancel(session);
+
 	/* Remove session from list */
 	capwap_rwlock_wrlock(&g_ac.sessionslock);
 	capwap_itemlist_remove(g_ac.sessions, session->itemlist);
+	if (capwap_hash_search(g_ac.sessionsaddress, &session->dtls.peeraddr) == (void*)session) {
+		capwap_hash_delete(g_ac.sessionsaddress, &session->dtls.peeraddr);
+	}
+
+	if (capwap_hash_search(g_ac.sessionsdatachannel, &session->dtls.peeraddr) == (void*)session) {
+		capwap_hash_delete(g_ac.sessionsdatachannel, &session->dtls.peeraddr);
+	}
+
+	if (session->wtpid && (capwap_hash_search(g_ac.sessionswtpid, session->wtpid) == (void*)session)) {
+		capwap_hash_delete(g_ac.sessionswtpid, session->wtpid);
+		capwap_hash_delete(g_ac.sessionssessionid, &session->sessionid);
+	}
 	capwap_rwlock_unlock(&g_ac.sessionslock);
 
 	/* Remove all pending packets */
-	while (session->packets->count > 0) {
-		capwap_itemlist_free(capwap_itemlist_remove_head(session->packets));
+	ac_session_flush_packets(session);
+
+	/* Abort the pending SOAP call, the completion is not executed */
+	ac_soapcalls_cancel(session);
+	capwap_list_flush(session->soapdeferred);
+	if (session->soappacket) {
+		capwap_packet_rxmng_free(session->soappacket);
+		session->soappacket = NULL;
 	}
 
 	/* Close DTSL Control */
@@ -942,17 +1364,13 @@ void ac_session_teardown(struct ac_session_t* session) {
 	/* Cancel all notify event */
 	if (session->notifyevent->first) {
 		char buffer[5];
-		struct ac_soap_response* response;
 
 		capwap_itoa(SOAP_EVENT_STATUS_CANCEL, buffer);
 		while (session->notifyevent->first != NULL) {
 			struct ac_session_notify_event_t* notify = (struct ac_session_notify_event_t*)session->notifyevent->first->item;
 
 			/* Cancel event */
-			response = ac_soap_updatebackendevent(session, notify->idevent, buffer);
-			if (response) {
-				ac_soapclient_free_response(response);
-			}
+			ac_soap_updatebackendevent(session, notify->idevent, buffer);
 
 			/* Remove notify event */
 			capwap_itemlist_free(capwap_itemlist_remove(session->notifyevent, session->notifyevent->first));
@@ -1041,58 +1459,66 @@ void ac_free_reference_last_response(struct ac_session_t* session) {
 	session->remoteseqnumber = 0;
 }
 
-/* */
-struct ac_soap_response* ac_session_send_soap_request(struct ac_session_t* session, char* method, int numparam, ...) {
-	int i;
+/* Submit SOAP call, the completion is executed by session thread as action */
+int ac_session_send_soap_request_async(struct ac_session_t* session, ac_soapcall_complete complete, const void* context, long length, char* method, int numparam, ...) {
+	int result;
 	va_list listparam;
-	struct ac_soap_response* response = NULL;
 
 	ASSERT(session != NULL);
-	ASSERT(session->soaprequest == NULL);
 	ASSERT(method != NULL);
 
-	/* Build Soap Request */
-	capwap_lock_enter(&session->sessionlock);
-	session->soaprequest = ac_backend_createrequest_with_session(method, SOAP_NAMESPACE_URI);
-	capwap_lock_exit(&session->sessionlock);
+	va_start(listparam, numparam);
+	result = ac_soapcalls_submit(session, complete, context, length, 0, method, numparam, listparam);
+	va_end(listparam);
 
-	/* */
-	if (!session->soaprequest) {
-		return NULL;
-	}
+	return result;
+}
+
+/* Submit SOAP call which can be merged with the calls of others sessions */
+int ac_session_send_soap_request_batch(struct ac_session_t* session, ac_soapcall_complete complete, const void* context, long length, char* method, int numparam, ...) {
+	int result;
+	va_list listparam;
+
+	ASSERT(session != NULL);
+	ASSERT(method != NULL);
 
-	/* Add params */
 	va_start(listparam, numparam);
-	for (i = 0; i < numparam; i++) {
-		char* type = va_arg(listparam, char*);
-		char* name = va_arg(listparam, char*);
-		char* value = va_arg(listparam, char*);
-
-		if (!ac_soapclient_add_param(session->soaprequest->request, type, name, value)) {
-			ac_soapclient_close_request(session->soaprequest, 1);
-			session->soaprequest = NULL;
-			break;
-		}
-	}
+	result = ac_soapcalls_submit(session, complete, context, length, 1, method, numparam, listparam);
 	va_end(listparam);
 
-	/* Send Request & Recv Response */
-	if (session->soaprequest) {
-		if (ac_soapclient_send_request(session->soaprequest, "")) {
-			response = ac_soapclient_recv_response(session->soaprequest);
-		}
+	return result;
+}
+
+/* Keep the request received until the completion of SOAP call */
+void ac_session_suspend_request(struct ac_session_t* session) {
+	ASSERT(session != NULL);
+	ASSERT(session->rxmngpacket != NULL);
+	ASSERT(session->soappacket == NULL);
 
-		/* Critical section */
-		capwap_lock_enter(&session->sessionlock);
+	session->soappacket = session->rxmngpacket;
+	session->rxmngpacket = NULL;
+}
 
-		/* Free resource */
-		ac_soapclient_close_request(session->soaprequest, 1);
-		session->soaprequest = NULL;
+/* */
+int ac_session_resume_request(struct ac_session_t* session, struct capwap_parsed_packet* packet) {
+	ASSERT(session != NULL);
+	ASSERT(session->soappacket != NULL);
+	ASSERT(packet != NULL);
 
-		capwap_lock_exit(&session->sessionlock);
-	}
+	/* The parsed packet was released at the suspension of request */
+	return ((capwap_parsing_packet(session->soappacket, packet) == PARSING_COMPLETE) ? 1 : 0);
+}
+
+/* */
+void ac_session_release_request(struct ac_session_t* session, struct capwap_parsed_packet* packet) {
+	ASSERT(session != NULL);
+	ASSERT(packet != NULL);
 
-	return response;
+	capwap_free_parsed_packet(packet);
+	if (session->soappacket) {
+		capwap_packet_rxmng_free(session->soappacket);
+		session->soappacket = NULL;
+	}
 }
 
 /* */
@@ -4,13 +4,21 @@
 #include "capwap_dtls.h"
 #include "capwap_event.h"
 #include "capwap_lock.h"
+#include "capwap_ring.h"
 #include "ac_soap.h"
+#include "ac_soapcalls.h"
 #include "ieee80211.h"
 
+/* Session queues */
+#define AC_SESSION_PACKETS_RING_SIZE			16
+#define AC_SESSION_ACTIONS_RING_SIZE			256
+#define AC_SESSION_ACTIONS_RING_RESERVED		64		/* Slots of actions queue left to the control actions */
+
 /* AC packet */
 struct ac_packet {
 	int plainbuffer;
-	char buffer[0];
+	int length;
+	char* buffer;										/* Allocated with ac_packets_alloc_buffer() */
 };
 
 /* */
@@ -23,9 +31,11 @@ struct ac_session_control {
 #define AC_SESSION_ACTION_CLOSE													0
 #define AC_SESSION_ACTION_RESET_WTP												1
 #define AC_SESSION_ACTION_NOTIFY_EVENT											2
+#define AC_SESSION_ACTION_SOAP_RESPONSE											3
 
 #define AC_SESSION_ACTION_RECV_KEEPALIVE										10
 #define AC_SESSION_ACTION_RECV_IEEE80211_MGMT_PACKET							11
+#define AC_SESSION_ACTION_RECV_DTLS_DATA_CHANNEL								12
 
 #define AC_SESSION_ACTION_ADDWLAN												20
 
@@ -41,6 +51,12 @@ struct ac_session_action {
 	char data[0];
 };
 
+/* DTLS record of data channel received by kernel module */
+struct ac_session_datachannel_packet {
+	union sockaddr_capwap peeraddr;
+	char packet[0];
+};
+
 /* */
 #define NOTIFY_ACTION_CHANGE_STATE								0
 #define NOTIFY_ACTION_RECEIVE_REQUEST_CONTROLMESSAGE			1
@@ -102,12 +118,14 @@ struct ac_session_t {
 	pthread_t threadid;
 	struct capwap_list_item* itemlist;					/* My itemlist into g_ac.sessions */
 
-	/* Reference */
+	/* Reference, the session destroyed by owner is freed by the last reference */
 	long count;
-	capwap_event_t changereference;
+	int released;
 
 	/* Soap */
-	struct ac_http_soap_request* soaprequest;
+	struct ac_soapcall* soapcall;						/* Pending asynchronous call with completion */
+	struct capwap_packet_rxmng* soappacket;				/* Request suspended until the completion of call */
+	struct capwap_list* soapdeferred;					/* Actions deferred until the completion of call */
 
 	/* WLAN Reference */
 	struct ac_wlans* wlans;
@@ -123,6 +141,7 @@ struct ac_session_t {
 
 	unsigned short mtu;
 	struct capwap_dtls dtls;
+	struct capwap_dtls datadtls;						/* DTLS handshake of data channel, the records are processed by kernel module */
 
 	struct capwap_timeout* timeout;
 	unsigned long idtimercontrol;
@@ -130,8 +149,8 @@ struct ac_session_t {
 
 	capwap_event_t waitpacket;
 	capwap_lock_t sessionlock;
-	struct capwap_list* action;
-	struct capwap_list* packets;
+	struct capwap_ring* action;							/* Queue of struct ac_session_action* */
+	struct capwap_ring* packets;						/* Queue of struct ac_packet */
 
 	struct capwap_list* notifyevent;
 
@@ -145,23 +164,48 @@ struct ac_session_t {
 	uint32_t remotetype;
 	uint8_t remoteseqnumber;
 	struct capwap_list* responsefragmentpacket;
+
+	/* Workers engine */
+	struct ac_worker* worker;							/* Owner worker, NULL with thread engine */
+	struct capwap_list_item* workeritem;				/* My itemlist into worker sessions */
+	struct ac_session_t* workernext;					/* Next session into worker run queue */
+	int workerscheduled;
+	unsigned long idtimerrelease;
+
+	/* DTLS handshake pool */
+	int handshakeslot;									/* Admission slot held until the end of DTLS handshake */
+	int handshakestatus;
+	int handshakeresult;
+	struct ac_session_t* handshakenext;					/* Next session into handshake queue */
+	int datahandshakeslot;								/* Admission slot of data channel handshake */
+	struct capwap_list* datahandshake;					/* DTLS records of data channel handshake */
 };
 
 /* Session */
 void* ac_session_thread(void* param);
-void ac_session_send_action(struct ac_session_t* session, long action, long param, const void* data, long length);
+int ac_session_process(struct ac_session_t* session, char* buffer, int length);
+void ac_session_finish(struct ac_session_t* session);
+int ac_session_dtls_handshake(struct ac_session_t* session, char* buffer, int length);
+int ac_session_send_action(struct ac_session_t* session, long action, long param, const void* data, long length);
 void ac_session_teardown(struct ac_session_t* session);
 void ac_session_close(struct ac_session_t* session);
+int ac_session_acquire_reference(struct ac_session_t* session);
+void ac_session_wakeup(struct ac_session_t* session);
 void ac_session_release_reference(struct ac_session_t* session);
+void ac_session_release(struct ac_session_t* session);
 
 /* */
 struct ac_session_t* ac_search_session_from_sessionid(struct capwap_sessionid_element* sessionid);
+struct ac_session_t* ac_search_session_from_datachannel(union sockaddr_capwap* address);
 int ac_has_sessionid(struct capwap_sessionid_element* sessionid);
 
 /* */
 struct ac_session_t* ac_search_session_from_wtpid(const char* wtpid);
 int ac_has_wtpid(const char* wtpid);
 
+/* */
+int ac_session_set_identity(struct ac_session_t* session, char* wtpid, struct capwap_sessionid_element* sessionid);
+
 /* */
 char* ac_get_printable_wtpid(struct capwap_wtpboarddata_element* wtpboarddata);
 
@@ -204,16 +248,22 @@ void ac_dfa_state_run(struct ac_session_t* session, struct capwap_parsed_packet*
 void ac_dfa_state_reset(struct ac_session_t* session, struct capwap_parsed_packet* packet);
 void ac_dfa_state_teardown(struct ac_session_t* session);
 
-/* Soap function */
-struct ac_soap_response* ac_session_send_soap_request(struct ac_session_t* session, char* method, int numparam, ...);
-#define ac_soap_authorizewtpsession(s, wtpid)								ac_session_send_soap_request((s), "authorizeWTPSession", 1, "xs:string", "idwtp", wtpid)
-#define ac_soap_joinwtpsession(s, wtpid, joinparam)							ac_session_send_soap_request((s), "joinWTPSession", 2, "xs:string", "idwtp", wtpid, "xs:base64Binary", "join", joinparam)
-#define ac_soap_configurestatuswtpsession(s, wtpid, confstatusparam)		ac_session_send_soap_request((s), "configureStatusWTPSession", 2, "xs:string", "idwtp", wtpid, "xs:base64Binary", "confstatus", confstatusparam)
-#define ac_soap_changestatewtpsession(s, wtpid, changestateparam)			ac_session_send_soap_request((s), "changeStateWTPSession", 2, "xs:string", "idwtp", wtpid, "xs:base64Binary", "changestate", changestateparam)
-#define ac_soap_runningwtpsession(s, wtpid)									ac_session_send_soap_request((s), "runningWTPSession", 1, "xs:string", "idwtp", wtpid)
-#define ac_soap_teardownwtpsession(s, wtpid)								ac_session_send_soap_request((s), "teardownWTPSession", 1, "xs:string", "idwtp", wtpid)
-#define ac_soap_checkwtpsession(s, wtpid)									ac_session_send_soap_request((s), "checkWTPSession", 1, "xs:string", "idwtp", wtpid)
-#define ac_soap_updatebackendevent(s, idevent, status)						ac_session_send_soap_request((s), "updateBackendEvent", 2, "xs:string", "idevent", idevent, "xs:int", "status", status)
-#define ac_soap_authorizestation(s, wtpid, stationparam)					ac_session_send_soap_request((s), "authorizeStation", 2, "xs:string", "idwtp", wtpid, "xs:base64Binary", "station", stationparam)
+/* Request suspended while waiting the completion of SOAP call */
+void ac_session_suspend_request(struct ac_session_t* session);
+int ac_session_resume_request(struct ac_session_t* session, struct capwap_parsed_packet* packet);
+void ac_session_release_request(struct ac_session_t* session, struct capwap_parsed_packet* packet);
+
+/* Asynchronous Soap function, without completion the call is not bound to session */
+int ac_session_send_soap_request_async(struct ac_session_t* session, ac_soapcall_complete complete, const void* context, long length, char* method, int numparam, ...);
+int ac_session_send_soap_request_batch(struct ac_session_t* session, ac_soapcall_complete complete, const void* context, long length, char* method, int numparam, ...);
+#define ac_soap_authorizewtpsession(s, c, wtpid)							ac_session_send_soap_request_async((s), (c), NULL, 0, "authorizeWTPSession", 1, "xs:string", "idwtp", wtpid)
+#define ac_soap_joinwtpsession(s, c, wtpid, joinparam)						ac_session_send_soap_request_async((s), (c), NULL, 0, "joinWTPSession", 2, "xs:string", "idwtp", wtpid, "xs:base64Binary", "join", joinparam)
+#define ac_soap_configurestatuswtpsession(s, c, wtpid, confstatusparam)		ac_session_send_soap_request_async((s), (c), NULL, 0, "configureStatusWTPSession", 2, "xs:string", "idwtp", wtpid, "xs:base64Binary", "confstatus", confstatusparam)
+#define ac_soap_changestatewtpsession(s, c, wtpid, changestateparam)		ac_session_send_soap_request_async((s), (c), NULL, 0, "changeStateWTPSession", 2, "xs:string", "idwtp", wtpid, "xs:base64Binary", "changestate", changestateparam)
+#define ac_soap_runningwtpsession(s, c, wtpid)								ac_session_send_soap_request_async((s), (c), NULL, 0, "runningWTPSession", 1, "xs:string", "idwtp", wtpid)
+#define ac_soap_checkwtpsession(s, c, wtpid)								ac_session_send_soap_request_async((s), (c), NULL, 0, "checkWTPSession", 1, "xs:string", "idwtp", wtpid)
+#define ac_soap_teardownwtpsession(s, wtpid)								ac_session_send_soap_request_async((s), NULL, NULL, 0, "teardownWTPSession", 1, "xs:string", "idwtp", wtpid)
+#define ac_soap_updatebackendevent(s, idevent, status)						ac_session_send_soap_request_async((s), NULL, NULL, 0, "updateBackendEvent", 2, "xs:string", "idevent", idevent, "xs:int", "status", status)
+#define ac_soap_authorizestation(s, c, ctx, len, wtpid, stationparam)		ac_session_send_soap_request_batch((s), (c), (ctx), (len), "authorizeStation", 2, "xs:string", "idwtp", wtpid, "xs:base64Binary", "station", stationparam)
 
 #endif /* __AC_SESSION_HEADER__ */
@@ -11,6 +11,46 @@
 #define HTTP_RESPONSE_BODY					2
 #define HTTP_RESPONSE_ERROR					3
 
+/* */
+#define SOAP_RESPONSE_RECV_BUFFER_LENGTH	4096
+#define SOAP_RESPONSE_DECODE_BUFFER_LENGTH	1536
+
+/* Elements of SOAP response */
+#define SOAP_ELEMENT_NONE					0
+#define SOAP_ELEMENT_ENVELOPE				1
+#define SOAP_ELEMENT_BODY					2
+#define SOAP_ELEMENT_RESPONSE				3
+#define SOAP_ELEMENT_RETURN					4
+#define SOAP_ELEMENT_FAULT					5
+#define SOAP_ELEMENT_FAULTCODE				6
+#define SOAP_ELEMENT_FAULTSTRING			7
+
+#define SOAP_ELEMENT_MAX_DEPTH				4
+
+/* Streaming parser of SOAP response. The base64 text of return is decoded while it
+   is received and pushed into JSON tokener, without XML document and text copies */
+struct ac_soap_parser {
+	struct ac_soap_response* response;
+	char* tagmethod;
+
+	/* */
+	int depth;
+	int path[SOAP_ELEMENT_MAX_DEPTH];
+	unsigned long found;
+
+	/* Text of element */
+	int capture;
+	int capturedepth;
+	int textlength;
+	int textoverflow;
+	char text[SOAP_RESPONSE_MAX_TEXT_LENGTH + 1];
+
+	/* Base64 decoder and JSON tokener, the tokener is released when the text is not JSON */
+	int quadlength;
+	char quad[4];
+	struct json_tokener* tokener;
+};
+
 /* */
 static const char l_encodeblock[] = 
 	"ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
@@ -21,54 +61,6 @@ static const char l_decodeblock[] =
 	"\x00\x00\x00\x00\x00\x00\x1b\x1c\x1d\x1e\x1f\x20\x21\x22\x23\x24"
 	"\x25\x26\x27\x28\x29\x2a\x2b\x2c\x2d\x2e\x2f\x30\x31\x32\x33\x34";
 
-/* */
-xmlNodePtr ac_xml_get_children(xmlNodePtr parent) {
-	xmlNodePtr children;
-
-	ASSERT(parent != NULL);
-
-	/* */
-	children = parent->xmlChildrenNode;
-	while ((children != NULL) && (children->type != XML_ELEMENT_NODE)) {
-		children = children->next;
-	}
-
-	return children;
-}
-
-/* */
-xmlNodePtr ac_xml_get_next(xmlNodePtr element) {
-	xmlNodePtr node;
-
-	ASSERT(element != NULL);
-
-	node = element->next;
-	while ((node != NULL) && (node->type != XML_ELEMENT_NODE)) {
-		node = node->next;
-	}
-
-	return node;
-}
-
-xmlNodePtr ac_xml_search_child(xmlNodePtr parent, char* prefix, char* name) {
-	xmlNodePtr children;
-
-	ASSERT(parent != NULL);
-	ASSERT(name != NULL);
-
-	children = ac_xml_get_children(parent);
-	while (children != NULL) {
-		if (!xmlStrcmp(children->name, BAD_CAST name) && (!prefix || !xmlStrcmp(children->ns->prefix, BAD_CAST prefix))) {
-			break;
-		}
-
-		/* */
-		children = ac_xml_get_next(children);
-	}
-
-	return children;
-}
-
 /* */
 static int ac_soapclient_parsing_url(struct ac_http_soap_server* server, const char* url) {
 	int length;
@@ -172,23 +164,257 @@ static int ac_soapclient_parsing_url(struct ac_http_soap_server* server, const c
 }
 
 /* */
-static int ac_soapclient_connect(struct ac_http_soap_request* httprequest) {
-	int result = 0;
+static uint64_t ac_soapclient_gettime(void) {
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return ((uint64_t)now.tv_sec * 1000000) + (uint64_t)(now.tv_nsec / 1000);
+}
+
+/* */
+static void ac_soapclient_close_connection(struct ac_http_soap_connection* connection) {
+	ASSERT(connection != NULL);
+
+	if (connection->sslsock) {
+		capwap_socket_ssl_shutdown(connection->sslsock, SOAP_PROTOCOL_CLOSE_TIMEOUT);
+		capwap_socket_ssl_close(connection->sslsock);
+		capwap_free(connection->sslsock);
+	}
+
+	/* Close socket */
+	if (connection->sock >= 0) {
+		capwap_socket_close(connection->sock);
+	}
+
+	capwap_free(connection);
+}
+
+/* */
+static struct ac_http_soap_connection* ac_soapclient_open_connection(struct ac_http_soap_server* server) {
+	uint64_t setuptime;
+	struct ac_http_soap_connection* connection;
+
+	/* */
+	connection = (struct ac_http_soap_connection*)capwap_alloc(sizeof(struct ac_http_soap_connection));
+	memset(connection, 0, sizeof(struct ac_http_soap_connection));
+
+	/* Create socket */
+	setuptime = ac_soapclient_gettime();
+	connection->sock = socket(server->address.ss.ss_family, SOCK_STREAM, 0);
+	if (connection->sock < 0) {
+		capwap_free(connection);
+		return NULL;
+	}
+
+	/* Connect to remote host */
+	if (!capwap_socket_connect(connection->sock, &server->address, SOAP_PROTOCOL_CONNECT_TIMEOUT)) {
+		ac_soapclient_close_connection(connection);
+		return NULL;
+	}
+
+	if (server->protocol == SOAP_HTTPS_PROTOCOL) {
+		/* Establish SSL/TLS connection, try to resume the last session with backend */
+		connection->sslsock = capwap_socket_ssl_connect(connection->sock, server->sslcontext, server->serverid, server->serveridlength, SOAP_PROTOCOL_CONNECT_TIMEOUT);
+		if (!connection->sslsock) {
+			ac_soapclient_close_connection(connection);
+			return NULL;
+		}
+	}
+
+	setuptime = ac_soapclient_gettime() - setuptime;
+
+	/* Update statistics, the resumed session saves the difference from the average full setup */
+	capwap_lock_enter(&server->poollock);
+
+	if (connection->sslsock && connection->sslsock->resumed) {
+		server->resumed++;
+		if (server->connections && ((server->setuptime / server->connections) > setuptime)) {
+			server->savedtime += (server->setuptime / server->connections) - setuptime;
+		}
+	} else {
+		server->connections++;
+		server->setuptime += setuptime;
+	}
+
+	capwap_lock_exit(&server->poollock);
+
+	return connection;
+}
+
+/* */
+static struct ac_http_soap_connection* ac_soapclient_evict_connections(struct ac_http_soap_server* server, uint64_t now) {
+	struct ac_http_soap_connection* expired = NULL;
+	struct ac_http_soap_connection** connection = &server->idle;
+
+	/* Detach the connections idle for too long */
+	while (*connection) {
+		if ((now - (*connection)->lastused) >= ((uint64_t)SOAP_PROTOCOL_POOL_IDLE_TIMEOUT * 1000)) {
+			struct ac_http_soap_connection* item = *connection;
+
+			*connection = item->next;
+			item->next = expired;
+			expired = item;
+
+			server->idlecount--;
+			server->evicted++;
+		} else {
+			connection = &(*connection)->next;
+		}
+	}
+
+	return expired;
+}
+
+/* */
+static int ac_soapclient_connection_isalive(struct ac_http_soap_connection* connection) {
+	struct pollfd fds;
+
+	/* An idle connection is readable only if backend has closed it */
+	memset(&fds, 0, sizeof(struct pollfd));
+	fds.fd = connection->sock;
+	fds.events = POLLIN;
+
+	return (!poll(&fds, 1, 0) ? 1 : 0);
+}
+
+/* */
+static int ac_soapclient_connect(struct ac_http_soap_request* httprequest, int reuse) {
+	int slot = 0;
+	int maxconnections;
+	uint64_t now;
+	uint64_t timeout;
+	struct ac_http_soap_connection* expired;
+	struct ac_http_soap_connection* connection = NULL;
+	struct ac_http_soap_server* server = httprequest->server;
+
+	ASSERT(httprequest->connection == NULL);
+
+	/* The last slots of pool are reserved to the control connection with backend */
+	maxconnections = server->maxconnections - (httprequest->reserved ? 0 : server->reservedconnections);
+
+	/* Wait a free slot of the pool */
+	now = ac_soapclient_gettime();
+	timeout = now + ((uint64_t)SOAP_PROTOCOL_POOL_WAIT_TIMEOUT * 1000);
+
+	capwap_lock_enter(&server->poollock);
+
+	for (;;) {
+		expired = ac_soapclient_evict_connections(server, now);
+		if (expired) {
+			capwap_lock_exit(&server->poollock);
+
+			/* Close expired connections outside of critical section */
+			while (expired) {
+				connection = expired;
+				expired = expired->next;
+				ac_soapclient_close_connection(connection);
+			}
+
+			connection = NULL;
+			capwap_lock_enter(&server->poollock);
+		}
+
+		if (httprequest->shutdown) {
+			break;
+		} else if (server->activecount < maxconnections) {
+			if (reuse && server->idle) {
+				connection = server->idle;
+				server->idle = connection->next;
+				server->idlecount--;
+			}
+
+			server->activecount++;
+			slot = 1;
+			break;
+		} else if (now >= timeout) {
+			break;
+		}
+
+		/* Wait release connection */
+		capwap_event_reset(&server->poolevent);
+		capwap_lock_exit(&server->poollock);
+		capwap_event_wait_timeout(&server->poolevent, (long)((timeout - now) / 1000) + 1);
+		capwap_lock_enter(&server->poollock);
+
+		now = ac_soapclient_gettime();
+	}
 
-	if (httprequest->server->protocol == SOAP_HTTP_PROTOCOL) {
-		result = capwap_socket_connect(httprequest->sock, &httprequest->server->address, SOAP_PROTOCOL_CONNECT_TIMEOUT);
-	} else if (httprequest->server->protocol == SOAP_HTTPS_PROTOCOL) {
-		result = capwap_socket_connect(httprequest->sock, &httprequest->server->address, SOAP_PROTOCOL_CONNECT_TIMEOUT);
-		if (result) {
-			/* Establish SSL/TLS connection */
-			httprequest->sslsock = capwap_socket_ssl_connect(httprequest->sock, httprequest->server->sslcontext, SOAP_PROTOCOL_CONNECT_TIMEOUT);
-			if (!httprequest->sslsock) {
-				result = 0;
+	capwap_lock_exit(&server->poollock);
+
+	/* */
+	if (!slot) {
+		log_printf(LOG_WARNING, "Unable to get a connection with backend %s, pool is full", server->host);
+		return 0;
+	}
+
+	/* Check idle connection */
+	if (connection) {
+		if (ac_soapclient_connection_isalive(connection)) {
+			capwap_lock_enter(&server->poollock);
+			server->reused++;
+			if (server->connections) {
+				server->savedtime += server->setuptime / server->connections;
 			}
+			capwap_lock_exit(&server->poollock);
+		} else {
+			ac_soapclient_close_connection(connection);
+			connection = NULL;
 		}
 	}
 
-	return result;
+	/* Create new connection */
+	if (!connection) {
+		connection = ac_soapclient_open_connection(server);
+		if (!connection) {
+			capwap_lock_enter(&server->poollock);
+			server->activecount--;
+			capwap_lock_exit(&server->poollock);
+
+			capwap_event_signal(&server->poolevent);
+			return 0;
+		}
+	}
+
+	/* */
+	httprequest->connection = connection;
+	httprequest->keepalive = 1;
+	return 1;
+}
+
+/* */
+static void ac_soapclient_release_connection(struct ac_http_soap_request* httprequest) {
+	int keepalive;
+	struct ac_http_soap_server* server = httprequest->server;
+	struct ac_http_soap_connection* connection = httprequest->connection;
+
+	if (!connection) {
+		return;
+	}
+
+	/* The connection is reusable only if the response has been received completely */
+	httprequest->connection = NULL;
+	keepalive = (httprequest->keepalive && !httprequest->shutdown && (httprequest->httpstate == HTTP_RESPONSE_BODY) && !httprequest->contentlength);
+
+	/* */
+	capwap_lock_enter(&server->poollock);
+
+	server->activecount--;
+	if (keepalive) {
+		connection->lastused = ac_soapclient_gettime();
+		connection->requests++;
+		connection->next = server->idle;
+		server->idle = connection;
+		server->idlecount++;
+		connection = NULL;
+	}
+
+	capwap_lock_exit(&server->poollock);
+	capwap_event_signal(&server->poolevent);
+
+	/* */
+	if (connection) {
+		ac_soapclient_close_connection(connection);
+	}
 }
 
 /* */
@@ -206,7 +432,7 @@ static int ac_soapclient_send_http(struct ac_http_soap_request* httprequest, cha
 	strftime(datetime, 32, "%a, %d %b %Y %T %z", &stm);
 
 	/* Calculate header length */
-	headerlength = 150 + length + strlen(httprequest->server->path) + strlen(httprequest->server->host) + strlen(datetime) + strlen((soapaction ? soapaction : ""));
+	headerlength = 192 + length + strlen(httprequest->server->path) + strlen(httprequest->server->host) + strlen(datetime) + strlen((soapaction ? soapaction : ""));
 	buffer = capwap_alloc(headerlength);
 
 	/* HTTP headers */
@@ -216,7 +442,7 @@ static int ac_soapclient_send_http(struct ac_http_soap_request* httprequest, cha
 		"Date: %s\r\n"
 		"Content-Length: %d\r\n"
 		"Content-Type: text/xml\r\n"
-		"Connection: Close\r\n"
+		"Connection: Keep-Alive\r\n"
 		"SoapAction: %s\r\n"
 		"Expect: 100-continue\r\n"
 		"\r\n"
@@ -237,9 +463,9 @@ static int ac_soapclient_send_http(struct ac_http_soap_request* httprequest, cha
 
 		/* Send packet */
 		if (httprequest->server->protocol == SOAP_HTTP_PROTOCOL) {
-			sendlength = capwap_socket_send(httprequest->sock, buffer, result, httprequest->requesttimeout);
+			sendlength = capwap_socket_send(httprequest->connection->sock, buffer, result, httprequest->requesttimeout);
 		} else if (httprequest->server->protocol == SOAP_HTTPS_PROTOCOL) {
-			sendlength = capwap_socket_crypto_send(httprequest->sslsock, buffer, result, httprequest->requesttimeout);
+			sendlength = capwap_socket_crypto_send(httprequest->connection->sslsock, buffer, result, httprequest->requesttimeout);
 		}
 
 		/* Check result */
@@ -259,11 +485,11 @@ static int ac_soapclient_http_readline(struct ac_http_soap_request* httprequest,
 	for (;;) {
 		/* Receive packet into temporaly buffer */
 		if (httprequest->server->protocol == SOAP_HTTP_PROTOCOL) {
-			if (capwap_socket_recv(httprequest->sock, &buffer[bufferpos], 1, httprequest->responsetimeout) != 1) {
+			if (capwap_socket_recv(httprequest->connection->sock, &buffer[bufferpos], 1, httprequest->responsetimeout) != 1) {
 				break;			/* Connection error */
 			}
 		} else if (httprequest->server->protocol == SOAP_HTTPS_PROTOCOL) {
-			if (capwap_socket_crypto_recv(httprequest->sslsock, &buffer[bufferpos], 1, httprequest->responsetimeout) != 1) {
+			if (capwap_socket_crypto_recv(httprequest->connection->sslsock, &buffer[bufferpos], 1, httprequest->responsetimeout) != 1) {
 				break;			/* Connection error */
 			}
 		}
@@ -343,6 +569,10 @@ static int ac_soapclient_xml_io_read(void* ctx, char* buffer, int len) {
 						if (!httprequest->contentlength) {
 							httprequest->httpstate = HTTP_RESPONSE_ERROR;
 						}
+					} else if (!strcmp(respbuffer, "Connection")) {
+						if (!strcasecmp(value, "close")) {
+							httprequest->keepalive = 0;
+						}
 					} else if (!strcmp(respbuffer, "Content-Type")) {
 						char* param;
 
@@ -368,11 +598,15 @@ static int ac_soapclient_xml_io_read(void* ctx, char* buffer, int len) {
 			return 0;
 		}
 
-		/* Receive body directly into XML buffer */
+		/* Receive body directly into XML buffer, without read beyond the response */
+		if (len > httprequest->contentlength) {
+			len = httprequest->contentlength;
+		}
+
 		if (httprequest->server->protocol == SOAP_HTTP_PROTOCOL) {
-			result = capwap_socket_recv(httprequest->sock, buffer, len, httprequest->responsetimeout);
+			result = capwap_socket_recv(httprequest->connection->sock, buffer, len, httprequest->responsetimeout);
 		} else if (httprequest->server->protocol == SOAP_HTTPS_PROTOCOL) {
-			result = capwap_socket_crypto_recv(httprequest->sslsock, buffer, len, httprequest->responsetimeout);
+			result = capwap_socket_crypto_recv(httprequest->connection->sslsock, buffer, len, httprequest->responsetimeout);
 		}
 
 		if (result > 0) {
@@ -384,14 +618,214 @@ static int ac_soapclient_xml_io_read(void* ctx, char* buffer, int len) {
 }
 
 /* */
-static int ac_soapclient_xml_io_close(void *ctx) {
-	struct ac_http_soap_request* httprequest = (struct ac_http_soap_request*)ctx;
+static void ac_soapclient_parser_json(struct ac_soap_parser* parser, const char* buffer, int length) {
+	struct json_object* jsonroot;
+
+	if (!parser->tokener) {
+		return;
+	}
+
+	/* The tokener keeps the partial value between the chunks */
+	jsonroot = json_tokener_parse_ex(parser->tokener, buffer, length);
+	if (jsonroot) {
+		parser->response->jsonreturn = jsonroot;
+	} else if (json_tokener_get_error(parser->tokener) == json_tokener_continue) {
+		return;
+	}
+
+	/* Complete or not JSON, ignore the remaining text */
+	json_tokener_free(parser->tokener);
+	parser->tokener = NULL;
+}
+
+/* */
+static void ac_soapclient_parser_decode(struct ac_soap_parser* parser, const char* encoded, int length) {
+	char element;
+	int plainlength = 0;
+	char plain[SOAP_RESPONSE_DECODE_BUFFER_LENGTH];
+
+	/* Same decoding of ac_base64_binary_decode, the invalid characters are ignored */
+	while (parser->tokener && (length > 0)) {
+		element = *encoded++;
+		element = (((element < 43) || (element > 122)) ? 0 : l_decodeblock[element - 43]);
+		length--;
+
+		if (!element) {
+			continue;
+		}
+
+		parser->quad[parser->quadlength++] = element - 1;
+		if (parser->quadlength == 4) {
+			plain[plainlength++] = (parser->quad[0] << 2 | parser->quad[1] >> 4);
+			plain[plainlength++] = (parser->quad[1] << 4 | parser->quad[2] >> 2);
+			plain[plainlength++] = (((parser->quad[2] << 6) & 0xc0) | parser->quad[3]);
+			parser->quadlength = 0;
+
+			if (plainlength == sizeof(plain)) {
+				ac_soapclient_parser_json(parser, plain, plainlength);
+				plainlength = 0;
+			}
+		}
+	}
 
-	if ((httprequest->httpstate != HTTP_RESPONSE_BODY) || httprequest->contentlength) {
-		return -1;
+	if (plainlength) {
+		ac_soapclient_parser_json(parser, plain, plainlength);
 	}
+}
+
+/* */
+static void ac_soapclient_parser_decode_end(struct ac_soap_parser* parser) {
+	int i;
+	char plain[3];
+
+	/* Partial block */
+	if (parser->quadlength) {
+		for (i = parser->quadlength; i < 4; i++) {
+			parser->quad[i] = 0;
+		}
+
+		plain[0] = (parser->quad[0] << 2 | parser->quad[1] >> 4);
+		plain[1] = (parser->quad[1] << 4 | parser->quad[2] >> 2);
+		plain[2] = (((parser->quad[2] << 6) & 0xc0) | parser->quad[3]);
+		ac_soapclient_parser_json(parser, plain, parser->quadlength - 1);
+		parser->quadlength = 0;
+	}
+
+	/* The terminator of string completes the value */
+	ac_soapclient_parser_json(parser, "", 1);
+	if (parser->tokener) {
+		json_tokener_free(parser->tokener);
+		parser->tokener = NULL;
+	}
+}
+
+/* */
+static int ac_soapclient_parser_element(struct ac_soap_parser* parser, const xmlChar* localname, const xmlChar* prefix) {
+	int element = SOAP_ELEMENT_NONE;
+	int parent = (parser->depth ? parser->path[parser->depth - 1] : SOAP_ELEMENT_NONE);
+
+	/* Only the first element of each type is used */
+	if (!parser->depth) {
+		element = SOAP_ELEMENT_ENVELOPE;
+	} else if (parent == SOAP_ELEMENT_ENVELOPE) {
+		if (!xmlStrcmp(localname, BAD_CAST "Body") && !xmlStrcmp(prefix, BAD_CAST "SOAP-ENV")) {
+			element = SOAP_ELEMENT_BODY;
+		}
+	} else if (parent == SOAP_ELEMENT_BODY) {
+		if (parser->tagmethod) {
+			if (!xmlStrcmp(localname, BAD_CAST parser->tagmethod)) {
+				element = SOAP_ELEMENT_RESPONSE;
+			}
+		} else if (!xmlStrcmp(localname, BAD_CAST "Fault") && !xmlStrcmp(prefix, BAD_CAST "SOAP-ENV")) {
+			element = SOAP_ELEMENT_FAULT;
+		}
+	} else if (parent == SOAP_ELEMENT_RESPONSE) {
+		if (!xmlStrcmp(localname, BAD_CAST "return")) {
+			element = SOAP_ELEMENT_RETURN;
+		}
+	} else if (parent == SOAP_ELEMENT_FAULT) {
+		if (!xmlStrcmp(localname, BAD_CAST "faultcode")) {
+			element = SOAP_ELEMENT_FAULTCODE;
+		} else if (!xmlStrcmp(localname, BAD_CAST "faultstring")) {
+			element = SOAP_ELEMENT_FAULTSTRING;
+		}
+	}
+
+	if ((element != SOAP_ELEMENT_NONE) && (parser->found & (1 << element))) {
+		element = SOAP_ELEMENT_NONE;
+	}
+
+	return element;
+}
+
+/* */
+static void ac_soapclient_parser_start_element(void* ctx, const xmlChar* localname, const xmlChar* prefix, const xmlChar* URI, int nb_namespaces, const xmlChar** namespaces, int nb_attributes, int nb_defaulted, const xmlChar** attributes) {
+	int element;
+	struct ac_soap_parser* parser = (struct ac_soap_parser*)ctx;
+
+	/* The text of element include the text of children */
+	if (parser->capture || (parser->depth >= SOAP_ELEMENT_MAX_DEPTH)) {
+		parser->depth++;
+		return;
+	}
+
+	/* */
+	element = ac_soapclient_parser_element(parser, localname, prefix);
+	parser->path[parser->depth++] = element;
+	if (element == SOAP_ELEMENT_NONE) {
+		return;
+	}
+
+	/* */
+	parser->found |= (1 << element);
+	if ((element == SOAP_ELEMENT_RETURN) || (element == SOAP_ELEMENT_FAULTCODE) || (element == SOAP_ELEMENT_FAULTSTRING)) {
+		parser->capture = element;
+		parser->capturedepth = parser->depth;
+		parser->textlength = 0;
+		parser->textoverflow = 0;
+
+		if (element == SOAP_ELEMENT_RETURN) {
+			parser->quadlength = 0;
+			parser->tokener = json_tokener_new();
+		}
+	}
+}
+
+/* */
+static void ac_soapclient_parser_end_element(void* ctx, const xmlChar* localname, const xmlChar* prefix, const xmlChar* URI) {
+	char* text = NULL;
+	struct ac_soap_parser* parser = (struct ac_soap_parser*)ctx;
 
-	return 0;
+	ASSERT(parser->depth > 0);
+
+	if (parser->capture && (parser->depth == parser->capturedepth)) {
+		parser->text[parser->textlength] = 0;
+
+		/* The long text of return is only JSON, the text of fault is truncated */
+		if (parser->capture == SOAP_ELEMENT_RETURN) {
+			ac_soapclient_parser_decode_end(parser);
+			if (!parser->textoverflow) {
+				parser->response->returnvalue = capwap_duplicate_string(parser->text);
+			}
+		} else {
+			text = capwap_duplicate_string(parser->text);
+			if (parser->capture == SOAP_ELEMENT_FAULTCODE) {
+				parser->response->faultcode = text;
+			} else {
+				parser->response->faultstring = text;
+			}
+		}
+
+		parser->capture = SOAP_ELEMENT_NONE;
+	}
+
+	parser->depth--;
+}
+
+/* */
+static void ac_soapclient_parser_characters(void* ctx, const xmlChar* ch, int len) {
+	int length;
+	struct ac_soap_parser* parser = (struct ac_soap_parser*)ctx;
+
+	if (!parser->capture) {
+		return;
+	}
+
+	/* */
+	length = SOAP_RESPONSE_MAX_TEXT_LENGTH - parser->textlength;
+	if (len > length) {
+		parser->textoverflow = 1;
+	} else {
+		length = len;
+	}
+
+	memcpy(&parser->text[parser->textlength], ch, length);
+	parser->textlength += length;
+
+	/* */
+	if (parser->capture == SOAP_ELEMENT_RETURN) {
+		ac_soapclient_parser_decode(parser, (const char*)ch, len);
+	}
 }
 
 /* */
@@ -420,18 +854,54 @@ struct ac_http_soap_server* ac_soapclient_create_server(const char* url) {
 	server = (struct ac_http_soap_server*)capwap_alloc(sizeof(struct ac_http_soap_server));
 	memset(server, 0, sizeof(struct ac_http_soap_server));
 
+	/* Connection pool */
+	capwap_lock_init(&server->poollock);
+	capwap_event_init(&server->poolevent);
+	server->maxconnections = SOAP_PROTOCOL_POOL_MAX_CONNECTIONS;
+	server->reservedconnections = SOAP_PROTOCOL_POOL_RESERVED_CONNECTIONS;
+
 	/* */
 	if (!ac_soapclient_parsing_url(server, url)) {
 		ac_soapclient_free_server(server);
 		return NULL;
 	}
 
+	/* Identify the server into TLS session cache */
+	if (server->address.ss.ss_family == AF_INET) {
+		memcpy(server->serverid, &server->address.sin.sin_port, sizeof(in_port_t));
+		memcpy(&server->serverid[sizeof(in_port_t)], &server->address.sin.sin_addr, sizeof(struct in_addr));
+		server->serveridlength = sizeof(in_port_t) + sizeof(struct in_addr);
+	} else if (server->address.ss.ss_family == AF_INET6) {
+		memcpy(server->serverid, &server->address.sin6.sin6_port, sizeof(in_port_t));
+		memcpy(&server->serverid[sizeof(in_port_t)], &server->address.sin6.sin6_addr, sizeof(struct in6_addr));
+		server->serveridlength = sizeof(in_port_t) + sizeof(struct in6_addr);
+	}
+
 	return server;
 }
 
 /* */
 void ac_soapclient_free_server(struct ac_http_soap_server* server) {
+	struct ac_http_soap_connection* connection;
+
 	ASSERT(server != NULL);
+	ASSERT(server->activecount == 0);
+
+	/* */
+	if (server->connections) {
+		log_printf(LOG_INFO, "Backend %s connection pool: %lu connections, %lu TLS resumed, %lu reused, %lu evicted, %lu ms of setup saved",
+			(server->host ? server->host : ""), server->connections, server->resumed, server->reused, server->evicted, (unsigned long)(server->savedtime / 1000));
+	}
+
+	/* Close idle connections */
+	while (server->idle) {
+		connection = server->idle;
+		server->idle = connection->next;
+		ac_soapclient_close_connection(connection);
+	}
+
+	capwap_event_destroy(&server->poolevent);
+	capwap_lock_destroy(&server->poollock);
 
 	if (server->host) {
 		capwap_free(server->host);
@@ -566,13 +1036,6 @@ struct ac_http_soap_request* ac_soapclient_prepare_request(struct ac_soap_reques
 	httprequest->requesttimeout = SOAP_PROTOCOL_REQUEST_TIMEOUT;
 	httprequest->responsetimeout = SOAP_PROTOCOL_RESPONSE_TIMEOUT;
 
-	/* Create socket */
-	httprequest->sock = socket(httprequest->server->address.ss.ss_family, SOCK_STREAM, 0);
-	if (httprequest->sock < 0) {
-		ac_soapclient_close_request(httprequest, 0);
-		return NULL;
-	}
-
 	return httprequest;
 }
 
@@ -593,16 +1056,23 @@ int ac_soapclient_send_request(struct ac_http_soap_request* httprequest, char* s
 
 	buffer = (char*)xmlBufferContent(xmlBuffer);
 
-	/* Connect to remote host */
-	if (!ac_soapclient_connect(httprequest)) {
+	/* Get connection to remote host */
+	if (!ac_soapclient_connect(httprequest, 1)) {
 		xmlBufferFree(xmlBuffer);
 		return 0;
 	}
 
 	/* Send HTTP Header */
 	if (!ac_soapclient_send_http(httprequest, soapaction, buffer, (int)length)) {
-		xmlBufferFree(xmlBuffer);
-		return 0;
+		int reused = (httprequest->connection->requests ? 1 : 0);
+
+		/* Backend can close an idle connection, retry only once with a new connection */
+		httprequest->keepalive = 0;
+		ac_soapclient_release_connection(httprequest);
+		if (!reused || !ac_soapclient_connect(httprequest, 0) || !ac_soapclient_send_http(httprequest, soapaction, buffer, (int)length)) {
+			xmlBufferFree(xmlBuffer);
+			return 0;
+		}
 	}
 
 	/* Sent SOAP Request */
@@ -612,14 +1082,24 @@ int ac_soapclient_send_request(struct ac_http_soap_request* httprequest, char* s
 
 /* */
 void ac_soapclient_shutdown_request(struct ac_http_soap_request* httprequest) {
+	struct ac_http_soap_connection* connection;
+
 	ASSERT(httprequest != NULL);
 
-	if (httprequest->sslsock) {
-		capwap_socket_ssl_shutdown(httprequest->sslsock, SOAP_PROTOCOL_CLOSE_TIMEOUT);
-	}
+	/* The connection is not returned into pool */
+	httprequest->shutdown = 1;
+	capwap_event_signal(&httprequest->server->poolevent);
 
-	if (httprequest->sock >= 0) {
-		capwap_socket_shutdown(httprequest->sock);
+	/* */
+	connection = httprequest->connection;
+	if (connection) {
+		if (connection->sslsock) {
+			capwap_socket_ssl_shutdown(connection->sslsock, SOAP_PROTOCOL_CLOSE_TIMEOUT);
+		}
+
+		if (connection->sock >= 0) {
+			capwap_socket_shutdown(connection->sock);
+		}
 	}
 }
 
@@ -632,90 +1112,98 @@ void ac_soapclient_close_request(struct ac_http_soap_request* httprequest, int c
 		ac_soapclient_free_request(httprequest->request);
 	}
 
-	/* */
-	if (httprequest->sslsock) {
-		capwap_socket_ssl_shutdown(httprequest->sslsock, SOAP_PROTOCOL_CLOSE_TIMEOUT);
-		capwap_socket_ssl_close(httprequest->sslsock);
-		capwap_free(httprequest->sslsock);
-	}
-
-	/* Close socket */
-	if (httprequest->sock >= 0) {
-		capwap_socket_close(httprequest->sock);
-	}
-
+	/* Return connection into pool */
+	ac_soapclient_release_connection(httprequest);
 	capwap_free(httprequest);
 }
 
 /* */
 struct ac_soap_response* ac_soapclient_recv_response(struct ac_http_soap_request* httprequest) {
+	int length;
+	int wellformed;
+	xmlParserCtxtPtr ctxt;
+	struct ac_soap_parser parser;
 	struct ac_soap_response* response;
+	char buffer[SOAP_RESPONSE_RECV_BUFFER_LENGTH];
+	xmlSAXHandler sax;
 
 	ASSERT(httprequest != NULL);
-	ASSERT(httprequest->sock >= 0);
+	ASSERT(httprequest->connection != NULL);
 
 	/* */
 	response = (struct ac_soap_response*)capwap_alloc(sizeof(struct ac_soap_response));
 	memset(response, 0, sizeof(struct ac_soap_response));
 
-	/* Receive HTTP response into XML callback */
+	/* Receive HTTP header and the first chunk of body */
 	httprequest->httpstate = HTTP_RESPONSE_STATUS_CODE;
-	response->xmlDocument = xmlReadIO(ac_soapclient_xml_io_read, ac_soapclient_xml_io_close, (void*)httprequest, "", NULL, 0);
-	if (!response->xmlDocument) {
+	length = ac_soapclient_xml_io_read((void*)httprequest, buffer, sizeof(buffer));
+	if (length <= 0) {
 		ac_soapclient_free_response(response);
 		return NULL;
 	}
 
-	/* Parsing response */
+	/* */
+	memset(&parser, 0, sizeof(struct ac_soap_parser));
+	parser.response = response;
 	response->responsecode = httprequest->responsecode;
-	response->xmlRoot = xmlDocGetRootElement(response->xmlDocument);
-	if (!response->xmlRoot) {
-		ac_soapclient_free_response(response);
-		return NULL;
+	if (response->responsecode == HTTP_RESULT_OK) {
+		parser.tagmethod = capwap_alloc(strlen(httprequest->request->method) + 9);
+		sprintf(parser.tagmethod, "%sResponse", httprequest->request->method);
 	}
 
-	/* Retrieve Body */
-	response->xmlBody = ac_xml_search_child(response->xmlRoot, "SOAP-ENV", "Body");
-	if (!response->xmlBody) {
-		ac_soapclient_free_response(response);
-		return NULL;
-	}
+	/* Only the events of elements and text, the XML document is not built */
+	memset(&sax, 0, sizeof(xmlSAXHandler));
+	sax.initialized = XML_SAX2_MAGIC;
+	sax.startElementNs = ac_soapclient_parser_start_element;
+	sax.endElementNs = ac_soapclient_parser_end_element;
+	sax.characters = ac_soapclient_parser_characters;
+	sax.cdataBlock = ac_soapclient_parser_characters;
+
+	/* Parsing body while it is received */
+	ctxt = xmlCreatePushParserCtxt(&sax, (void*)&parser, NULL, 0, NULL);
+	if (ctxt) {
+		while (length > 0) {
+			if (xmlParseChunk(ctxt, buffer, length, 0)) {
+				break;
+			}
 
-	/* Retrieve response */
-	if (response->responsecode == HTTP_RESULT_OK) {
-		char* tagMethod = capwap_alloc(strlen(httprequest->request->method) + 9);
-		sprintf(tagMethod, "%sResponse", httprequest->request->method);
-		response->xmlResponse = ac_xml_search_child(response->xmlBody, NULL, tagMethod);
-		capwap_free(tagMethod);
+			length = ac_soapclient_xml_io_read((void*)httprequest, buffer, sizeof(buffer));
+		}
 
-		if (!response->xmlResponse) {
-			ac_soapclient_free_response(response);
-			return NULL;
+		/* Terminate parsing only with the whole body */
+		wellformed = 0;
+		if (!length && !xmlParseChunk(ctxt, NULL, 0, 1)) {
+			wellformed = ctxt->wellFormed;
 		}
 
-		/* Retrieve optional return response */
-		response->xmlResponseReturn = ac_xml_search_child(response->xmlResponse, NULL, "return");
+		xmlFreeParserCtxt(ctxt);
 	} else {
-		/* Retrieve Fault */
-		response->xmlFault = ac_xml_search_child(response->xmlBody, "SOAP-ENV", "Fault");
-		if (!response->xmlFault) {
-			ac_soapclient_free_response(response);
-			return NULL;
-		}
+		wellformed = 0;
+	}
 
-		/* Retrieve FaultCode */
-		response->xmlFaultCode = ac_xml_search_child(response->xmlFault, NULL, "faultcode");
-		if (!response->xmlFaultCode) {
-			ac_soapclient_free_response(response);
-			return NULL;
-		}
+	/* Release the partial result */
+	if (parser.tokener) {
+		json_tokener_free(parser.tokener);
+	}
+
+	if (parser.tagmethod) {
+		capwap_free(parser.tagmethod);
+	}
+
+	/* Check the elements of valid or fault response */
+	if (!wellformed || !(parser.found & (1 << SOAP_ELEMENT_BODY))) {
+		ac_soapclient_free_response(response);
+		return NULL;
+	}
 
-		/* Retrieve FaultString */
-		response->xmlFaultString = ac_xml_search_child(response->xmlFault, NULL, "faultstring");
-		if (!response->xmlFaultString) {
+	if (response->responsecode == HTTP_RESULT_OK) {
+		if (!(parser.found & (1 << SOAP_ELEMENT_RESPONSE))) {
 			ac_soapclient_free_response(response);
 			return NULL;
 		}
+	} else if (!(parser.found & (1 << SOAP_ELEMENT_FAULT)) || !response->faultcode || !response->faultstring) {
+		ac_soapclient_free_response(response);
+		return NULL;
 	}
 
 	return response;
@@ -723,48 +1211,49 @@ struct ac_soap_response* ac_soapclient_recv_response(struct ac_http_soap_request
 
 /* */
 struct json_object* ac_soapclient_parse_json_response(struct ac_soap_response* response) {
-	int length;
-	char* json;
-	xmlChar* xmlResult;
-	struct json_object* jsonroot;
-
 	ASSERT(response != NULL);
 
-	/* */
-	if ((response->responsecode != HTTP_RESULT_OK) || !response->xmlResponseReturn) {
-		return NULL;
-	}
-
-	/* Decode base64 result */
-	xmlResult = xmlNodeGetContent(response->xmlResponseReturn);
-	if (!xmlResult) {
+	/* The JSON result has been parsed while received */
+	if ((response->responsecode != HTTP_RESULT_OK) || !response->jsonreturn) {
 		return NULL;
 	}
 
-	length = xmlStrlen(xmlResult);
-	if (!length) {
-		xmlFree(xmlResult);
-		return NULL;
-	}
+	return json_object_get(response->jsonreturn);
+}
 
-	json = (char*)capwap_alloc(AC_BASE64_DECODE_LENGTH(length));
-	ac_base64_string_decode((const char*)xmlResult, json);
+/* Build a valid response with JSON result, used for the results of a batched request */
+struct ac_soap_response* ac_soapclient_create_json_response(struct json_object* jsonroot) {
+	struct ac_soap_response* response;
 
-	xmlFree(xmlResult);
+	ASSERT(jsonroot != NULL);
 
-	/* Parsing JSON result */
-	jsonroot = json_tokener_parse(json);
-	capwap_free(json);
+	/* */
+	response = (struct ac_soap_response*)capwap_alloc(sizeof(struct ac_soap_response));
+	memset(response, 0, sizeof(struct ac_soap_response));
+	response->responsecode = HTTP_RESULT_OK;
+	response->jsonreturn = json_object_get(jsonroot);
 
-	return jsonroot;
+	return response;
 }
 
 /* */
 void ac_soapclient_free_response(struct ac_soap_response* response) {
 	ASSERT(response != NULL);
 
-	if (response->xmlDocument) {
-		xmlFreeDoc(response->xmlDocument);
+	if (response->returnvalue) {
+		capwap_free(response->returnvalue);
+	}
+
+	if (response->jsonreturn) {
+		json_object_put(response->jsonreturn);
+	}
+
+	if (response->faultcode) {
+		capwap_free(response->faultcode);
+	}
+
+	if (response->faultstring) {
+		capwap_free(response->faultstring);
 	}
 
 	capwap_free(response);
@@ -18,6 +18,24 @@
 #define SOAP_PROTOCOL_RESPONSE_TIMEOUT		10000
 #define SOAP_PROTOCOL_CLOSE_TIMEOUT			10000
 
+#define SOAP_PROTOCOL_POOL_MAX_CONNECTIONS	8		/* Default, backend.pool.connections */
+#define SOAP_PROTOCOL_POOL_IDLE_TIMEOUT		30000
+#define SOAP_PROTOCOL_POOL_WAIT_TIMEOUT		10000
+#define SOAP_PROTOCOL_POOL_RESERVED_CONNECTIONS	2		/* Default, backend.pool.reserved */
+
+#define SOAP_PROTOCOL_SERVERID_LENGTH		(sizeof(in_port_t) + sizeof(struct in6_addr))
+
+/* Persistent HTTP/1.1 connection */
+struct ac_http_soap_connection {
+	int sock;
+	struct capwap_socket_ssl* sslsock;
+
+	uint64_t lastused;
+	unsigned long requests;
+
+	struct ac_http_soap_connection* next;
+};
+
 /* */
 struct ac_http_soap_server {
 	int protocol;
@@ -28,6 +46,26 @@ struct ac_http_soap_server {
 
 	/* SSL/TLS context */
 	void* sslcontext;
+	uint8_t serverid[SOAP_PROTOCOL_SERVERID_LENGTH];
+	int serveridlength;
+
+	/* Keep-alive connection pool. The idle connections are a stack,
+	   the most recently used connection is reused first */
+	capwap_lock_t poollock;
+	capwap_event_t poolevent;
+	struct ac_http_soap_connection* idle;
+	int idlecount;
+	int activecount;
+	int maxconnections;
+	int reservedconnections;				/* Only for the reserved requests */
+
+	/* Statistics, time in microseconds */
+	unsigned long connections;
+	unsigned long resumed;
+	unsigned long reused;
+	unsigned long evicted;
+	uint64_t setuptime;
+	uint64_t savedtime;
 };
 
 /* */
@@ -45,12 +83,12 @@ struct ac_http_soap_request {
 	struct ac_http_soap_server* server;
 	struct ac_soap_request* request;
 
-	int sock;
+	struct ac_http_soap_connection* connection;
 	int requesttimeout;
 	int responsetimeout;
-
-	/* SSL info */
-	struct capwap_socket_ssl* sslsock;
+	int keepalive;
+	int shutdown;
+	int reserved;							/* Can use the reserved connections of pool */
 
 	/* Information for SOAP Response */
 	int httpstate;
@@ -59,21 +97,20 @@ struct ac_http_soap_request {
 	int contentxml;
 };
 
-/* */
+/* The text of return and fault longer than this size is not saved */
+#define SOAP_RESPONSE_MAX_TEXT_LENGTH		1024
+
+/* Response parsed while it is received, without XML document */
 struct ac_soap_response {
 	int responsecode;
-	xmlDocPtr xmlDocument;
-	xmlNodePtr xmlRoot;
-	xmlNodePtr xmlBody;
 
 	/* Valid response */
-	xmlNodePtr xmlResponse;
-	xmlNodePtr xmlResponseReturn;
+	char* returnvalue;						/* Text of return, NULL if missing or too long */
+	struct json_object* jsonreturn;			/* JSON decoded from base64 return */
 
 	/* Fault response */
-	xmlNodePtr xmlFault;
-	xmlNodePtr xmlFaultCode;
-	xmlNodePtr xmlFaultString;
+	char* faultcode;
+	char* faultstring;
 };
 
 /* */
@@ -96,6 +133,7 @@ int ac_soapclient_send_request(struct ac_http_soap_request* httprequest, char* s
 struct ac_soap_response* ac_soapclient_recv_response(struct ac_http_soap_request* httprequest);
 
 struct json_object* ac_soapclient_parse_json_response(struct ac_soap_response* response);
+struct ac_soap_response* ac_soapclient_create_json_response(struct json_object* jsonroot);
 
 void ac_soapclient_shutdown_request(struct ac_http_soap_request* httprequest);
 void ac_soapclient_close_request(struct ac_http_soap_request* httprequest, int closerequest);
@@ -0,0 +1,690 @@
+#include <stdarg.h>
+#include <time.h>
+#include "ac.h"
+#include "capwap_dfa.h"
+#include "ac_session.h"
+#include "ac_backend.h"
+#include "ac_soapcalls.h"
+
+/* Pool of threads which executes the SOAP calls of sessions, the session owner
+   continues its work and receives the completion as action */
+struct ac_soapcalls_t {
+	int endthread;
+
+	capwap_event_t wait;
+	capwap_lock_t lock;
+
+	/* Queue of calls */
+	struct ac_soapcall* first;
+	struct ac_soapcall* last;
+
+	/* Queue of calls merged into batched request, the batch is disabled until
+	   nobatchdeadline when the Backend doesn't know the batched request */
+	uint64_t nobatchdeadline;
+	struct ac_soapcall* batchfirst;
+	struct ac_soapcall* batchlast;
+	unsigned long batchcount;
+	uint64_t batchdeadline;
+
+	/* Statistics */
+	unsigned long batches;
+	unsigned long batchcalls;
+
+	/* */
+	unsigned long count;
+	pthread_t* threads;
+};
+
+static struct ac_soapcalls_t g_ac_soapcalls;
+
+/* */
+static struct ac_http_soap_request* ac_soapcalls_create_request(struct ac_soapcall* call) {
+	int i;
+	struct ac_http_soap_request* soaprequest;
+
+	/* Build Soap Request */
+	soaprequest = ac_backend_createrequest_with_session(call->method, SOAP_NAMESPACE_URI);
+	if (soaprequest) {
+		for (i = 0; i < call->numparam; i++) {
+			if (!ac_soapclient_add_param(soaprequest->request, call->params[i * 3], call->params[i * 3 + 1], call->params[i * 3 + 2])) {
+				ac_soapclient_close_request(soaprequest, 1);
+				return NULL;
+			}
+		}
+	}
+
+	return soaprequest;
+}
+
+/* */
+static uint64_t ac_soapcalls_gettime(void) {
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return ((uint64_t)now.tv_sec * 1000) + (uint64_t)(now.tv_nsec / 1000000);
+}
+
+/* */
+static const char* ac_soapcalls_get_param(struct ac_soapcall* call, const char* name) {
+	int i;
+
+	for (i = 0; i < call->numparam; i++) {
+		if (!strcmp(call->params[i * 3 + 1], name)) {
+			return call->params[i * 3 + 2];
+		}
+	}
+
+	return NULL;
+}
+
+/* */
+static void ac_soapcalls_execute(struct ac_soapcall* call) {
+	struct ac_http_soap_request* soaprequest;
+
+	/* The request is built out of critical section, the backend lock can be held for a long time */
+	soaprequest = ac_soapcalls_create_request(call);
+
+	capwap_lock_enter(&g_ac_soapcalls.lock);
+	if (soaprequest && !call->cancel) {
+		call->soaprequest = soaprequest;
+		capwap_lock_exit(&g_ac_soapcalls.lock);
+
+		/* Send Request & Recv Response */
+		if (ac_soapclient_send_request(soaprequest, "")) {
+			call->response = ac_soapclient_recv_response(soaprequest);
+		}
+
+		capwap_lock_enter(&g_ac_soapcalls.lock);
+		call->soaprequest = NULL;
+	}
+
+	capwap_lock_exit(&g_ac_soapcalls.lock);
+
+	/* Free resource */
+	if (soaprequest) {
+		ac_soapclient_close_request(soaprequest, 1);
+	}
+}
+
+/* */
+static void ac_soapcalls_deliver(struct ac_soapcall* call) {
+	struct ac_session_t* session;
+
+	/* Deliver the completion to session, after this point the call can not be canceled */
+	capwap_lock_enter(&g_ac_soapcalls.lock);
+
+	session = call->session;
+	if (session && !call->cancel) {
+		if (ac_session_send_action(session, AC_SESSION_ACTION_SOAP_RESPONSE, 0, (void*)&call, sizeof(struct ac_soapcall*))) {
+			call->status = AC_SOAPCALL_DONE;
+		} else {
+			/* The session executes the completion as failed call */
+			call->status = AC_SOAPCALL_LOST;
+			ac_session_wakeup(session);
+		}
+
+		call = NULL;
+	}
+
+	capwap_lock_exit(&g_ac_soapcalls.lock);
+
+	/* */
+	if (session) {
+		ac_session_release_reference(session);
+	}
+
+	if (call) {
+		ac_soapcalls_free(call);
+	}
+}
+
+/* A client fault which names the batched request is the reply of Backend which doesn't
+   implement authorizeStations, the other faults can be transient */
+static int ac_soapcalls_is_unknown_batch(struct ac_soap_response* response) {
+	const char* faultcode;
+
+	if (!response->faultcode || !response->faultstring) {
+		return 0;
+	}
+
+	/* Ignore namespace prefix of fault code */
+	faultcode = strrchr(response->faultcode, ':');
+	faultcode = (faultcode ? faultcode + 1 : response->faultcode);
+
+	return ((!strcmp(faultcode, "Client") && strstr(response->faultstring, "authorizeStations")) ? 1 : 0);
+}
+
+/* Send the station authorizations as a single authorizeStations request and dispatch the
+   result of each station as the response of its call. Return 1 when the calls are
+   completed, 0 when the Backend doesn't know the batched request and -1 when the
+   batched request failed */
+static int ac_soapcalls_execute_batch(struct ac_soapcall* batch, unsigned long count) {
+	int result = 0;
+	unsigned long i;
+	char* json;
+	const char* jsonmessage;
+	char* base64stations;
+	const char* wtpid;
+	const char* station;
+	struct ac_soapcall* call;
+	struct json_object* jsonparam;
+	struct json_object* jsonarray;
+	struct json_object* jsonitem;
+	struct json_object* jsonroot;
+	struct ac_soap_response* response = NULL;
+	struct ac_http_soap_request* soaprequest;
+
+	/* Create SOAP request with JSON param
+		{
+			Stations: [
+				{
+					WTPId: [string],
+					Station: <Station param of authorizeStation>
+				}
+			]
+		}
+	*/
+
+	/* */
+	jsonarray = json_object_new_array();
+	for (call = batch; call; call = call->next) {
+		wtpid = ac_soapcalls_get_param(call, "idwtp");
+		station = ac_soapcalls_get_param(call, "station");
+
+		/* */
+		jsonitem = json_object_new_object();
+		json_object_object_add(jsonitem, "WTPId", json_object_new_string(wtpid ? wtpid : ""));
+		if (station) {
+			json = (char*)capwap_alloc(AC_BASE64_DECODE_LENGTH(strlen(station)));
+			ac_base64_string_decode(station, json);
+			json_object_object_add(jsonitem, "Station", json_tokener_parse(json));
+			capwap_free(json);
+		}
+
+		json_object_array_add(jsonarray, jsonitem);
+	}
+
+	jsonparam = json_object_new_object();
+	json_object_object_add(jsonparam, "Stations", jsonarray);
+
+	/* Get JSON param and convert base64 */
+	jsonmessage = json_object_to_json_string(jsonparam);
+	base64stations = capwap_alloc(AC_BASE64_ENCODE_LENGTH(strlen(jsonmessage)));
+	ac_base64_string_encode(jsonmessage, base64stations);
+	json_object_put(jsonparam);
+
+	/* Send message */
+	soaprequest = ac_backend_createrequest_with_session("authorizeStations", SOAP_NAMESPACE_URI);
+	if (soaprequest) {
+		if (ac_soapclient_add_param(soaprequest->request, "xs:base64Binary", "stations", base64stations)) {
+			if (ac_soapclient_send_request(soaprequest, "")) {
+				response = ac_soapclient_recv_response(soaprequest);
+			}
+		}
+
+		ac_soapclient_close_request(soaprequest, 1);
+	}
+
+	capwap_free(base64stations);
+
+	/* Receive SOAP response with JSON result, the results are in the same order of stations
+		{
+			Stations: [
+				<Result of authorizeStation>
+			]
+		}
+	*/
+
+	if (response) {
+		if (response->responsecode == HTTP_RESULT_OK) {
+			jsonroot = ac_soapclient_parse_json_response(response);
+			if (jsonroot) {
+				jsonarray = compat_json_object_object_get(jsonroot, "Stations");
+				if (jsonarray && (json_object_get_type(jsonarray) == json_type_array) && (json_object_array_length(jsonarray) == count)) {
+					for (i = 0, call = batch; call; i++, call = call->next) {
+						jsonitem = json_object_array_get_idx(jsonarray, i);
+						if (jsonitem && (json_object_get_type(jsonitem) == json_type_object)) {
+							call->response = ac_soapclient_create_json_response(jsonitem);
+						}
+					}
+				} else {
+					log_printf(LOG_WARNING, "Invalid response of batched station authorization");
+				}
+
+				json_object_put(jsonroot);
+			}
+
+			result = 1;
+		} else {
+			result = (ac_soapcalls_is_unknown_batch(response) ? 0 : -1);
+		}
+
+		ac_soapclient_free_response(response);
+	} else {
+		/* Backend not available, the calls fail without retry */
+		result = 1;
+	}
+
+	return result;
+}
+
+/* */
+static void ac_soapcalls_run_batch(struct ac_soapcall* batch, unsigned long count) {
+	int result;
+	struct ac_soapcall* call;
+	struct ac_soapcall* next;
+
+	/* A single call doesn't need the batched request, when the batched request fails
+	   the calls are sent one by one */
+	if (count > 1) {
+		result = ac_soapcalls_execute_batch(batch, count);
+		if (!result) {
+			log_printf(LOG_WARNING, "Backend does not support batched station authorization, disabled batch for %d seconds", AC_SOAPCALLS_BATCH_RETRY_INTERVAL / 1000);
+
+			capwap_lock_enter(&g_ac_soapcalls.lock);
+			g_ac_soapcalls.nobatchdeadline = ac_soapcalls_gettime() + AC_SOAPCALLS_BATCH_RETRY_INTERVAL;
+			capwap_lock_exit(&g_ac_soapcalls.lock);
+		} else if (result < 0) {
+			log_printf(LOG_DEBUG, "Batched station authorization failed, send the calls one by one");
+		}
+
+		if (result <= 0) {
+			count = 1;
+		}
+	}
+
+	/* */
+	for (call = batch; call; call = next) {
+		next = call->next;
+		call->next = NULL;
+
+		if (count == 1) {
+			ac_soapcalls_execute(call);
+		}
+
+		ac_soapcalls_deliver(call);
+	}
+}
+
+/* */
+static void ac_soapcalls_run(void) {
+	uint64_t now = 0;
+	unsigned long count;
+	struct ac_soapcall* call;
+	struct ac_soapcall* batch;
+
+	capwap_lock_enter(&g_ac_soapcalls.lock);
+
+	for (;;) {
+		/* Batch complete or timeout of window */
+		if (g_ac_soapcalls.batchfirst) {
+			now = ac_soapcalls_gettime();
+			if ((g_ac_soapcalls.batchcount >= AC_SOAPCALLS_BATCH_MAX_CALLS) || (now >= g_ac_soapcalls.batchdeadline) || g_ac_soapcalls.endthread) {
+				batch = g_ac_soapcalls.batchfirst;
+				count = g_ac_soapcalls.batchcount;
+
+				g_ac_soapcalls.batchfirst = NULL;
+				g_ac_soapcalls.batchlast = NULL;
+				g_ac_soapcalls.batchcount = 0;
+				g_ac_soapcalls.batches++;
+				g_ac_soapcalls.batchcalls += count;
+
+				/* */
+				for (call = batch; call; call = call->next) {
+					call->status = AC_SOAPCALL_RUNNING;
+				}
+
+				capwap_lock_exit(&g_ac_soapcalls.lock);
+
+				ac_soapcalls_run_batch(batch, count);
+
+				capwap_lock_enter(&g_ac_soapcalls.lock);
+				continue;
+			}
+		}
+
+		call = g_ac_soapcalls.first;
+		if (!call) {
+			if (g_ac_soapcalls.batchfirst) {
+				/* Wait the end of window */
+				capwap_lock_exit(&g_ac_soapcalls.lock);
+				capwap_event_wait_timeout(&g_ac_soapcalls.wait, (long)(g_ac_soapcalls.batchdeadline - now));
+				capwap_lock_enter(&g_ac_soapcalls.lock);
+				continue;
+			} else if (g_ac_soapcalls.endthread) {
+				break;
+			}
+
+			/* Wait new call */
+			capwap_lock_exit(&g_ac_soapcalls.lock);
+			capwap_event_wait(&g_ac_soapcalls.wait);
+			capwap_lock_enter(&g_ac_soapcalls.lock);
+			continue;
+		}
+
+		/* Remove call from queue, wake up another thread for the next call */
+		g_ac_soapcalls.first = call->next;
+		if (!g_ac_soapcalls.first) {
+			g_ac_soapcalls.last = NULL;
+		} else {
+			capwap_event_signal(&g_ac_soapcalls.wait);
+		}
+
+		call->next = NULL;
+		call->status = AC_SOAPCALL_RUNNING;
+		capwap_lock_exit(&g_ac_soapcalls.lock);
+
+		/* */
+		ac_soapcalls_execute(call);
+		ac_soapcalls_deliver(call);
+
+		capwap_lock_enter(&g_ac_soapcalls.lock);
+	}
+
+	/* Wake up the others threads */
+	capwap_event_signal(&g_ac_soapcalls.wait);
+	capwap_lock_exit(&g_ac_soapcalls.lock);
+}
+
+/* */
+static void* ac_soapcalls_thread(void* param) {
+	log_printf(LOG_DEBUG, "SOAP call thread start");
+	ac_soapcalls_run();
+	log_printf(LOG_DEBUG, "SOAP call thread stop");
+
+	/* Thread exit */
+	pthread_exit(NULL);
+	return NULL;
+}
+
+/* */
+int ac_soapcalls_start(void) {
+	int result;
+	unsigned long i;
+
+	memset(&g_ac_soapcalls, 0, sizeof(struct ac_soapcalls_t));
+
+	/* Init */
+	capwap_event_init(&g_ac_soapcalls.wait);
+	capwap_lock_init(&g_ac_soapcalls.lock);
+
+	/* A thread for every connection of pool not reserved to the Backend Management Thread */
+	g_ac_soapcalls.count = g_ac.backendpoolconnections - g_ac.backendpoolreserved;
+	g_ac_soapcalls.threads = (pthread_t*)capwap_alloc(sizeof(pthread_t) * g_ac_soapcalls.count);
+
+	for (i = 0; i < g_ac_soapcalls.count; i++) {
+		result = pthread_create(&g_ac_soapcalls.threads[i], NULL, ac_soapcalls_thread, NULL);
+		if (result) {
+			log_printf(LOG_ERR, "Unable create SOAP call thread, error code %d", result);
+
+			/* Release only the started threads */
+			g_ac_soapcalls.count = i;
+			ac_soapcalls_stop();
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+/* The queued calls are executed before the threads terminate */
+void ac_soapcalls_stop(void) {
+	void* dummy;
+	unsigned long i;
+
+	/* */
+	capwap_lock_enter(&g_ac_soapcalls.lock);
+	g_ac_soapcalls.endthread = 1;
+	capwap_lock_exit(&g_ac_soapcalls.lock);
+	capwap_event_signal(&g_ac_soapcalls.wait);
+
+	/* */
+	for (i = 0; i < g_ac_soapcalls.count; i++) {
+		pthread_join(g_ac_soapcalls.threads[i], &dummy);
+	}
+
+	/* */
+	if (g_ac_soapcalls.batches) {
+		log_printf(LOG_INFO, "SOAP calls: %lu station authorizations sent into %lu batches", g_ac_soapcalls.batchcalls, g_ac_soapcalls.batches);
+	}
+
+	/* Free memory */
+	ASSERT(g_ac_soapcalls.first == NULL);
+	ASSERT(g_ac_soapcalls.batchfirst == NULL);
+	capwap_event_destroy(&g_ac_soapcalls.wait);
+	capwap_lock_destroy(&g_ac_soapcalls.lock);
+	capwap_free(g_ac_soapcalls.threads);
+
+	memset(&g_ac_soapcalls, 0, sizeof(struct ac_soapcalls_t));
+}
+
+/* Queue a SOAP call. Without completion the call is not bound to session, otherwise
+   the session can have only one call with completion */
+int ac_soapcalls_submit(struct ac_session_t* session, ac_soapcall_complete complete, const void* context, long length, int batch, char* method, int numparam, va_list listparam) {
+	int i;
+	struct ac_soapcall* call;
+
+	ASSERT(method != NULL);
+	ASSERT(length >= 0);
+
+	/* The session can not be released until the completion is delivered */
+	if (complete) {
+		ASSERT(session != NULL);
+		ASSERT(session->soapcall == NULL);
+
+		if (!ac_session_acquire_reference(session)) {
+			return 0;
+		}
+	}
+
+	/* */
+	call = (struct ac_soapcall*)capwap_alloc(sizeof(struct ac_soapcall) + length);
+	memset(call, 0, sizeof(struct ac_soapcall));
+	call->session = (complete ? session : NULL);
+	call->complete = complete;
+	call->status = AC_SOAPCALL_QUEUED;
+	call->batch = batch;
+	call->method = capwap_duplicate_string(method);
+
+	/* Copy params */
+	call->numparam = numparam;
+	if (numparam > 0) {
+		call->params = (char**)capwap_alloc(sizeof(char*) * numparam * 3);
+		for (i = 0; i < (numparam * 3); i++) {
+			call->params[i] = capwap_duplicate_string(va_arg(listparam, char*));
+		}
+	}
+
+	/* */
+	call->length = length;
+	if (length > 0) {
+		ASSERT(context != NULL);
+		memcpy(call->context, context, length);
+	}
+
+	if (complete) {
+		session->soapcall = call;
+	}
+
+	/* Append to queue */
+	capwap_lock_enter(&g_ac_soapcalls.lock);
+
+	if (call->batch && (ac_soapcalls_gettime() >= g_ac_soapcalls.nobatchdeadline)) {
+		if (g_ac_soapcalls.batchlast) {
+			g_ac_soapcalls.batchlast->next = call;
+		} else {
+			g_ac_soapcalls.batchfirst = call;
+			g_ac_soapcalls.batchdeadline = ac_soapcalls_gettime() + AC_SOAPCALLS_BATCH_WINDOW;
+		}
+
+		g_ac_soapcalls.batchlast = call;
+		g_ac_soapcalls.batchcount++;
+	} else {
+		if (g_ac_soapcalls.last) {
+			g_ac_soapcalls.last->next = call;
+		} else {
+			g_ac_soapcalls.first = call;
+		}
+
+		g_ac_soapcalls.last = call;
+	}
+
+	capwap_lock_exit(&g_ac_soapcalls.lock);
+
+	capwap_event_signal(&g_ac_soapcalls.wait);
+	return 1;
+}
+
+/* Execute the completion of call, called by session owner. The completion
+   of canceled call is not executed */
+void ac_soapcalls_complete(struct ac_session_t* session, struct ac_soapcall* call) {
+	ASSERT(session != NULL);
+	ASSERT(call != NULL);
+
+	if (session->soapcall == call) {
+		session->soapcall = NULL;
+		call->complete(session, call->response, ((call->length > 0) ? (void*)call->context : NULL));
+	}
+
+	ac_soapcalls_free(call);
+}
+
+/* Execute the completion of call not queued to session */
+int ac_soapcalls_poll(struct ac_session_t* session) {
+	int lost;
+	struct ac_soapcall* call;
+
+	ASSERT(session != NULL);
+
+	call = session->soapcall;
+	if (!call) {
+		return 0;
+	}
+
+	/* */
+	capwap_lock_enter(&g_ac_soapcalls.lock);
+	lost = ((call->status == AC_SOAPCALL_LOST) ? 1 : 0);
+	capwap_lock_exit(&g_ac_soapcalls.lock);
+
+	if (lost) {
+		if (call->response) {
+			ac_soapclient_free_response(call->response);
+			call->response = NULL;
+		}
+
+		ac_soapcalls_complete(session, call);
+	}
+
+	return lost;
+}
+
+/* Cancel the call with completion of session, a running call is aborted */
+void ac_soapcalls_cancel(struct ac_session_t* session) {
+	struct ac_soapcall* prev = NULL;
+	struct ac_soapcall* search;
+	struct ac_soapcall* call;
+
+	ASSERT(session != NULL);
+
+	call = session->soapcall;
+	if (!call) {
+		return;
+	}
+
+	/* */
+	session->soapcall = NULL;
+	capwap_lock_enter(&g_ac_soapcalls.lock);
+
+	if (call->status == AC_SOAPCALL_QUEUED) {
+		search = g_ac_soapcalls.first;
+		while (search) {
+			if (search == call) {
+				if (prev) {
+					prev->next = call->next;
+				} else {
+					g_ac_soapcalls.first = call->next;
+				}
+
+				if (g_ac_soapcalls.last == call) {
+					g_ac_soapcalls.last = prev;
+				}
+
+				break;
+			}
+
+			prev = search;
+			search = search->next;
+		}
+
+		/* Call waiting for batch */
+		if (!search) {
+			prev = NULL;
+			search = g_ac_soapcalls.batchfirst;
+			while (search) {
+				if (search == call) {
+					if (prev) {
+						prev->next = call->next;
+					} else {
+						g_ac_soapcalls.batchfirst = call->next;
+					}
+
+					if (g_ac_soapcalls.batchlast == call) {
+						g_ac_soapcalls.batchlast = prev;
+					}
+
+					g_ac_soapcalls.batchcount--;
+					break;
+				}
+
+				prev = search;
+				search = search->next;
+			}
+		}
+	} else {
+		/* The running call is released by its thread, the completion already
+		   delivered is released with the actions of session */
+		if (call->status == AC_SOAPCALL_RUNNING) {
+			call->cancel = 1;
+			if (call->soaprequest) {
+				ac_soapclient_shutdown_request(call->soaprequest);
+			}
+
+			call = NULL;
+		} else if (call->status == AC_SOAPCALL_DONE) {
+			call = NULL;
+		}
+	}
+
+	capwap_lock_exit(&g_ac_soapcalls.lock);
+
+	/* The reference of session is released by the thread of lost call */
+	if (call) {
+		if (call->status == AC_SOAPCALL_QUEUED) {
+			ac_session_release_reference(session);
+		}
+
+		ac_soapcalls_free(call);
+	}
+}
+
+/* */
+void ac_soapcalls_free(struct ac_soapcall* call) {
+	int i;
+
+	ASSERT(call != NULL);
+
+	if (call->params) {
+		for (i = 0; i < (call->numparam * 3); i++) {
+			capwap_free(call->params[i]);
+		}
+
+		capwap_free(call->params);
+	}
+
+	if (call->response) {
+		ac_soapclient_free_response(call->response);
+	}
+
+	capwap_free(call->method);
+	capwap_free(call);
+}
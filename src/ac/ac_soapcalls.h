@@ -0,0 +1,58 @@
+#ifndef __AC_SOAPCALLS_HEADER__
+#define __AC_SOAPCALLS_HEADER__
+
+#include <stdarg.h>
+
+/* Batch of station authorizations, the calls queued within window are sent as a single request */
+#define AC_SOAPCALLS_BATCH_WINDOW				20
+#define AC_SOAPCALLS_BATCH_MAX_CALLS			64
+#define AC_SOAPCALLS_BATCH_RETRY_INTERVAL		600000		/* Retry of batch after the Backend refused it */
+
+/* Status of call */
+#define AC_SOAPCALL_QUEUED						0
+#define AC_SOAPCALL_RUNNING						1
+#define AC_SOAPCALL_DONE						2
+#define AC_SOAPCALL_LOST						3		/* Completion not queued to session */
+
+/* */
+struct ac_session_t;
+struct ac_soap_response;
+
+/* Completion of call, executed by session owner. The response is NULL if the call failed */
+typedef void (*ac_soapcall_complete)(struct ac_session_t* session, struct ac_soap_response* response, void* context);
+
+/* */
+struct ac_soapcall {
+	struct ac_session_t* session;						/* NULL without completion */
+	ac_soapcall_complete complete;
+	int status;
+	int cancel;
+	int batch;											/* Call can be merged into a batched request */
+
+	/* Request */
+	char* method;
+	int numparam;
+	char** params;										/* Type, name and value of each param */
+	struct ac_http_soap_request* soaprequest;
+
+	/* */
+	struct ac_soap_response* response;
+	struct ac_soapcall* next;
+
+	/* Context of completion */
+	long length;
+	char context[0];
+};
+
+/* */
+int ac_soapcalls_start(void);
+void ac_soapcalls_stop(void);
+
+/* */
+int ac_soapcalls_submit(struct ac_session_t* session, ac_soapcall_complete complete, const void* context, long length, int batch, char* method, int numparam, va_list listparam);
+void ac_soapcalls_complete(struct ac_session_t* session, struct ac_soapcall* call);
+int ac_soapcalls_poll(struct ac_session_t* session);
+void ac_soapcalls_cancel(struct ac_session_t* session);
+void ac_soapcalls_free(struct ac_soapcall* call);
+
+#endif /* __AC_SOAPCALLS_HEADER__ */
@@ -0,0 +1,282 @@
+#include "ac.h"
+#include "ac_stationcache.h"
+#include <time.h>
+
+/* Cache of station authorizations, shared by all sessions */
+struct ac_stationcache_t {
+	capwap_lock_t lock;
+
+	struct capwap_hash* entries;
+	struct ac_stationcache_entry* first;
+	struct ac_stationcache_entry* last;
+	unsigned long generation;
+
+	/* Statistics */
+	unsigned long hits;
+	unsigned long misses;
+	unsigned long expirations;
+	unsigned long evictions;
+	unsigned long invalidations;
+	unsigned long discards;
+};
+
+static struct ac_stationcache_t g_ac_stationcache;
+
+/* */
+static uint64_t ac_stationcache_gettime(void) {
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return ((uint64_t)now.tv_sec * 1000) + (uint64_t)(now.tv_nsec / 1000000);
+}
+
+/* */
+static unsigned long ac_stationcache_item_gethash(const void* key, unsigned long hashsize) {
+	int i;
+	unsigned long hash = 5381;
+	const struct ac_stationcache_key* cachekey = (const struct ac_stationcache_key*)key;
+
+	for (i = 0; i < MACADDRESS_EUI48_LENGTH; i++) {
+		hash = ((hash << 5) + hash) + cachekey->address[i];
+	}
+
+	for (i = 0; cachekey->ssid[i]; i++) {
+		hash = ((hash << 5) + hash) + (uint8_t)cachekey->ssid[i];
+	}
+
+	for (i = 0; cachekey->wtpid[i]; i++) {
+		hash = ((hash << 5) + hash) + (uint8_t)cachekey->wtpid[i];
+	}
+
+	return hash % hashsize;
+}
+
+/* */
+static const void* ac_stationcache_item_getkey(const void* data) {
+	return (const void*)&((struct ac_stationcache_entry*)data)->key;
+}
+
+/* */
+static int ac_stationcache_item_cmp(const void* key1, const void* key2) {
+	return memcmp(key1, key2, sizeof(struct ac_stationcache_key));
+}
+
+/* */
+static void ac_stationcache_item_free(void* data) {
+	capwap_free(data);
+}
+
+/* */
+static int ac_stationcache_setkey(struct ac_stationcache_key* key, const char* wtpid, const char* ssid, const uint8_t* address) {
+	if ((strlen(ssid) > IEEE80211_SSID_MAX_LENGTH) || (strlen(wtpid) >= CAPWAP_MACADDRESS_EUI64_BUFFER)) {
+		return 0;
+	}
+
+	memset(key, 0, sizeof(struct ac_stationcache_key));
+	memcpy(key->address, address, MACADDRESS_EUI48_LENGTH);
+	strcpy(key->ssid, ssid);
+	strcpy(key->wtpid, wtpid);
+	return 1;
+}
+
+/* */
+static void ac_stationcache_unlink(struct ac_stationcache_entry* entry) {
+	if (entry->prev) {
+		entry->prev->next = entry->next;
+	} else {
+		g_ac_stationcache.first = entry->next;
+	}
+
+	if (entry->next) {
+		entry->next->prev = entry->prev;
+	} else {
+		g_ac_stationcache.last = entry->prev;
+	}
+
+	entry->prev = NULL;
+	entry->next = NULL;
+}
+
+/* */
+static void ac_stationcache_link(struct ac_stationcache_entry* entry) {
+	entry->prev = NULL;
+	entry->next = g_ac_stationcache.first;
+	if (g_ac_stationcache.first) {
+		g_ac_stationcache.first->prev = entry;
+	} else {
+		g_ac_stationcache.last = entry;
+	}
+
+	g_ac_stationcache.first = entry;
+}
+
+/* */
+static void ac_stationcache_delete(struct ac_stationcache_entry* entry) {
+	struct ac_stationcache_key key;
+
+	/* The entry is released by hash */
+	memcpy(&key, &entry->key, sizeof(struct ac_stationcache_key));
+	ac_stationcache_unlink(entry);
+	capwap_hash_delete(g_ac_stationcache.entries, &key);
+}
+
+/* */
+void ac_stationcache_init(void) {
+	memset(&g_ac_stationcache, 0, sizeof(struct ac_stationcache_t));
+
+	capwap_lock_init(&g_ac_stationcache.lock);
+	g_ac_stationcache.entries = capwap_hash_create(AC_STATIONCACHE_HASH_SIZE);
+	g_ac_stationcache.entries->item_gethash = ac_stationcache_item_gethash;
+	g_ac_stationcache.entries->item_getkey = ac_stationcache_item_getkey;
+	g_ac_stationcache.entries->item_cmp = ac_stationcache_item_cmp;
+	g_ac_stationcache.entries->item_free = ac_stationcache_item_free;
+}
+
+/* */
+void ac_stationcache_free(void) {
+	if (g_ac_stationcache.hits || g_ac_stationcache.misses) {
+		log_printf(LOG_INFO, "Station authorization cache: %lu hits, %lu misses, %lu expirations, %lu evictions, %lu invalidations, %lu discards",
+			g_ac_stationcache.hits, g_ac_stationcache.misses, g_ac_stationcache.expirations, g_ac_stationcache.evictions, g_ac_stationcache.invalidations, g_ac_stationcache.discards);
+	}
+
+	capwap_hash_free(g_ac_stationcache.entries);
+	capwap_lock_destroy(&g_ac_stationcache.lock);
+}
+
+/* Retrieve the decision of Backend, return 0 if the station must be authorized by Backend */
+int ac_stationcache_get(const char* wtpid, const char* ssid, const uint8_t* address, struct ac_stationcache_decision* decision) {
+	int result = 0;
+	struct ac_stationcache_key key;
+	struct ac_stationcache_entry* entry;
+
+	ASSERT(wtpid != NULL);
+	ASSERT(ssid != NULL);
+	ASSERT(address != NULL);
+	ASSERT(decision != NULL);
+
+	if (!g_ac.stationcachesize || !ac_stationcache_setkey(&key, wtpid, ssid, address)) {
+		return 0;
+	}
+
+	/* */
+	capwap_lock_enter(&g_ac_stationcache.lock);
+
+	entry = (struct ac_stationcache_entry*)capwap_hash_search(g_ac_stationcache.entries, &key);
+	if (entry && (entry->expire <= ac_stationcache_gettime())) {
+		ac_stationcache_delete(entry);
+		g_ac_stationcache.expirations++;
+		entry = NULL;
+	}
+
+	if (entry) {
+		memset(decision, 0, sizeof(struct ac_stationcache_decision));
+		decision->authorized = entry->authorized;
+		decision->ifdatachannel = entry->ifdatachannel;
+		decision->vlan = entry->vlan;
+		strcpy(decision->wtpvlan, entry->wtpvlan);
+
+		/* Most recently used */
+		ac_stationcache_unlink(entry);
+		ac_stationcache_link(entry);
+
+		g_ac_stationcache.hits++;
+		result = 1;
+	} else {
+		g_ac_stationcache.misses++;
+	}
+
+	capwap_lock_exit(&g_ac_stationcache.lock);
+
+	return result;
+}
+
+/* Save the decision of Backend, the denied authorization expires first */
+void ac_stationcache_set(const char* wtpid, const char* ssid, const uint8_t* address, const struct ac_stationcache_decision* decision, unsigned long generation) {
+	struct ac_stationcache_key key;
+	struct ac_stationcache_entry* entry;
+
+	ASSERT(wtpid != NULL);
+	ASSERT(ssid != NULL);
+	ASSERT(address != NULL);
+	ASSERT(decision != NULL);
+
+	if (!g_ac.stationcachesize || !ac_stationcache_setkey(&key, wtpid, ssid, address)) {
+		return;
+	}
+
+	/* */
+	capwap_lock_enter(&g_ac_stationcache.lock);
+
+	/* The decision was invalidated while the request was in flight */
+	if (generation != g_ac_stationcache.generation) {
+		g_ac_stationcache.discards++;
+		capwap_lock_exit(&g_ac_stationcache.lock);
+		return;
+	}
+
+	entry = (struct ac_stationcache_entry*)capwap_hash_search(g_ac_stationcache.entries, &key);
+	if (entry) {
+		ac_stationcache_unlink(entry);
+	} else {
+		/* Evict the least recently used */
+		if (g_ac_stationcache.entries->count >= g_ac.stationcachesize) {
+			ac_stationcache_delete(g_ac_stationcache.last);
+			g_ac_stationcache.evictions++;
+		}
+
+		entry = (struct ac_stationcache_entry*)capwap_alloc(sizeof(struct ac_stationcache_entry));
+		memset(entry, 0, sizeof(struct ac_stationcache_entry));
+		memcpy(&entry->key, &key, sizeof(struct ac_stationcache_key));
+		capwap_hash_add(g_ac_stationcache.entries, (void*)entry);
+	}
+
+	/* */
+	entry->expire = ac_stationcache_gettime() + (uint64_t)(decision->authorized ? g_ac.stationcachetimeout : g_ac.stationcachedeniedtimeout) * 1000;
+	entry->authorized = decision->authorized;
+	entry->ifdatachannel = decision->ifdatachannel;
+	entry->vlan = decision->vlan;
+	strcpy(entry->wtpvlan, decision->wtpvlan);
+	ac_stationcache_link(entry);
+
+	capwap_lock_exit(&g_ac_stationcache.lock);
+}
+
+/* */
+unsigned long ac_stationcache_invalidate(const char* ssid, const uint8_t* address) {
+	unsigned long count = 0;
+	struct ac_stationcache_entry* entry;
+	struct ac_stationcache_entry* next;
+
+	capwap_lock_enter(&g_ac_stationcache.lock);
+
+	/* The decisions of station are bound to each WTP */
+	entry = g_ac_stationcache.first;
+	while (entry) {
+		next = entry->next;
+
+		/* */
+		if ((!ssid || !strcmp(entry->key.ssid, ssid)) && (!address || !memcmp(entry->key.address, address, MACADDRESS_EUI48_LENGTH))) {
+			ac_stationcache_delete(entry);
+			count++;
+		}
+
+		entry = next;
+	}
+
+	g_ac_stationcache.generation++;
+	g_ac_stationcache.invalidations += count;
+	capwap_lock_exit(&g_ac_stationcache.lock);
+
+	return count;
+}
+
+/* */
+unsigned long ac_stationcache_getgeneration(void) {
+	unsigned long generation;
+
+	capwap_lock_enter(&g_ac_stationcache.lock);
+	generation = g_ac_stationcache.generation;
+	capwap_lock_exit(&g_ac_stationcache.lock);
+
+	return generation;
+}
@@ -0,0 +1,58 @@
+#ifndef __AC_STATIONCACHE_HEADER__
+#define __AC_STATIONCACHE_HEADER__
+
+#include "capwap_element_addstation.h"
+#include "ieee80211.h"
+
+/* */
+#define AC_STATIONCACHE_HASH_SIZE				1024
+
+/* Authorization of station received from Backend */
+struct ac_stationcache_decision {
+	int authorized;
+	unsigned long ifdatachannel;						/* Data channel interface index of Backend */
+	uint16_t vlan;										/* VLAN of station into AC */
+	char wtpvlan[CAPWAP_ADDSTATION_VLAN_MAX_LENGTH];	/* VLAN of station into WTP, empty without VLAN */
+};
+
+/* Decisions of Backend for the station which reassociate to a WLAN of a WTP, the
+   entries expire after timeout and the least recently used are evicted. The Backend
+   can take different decisions for the same station and SSID on different WTPs, a
+   decision is never shared between WTPs. The Backend invalidates the entries with
+   the events of waitBackendEvent */
+struct ac_stationcache_key {
+	uint8_t address[MACADDRESS_EUI48_LENGTH];
+	char ssid[IEEE80211_SSID_MAX_LENGTH + 1];
+	char wtpid[CAPWAP_MACADDRESS_EUI64_BUFFER];
+};
+
+struct ac_stationcache_entry {
+	struct ac_stationcache_key key;
+	uint64_t expire;
+
+	int authorized;
+	unsigned long ifdatachannel;
+	uint16_t vlan;
+	char wtpvlan[CAPWAP_ADDSTATION_VLAN_MAX_LENGTH];
+
+	/* LRU list, the first is the most recently used */
+	struct ac_stationcache_entry* prev;
+	struct ac_stationcache_entry* next;
+};
+
+/* */
+void ac_stationcache_init(void);
+void ac_stationcache_free(void);
+
+/* */
+int ac_stationcache_get(const char* wtpid, const char* ssid, const uint8_t* address, struct ac_stationcache_decision* decision);
+void ac_stationcache_set(const char* wtpid, const char* ssid, const uint8_t* address, const struct ac_stationcache_decision* decision, unsigned long generation);
+
+/* Generation of cache, changed by any invalidation. A decision requested before an
+   invalidation is not cached */
+unsigned long ac_stationcache_getgeneration(void);
+
+/* Remove the decisions of station and/or WLAN on every WTP, NULL for any */
+unsigned long ac_stationcache_invalidate(const char* ssid, const uint8_t* address);
+
+#endif /* __AC_STATIONCACHE_HEADER__ */
@@ -0,0 +1,115 @@
+#include "ac.h"
+#include "capwap_dfa.h"
+#include "ac_session.h"
+#include "ac_timers.h"
+#include <sys/timerfd.h>
+
+/* Timer service shared by all the sessions: one timing wheel, one
+   timerfd armed to the closest expiration and one thread which moves
+   the expired timers to the sessions and wakes them up */
+struct ac_timers_t {
+	pthread_t threadid;
+	int endthread;
+
+	int timerfd;
+	struct capwap_timeout_wheel* wheel;
+};
+
+static struct ac_timers_t g_ac_timers;
+
+/* Called with wheel lock held */
+static void ac_timers_arm(struct capwap_timeout_wheel* wheel, uint64_t expire, void* param) {
+	struct itimerspec timer;
+
+	/* A zero expiration disarm timerfd */
+	memset(&timer, 0, sizeof(struct itimerspec));
+	timer.it_value.tv_sec = (time_t)(expire / 1000);
+	timer.it_value.tv_nsec = (long)(expire % 1000) * 1000000;
+	if (timerfd_settime(g_ac_timers.timerfd, TFD_TIMER_ABSTIME, &timer, NULL)) {
+		log_printf(LOG_ERR, "Unable to arm sessions timer, error code %d", errno);
+	}
+}
+
+/* Called with wheel lock held */
+static void ac_timers_notify(struct capwap_timeout* timeout, void* param) {
+	ac_session_wakeup((struct ac_session_t*)param);
+}
+
+/* */
+static void* ac_timers_thread(void* param) {
+	ssize_t result;
+	uint64_t expirations;
+
+	log_printf(LOG_DEBUG, "Sessions timer start");
+
+	while (!g_ac_timers.endthread) {
+		result = read(g_ac_timers.timerfd, &expirations, sizeof(uint64_t));
+		if ((result < 0) && (errno != EINTR) && (errno != EAGAIN)) {
+			log_printf(LOG_ERR, "Unable to read sessions timer, error code %d", errno);
+			break;
+		}
+
+		/* */
+		capwap_timeout_wheel_process(g_ac_timers.wheel);
+	}
+
+	log_printf(LOG_DEBUG, "Sessions timer stop");
+
+	/* Thread exit */
+	pthread_exit(NULL);
+	return NULL;
+}
+
+/* */
+int ac_timers_start(void) {
+	int result;
+
+	memset(&g_ac_timers, 0, sizeof(struct ac_timers_t));
+
+	/* */
+	g_ac_timers.timerfd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+	if (g_ac_timers.timerfd < 0) {
+		log_printf(LOG_ERR, "Unable create sessions timer, error code %d", errno);
+		return 0;
+	}
+
+	g_ac_timers.wheel = capwap_timeout_wheel_create(ac_timers_arm, NULL);
+
+	/* */
+	result = pthread_create(&g_ac_timers.threadid, NULL, ac_timers_thread, NULL);
+	if (result) {
+		log_printf(LOG_ERR, "Unable create sessions timer thread, error code %d", result);
+		capwap_timeout_wheel_free(g_ac_timers.wheel);
+		close(g_ac_timers.timerfd);
+		return 0;
+	}
+
+	return 1;
+}
+
+/* Stop timer service, all the sessions must be already released */
+void ac_timers_stop(void) {
+	void* dummy;
+	struct itimerspec timer;
+
+	/* Wake up the thread with an immediate expiration */
+	g_ac_timers.endthread = 1;
+	memset(&timer, 0, sizeof(struct itimerspec));
+	timer.it_value.tv_nsec = 1;
+	timerfd_settime(g_ac_timers.timerfd, 0, &timer, NULL);
+
+	pthread_join(g_ac_timers.threadid, &dummy);
+
+	/* */
+	capwap_timeout_wheel_free(g_ac_timers.wheel);
+	close(g_ac_timers.timerfd);
+	memset(&g_ac_timers, 0, sizeof(struct ac_timers_t));
+}
+
+/* The timers of session are delivered waking up the session */
+struct capwap_timeout* ac_timers_create_timeout(struct ac_session_t* session) {
+	ASSERT(session != NULL);
+	ASSERT(g_ac_timers.wheel != NULL);
+
+	return capwap_timeout_init_shared(g_ac_timers.wheel, ac_timers_notify, (void*)session);
+}
@@ -0,0 +1,11 @@
+#ifndef __AC_TIMERS_HEADER__
+#define __AC_TIMERS_HEADER__
+
+/* */
+int ac_timers_start(void);
+void ac_timers_stop(void);
+
+/* */
+struct capwap_timeout* ac_timers_create_timeout(struct ac_session_t* session);
+
+#endif /* __AC_TIMERS_HEADER__ */
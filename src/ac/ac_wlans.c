@@ -375,6 +375,9 @@ struct ac_station* ac_stations_create_station(struct ac_session_t* session, uint
 		authoritativestation = (struct ac_station*)capwap_hash_search(g_ac.authstations, address);
 		if (authoritativestation && authoritativestation->session) {
 			authoritativesession = authoritativestation->session;
+			if ((authoritativesession != session) && !ac_session_acquire_reference(authoritativesession)) {
+				authoritativesession = NULL;
+			}
 		}
 
 		capwap_rwlock_unlock(&g_ac.authstationslock);
@@ -389,6 +392,7 @@ struct ac_station* ac_stations_create_station(struct ac_session_t* session, uint
 			/* Release Station from old Authoritative Session */
 			if (authoritativesession) {
 				ac_session_send_action(authoritativesession, AC_SESSION_ACTION_STATION_ROAMING, 0, (void*)address, MACADDRESS_EUI48_LENGTH);
+				ac_session_release_reference(authoritativesession);
 			}
 		}
 	} else {
@@ -430,7 +434,9 @@ void ac_stations_authorize_station(struct ac_session_t* session, struct ac_stati
 		notify.supportedratescount = station->supportedratescount;
 		memcpy(notify.supportedrates, station->supportedrates, station->supportedratescount);
 
-		ac_session_send_action(session, AC_SESSION_ACTION_STATION_CONFIGURATION_IEEE80211_ADD_STATION, 0, &notify, sizeof(struct ac_notify_station_configuration_ieee8011_add_station));
+		if (!ac_session_send_action(session, AC_SESSION_ACTION_STATION_CONFIGURATION_IEEE80211_ADD_STATION, 0, &notify, sizeof(struct ac_notify_station_configuration_ieee8011_add_station))) {
+			log_printf(LOG_WARNING, "Unable to authorize station, session is too busy");
+		}
 	}
 }
 
@@ -453,7 +459,9 @@ void ac_stations_deauthorize_station(struct ac_session_t* session, struct ac_sta
 
 		/* */
 		station->flags &= ~(AC_STATION_FLAGS_AUTHENTICATED | AC_STATION_FLAGS_ASSOCIATE | AC_STATION_FLAGS_AUTHORIZED);
-		ac_session_send_action(session, AC_SESSION_ACTION_STATION_CONFIGURATION_IEEE80211_DELETE_STATION, 0, &notify, sizeof(struct ac_notify_station_configuration_ieee8011_delete_station));
+		if (!ac_session_send_action(session, AC_SESSION_ACTION_STATION_CONFIGURATION_IEEE80211_DELETE_STATION, 0, &notify, sizeof(struct ac_notify_station_configuration_ieee8011_delete_station))) {
+			log_printf(LOG_WARNING, "Unable to deauthorize station, session is too busy");
+		}
 	} else if (station->flags & AC_STATION_FLAGS_AUTHENTICATED) {
 		/* Create deauthentication packet */
 		memset(&ieee80211_params, 0, sizeof(struct ieee80211_deauthentication_params));
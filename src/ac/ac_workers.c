@@ -0,0 +1,276 @@
+#include "ac.h"
+#include "capwap_dfa.h"
+#include "ac_session.h"
+#include "ac_workers.h"
+
+/* */
+struct ac_worker {
+	pthread_t threadid;
+	int endthread;
+
+	capwap_event_t wait;
+	capwap_lock_t lock;
+
+	/* Sessions owned by worker */
+	struct capwap_list* sessions;
+
+	/* Sessions with pending work, the expired timers are notified by the timer service */
+	struct ac_session_t* runfirst;
+	struct ac_session_t* runlast;
+
+	/* Shared packet buffer of worker sessions */
+	char buffer[CAPWAP_MAX_PACKET_SIZE];
+};
+
+/* */
+struct ac_workers_t {
+	unsigned long count;
+	struct ac_worker* workers;
+};
+
+static struct ac_workers_t g_ac_workers;
+
+/* Append session to run queue, require worker lock */
+static void ac_worker_enqueue_session(struct ac_worker* worker, struct ac_session_t* session) {
+	if (!session->workerscheduled) {
+		session->workerscheduled = 1;
+		session->workernext = NULL;
+
+		if (worker->runlast) {
+			worker->runlast->workernext = session;
+		} else {
+			worker->runfirst = session;
+		}
+
+		worker->runlast = session;
+	}
+}
+
+/* Remove session from run queue, require worker lock */
+static void ac_worker_dequeue_session(struct ac_worker* worker, struct ac_session_t* session) {
+	struct ac_session_t* prev = NULL;
+	struct ac_session_t* search = worker->runfirst;
+
+	if (!session->workerscheduled) {
+		return;
+	}
+
+	while (search) {
+		if (search == session) {
+			if (prev) {
+				prev->workernext = session->workernext;
+			} else {
+				worker->runfirst = session->workernext;
+			}
+
+			if (worker->runlast == session) {
+				worker->runlast = prev;
+			}
+
+			break;
+		}
+
+		prev = search;
+		search = search->workernext;
+	}
+
+	session->workerscheduled = 0;
+	session->workernext = NULL;
+}
+
+/* */
+static void ac_worker_release_session(struct ac_worker* worker, struct ac_session_t* session) {
+	/* Detach session from worker, the session will not be scheduled anymore */
+	capwap_lock_enter(&worker->lock);
+	ac_worker_dequeue_session(worker, session);
+	capwap_itemlist_free(capwap_itemlist_remove(worker->sessions, session->workeritem));
+	session->workeritem = NULL;
+	capwap_lock_exit(&worker->lock);
+
+	/* */
+	log_printf(LOG_DEBUG, "Session end");
+	ac_session_finish(session);
+}
+
+/* */
+static void ac_worker_run(struct ac_worker* worker) {
+	struct ac_session_t* session;
+
+	capwap_lock_enter(&worker->lock);
+
+	while (!worker->endthread || (worker->sessions->count > 0)) {
+		session = worker->runfirst;
+		if (session) {
+			/* Remove session from run queue */
+			worker->runfirst = session->workernext;
+			if (!worker->runfirst) {
+				worker->runlast = NULL;
+			}
+
+			session->workernext = NULL;
+			session->workerscheduled = 0;
+			capwap_lock_exit(&worker->lock);
+
+			/* Execute session */
+			if (ac_session_process(session, worker->buffer, sizeof(worker->buffer))) {
+				ac_worker_release_session(worker, session);
+				capwap_lock_enter(&worker->lock);
+			} else {
+				capwap_lock_enter(&worker->lock);
+			}
+
+			continue;
+		}
+
+		/* Wait new work */
+		capwap_lock_exit(&worker->lock);
+		capwap_event_wait(&worker->wait);
+		capwap_lock_enter(&worker->lock);
+	}
+
+	capwap_lock_exit(&worker->lock);
+}
+
+/* */
+static void* ac_worker_thread(void* param) {
+	struct ac_worker* worker = (struct ac_worker*)param;
+
+	ASSERT(param != NULL);
+
+	/* */
+	log_printf(LOG_DEBUG, "Worker start");
+	ac_worker_run(worker);
+	log_printf(LOG_DEBUG, "Worker stop");
+
+	/* Thread exit */
+	pthread_exit(NULL);
+	return NULL;
+}
+
+/* */
+int ac_workers_start(void) {
+	int result;
+	long cpus;
+	unsigned long i;
+
+	memset(&g_ac_workers, 0, sizeof(struct ac_workers_t));
+
+	/* Number of workers */
+	if (!g_ac.sessionsworkers) {
+		cpus = sysconf(_SC_NPROCESSORS_ONLN);
+		g_ac_workers.count = ((cpus > 0) ? (unsigned long)cpus : 1);
+	} else {
+		g_ac_workers.count = g_ac.sessionsworkers;
+	}
+
+	/* */
+	g_ac_workers.workers = (struct ac_worker*)capwap_alloc(sizeof(struct ac_worker) * g_ac_workers.count);
+	memset(g_ac_workers.workers, 0, sizeof(struct ac_worker) * g_ac_workers.count);
+
+	for (i = 0; i < g_ac_workers.count; i++) {
+		struct ac_worker* worker = &g_ac_workers.workers[i];
+
+		/* Init */
+		capwap_event_init(&worker->wait);
+		capwap_lock_init(&worker->lock);
+		worker->sessions = capwap_list_create();
+
+		/* Create thread */
+		result = pthread_create(&worker->threadid, NULL, ac_worker_thread, (void*)worker);
+		if (result) {
+			log_printf(LOG_ERR, "Unable create worker thread, error code %d", result);
+
+			/* Release only the started workers */
+			capwap_event_destroy(&worker->wait);
+			capwap_lock_destroy(&worker->lock);
+			capwap_list_free(worker->sessions);
+			g_ac_workers.count = i;
+			ac_workers_stop();
+			return 0;
+		}
+	}
+
+	log_printf(LOG_INFO, "Started %lu session workers", g_ac_workers.count);
+	return 1;
+}
+
+/* */
+void ac_workers_stop(void) {
+	void* dummy;
+	unsigned long i;
+
+	/* Workers terminate when all owned sessions are released */
+	for (i = 0; i < g_ac_workers.count; i++) {
+		struct ac_worker* worker = &g_ac_workers.workers[i];
+
+		capwap_lock_enter(&worker->lock);
+		worker->endthread = 1;
+		capwap_lock_exit(&worker->lock);
+		capwap_event_signal(&worker->wait);
+	}
+
+	/* */
+	for (i = 0; i < g_ac_workers.count; i++) {
+		struct ac_worker* worker = &g_ac_workers.workers[i];
+
+		pthread_join(worker->threadid, &dummy);
+
+		/* Free memory */
+		ASSERT(worker->sessions->count == 0);
+		capwap_event_destroy(&worker->wait);
+		capwap_lock_destroy(&worker->lock);
+		capwap_list_free(worker->sessions);
+	}
+
+	/* */
+	if (g_ac_workers.workers) {
+		capwap_free(g_ac_workers.workers);
+	}
+
+	memset(&g_ac_workers, 0, sizeof(struct ac_workers_t));
+}
+
+/* Bind the session to the less loaded worker */
+void ac_workers_assign_session(struct ac_session_t* session) {
+	unsigned long i;
+	struct ac_worker* worker;
+	struct capwap_list_item* itemlist;
+
+	ASSERT(session != NULL);
+	ASSERT(g_ac_workers.count > 0);
+
+	/* The sessions count is read without lock, a stale value only affects balancing */
+	worker = &g_ac_workers.workers[0];
+	for (i = 1; i < g_ac_workers.count; i++) {
+		if (g_ac_workers.workers[i].sessions->count < worker->sessions->count) {
+			worker = &g_ac_workers.workers[i];
+		}
+	}
+
+	/* */
+	itemlist = capwap_itemlist_create(sizeof(struct ac_session_t*));
+	*(struct ac_session_t**)itemlist->item = session;
+
+	capwap_lock_enter(&worker->lock);
+	session->worker = worker;
+	session->workeritem = itemlist;
+	capwap_itemlist_insert_after(worker->sessions, NULL, itemlist);
+	capwap_lock_exit(&worker->lock);
+
+	log_printf(LOG_DEBUG, "Session start");
+}
+
+/* Wake up the owner worker of session */
+void ac_workers_schedule_session(struct ac_session_t* session) {
+	struct ac_worker* worker = session->worker;
+
+	ASSERT(worker != NULL);
+
+	capwap_lock_enter(&worker->lock);
+	if (session->workeritem) {
+		ac_worker_enqueue_session(worker, session);
+	}
+	capwap_lock_exit(&worker->lock);
+
+	capwap_event_signal(&worker->wait);
+}
@@ -0,0 +1,12 @@
+#ifndef __AC_WORKERS_HEADER__
+#define __AC_WORKERS_HEADER__
+
+/* */
+int ac_workers_start(void);
+void ac_workers_stop(void);
+
+/* */
+void ac_workers_assign_session(struct ac_session_t* session);
+void ac_workers_schedule_session(struct ac_session_t* session);
+
+#endif /* __AC_WORKERS_HEADER__ */
@@ -11,20 +11,43 @@
 /* */
 union capwap_addr sc_localaddr;
 
+/* */
+DEFINE_PER_CPU(struct sc_capwap_copystats, sc_capwap_copystats);
+
 /* Ethernet-II snap header (RFC1042 for most EtherTypes) */
 static unsigned char sc_rfc1042_header[] = { 0xaa, 0xaa, 0x03, 0x00, 0x00, 0x00 };
 
 /* Bridge-Tunnel header (for EtherTypes ETH_P_AARP and ETH_P_IPX) */
 static unsigned char sc_bridge_tunnel_header[] = { 0xaa, 0xaa, 0x03, 0x00, 0x00, 0xf8 };
 
+/* Memory of fragments queued by all sessions */
+static atomic_t sc_capwap_fragment_memory = ATOMIC_INIT(0);
+
+/* Limits of reassembly memory, in bytes */
+static unsigned int fragment_session_memory = CAPWAP_FRAGMENT_SESSION_MEMORY;
+module_param(fragment_session_memory, uint, 0644);
+MODULE_PARM_DESC(fragment_session_memory, "Memory of fragments queued by a session (bytes)");
+
+static unsigned int fragment_memory = CAPWAP_FRAGMENT_MEMORY;
+module_param(fragment_memory, uint, 0644);
+MODULE_PARM_DESC(fragment_memory, "Memory of fragments queued by all sessions (bytes)");
+
 /* */
-static void sc_capwap_fragment_free(struct sc_capwap_fragment* fragment) {
+DEFINE_PER_CPU(struct sc_capwap_defragstats, sc_capwap_defragstats);
+
+/* */
+static void sc_capwap_fragment_free(struct sc_capwap_fragment_queue* queue, struct sc_capwap_fragment* fragment) {
 	TRACEKMOD("### sc_capwap_fragment_free\n");
 
 	/* */
 	list_del(&fragment->lru_list);
 	fragment->flags = 0;
 
+	/* Release memory */
+	queue->memory -= fragment->truesize;
+	atomic_sub(fragment->truesize, &sc_capwap_fragment_memory);
+	fragment->truesize = 0;
+
 	/* Free socket buffer */
 	while (fragment->fragments) {
 		struct sk_buff* next = fragment->fragments->next;
@@ -34,30 +57,68 @@ static void sc_capwap_fragment_free(struct sc_capwap_fragment* fragment) {
 	}
 }
 
-/* */
-static void sc_capwap_defrag_evictor(struct sc_capwap_session* session, ktime_t now) {
+/* Remove the expired reassemblies, the LRU list is ordered by last update */
+static void sc_capwap_defrag_evictor(struct sc_capwap_fragment_queue* queue, ktime_t now) {
 	ktime_t delta;
 	struct sc_capwap_fragment* fragment;
-	struct list_head* list = &session->fragments.lru_list;
 
 	TRACEKMOD("### sc_capwap_defrag_evictor\n");
 
-	/* Light check without lock */
-	if (!list_empty(list)) {
-		spin_lock(&session->fragments.lock);
-
-		/* Remove last old fragment */
-		if (!list_empty(list)) {
-			fragment = list_first_entry(list, struct sc_capwap_fragment, lru_list);
-			delta = ktime_sub(now, fragment->tstamp);
-			if ((delta.tv64 < -NSEC_PER_SEC) || (delta.tv64 > NSEC_PER_SEC)) {
-				TRACEKMOD("*** Expired fragment %hu (%llu %llu)\n", fragment->fragmentid, now.tv64, fragment->tstamp.tv64);
-				sc_capwap_fragment_free(fragment);
-			}
+	while (!list_empty(&queue->lru_list)) {
+		fragment = list_first_entry(&queue->lru_list, struct sc_capwap_fragment, lru_list);
+		delta = ktime_sub(now, fragment->tstamp);
+		if ((delta.tv64 >= -NSEC_PER_SEC) && (delta.tv64 <= NSEC_PER_SEC)) {
+			break;
+		}
+
+		TRACEKMOD("*** Expired fragment %hu (%llu %llu)\n", fragment->fragmentid, now.tv64, fragment->tstamp.tv64);
+		this_cpu_inc(sc_capwap_defragstats.timeouts);
+		sc_capwap_fragment_free(queue, fragment);
+	}
+}
+
+/* Search the reassembly of fragment id, a new reassembly takes any free slot */
+static struct sc_capwap_fragment* sc_capwap_defrag_getfragment(struct sc_capwap_fragment_queue* queue, uint16_t frag_id) {
+	int i;
+	struct sc_capwap_fragment* fragment;
+
+	TRACEKMOD("### sc_capwap_defrag_getfragment\n");
+
+	/* Only the active reassemblies are into LRU list */
+	list_for_each_entry(fragment, &queue->lru_list, lru_list) {
+		if (fragment->fragmentid == frag_id) {
+			return fragment;
+		}
+	}
+
+	/* */
+	for (i = 0, fragment = NULL; i < CAPWAP_FRAGMENT_QUEUE; i++) {
+		if (!(queue->queues[i].flags & CAPWAP_FRAGMENT_ENABLE)) {
+			fragment = &queue->queues[i];
+			break;
 		}
+	}
+
+	/* All slots are used, drop the least recently updated reassembly */
+	if (!fragment) {
+		TRACEKMOD("*** All fragment queues are busy\n");
 
-		spin_unlock(&session->fragments.lock);
+		this_cpu_inc(sc_capwap_defragstats.busy);
+		fragment = list_first_entry(&queue->lru_list, struct sc_capwap_fragment, lru_list);
+		sc_capwap_fragment_free(queue, fragment);
 	}
+
+	/* Init fragment */
+	fragment->flags = CAPWAP_FRAGMENT_ENABLE;
+	fragment->fragmentid = frag_id;
+	fragment->fragments = NULL;
+	fragment->lastfragment = NULL;
+	fragment->recvlength = 0;
+	fragment->totallength = 0;
+	fragment->truesize = 0;
+	list_add_tail(&fragment->lru_list, &queue->lru_list);
+
+	return fragment;
 }
 
 /* */
@@ -74,8 +135,8 @@ static struct sk_buff* sc_capwap_reasm(struct sc_capwap_fragment* fragment) {
 	skbfrag = fragment->fragments;
 	len = GET_HLEN_HEADER((struct sc_capwap_header*)skbfrag->data) * 4;
 
-	/* Create new packet */
-	skb = alloc_skb(len + fragment->totallength, GFP_KERNEL);
+	/* Create new packet, called with lock of fragment queue */
+	skb = alloc_skb(len + fragment->totallength, GFP_ATOMIC);
 	if (!skb) {
 		return NULL;
 	}
@@ -115,6 +176,7 @@ static struct sk_buff* sc_capwap_defrag(struct sc_capwap_session* session, struc
 	struct sc_capwap_fragment* fragment;
 	struct sc_skb_capwap_cb* cb;
 	struct sk_buff* skb_defrag = NULL;
+	struct sc_capwap_fragment_queue* queue = &session->fragments;
 	struct sc_capwap_header* header = (struct sc_capwap_header*)skb->data;
 
 	TRACEKMOD("### sc_capwap_defrag\n");
@@ -135,26 +197,14 @@ static struct sk_buff* sc_capwap_defrag(struct sc_capwap_session* session, struc
 	cb->frag_length = skb->len - headersize;
 
 	/* */
-	spin_lock(&session->fragments.lock);
+	spin_lock(&queue->lock);
 	TRACEKMOD("*** Fragment info: id %hu offset %hu length %hu\n", frag_id, cb->frag_offset, cb->frag_length);
 
-	/* Get fragment */
-	fragment = &session->fragments.queues[frag_id % CAPWAP_FRAGMENT_QUEUE];
-	if ((fragment->flags & CAPWAP_FRAGMENT_ENABLE) && (fragment->fragmentid != frag_id)) {
-		TRACEKMOD("*** Unable defrag, queue fragment busy\n");
-		goto error2;	/* Queue fragment busy*/
-	}
+	/* Cleaning old fragments */
+	sc_capwap_defrag_evictor(queue, skb->tstamp);
 
-	/* Init fragment */
-	if (!(fragment->flags & CAPWAP_FRAGMENT_ENABLE)) {
-		fragment->flags = CAPWAP_FRAGMENT_ENABLE;
-		fragment->fragmentid = frag_id;
-		fragment->fragments = NULL;
-		fragment->lastfragment = NULL;
-		fragment->recvlength = 0;
-		fragment->totallength = 0;
-		list_add_tail(&fragment->lru_list, &session->fragments.lru_list);
-	}
+	/* Get fragment */
+	fragment = sc_capwap_defrag_getfragment(queue, frag_id);
 
 	/* Search fragment position */
 	prev = fragment->lastfragment;
@@ -164,7 +214,8 @@ static struct sk_buff* sc_capwap_defrag(struct sc_capwap_session* session, struc
 		if ((CAPWAP_SKB_CB(prev)->frag_offset + CAPWAP_SKB_CB(prev)->frag_length) <= cb->frag_offset) {
 			next = NULL;
 		} else {
-			sc_capwap_fragment_free(fragment);
+			this_cpu_inc(sc_capwap_defragstats.overlaps);
+			sc_capwap_fragment_free(queue, fragment);
 			TRACEKMOD("*** Unable defrag, overlap error\n");
 			goto error2;	/* Overlap error */
 		}
@@ -175,12 +226,14 @@ static struct sk_buff* sc_capwap_defrag(struct sc_capwap_session* session, struc
 
 			if (next_cb->frag_offset == cb->frag_offset) {
 				TRACEKMOD("*** Unable defrag, duplicate packet\n");
+				this_cpu_inc(sc_capwap_defragstats.duplicates);
 				goto error2;	/* Duplicate packet */
 			} else if (next_cb->frag_offset > cb->frag_offset) {
 				if ((cb->frag_offset + cb->frag_length) <= next_cb->frag_offset) {
 					break;
 				} else {
-					sc_capwap_fragment_free(fragment);
+					this_cpu_inc(sc_capwap_defragstats.overlaps);
+					sc_capwap_fragment_free(queue, fragment);
 					TRACEKMOD("*** Unable defrag, overlap error\n");
 					goto error2;	/* Overlap error */
 				}
@@ -190,6 +243,19 @@ static struct sk_buff* sc_capwap_defrag(struct sc_capwap_session* session, struc
 		}
 	}
 
+	/* Memory accounting, per session and global. The limits can be changed at runtime */
+	if ((queue->memory + skb->truesize) > fragment_session_memory) {
+		TRACEKMOD("*** Unable defrag, session memory limit\n");
+		goto error3;
+	} else if ((unsigned int)atomic_add_return(skb->truesize, &sc_capwap_fragment_memory) > fragment_memory) {
+		atomic_sub(skb->truesize, &sc_capwap_fragment_memory);
+		TRACEKMOD("*** Unable defrag, global memory limit\n");
+		goto error3;
+	}
+
+	queue->memory += skb->truesize;
+	fragment->truesize += skb->truesize;
+
 	/* Insert fragment */
 	skb->prev = NULL;
 	skb->next = next;
@@ -213,32 +279,46 @@ static struct sk_buff* sc_capwap_defrag(struct sc_capwap_session* session, struc
 	/* Check if receive all fragment */
 	if ((fragment->flags & CAPWAP_FRAGMENT_LAST) && (fragment->recvlength == fragment->totallength)) {
 		skb_defrag = sc_capwap_reasm(fragment);
+		if (skb_defrag) {
+			this_cpu_inc(sc_capwap_defragstats.reassembled);
+		}
 
 		/* Free fragment complete */
-		sc_capwap_fragment_free(fragment);
+		sc_capwap_fragment_free(queue, fragment);
 	} else {
 		/* Update timeout */
 		fragment->tstamp = skb->tstamp;
 		TRACEKMOD("*** Fragment id %hu expire at %llu\n", frag_id, fragment->tstamp.tv64);
 
 		/* Set LRU timeout */
-		if (!list_is_last(&fragment->lru_list, &session->fragments.lru_list)) {
-			list_move_tail(&fragment->lru_list, &session->fragments.lru_list);
+		if (!list_is_last(&fragment->lru_list, &queue->lru_list)) {
+			list_move_tail(&fragment->lru_list, &queue->lru_list);
 		}
 	}
 
-	spin_unlock(&session->fragments.lock);
+	spin_unlock(&queue->lock);
 
 	return skb_defrag;
 
+error3:
+	this_cpu_inc(sc_capwap_defragstats.nomemory);
+	if (!fragment->fragments) {
+		sc_capwap_fragment_free(queue, fragment);
+	}
+
 error2:
-	spin_unlock(&session->fragments.lock);
+	spin_unlock(&queue->lock);
 
 error:
 	kfree_skb(skb);
 	return NULL;
 }
 
+/* */
+int sc_capwap_defrag_memory(void) {
+	return atomic_read(&sc_capwap_fragment_memory);
+}
+
 /* */
 static unsigned int sc_capwap_80211_hdrlen(__le16 fc) {
 	unsigned int hdrlen = 24;
@@ -307,20 +387,20 @@ int sc_capwap_8023_to_80211(struct sk_buff* skb, const uint8_t* bssid) {
 	/* Remove IEEE 802.3 header */
 	skb_pull(skb, skip_header_bytes);
 
-	/* Check headroom */
-	head_need = hdrlen + encaps_len - skb_headroom(skb);
-	if ((head_need > 0) || skb_cloned(skb)) {
-		head_need = max(head_need, 0);
-		if (head_need) {
+	/* Check headroom, the TAP interface reserves it so the head is reallocated
+	   only when it is shared */
+	head_need = hdrlen + encaps_len;
+	if ((skb_headroom(skb) < head_need) || skb_header_cloned(skb)) {
+		TRACEKMOD("*** Expand headroom skb of: %d\n", max(head_need - (int)skb_headroom(skb), 0));
+
+		this_cpu_inc(sc_capwap_copystats.cowhead);
+		if (skb_headroom(skb) < head_need) {
 			skb_orphan(skb);
 		}
 
-		TRACEKMOD("*** Expand headroom skb of: %d\n", head_need);
-		if (pskb_expand_head(skb, head_need, 0, GFP_ATOMIC)) {
+		if (skb_cow_head(skb, head_need)) {
 			return -ENOMEM;
 		}
-
-		skb->truesize += head_need;
 	}
 
 	/* Add LLC header */
@@ -416,8 +496,12 @@ void sc_capwap_freesession(struct sc_capwap_session* session) {
 
 	/* Free socket buffers */
 	list_for_each_entry_safe(fragment, temp, &session->fragments.lru_list, lru_list) {
-		sc_capwap_fragment_free(fragment);
+		sc_capwap_fragment_free(&session->fragments, fragment);
 	}
+
+	/* Free DTLS keys */
+	sc_dtls_freekeys(rcu_dereference_protected(session->dtls, 1));
+	RCU_INIT_POINTER(session->dtls, NULL);
 }
 
 /* */
@@ -485,6 +569,7 @@ int sc_capwap_createkeepalive(struct sc_capwap_sessionid_element* sessionid, uin
 int sc_capwap_parsingpacket(struct sc_capwap_session* session, const union capwap_addr* sockaddr, struct sk_buff* skb) {
 	int length;
 	uint16_t headersize;
+	struct sc_dtls_keys* keys;
 	struct sc_capwap_data_message* dataheader;
 	struct sc_capwap_message_element* message;
 	struct sc_capwap_header* header = (struct sc_capwap_header*)skb->data;
@@ -504,9 +589,36 @@ int sc_capwap_parsingpacket(struct sc_capwap_session* session, const union capwa
 	} else if (GET_VERSION_HEADER(header) != CAPWAP_PROTOCOL_VERSION) {
 		TRACEKMOD("*** Invalid capwap header version\n");
 		return -EINVAL;
+	}
+
+	/* DTLS data channel */
+	keys = (session ? rcu_dereference(session->dtls) : NULL);
+	if (GET_TYPE_HEADER(header) == CAPWAP_PREAMBLE_DTLS_HEADER) {
+		if (!keys || !sc_dtls_is_applicationdata(skb)) {
+			/* Handshake and alert are processed by userspace */
+			sc_netlink_notify_recv_dtls(sockaddr, (session ? &session->sessionid : NULL), skb->data, skb->len);
+			kfree_skb(skb);
+			return 0;
+		}
+
+		/* */
+		if (sc_dtls_decrypt(keys, skb)) {
+			TRACEKMOD("*** Unable to decrypt packet\n");
+			return -EINVAL;
+		}
+
+		/* Check plain header */
+		header = (struct sc_capwap_header*)skb->data;
+		if ((skb->len < sizeof(struct sc_capwap_header)) || (GET_VERSION_HEADER(header) != CAPWAP_PROTOCOL_VERSION) || (GET_TYPE_HEADER(header) != CAPWAP_PREAMBLE_HEADER)) {
+			TRACEKMOD("*** Invalid capwap header into DTLS record\n");
+			return -EINVAL;
+		}
 	} else if (GET_TYPE_HEADER(header) != CAPWAP_PREAMBLE_HEADER) {
-		TRACEKMOD("*** Packet is encrypted\n");
-		return -EINVAL;		/* Accept only plain packet */
+		TRACEKMOD("*** Invalid capwap header type\n");
+		return -EINVAL;
+	} else if (keys || (session && session->dtlsdatachannel)) {
+		TRACEKMOD("*** Plain packet into DTLS data channel\n");
+		return -EINVAL;
 	}
 
 	/* */
@@ -573,15 +685,13 @@ int sc_capwap_parsingpacket(struct sc_capwap_session* session, const union capwa
 			headersize -= msglength;
 		}
 	} else if (session) {
-		if (!skb->tstamp.tv64) {
-			skb->tstamp = ktime_get();
-		}
-
-		/* Cleaning old fragments */
-		sc_capwap_defrag_evictor(session, skb->tstamp);
-
-		/* */
+		/* Only the fragments use the reassembly queue and its lock, the expired
+		   reassemblies are removed when the next fragment arrives */
 		if (IS_FLAG_F_HEADER(header)) {
+			if (!skb->tstamp.tv64) {
+				skb->tstamp = ktime_get();
+			}
+
 			skb = sc_capwap_defrag(session, skb);
 			if (!skb) {
 				return 0;
@@ -610,113 +720,252 @@ int sc_capwap_parsingpacket(struct sc_capwap_session* session, const union capwa
 	return -EINVAL;
 }
 
+/* */
+static int sc_capwap_setheader(struct sc_capwap_header* header, uint8_t radioid, uint8_t binding, uint32_t flags, struct sc_capwap_radio_addr* radioaddr, int radioaddrlength, struct sc_capwap_wireless_information* winfo, int winfolength) {
+	int size = sizeof(struct sc_capwap_header) + radioaddrlength + winfolength;
+	uint8_t* headeroption = (uint8_t*)header + sizeof(struct sc_capwap_header);
+
+	memset(header, 0, sizeof(struct sc_capwap_header));
+	SET_VERSION_HEADER(header, CAPWAP_PROTOCOL_VERSION);
+	SET_TYPE_HEADER(header, CAPWAP_PREAMBLE_HEADER);
+	SET_WBID_HEADER(header, binding);
+	SET_RID_HEADER(header, radioid);
+	SET_FLAG_T_HEADER(header, ((flags & NLSMARTCAPWAP_FLAGS_TUNNEL_8023) ? 0 : 1));
+
+	if (radioaddr) {
+		SET_FLAG_M_HEADER(header, 1);
+		memcpy(headeroption, radioaddr, radioaddrlength);
+		headeroption += radioaddrlength;
+	}
+
+	if (winfo) {
+		SET_FLAG_W_HEADER(header, 1);
+		memcpy(headeroption, winfo, winfolength);
+		headeroption += winfolength;
+	}
+
+	SET_HLEN_HEADER(header, size / 4);
+	return size;
+}
+
+/* Send the fragments, the first can carry a bigger header */
+static int sc_capwap_sendfragments(struct sc_capwap_session* session, struct kvec* vec, int count, int datagramsize, uint8_t* buffer) {
+	int i;
+	int err;
+	int size;
+	int length;
+	int first = 0;
+	int recordsize = datagramsize;
+	struct sc_dtls_keys* keys = (buffer ? rcu_dereference(session->dtls) : NULL);
+
+	TRACEKMOD("### sc_capwap_sendfragments\n");
+
+	/* The UDP GSO requires datagrams of the same size, except the last, so a
+	   first fragment with different size is sent alone */
+	if ((vec[0].iov_len + vec[1].iov_len) != datagramsize) {
+		first = 1;
+
+		this_cpu_inc(sc_capwap_copystats.fragments);
+		err = sc_capwap_sendpacket(session, vec, 2, buffer, recordsize + (buffer ? SC_DTLS_OVERHEAD : 0));
+		if (err < 0) {
+			return err;
+		}
+	}
+
+	/* With DTLS every fragment is a record of the same size */
+	if (keys) {
+		recordsize += SC_DTLS_OVERHEAD;
+	}
+
+	/* */
+	if ((count - first) > sc_socket_maxsegments()) {
+		err = -EOPNOTSUPP;
+	} else if (keys) {
+		for (i = first, length = 0; i < count; i++) {
+			size = sc_dtls_encrypt(keys, &vec[i * 2], 2, buffer + length, recordsize);
+			if (size < 0) {
+				return size;
+			}
+
+			length += size;
+		}
+
+		vec[count * 2].iov_base = buffer;
+		vec[count * 2].iov_len = length;
+		err = sc_socket_sendv_segments(SOCKET_UDP, &vec[count * 2], 1, &session->peeraddr, recordsize, count - first);
+	} else {
+		err = sc_socket_sendv_segments(SOCKET_UDP, &vec[first * 2], (count - first) * 2, &session->peeraddr, recordsize, count - first);
+	}
+
+	if (err >= 0) {
+		this_cpu_inc(sc_capwap_copystats.gso);
+	} else if ((err == -EOPNOTSUPP) || (err == -EIO) || (err == -EINVAL) || (err == -EMSGSIZE)) {
+		/* Without UDP GSO or checksum offload send a datagram at time */
+		for (i = first; i < count; i++) {
+			this_cpu_inc(sc_capwap_copystats.fragments);
+			err = sc_capwap_sendpacket(session, &vec[i * 2], 2, buffer, recordsize);
+			if (err < 0) {
+				break;
+			}
+		}
+	}
+
+	return err;
+}
+
 /* */
 int sc_capwap_forwarddata(struct sc_capwap_session* session, uint8_t radioid, uint8_t binding, struct sk_buff* skb, uint32_t flags, struct sc_capwap_radio_addr* radioaddr, int radioaddrlength, struct sc_capwap_wireless_information* winfo, int winfolength) {
+	int i;
 	int err;
 	int size;
+	int count;
 	int length;
-	int reserve;
-	int headroom;
-	int requestfragment;
-	__be16 fragmentid = 0;
+	int datagramsize;
+	int fragmentsize;
+	__be16 fragmentid;
 	int fragmentoffset = 0;
+	struct kvec* vec;
+	uint8_t* scratch;
 	struct sc_capwap_header* header;
-	struct sk_buff* clone = NULL;
+	uint8_t headerbuffer[CAPWAP_HEADER_MAX_LENGTH];
 	int packetlength = skb->len;
+	int mtu = session->mtu;
+	uint8_t* dtlsbuffer = NULL;
+	struct sc_dtls_keys* keys = rcu_dereference(session->dtls);
 
 	TRACEKMOD("### sc_capwap_forwarddata\n");
 
-	/* Check headroom */
-	headroom = skb_headroom(skb);
-	reserve = sizeof(struct sc_capwap_header) + radioaddrlength + winfolength;
-	if (skb_is_nonlinear(skb) || (headroom < reserve)) {
-		TRACEKMOD("*** Copy socket buffer and expand headroom of: %d\n", (reserve - headroom));
-		clone = skb_copy_expand(skb, max(headroom, reserve), skb_tailroom(skb), GFP_KERNEL);
-		if (!clone) {
-			TRACEKMOD("*** Unable to copy socket buffer\n");
+	/* */
+	size = sizeof(struct sc_capwap_header) + radioaddrlength + winfolength;
+	if (size > CAPWAP_HEADER_MAX_LENGTH) {
+		return -EINVAL;
+	}
+
+	/* The CAPWAP header is built apart and the payload is only read, so the
+	   packet is never copied unless it is nonlinear */
+	this_cpu_inc(sc_capwap_copystats.forwarded);
+	if (skb_is_nonlinear(skb)) {
+		TRACEKMOD("*** Linearize socket buffer\n");
+
+		this_cpu_inc(sc_capwap_copystats.linearize);
+		if (skb_linearize(skb)) {
+			TRACEKMOD("*** Unable to linearize socket buffer\n");
 			return -ENOMEM;
 		}
-
-		skb = clone;
 	}
 
-	/* Check MTU */
-	requestfragment = (((packetlength + reserve) > session->mtu) ? 1 : 0);
-	if (requestfragment) {
-		fragmentid = cpu_to_be16(sc_capwap_newfragmentid(session));
+	/* */
+	if (keys) {
+		mtu -= SC_DTLS_OVERHEAD;
+	} else if (session->dtlsdatachannel) {
+		TRACEKMOD("*** DTLS data channel without keys\n");
+		return -ENOTCONN;
 	}
 
-	/* */
-	header = (struct sc_capwap_header*)skb_push(skb, sizeof(struct sc_capwap_header) + radioaddrlength + winfolength);
-	while (packetlength > 0) {
-		memset(header, 0, sizeof(struct sc_capwap_header));
-		SET_VERSION_HEADER(header, CAPWAP_PROTOCOL_VERSION);
-		SET_TYPE_HEADER(header, CAPWAP_PREAMBLE_HEADER);
-		SET_WBID_HEADER(header, binding);
-		SET_RID_HEADER(header, radioid);
-		SET_FLAG_T_HEADER(header, ((flags & NLSMARTCAPWAP_FLAGS_TUNNEL_8023) ? 0 : 1));
-
-		if (!fragmentoffset) {
-			uint8_t* headeroption = (uint8_t*)header + sizeof(struct sc_capwap_header);
-
-			if (radioaddr) {
-				SET_FLAG_M_HEADER(header, 1);
-				memcpy(headeroption, radioaddr, radioaddrlength);
-				headeroption += radioaddrlength;
-			}
+	/* Packet without fragmentation */
+	if ((packetlength + size) <= mtu) {
+		struct kvec packetvec[2];
 
-			if (winfo) {
-				SET_FLAG_W_HEADER(header, 1);
-				memcpy(headeroption, winfo, winfolength);
-				headeroption += winfolength;
+		if (keys) {
+			dtlsbuffer = (uint8_t*)kmalloc(session->mtu, GFP_ATOMIC);
+			if (!dtlsbuffer) {
+				return -ENOMEM;
 			}
-
-			size = sizeof(struct sc_capwap_header) + radioaddrlength + winfolength;
-			SET_HLEN_HEADER(header, size / 4);
-		} else {
-			size = sizeof(struct sc_capwap_header);
-			SET_HLEN_HEADER(header, size / 4);
 		}
 
-		/* Calculate body size */
-		length = session->mtu - size;
-		if (packetlength <= length) {
-			length = packetlength;
-		} else if (requestfragment) {
-			length -= length % 8;		/* Capwap fragment size is module 8 */
-		} else {
-			break;
-		}
+		packetvec[0].iov_base = headerbuffer;
+		packetvec[0].iov_len = sc_capwap_setheader((struct sc_capwap_header*)headerbuffer, radioid, binding, flags, radioaddr, radioaddrlength, winfo, winfolength);
+		packetvec[1].iov_base = skb->data;
+		packetvec[1].iov_len = packetlength;
 
-		/* Fragment options */
-		if (requestfragment) {
-			SET_FLAG_F_HEADER(header, 1);
-			if (packetlength == length) {
-				SET_FLAG_L_HEADER(header, 1);
-			}
+		err = sc_capwap_sendpacket(session, packetvec, 2, dtlsbuffer, session->mtu);
+		TRACEKMOD("*** Send packet result: %d\n", err);
+
+		kfree(dtlsbuffer);
+		return ((err < 0) ? -EIO : 0);
+	}
+
+	/* All fragments have the same datagram size, except the last, and the
+	   fragment size is module 8 */
+	if ((mtu - size) < 8) {
+		return -EINVAL;
+	}
+
+	fragmentsize = mtu - sizeof(struct sc_capwap_header);
+	fragmentsize -= fragmentsize % 8;
+	datagramsize = sizeof(struct sc_capwap_header) + fragmentsize;
+
+	length = (mtu - size) - ((mtu - size) % 8);
+	count = 1 + ((packetlength > length) ? DIV_ROUND_UP(packetlength - length, fragmentsize) : 0);
+
+	/* Headers and vectors of every fragment, one more vector for the DTLS records */
+	scratch = (uint8_t*)kmalloc((count * CAPWAP_HEADER_MAX_LENGTH) + ((count * 2 + 1) * sizeof(struct kvec)) + (keys ? (count * (datagramsize + SC_DTLS_OVERHEAD)) : 0), GFP_ATOMIC);
+	if (!scratch) {
+		return -ENOMEM;
+	}
+
+	vec = (struct kvec*)scratch;
+	header = (struct sc_capwap_header*)(scratch + ((count * 2 + 1) * sizeof(struct kvec)));
+	if (keys) {
+		dtlsbuffer = (uint8_t*)header + (count * CAPWAP_HEADER_MAX_LENGTH);
+	}
 
-			header->frag_id = fragmentid;
-			header->frag_off = cpu_to_be16(fragmentoffset);
+	/* */
+	fragmentid = cpu_to_be16(sc_capwap_newfragmentid(session));
+	for (i = 0; i < count; i++) {
+		if (!i) {
+			size = sc_capwap_setheader(header, radioid, binding, flags, radioaddr, radioaddrlength, winfo, winfolength);
+		} else {
+			size = sc_capwap_setheader(header, radioid, binding, flags, NULL, 0, NULL, 0);
 		}
 
-		/* Send packet */
-		err = sc_socket_send(SOCKET_UDP, (uint8_t*)header, (size + length), &session->peeraddr);
-		TRACEKMOD("*** Send packet result: %d\n", err);
-		if (err < 0) {
-			break;
+		/* */
+		length = min(packetlength, (mtu - size) - ((mtu - size) % 8));
+		SET_FLAG_F_HEADER(header, 1);
+		if (packetlength == length) {
+			SET_FLAG_L_HEADER(header, 1);
 		}
 
+		header->frag_id = fragmentid;
+		header->frag_off = cpu_to_be16(fragmentoffset);
+
+		/* */
+		vec[i * 2].iov_base = header;
+		vec[i * 2].iov_len = size;
+		vec[i * 2 + 1].iov_base = skb->data + fragmentoffset;
+		vec[i * 2 + 1].iov_len = length;
+
 		/* */
-		header = (struct sc_capwap_header*)(((uint8_t*)header + size + length) - sizeof(struct sc_capwap_header));
+		header = (struct sc_capwap_header*)((uint8_t*)header + CAPWAP_HEADER_MAX_LENGTH);
 		fragmentoffset += length;
 		packetlength -= length;
 	}
 
-	if (clone) {
-		kfree_skb(clone);
+	/* */
+	err = sc_capwap_sendfragments(session, vec, count, datagramsize, dtlsbuffer);
+	TRACEKMOD("*** Send fragments result: %d\n", err);
+
+	kfree(scratch);
+	return ((err < 0) ? -EIO : 0);
+}
+
+/* Send a CAPWAP packet, with DTLS data channel the packet is encrypted into buffer */
+int sc_capwap_sendpacket(struct sc_capwap_session* session, struct kvec* vec, int count, uint8_t* buffer, int size) {
+	int length;
+	struct sc_dtls_keys* keys = (buffer ? rcu_dereference(session->dtls) : NULL);
+
+	TRACEKMOD("### sc_capwap_sendpacket\n");
+
+	if (keys) {
+		length = sc_dtls_encrypt(keys, vec, count, buffer, size);
+		if (length < 0) {
+			return length;
+		}
+
+		return sc_socket_send(SOCKET_UDP, buffer, length, &session->peeraddr);
 	}
 
-	return (!packetlength ? 0 : -EIO);
+	return sc_socket_sendv(SOCKET_UDP, vec, count, &session->peeraddr);
 }
 
 /* */
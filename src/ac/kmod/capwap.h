@@ -1,8 +1,12 @@
 #ifndef __KMOD_CAPWAP_HEADER__
 #define __KMOD_CAPWAP_HEADER__
 
+#include <linux/percpu.h>
+#include <linux/if_ether.h>
+#include <linux/ieee80211.h>
 #include "capwap_rfc.h"
 #include "socket.h"
+#include "dtls.h"
 
 /* */
 #define MAX_MTU						9000
@@ -10,8 +14,12 @@
 #define MIN_MTU						500
 #define IEEE80211_MTU				7981
 
-/* */
-#define CAPWAP_FRAGMENT_QUEUE		16
+/* Reassembly slots and memory of every session, the memory of all sessions is
+   limited too. The memory limits are the default of module parameters
+   fragment_session_memory and fragment_memory */
+#define CAPWAP_FRAGMENT_QUEUE				16
+#define CAPWAP_FRAGMENT_SESSION_MEMORY		(256 * 1024)
+#define CAPWAP_FRAGMENT_MEMORY				(4 * 1024 * 1024)
 
 /* */
 #define CAPWAP_FRAGMENT_ENABLE		0x0001
@@ -48,10 +56,29 @@ struct sc_skb_capwap_cb {
 	/* Fragment */
 	uint16_t frag_offset;
 	uint16_t frag_length;
+
+	/* Time of queue to worker thread */
+	ktime_t tstamp;
 };
 
 #define CAPWAP_SKB_CB(skb)					((struct sc_skb_capwap_cb*)((skb)->cb))
 
+/* Headroom to replace the IEEE 802.3 header with IEEE 802.11 header and LLC */
+#define CAPWAP_8023_TO_80211_HEADROOM		(sizeof(struct ieee80211_hdr_3addr) + 6 - (2 * ETH_ALEN))
+
+/* Packets copied by forwarding path */
+struct sc_capwap_copystats {
+	unsigned long forwarded;
+	unsigned long linearize;
+	unsigned long cowhead;
+
+	/* Fragments sent with UDP GSO train or one at time */
+	unsigned long gso;
+	unsigned long fragments;
+};
+
+DECLARE_PER_CPU(struct sc_capwap_copystats, sc_capwap_copystats);
+
 /* */
 struct sc_capwap_fragment {
 	struct list_head lru_list;
@@ -65,16 +92,31 @@ struct sc_capwap_fragment {
 	struct sk_buff* lastfragment;
 	int recvlength;
 	int totallength;
+	int truesize;
 };
 
 /* */
 struct sc_capwap_fragment_queue {
 	spinlock_t lock;
 
+	/* Active reassemblies, any free slot can be used by a fragment id */
 	struct list_head lru_list;
 	struct sc_capwap_fragment queues[CAPWAP_FRAGMENT_QUEUE];
+	int memory;
+};
+
+/* Reassembly counters */
+struct sc_capwap_defragstats {
+	unsigned long reassembled;
+	unsigned long timeouts;
+	unsigned long overlaps;
+	unsigned long duplicates;
+	unsigned long busy;
+	unsigned long nomemory;
 };
 
+DECLARE_PER_CPU(struct sc_capwap_defragstats, sc_capwap_defragstats);
+
 /* */
 struct sc_capwap_session {
 	uint16_t mtu;
@@ -85,6 +127,10 @@ struct sc_capwap_session {
 	spinlock_t fragmentid_lock;
 
 	struct sc_capwap_fragment_queue fragments;
+
+	/* DTLS data channel, without keys the records are processed by userspace */
+	int dtlsdatachannel;				/* Refuse plain packets */
+	struct sc_dtls_keys __rcu* dtls;
 };
 
 /* */
@@ -103,6 +149,7 @@ int sc_capwap_bind(union capwap_addr* sockaddr);
 void sc_capwap_initsession(struct sc_capwap_session* session);
 void sc_capwap_freesession(struct sc_capwap_session* session);
 uint16_t sc_capwap_newfragmentid(struct sc_capwap_session* session);
+int sc_capwap_defrag_memory(void);
 
 int sc_capwap_8023_to_80211(struct sk_buff* skb, const uint8_t* bssid);
 int sc_capwap_80211_to_8023(struct sk_buff* skb);
@@ -111,6 +158,7 @@ void sc_capwap_sessionid_printf(const struct sc_capwap_sessionid_element* sessio
 
 int sc_capwap_createkeepalive(struct sc_capwap_sessionid_element* sessionid, uint8_t* buffer, int size);
 int sc_capwap_parsingpacket(struct sc_capwap_session* session, const union capwap_addr* sockaddr, struct sk_buff* skb);
+int sc_capwap_sendpacket(struct sc_capwap_session* session, struct kvec* vec, int count, uint8_t* buffer, int size);
 
 struct sc_capwap_radio_addr* sc_capwap_setradiomacaddress(uint8_t* buffer, int size, uint8_t* bssid);
 struct sc_capwap_wireless_information* sc_capwap_setwinfo_frameinfo(uint8_t* buffer, int size, uint8_t rssi, uint8_t snr, uint16_t rate);
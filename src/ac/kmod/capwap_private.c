@@ -3,6 +3,9 @@
 #include <linux/hash.h>
 #include <linux/slab.h>
 #include <linux/kthread.h>
+#include <linux/jhash.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
 #include <linux/if_ether.h>
 #include <linux/if_vlan.h>
 #include <linux/etherdevice.h>
@@ -21,6 +24,8 @@
 #define SESSION_HASH_SIZE_SHIFT				16
 #define SESSION_HASH_SIZE					(1 << SESSION_HASH_SIZE_SHIFT)
 #define MAX_WORKER_THREAD					32
+#define WORKER_THREAD_BUDGET				64
+#define WORKER_THREAD_MAX_BACKLOG			4096
 
 /* */
 static DEFINE_MUTEX(sc_session_update_mutex);
@@ -32,12 +37,14 @@ static struct list_head sc_session_running_list;
 static struct sc_capwap_session_priv* __rcu sc_session_hash_ipaddr[SESSION_HASH_SIZE];
 static struct sc_capwap_session_priv* __rcu sc_session_hash_sessionid[SESSION_HASH_SIZE];
 
-/* Threads */
-static DEFINE_SPINLOCK(sc_session_threads_lock);
-static uint32_t sc_session_threads_pos;
+/* Threads, one for each online cpu. The set of threads is fixed after init so
+   the dispatch does not need any lock */
 static uint32_t sc_session_threads_count;
 static struct sc_capwap_workthread sc_session_threads[MAX_WORKER_THREAD];
 
+/* Statistics */
+static struct dentry* sc_debugfs_dir;
+
 /* */
 static uint32_t sc_capwap_hash_ipaddr(const union capwap_addr* peeraddr) {
 	TRACEKMOD("### sc_capwap_hash_ipaddr\n");
@@ -188,6 +195,31 @@ static struct sc_capwap_session_priv* sc_capwap_getsession_sessionid(const struc
 	return sessionpriv;
 }
 
+/* Move the session from setup list to running list, the session is bound to peer address */
+static void sc_capwap_runsession(struct sc_capwap_session_priv* sessionpriv, const union capwap_addr* sockaddr) {
+	uint32_t hash;
+
+	TRACEKMOD("### sc_capwap_runsession\n");
+
+	/* */
+	list_del_rcu(&sessionpriv->list);
+	synchronize_net();
+
+	/* */
+	memcpy(&sessionpriv->session.peeraddr, sockaddr, sizeof(union capwap_addr));
+	list_add_rcu(&sessionpriv->list, &sc_session_running_list);
+
+	/* */
+	hash = sc_capwap_hash_ipaddr(sockaddr);
+	sessionpriv->next_ipaddr = rcu_dereference_protected(sc_session_hash_ipaddr[hash], sc_capwap_update_lock_is_locked());
+	rcu_assign_pointer(sc_session_hash_ipaddr[hash], sessionpriv);
+
+	/* */
+	hash = sc_capwap_hash_sessionid(&sessionpriv->session.sessionid);
+	sessionpriv->next_sessionid = rcu_dereference_protected(sc_session_hash_sessionid[hash], sc_capwap_update_lock_is_locked());
+	rcu_assign_pointer(sc_session_hash_sessionid[hash], sessionpriv);
+}
+
 /* */
 static int sc_capwap_deletesetupsession(const struct sc_capwap_sessionid_element* sessionid) {
 	int ret = -ENOENT;
@@ -285,31 +317,18 @@ static int sc_capwap_sendpacket_wtp(struct sc_capwap_session_priv* sessionpriv,
 
 /* */
 static void sc_capwap_sendbroadcastpacket_wtp(struct sc_netdev_priv* netpriv, uint16_t vlan, struct sk_buff* skb, struct sc_capwap_session_priv* ignore) {
-	struct sk_buff* clone;
 	struct sc_capwap_connection* connection;
 	struct sc_capwap_wireless_information* winfo;
 	uint8_t buffer[CAPWAP_WINFO_DESTWLAN_LENGTH_PADDED];
-	int headroom = sizeof(struct sc_capwap_header) + CAPWAP_WINFO_DESTWLAN_LENGTH_PADDED;
 
 	TRACEKMOD("### sc_capwap_sendbroadcastpacket_wtp\n");
 
-	/* */
-	if (headroom < skb_headroom(skb)) {
-		headroom = skb_headroom(skb);
-	}
-
-	/* Send packet for every connection */
+	/* Send packet for every connection, the forwarding builds the CAPWAP header
+	   apart and never writes the payload so all connections share the same data */
 	list_for_each_entry_rcu(connection, &netpriv->list_connections, list_dev) {
 		if ((connection->vlan == vlan) && (connection->sessionpriv != ignore)) {
-			clone = skb_copy_expand(skb, headroom, skb_tailroom(skb), GFP_KERNEL);
-			if (!clone) {
-				break;
-			}
-
-			/* Forward packet */
 			winfo = sc_capwap_setwinfo_destwlans(buffer, CAPWAP_WINFO_DESTWLAN_LENGTH_PADDED, connection->wlanidmask);
-			sc_capwap_forwarddata(&connection->sessionpriv->session, connection->radioid, connection->sessionpriv->binding, clone, NLSMARTCAPWAP_FLAGS_TUNNEL_8023, NULL, 0, winfo, CAPWAP_WINFO_DESTWLAN_LENGTH_PADDED);
-			kfree_skb(clone);
+			sc_capwap_forwarddata(&connection->sessionpriv->session, connection->radioid, connection->sessionpriv->binding, skb, NLSMARTCAPWAP_FLAGS_TUNNEL_8023, NULL, 0, winfo, CAPWAP_WINFO_DESTWLAN_LENGTH_PADDED);
 		}
 	}
 }
@@ -323,6 +342,10 @@ static void sc_capwap_sendpacket_iface(struct sc_capwap_station* station, struct
 	/* */
 	if (devpriv->dev->flags & IFF_UP) {
 		if (station->vlan) {
+			if ((skb_headroom(skb) < VLAN_HLEN) || skb_header_cloned(skb)) {
+				this_cpu_inc(sc_capwap_copystats.cowhead);
+			}
+
 			skb = vlan_insert_tag(skb, htons(ETH_P_8021Q), station->vlan & VLAN_VID_MASK);
 			if (!skb) {
 				/* Unable add VLAN id */
@@ -447,41 +470,177 @@ static int sc_capwap_thread_recvpacket(struct sk_buff* skb) {
 }
 
 /* */
-static int sc_capwap_thread(void* data) {
+static void sc_capwap_thread_updatestats(struct sc_capwap_workthread* thread, unsigned long packets, ktime_t now) {
+	struct sc_capwap_workthread_stats* stats = &thread->stats;
+
+	stats->polls++;
+	stats->packets += packets;
+
+	/* */
+	stats->intervalpackets += packets;
+	if (ktime_to_ns(ktime_sub(now, stats->intervalstart)) >= NSEC_PER_SEC) {
+		stats->pps = stats->intervalpackets;
+		stats->intervalpackets = 0;
+		stats->intervalstart = now;
+	}
+}
+
+/* Process at most budget packets of batch, the batch is refilled from backlog
+   in a single lock only when it is empty */
+static int sc_capwap_thread_poll(struct sc_capwap_workthread* thread, int budget) {
+	u64 latency;
+	ktime_t tstamp;
+	ktime_t now = ktime_set(0, 0);
 	struct sk_buff* skb;
+	int count = 0;
+
+	/* */
+	if (skb_queue_empty(&thread->batch)) {
+		spin_lock_irq(&thread->queue.lock);
+		skb_queue_splice_tail_init(&thread->queue, &thread->batch);
+		spin_unlock_irq(&thread->queue.lock);
+	}
+
+	/* */
+	while ((count < budget) && ((skb = __skb_dequeue(&thread->batch)) != NULL)) {
+		tstamp = CAPWAP_SKB_CB(skb)->tstamp;
+		if (sc_capwap_thread_recvpacket(skb)) {
+			TRACEKMOD("*** Free packet\n");
+			kfree_skb(skb);
+		}
+
+		/* */
+		now = ktime_get();
+		latency = ktime_to_ns(ktime_sub(now, tstamp));
+		thread->stats.latency += latency;
+		if (latency > thread->stats.maxlatency) {
+			thread->stats.maxlatency = latency;
+		}
+
+		count++;
+	}
+
+	/* */
+	if (count) {
+		sc_capwap_thread_updatestats(thread, count, now);
+	}
+
+	return count;
+}
+
+/* NAPI like loop, the thread polls the packets in batches of budget until
+   the backlog is empty and only then goes to sleep */
+static int sc_capwap_thread(void* data) {
 	struct sc_capwap_workthread* thread = (struct sc_capwap_workthread*)data;
 
 	TRACEKMOD("### sc_capwap_thread\n");
 	TRACEKMOD("*** Thread start: %d\n", smp_processor_id());
 
 	for (;;) {
-		wait_event_interruptible(thread->waitevent, (skb_queue_len(&thread->queue) > 0) || kthread_should_stop());
-		if (kthread_should_stop()) {
-			break;
-		}
+		set_current_state(TASK_INTERRUPTIBLE);
 
-		/* Get packet */
-		skb = skb_dequeue(&thread->queue);
-		if (!skb) {
-			TRACEKMOD("*** Nothing from thread %d\n", smp_processor_id());
+		/* */
+		spin_lock_irq(&thread->queue.lock);
+		if (skb_queue_empty(&thread->batch) && skb_queue_empty(&thread->queue)) {
+			thread->scheduled = 0;
+			spin_unlock_irq(&thread->queue.lock);
+
+			if (kthread_should_stop()) {
+				break;
+			}
+
+			schedule();
 			continue;
 		}
 
+		spin_unlock_irq(&thread->queue.lock);
+		__set_current_state(TASK_RUNNING);
+
 		/* */
-		TRACEKMOD("*** Thread receive packet %d\n", smp_processor_id());
-		if (sc_capwap_thread_recvpacket(skb)) {
-			TRACEKMOD("*** Free packet\n");
-			kfree_skb(skb);
-		}
+		sc_capwap_thread_poll(thread, WORKER_THREAD_BUDGET);
+		cond_resched();
 	}
 
+	__set_current_state(TASK_RUNNING);
+
 	/* Purge queue */
 	skb_queue_purge(&thread->queue);
+	__skb_queue_purge(&thread->batch);
 
 	TRACEKMOD("*** Thread end: %d\n", smp_processor_id());
 	return 0;
 }
 
+/* */
+static int sc_capwap_stats_show(struct seq_file* seq, void* v) {
+	int cpu;
+	uint32_t i;
+	struct sc_capwap_workthread_stats* stats;
+	struct sc_capwap_copystats* copystats;
+	unsigned long forwarded = 0;
+	unsigned long linearize = 0;
+	unsigned long cowhead = 0;
+	unsigned long gso = 0;
+	unsigned long fragments = 0;
+	struct sc_capwap_defragstats* defragstats;
+	struct sc_capwap_defragstats defragtotal;
+
+	seq_printf(seq, "thread packets polls dropped pps avglatency(ns) maxlatency(ns)\n");
+	for (i = 0; i < sc_session_threads_count; i++) {
+		stats = &sc_session_threads[i].stats;
+
+		/* Counters are updated by thread without lock, the values are approximated */
+		seq_printf(seq, "%u %lu %lu %lu %lu %llu %llu\n", i, stats->packets, stats->polls, stats->dropped,
+			((ktime_to_ns(ktime_sub(ktime_get(), stats->intervalstart)) < (2 * NSEC_PER_SEC)) ? stats->pps : 0),
+			(unsigned long long)(stats->packets ? div64_u64(stats->latency, stats->packets) : 0),
+			(unsigned long long)stats->maxlatency);
+	}
+
+	/* Copies of forwarding path */
+	for_each_possible_cpu(cpu) {
+		copystats = per_cpu_ptr(&sc_capwap_copystats, cpu);
+		forwarded += copystats->forwarded;
+		linearize += copystats->linearize;
+		cowhead += copystats->cowhead;
+		gso += copystats->gso;
+		fragments += copystats->fragments;
+	}
+
+	seq_printf(seq, "\nforwarded linearize cowhead gso fragments\n");
+	seq_printf(seq, "%lu %lu %lu %lu %lu\n", forwarded, linearize, cowhead, gso, fragments);
+
+	/* Reassembly of all sessions */
+	memset(&defragtotal, 0, sizeof(struct sc_capwap_defragstats));
+	for_each_possible_cpu(cpu) {
+		defragstats = per_cpu_ptr(&sc_capwap_defragstats, cpu);
+		defragtotal.reassembled += defragstats->reassembled;
+		defragtotal.timeouts += defragstats->timeouts;
+		defragtotal.overlaps += defragstats->overlaps;
+		defragtotal.duplicates += defragstats->duplicates;
+		defragtotal.busy += defragstats->busy;
+		defragtotal.nomemory += defragstats->nomemory;
+	}
+
+	seq_printf(seq, "\nreassembled timeouts overlaps duplicates busy nomemory memory\n");
+	seq_printf(seq, "%lu %lu %lu %lu %lu %lu %d\n", defragtotal.reassembled, defragtotal.timeouts, defragtotal.overlaps, defragtotal.duplicates, defragtotal.busy, defragtotal.nomemory, sc_capwap_defrag_memory());
+
+	return 0;
+}
+
+/* */
+static int sc_capwap_stats_open(struct inode* inode, struct file* file) {
+	return single_open(file, sc_capwap_stats_show, NULL);
+}
+
+/* */
+static const struct file_operations sc_capwap_stats_fops = {
+	.owner = THIS_MODULE,
+	.open = sc_capwap_stats_open,
+	.read = seq_read,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+
 /* */
 void sc_capwap_update_lock(void) {
 	mutex_lock(&sc_session_update_mutex);
@@ -503,6 +662,8 @@ int sc_capwap_update_lock_is_locked(void) {
 int sc_capwap_sendkeepalive(const struct sc_capwap_sessionid_element* sessionid) {
 	int ret;
 	int length;
+	struct kvec vec;
+	uint8_t* dtlsbuffer = NULL;
 	struct sc_capwap_session_priv* sessionpriv;
 	uint8_t buffer[CAPWAP_KEEP_ALIVE_MAX_SIZE];
 
@@ -530,8 +691,23 @@ int sc_capwap_sendkeepalive(const struct sc_capwap_sessionid_element* sessionid)
 	/* Build keepalive */
 	length = sc_capwap_createkeepalive(&sessionpriv->session.sessionid, buffer, CAPWAP_KEEP_ALIVE_MAX_SIZE);
 
+	/* Encrypt with DTLS data channel */
+	if (rcu_access_pointer(sessionpriv->session.dtls)) {
+		dtlsbuffer = (uint8_t*)kmalloc(CAPWAP_KEEP_ALIVE_MAX_SIZE + SC_DTLS_OVERHEAD, GFP_ATOMIC);
+		if (!dtlsbuffer) {
+			ret = -ENOMEM;
+			goto done;
+		}
+	} else if (sessionpriv->session.dtlsdatachannel) {
+		TRACEKMOD("*** DTLS data channel without keys\n");
+		ret = -ENOTCONN;
+		goto done;
+	}
+
 	/* Send packet */
-	ret = sc_socket_send(SOCKET_UDP, buffer, length, &sessionpriv->session.peeraddr);
+	vec.iov_base = buffer;
+	vec.iov_len = length;
+	ret = sc_capwap_sendpacket(&sessionpriv->session, &vec, 1, dtlsbuffer, CAPWAP_KEEP_ALIVE_MAX_SIZE + SC_DTLS_OVERHEAD);
 	TRACEKMOD("*** Send keep-alive result: %d\n", ret);
 	if (ret > 0) {
 		ret = 0;
@@ -539,11 +715,12 @@ int sc_capwap_sendkeepalive(const struct sc_capwap_sessionid_element* sessionid)
 
 done:
 	rcu_read_unlock();
+	kfree(dtlsbuffer);
 	return ret;
 }
 
 /* */
-int sc_capwap_newsession(const struct sc_capwap_sessionid_element* sessionid, uint8_t binding, uint16_t mtu) {
+int sc_capwap_newsession(const struct sc_capwap_sessionid_element* sessionid, uint8_t binding, uint16_t mtu, uint32_t flags) {
 	struct sc_capwap_session_priv* sessionpriv;
 
 	TRACEKMOD("### sc_capwap_newsession\n");
@@ -568,6 +745,7 @@ int sc_capwap_newsession(const struct sc_capwap_sessionid_element* sessionid, ui
 	memcpy(&sessionpriv->session.sessionid, sessionid, sizeof(struct sc_capwap_sessionid_element));
 	sessionpriv->binding = binding;
 	sessionpriv->session.mtu = mtu;
+	sessionpriv->session.dtlsdatachannel = ((flags & NLSMARTCAPWAP_FLAGS_DTLS_DATA_CHANNEL) ? 1 : 0);
 	INIT_LIST_HEAD(&sessionpriv->list_stations);
 	INIT_LIST_HEAD(&sessionpriv->list_connections);
 
@@ -587,6 +765,7 @@ int sc_capwap_init(void) {
 	int err = -ENOMEM;
 
 	TRACEKMOD("### sc_capwap_init\n");
+	BUILD_BUG_ON(sizeof(struct sc_skb_capwap_cb) > FIELD_SIZEOF(struct sk_buff, cb));
 
 	/* Init session */
 	memset(&sc_localaddr, 0, sizeof(union capwap_addr));
@@ -598,7 +777,6 @@ int sc_capwap_init(void) {
 	memset(sc_session_hash_sessionid, 0, sizeof(struct sc_capwap_session_priv*) * SESSION_HASH_SIZE);
 
 	/* Create threads */
-	sc_session_threads_pos = 0;
 	sc_session_threads_count = 0;
 	for_each_online_cpu(cpu) {
 		memset(&sc_session_threads[sc_session_threads_count], 0, sizeof(struct sc_capwap_workthread));
@@ -629,10 +807,17 @@ int sc_capwap_init(void) {
 	/* Start threads */
 	for (i = 0; i < sc_session_threads_count; i++) {
 		skb_queue_head_init(&sc_session_threads[i].queue);
-		init_waitqueue_head(&sc_session_threads[i].waitevent);
+		__skb_queue_head_init(&sc_session_threads[i].batch);
+		sc_session_threads[i].stats.intervalstart = ktime_get();
 		wake_up_process(sc_session_threads[i].thread);
 	}
 
+	/* Statistics of threads, debugfs is optional */
+	sc_debugfs_dir = debugfs_create_dir("smartcapwap", NULL);
+	if (!IS_ERR_OR_NULL(sc_debugfs_dir)) {
+		debugfs_create_file("stats", S_IRUSR, sc_debugfs_dir, NULL, &sc_capwap_stats_fops);
+	}
+
 	return 0;
 
 error:
@@ -656,6 +841,10 @@ void sc_capwap_close(void) {
 	sc_capwap_closesessions();
 	sc_iface_closeall();
 
+	/* */
+	debugfs_remove_recursive(sc_debugfs_dir);
+	sc_debugfs_dir = NULL;
+
 	/* Terminate threads */
 	for (i = 0; i < sc_session_threads_count; i++) {
 		kthread_stop(sc_session_threads[i].thread);
@@ -752,26 +941,115 @@ int sc_capwap_removewlan(const struct sc_capwap_sessionid_element* sessionid, ui
 }
 
 /* */
+int sc_capwap_setdtlskeys(const struct sc_capwap_sessionid_element* sessionid, const union capwap_addr* sockaddr, struct sc_dtls_keys* keys) {
+	struct sc_dtls_keys* oldkeys;
+	struct sc_capwap_session_priv* search;
+	struct sc_capwap_session_priv* sessionpriv;
+
+	TRACEKMOD("### sc_capwap_setdtlskeys\n");
+
+	/* */
+	sc_capwap_update_lock();
+
+	/* Search into running session, otherwise the DTLS handshake bind the setup session to peer address */
+	sessionpriv = sc_capwap_getsession_sessionid(sessionid);
+	if (!sessionpriv) {
+		list_for_each_entry(search, &sc_session_setup_list, list) {
+			if (!memcmp(&search->session.sessionid, sessionid, sizeof(struct sc_capwap_sessionid_element))) {
+				sessionpriv = search;
+				break;
+			}
+		}
+
+		if (!sessionpriv) {
+			sc_capwap_update_unlock();
+			TRACEKMOD("*** Session not found\n");
+			return -ENOENT;
+		}
+
+		sc_capwap_runsession(sessionpriv, sockaddr);
+	}
+
+	/* Replace keys */
+	oldkeys = rcu_dereference_protected(sessionpriv->session.dtls, sc_capwap_update_lock_is_locked());
+	rcu_assign_pointer(sessionpriv->session.dtls, keys);
+
+	sc_capwap_update_unlock();
+
+	/* */
+	if (oldkeys) {
+		synchronize_net();
+		sc_dtls_freekeys(oldkeys);
+	}
+
+	return 0;
+}
+
+/* */
+static uint32_t sc_capwap_flowhash(struct sk_buff* skb) {
+	struct ethhdr* eh;
+	struct sc_skb_capwap_cb* cb = CAPWAP_SKB_CB(skb);
+
+	TRACEKMOD("### sc_capwap_flowhash\n");
+
+	if (cb->flags & SKB_CAPWAP_FLAG_FROM_USER_SPACE) {
+		return jhash2(cb->sessionid.id32, 4, 0);
+	} else if (cb->flags & SKB_CAPWAP_FLAG_FROM_DATA_CHANNEL) {
+		/* The data channel of WTP is a single UDP flow, reuse the RSS hash when available */
+		return skb_get_hash(skb);
+	} else if (cb->flags & SKB_CAPWAP_FLAG_FROM_AC_TAP) {
+		eh = eth_hdr(skb);
+		return jhash((is_multicast_ether_addr(eh->h_dest) ? eh->h_source : eh->h_dest), ETH_ALEN, 0);
+	}
+
+	return 0;
+}
+
+/* Packets are dispatched to the worker threads by flow: data channel by peer
+   address, packets from userspace by session id and packets from TAP interface
+   by station address (by source address for broadcast/multicast). A worker
+   processes its queue in order, so the packets of the same flow are delivered
+   in the same order they were received; the order among different flows,
+   also when they use the same tunnel, is not guaranteed */
 void sc_capwap_recvpacket(struct sk_buff* skb) {
 	uint32_t pos;
+	int wakeup;
+	unsigned long flags;
+	struct sc_capwap_workthread* thread;
 
 	TRACEKMOD("### sc_capwap_recvpacket\n");
 
-	spin_lock(&sc_session_threads_lock);
-	sc_session_threads_pos = ((sc_session_threads_pos + 1) % sc_session_threads_count);
-	pos = sc_session_threads_pos;
-	spin_unlock(&sc_session_threads_lock);
+	pos = (uint32_t)(((uint64_t)sc_capwap_flowhash(skb) * sc_session_threads_count) >> 32);
+	thread = &sc_session_threads[pos];
 
 	TRACEKMOD("*** Add packet (flags 0x%04x size %d) to thread: %u\n", (int)CAPWAP_SKB_CB(skb)->flags, (int)skb->len, pos);
 
 	/* Queue packet */
-	skb_queue_tail(&sc_session_threads[pos].queue, skb);
-	wake_up_interruptible(&sc_session_threads[pos].waitevent);
+	CAPWAP_SKB_CB(skb)->tstamp = ktime_get();
+	spin_lock_irqsave(&thread->queue.lock, flags);
+	if (skb_queue_len(&thread->queue) >= WORKER_THREAD_MAX_BACKLOG) {
+		thread->stats.dropped++;
+		spin_unlock_irqrestore(&thread->queue.lock, flags);
+
+		TRACEKMOD("*** Backlog of thread %u full\n", pos);
+		kfree_skb(skb);
+		return;
+	}
+
+	__skb_queue_tail(&thread->queue, skb);
+
+	/* Wake up thread only if it is not already polling */
+	wakeup = !thread->scheduled;
+	thread->scheduled = 1;
+	spin_unlock_irqrestore(&thread->queue.lock, flags);
+
+	if (wakeup) {
+		wake_up_process(thread->thread);
+	}
 }
 
 /* */
 struct sc_capwap_session* sc_capwap_recvunknownkeepalive(const union capwap_addr* sockaddr, const struct sc_capwap_sessionid_element* sessionid) {
-	uint32_t hash;
 	struct sc_capwap_session_priv* search;
 	struct sc_capwap_session_priv* sessionpriv = NULL;
 
@@ -801,25 +1079,14 @@ struct sc_capwap_session* sc_capwap_recvunknownkeepalive(const union capwap_addr
 	if (!sessionpriv) {
 		TRACEKMOD("*** Setup session not found\n");
 		goto done;
+	} else if (sessionpriv->session.dtlsdatachannel) {
+		TRACEKMOD("*** Plain keep-alive into DTLS data channel\n");
+		sessionpriv = NULL;
+		goto done;
 	}
 
 	/* */
-	list_del_rcu(&sessionpriv->list);
-	synchronize_net();
-
-	/* */
-	memcpy(&sessionpriv->session.peeraddr, sockaddr, sizeof(union capwap_addr));
-	list_add_rcu(&sessionpriv->list, &sc_session_running_list);
-
-	/* */
-	hash = sc_capwap_hash_ipaddr(sockaddr);
-	sessionpriv->next_ipaddr = rcu_dereference_protected(sc_session_hash_ipaddr[hash], sc_capwap_update_lock_is_locked());
-	rcu_assign_pointer(sc_session_hash_ipaddr[hash], sessionpriv);
-
-	/* */
-	hash = sc_capwap_hash_sessionid(sessionid);
-	sessionpriv->next_sessionid = rcu_dereference_protected(sc_session_hash_sessionid[hash], sc_capwap_update_lock_is_locked());
-	rcu_assign_pointer(sc_session_hash_sessionid[hash], sessionpriv);
+	sc_capwap_runsession(sessionpriv, sockaddr);
 
 done:
 	rcu_read_lock();
@@ -27,12 +27,34 @@ struct sc_capwap_session_priv {
 	struct sc_capwap_wlan wlans[CAPWAP_RADIOID_MAX_COUNT][CAPWAP_WLANID_MAX_COUNT];
 };
 
+/* */
+struct sc_capwap_workthread_stats {
+	unsigned long packets;
+	unsigned long polls;
+	unsigned long dropped;
+
+	/* Time from queue to end of processing */
+	u64 latency;
+	u64 maxlatency;
+
+	/* Packets per second of last complete interval */
+	ktime_t intervalstart;
+	unsigned long intervalpackets;
+	unsigned long pps;
+};
+
 /* */
 struct sc_capwap_workthread {
 	struct task_struct* thread;
 
+	/* Backlog filled by any cpu, the thread is woken up only when it is idle */
 	struct sk_buff_head queue;
-	wait_queue_head_t waitevent;
+	int scheduled;
+
+	/* Packets of current poll, owned by thread */
+	struct sk_buff_head batch;
+
+	struct sc_capwap_workthread_stats stats;
 };
 
 /* */
@@ -53,13 +75,16 @@ static inline int sc_capwap_update_lock_is_locked(void) { return 1; }
 int sc_capwap_sendkeepalive(const struct sc_capwap_sessionid_element* sessionid);
 
 /* */
-int sc_capwap_newsession(const struct sc_capwap_sessionid_element* sessionid, uint8_t binding, uint16_t mtu);
+int sc_capwap_newsession(const struct sc_capwap_sessionid_element* sessionid, uint8_t binding, uint16_t mtu, uint32_t flags);
 int sc_capwap_deletesession(const struct sc_capwap_sessionid_element* sessionid);
 
 /* */
 int sc_capwap_addwlan(const struct sc_capwap_sessionid_element* sessionid, uint8_t radioid, uint8_t wlanid, const uint8_t* bssid, uint8_t macmode, uint8_t tunnelmode);
 int sc_capwap_removewlan(const struct sc_capwap_sessionid_element* sessionid, uint8_t radioid, uint8_t wlanid);
 
+/* */
+int sc_capwap_setdtlskeys(const struct sc_capwap_sessionid_element* sessionid, const union capwap_addr* sockaddr, struct sc_dtls_keys* keys);
+
 /* */
 int sc_capwap_authstation(const struct sc_capwap_sessionid_element* sessionid, const uint8_t* address, uint32_t ifindex, uint8_t radioid, uint8_t wlanid, uint16_t vlan);
 int sc_capwap_deauthstation(const struct sc_capwap_sessionid_element* sessionid, const uint8_t* address);
@@ -0,0 +1,386 @@
+#include "config.h"
+#include <linux/version.h>
+#include <linux/module.h>
+#include <linux/slab.h>
+#include <linux/err.h>
+#include <linux/scatterlist.h>
+#include <crypto/aead.h>
+#include "capwap_rfc.h"
+#include "nlsmartcapwap.h"
+#include "dtls.h"
+
+/* kzfree was renamed kfree_sensitive in Linux 5.9 and removed in 5.10 */
+#if LINUX_VERSION_CODE < KERNEL_VERSION(5,9,0)
+#define kfree_sensitive(x)					kzfree(x)
+#endif
+
+/* Additional data of AEAD cipher (RFC 5246 6.2.3.3) */
+struct sc_dtls_aad {
+	__be16 epoch;
+	uint8_t sequence[6];
+	uint8_t type;
+	__be16 version;
+	__be16 length;
+} __packed;
+
+/* Temporary memory of a single crypto operation, followed by the aead request */
+struct sc_dtls_tmp {
+	struct scatterlist sg[2];
+	struct sc_dtls_aad aad;
+	uint8_t iv[SC_DTLS_IV_LENGTH];
+};
+
+/* */
+static uint64_t sc_dtls_get_sequence(const uint8_t* sequence) {
+	return ((uint64_t)sequence[0] << 40) | ((uint64_t)sequence[1] << 32) | ((uint64_t)sequence[2] << 24) | ((uint64_t)sequence[3] << 16) | ((uint64_t)sequence[4] << 8) | (uint64_t)sequence[5];
+}
+
+/* */
+static void sc_dtls_set_sequence(uint8_t* sequence, uint64_t value) {
+	sequence[0] = (uint8_t)(value >> 40);
+	sequence[1] = (uint8_t)(value >> 32);
+	sequence[2] = (uint8_t)(value >> 24);
+	sequence[3] = (uint8_t)(value >> 16);
+	sequence[4] = (uint8_t)(value >> 8);
+	sequence[5] = (uint8_t)value;
+}
+
+/* */
+static struct crypto_aead* sc_dtls_createaead(uint8_t cipher, const uint8_t* key, int keylength) {
+	int err;
+	struct crypto_aead* aead;
+
+	TRACEKMOD("### sc_dtls_createaead\n");
+
+	if (cipher != NLSMARTCAPWAP_DTLS_CIPHER_AES_GCM) {
+		return ERR_PTR(-EINVAL);
+	}
+
+	/* Only synchronous implementation, the records are processed by worker threads */
+	aead = crypto_alloc_aead("gcm(aes)", 0, CRYPTO_ALG_ASYNC);
+	if (IS_ERR(aead)) {
+		return aead;
+	}
+
+	/* */
+	err = crypto_aead_setkey(aead, key, keylength);
+	if (!err) {
+		err = crypto_aead_setauthsize(aead, SC_DTLS_TAG_LENGTH);
+	}
+
+	if (err) {
+		crypto_free_aead(aead);
+		return ERR_PTR(err);
+	}
+
+	return aead;
+}
+
+/* */
+static struct sc_dtls_tmp* sc_dtls_alloc_tmp(struct crypto_aead* aead, struct aead_request** req) {
+	struct sc_dtls_tmp* tmp;
+	unsigned int offset = ALIGN(sizeof(struct sc_dtls_tmp), crypto_tfm_ctx_alignment());
+
+	tmp = (struct sc_dtls_tmp*)kmalloc(offset + sizeof(struct aead_request) + crypto_aead_reqsize(aead), GFP_ATOMIC);
+	if (!tmp) {
+		return NULL;
+	}
+
+	/* */
+	*req = (struct aead_request*)((uint8_t*)tmp + offset);
+	aead_request_set_tfm(*req, aead);
+	aead_request_set_callback(*req, 0, NULL, NULL);
+
+	return tmp;
+}
+
+/* */
+static int sc_dtls_replay_check(struct sc_dtls_keys* keys, uint64_t sequence) {
+	uint64_t delta;
+
+	if (sequence > keys->rxsequence) {
+		return 0;
+	}
+
+	delta = keys->rxsequence - sequence;
+	if ((delta >= 64) || (keys->replaybitmap & (1ULL << delta))) {
+		return -EINVAL;
+	}
+
+	return 0;
+}
+
+/* */
+static void sc_dtls_replay_update(struct sc_dtls_keys* keys, uint64_t sequence) {
+	uint64_t delta;
+
+	if (sequence > keys->rxsequence) {
+		delta = sequence - keys->rxsequence;
+		keys->replaybitmap = ((delta < 64) ? ((keys->replaybitmap << delta) | 1) : 1);
+		keys->rxsequence = sequence;
+	} else {
+		keys->replaybitmap |= 1ULL << (keys->rxsequence - sequence);
+	}
+}
+
+/* */
+struct sc_dtls_keys* sc_dtls_createkeys(uint8_t cipher, uint16_t epoch, uint64_t txsequence, const uint8_t* rxkey, const uint8_t* rxsalt, const uint8_t* txkey, const uint8_t* txsalt, int keylength) {
+	int err;
+	struct sc_dtls_keys* keys;
+
+	TRACEKMOD("### sc_dtls_createkeys\n");
+
+	/* */
+	keys = (struct sc_dtls_keys*)kzalloc(sizeof(struct sc_dtls_keys), GFP_KERNEL);
+	if (!keys) {
+		return ERR_PTR(-ENOMEM);
+	}
+
+	/* */
+	keys->rx = sc_dtls_createaead(cipher, rxkey, keylength);
+	if (IS_ERR(keys->rx)) {
+		err = PTR_ERR(keys->rx);
+		keys->rx = NULL;
+		goto error;
+	}
+
+	keys->tx = sc_dtls_createaead(cipher, txkey, keylength);
+	if (IS_ERR(keys->tx)) {
+		err = PTR_ERR(keys->tx);
+		keys->tx = NULL;
+		goto error;
+	}
+
+	/* */
+	memcpy(keys->rxsalt, rxsalt, SC_DTLS_SALT_LENGTH);
+	memcpy(keys->txsalt, txsalt, SC_DTLS_SALT_LENGTH);
+	keys->epoch = epoch;
+	atomic64_set(&keys->txsequence, txsequence);
+
+	/* The first record of epoch is the Finished message of handshake */
+	spin_lock_init(&keys->replaylock);
+	keys->rxsequence = 0;
+	keys->replaybitmap = 1;
+
+	return keys;
+
+error:
+	sc_dtls_freekeys(keys);
+	return ERR_PTR(err);
+}
+
+/* */
+void sc_dtls_freekeys(struct sc_dtls_keys* keys) {
+	TRACEKMOD("### sc_dtls_freekeys\n");
+
+	if (keys) {
+		if (keys->rx) {
+			crypto_free_aead(keys->rx);
+		}
+
+		if (keys->tx) {
+			crypto_free_aead(keys->tx);
+		}
+
+		kfree_sensitive(keys);
+	}
+}
+
+/* */
+int sc_dtls_is_applicationdata(struct sk_buff* skb) {
+	struct sc_dtls_record* record;
+
+	if (skb->len < (sizeof(struct sc_capwap_dtls_header) + sizeof(struct sc_dtls_record))) {
+		return 0;
+	}
+
+	record = (struct sc_dtls_record*)(skb->data + sizeof(struct sc_capwap_dtls_header));
+	return ((record->type == SC_DTLS_RECORD_TYPE_APPLICATION_DATA) ? 1 : 0);
+}
+
+/* Decrypt in place a linear socket buffer, on success the socket buffer contains the plain CAPWAP packet */
+int sc_dtls_decrypt(struct sc_dtls_keys* keys, struct sk_buff* skb) {
+	int err;
+	int length;
+	uint64_t sequence;
+	struct sc_dtls_tmp* tmp;
+	struct aead_request* req;
+	struct sc_dtls_record* record;
+	int headersize = sizeof(struct sc_capwap_dtls_header) + sizeof(struct sc_dtls_record);
+
+	TRACEKMOD("### sc_dtls_decrypt\n");
+
+	/* Check record */
+	if (skb->len < (headersize + SC_DTLS_EXPLICIT_NONCE_LENGTH + SC_DTLS_TAG_LENGTH)) {
+		TRACEKMOD("*** Invalid DTLS record length\n");
+		return -EINVAL;
+	}
+
+	record = (struct sc_dtls_record*)(skb->data + sizeof(struct sc_capwap_dtls_header));
+	length = be16_to_cpu(record->length);
+	if ((record->version != cpu_to_be16(SC_DTLS_1_2_VERSION)) || (be16_to_cpu(record->epoch) != keys->epoch) || (length != (skb->len - headersize))) {
+		TRACEKMOD("*** Invalid DTLS record header\n");
+		return -EINVAL;
+	}
+
+	/* Drop replayed record before decrypt */
+	sequence = sc_dtls_get_sequence(record->sequence);
+
+	spin_lock(&keys->replaylock);
+	err = sc_dtls_replay_check(keys, sequence);
+	spin_unlock(&keys->replaylock);
+
+	if (err) {
+		TRACEKMOD("*** Replayed DTLS record %llu\n", sequence);
+		return err;
+	}
+
+	/* Socket buffer is shared with the clones */
+	if (skb_cloned(skb) && pskb_expand_head(skb, 0, 0, GFP_ATOMIC)) {
+		return -ENOMEM;
+	}
+
+	record = (struct sc_dtls_record*)(skb->data + sizeof(struct sc_capwap_dtls_header));
+
+	/* */
+	tmp = sc_dtls_alloc_tmp(keys->rx, &req);
+	if (!tmp) {
+		return -ENOMEM;
+	}
+
+	/* Ciphertext with authentication tag */
+	length -= SC_DTLS_EXPLICIT_NONCE_LENGTH;
+
+	tmp->aad.epoch = record->epoch;
+	memcpy(tmp->aad.sequence, record->sequence, sizeof(tmp->aad.sequence));
+	tmp->aad.type = record->type;
+	tmp->aad.version = record->version;
+	tmp->aad.length = cpu_to_be16(length - SC_DTLS_TAG_LENGTH);
+
+	memcpy(tmp->iv, keys->rxsalt, SC_DTLS_SALT_LENGTH);
+	memcpy(&tmp->iv[SC_DTLS_SALT_LENGTH], (uint8_t*)record + sizeof(struct sc_dtls_record), SC_DTLS_EXPLICIT_NONCE_LENGTH);
+
+	sg_init_table(tmp->sg, 2);
+	sg_set_buf(&tmp->sg[0], &tmp->aad, sizeof(struct sc_dtls_aad));
+	sg_set_buf(&tmp->sg[1], (uint8_t*)record + sizeof(struct sc_dtls_record) + SC_DTLS_EXPLICIT_NONCE_LENGTH, length);
+
+	aead_request_set_crypt(req, tmp->sg, tmp->sg, length, tmp->iv);
+	aead_request_set_ad(req, sizeof(struct sc_dtls_aad));
+
+	/* */
+	err = crypto_aead_decrypt(req);
+	kfree(tmp);
+
+	if (err) {
+		TRACEKMOD("*** Unable to authenticate DTLS record: %d\n", err);
+		return -EBADMSG;
+	}
+
+	/* Update window only with authenticated record */
+	spin_lock(&keys->replaylock);
+	err = sc_dtls_replay_check(keys, sequence);
+	if (!err) {
+		sc_dtls_replay_update(keys, sequence);
+	}
+	spin_unlock(&keys->replaylock);
+
+	if (err) {
+		return err;
+	}
+
+	/* Remove DTLS header and tag */
+	skb_pull(skb, headersize + SC_DTLS_EXPLICIT_NONCE_LENGTH);
+	skb_trim(skb, length - SC_DTLS_TAG_LENGTH);
+
+	return 0;
+}
+
+/* Build into buffer the DTLS preamble and the record of CAPWAP packet, return the length of datagram */
+int sc_dtls_encrypt(struct sc_dtls_keys* keys, const struct kvec* vec, int count, uint8_t* buffer, int size) {
+	int i;
+	int err;
+	int length = 0;
+	uint8_t* payload;
+	uint64_t sequence;
+	struct sc_dtls_tmp* tmp;
+	struct aead_request* req;
+	struct sc_dtls_record* record;
+	struct sc_capwap_dtls_header* dtlsheader;
+
+	TRACEKMOD("### sc_dtls_encrypt\n");
+
+	/* */
+	for (i = 0; i < count; i++) {
+		length += vec[i].iov_len;
+	}
+
+	if (size < (length + SC_DTLS_OVERHEAD)) {
+		return -ENOMEM;
+	}
+
+	/* The keys must be renegotiated before the sequence number wraps */
+	sequence = (uint64_t)atomic64_inc_return(&keys->txsequence) - 1;
+	if (sequence > SC_DTLS_MAX_SEQUENCE) {
+		TRACEKMOD("*** DTLS sequence number exhausted\n");
+		return -EOVERFLOW;
+	}
+
+	/* DTLS preamble */
+	dtlsheader = (struct sc_capwap_dtls_header*)buffer;
+	memset(dtlsheader, 0, sizeof(struct sc_capwap_dtls_header));
+	dtlsheader->preamble.version = CAPWAP_PROTOCOL_VERSION;
+	dtlsheader->preamble.type = CAPWAP_PREAMBLE_DTLS_HEADER;
+
+	/* Record header, the explicit nonce is the epoch and sequence number */
+	record = (struct sc_dtls_record*)(buffer + sizeof(struct sc_capwap_dtls_header));
+	record->type = SC_DTLS_RECORD_TYPE_APPLICATION_DATA;
+	record->version = cpu_to_be16(SC_DTLS_1_2_VERSION);
+	record->epoch = cpu_to_be16(keys->epoch);
+	sc_dtls_set_sequence(record->sequence, sequence);
+	record->length = cpu_to_be16(SC_DTLS_EXPLICIT_NONCE_LENGTH + length + SC_DTLS_TAG_LENGTH);
+
+	payload = (uint8_t*)record + sizeof(struct sc_dtls_record);
+	memcpy(payload, &record->epoch, SC_DTLS_EXPLICIT_NONCE_LENGTH);
+	payload += SC_DTLS_EXPLICIT_NONCE_LENGTH;
+
+	/* Gather the packet and encrypt in place, the packet can be on stack */
+	for (i = 0; i < count; i++) {
+		memcpy(payload, vec[i].iov_base, vec[i].iov_len);
+		payload += vec[i].iov_len;
+	}
+
+	payload -= length;
+
+	/* */
+	tmp = sc_dtls_alloc_tmp(keys->tx, &req);
+	if (!tmp) {
+		return -ENOMEM;
+	}
+
+	tmp->aad.epoch = record->epoch;
+	memcpy(tmp->aad.sequence, record->sequence, sizeof(tmp->aad.sequence));
+	tmp->aad.type = record->type;
+	tmp->aad.version = record->version;
+	tmp->aad.length = cpu_to_be16(length);
+
+	memcpy(tmp->iv, keys->txsalt, SC_DTLS_SALT_LENGTH);
+	memcpy(&tmp->iv[SC_DTLS_SALT_LENGTH], &record->epoch, SC_DTLS_EXPLICIT_NONCE_LENGTH);
+
+	sg_init_table(tmp->sg, 2);
+	sg_set_buf(&tmp->sg[0], &tmp->aad, sizeof(struct sc_dtls_aad));
+	sg_set_buf(&tmp->sg[1], payload, length + SC_DTLS_TAG_LENGTH);
+
+	aead_request_set_crypt(req, tmp->sg, tmp->sg, length, tmp->iv);
+	aead_request_set_ad(req, sizeof(struct sc_dtls_aad));
+
+	/* */
+	err = crypto_aead_encrypt(req);
+	kfree(tmp);
+
+	if (err) {
+		TRACEKMOD("*** Unable to encrypt DTLS record: %d\n", err);
+		return err;
+	}
+
+	return length + SC_DTLS_OVERHEAD;
+}
@@ -0,0 +1,60 @@
+#ifndef __KMOD_DTLS_HEADER__
+#define __KMOD_DTLS_HEADER__
+
+#include <linux/spinlock.h>
+#include <linux/atomic.h>
+#include <linux/skbuff.h>
+#include <linux/uio.h>
+#include <crypto/aead.h>
+#include "capwap_rfc.h"
+
+/* DTLS 1.2 record layer of data channel, only AEAD cipher with explicit nonce (RFC 5288).
+   The handshake is made by userspace that push the keys of epoch */
+#define SC_DTLS_1_2_VERSION						0xfefd
+#define SC_DTLS_RECORD_TYPE_APPLICATION_DATA	23
+
+#define SC_DTLS_MAX_KEY_LENGTH					32
+#define SC_DTLS_SALT_LENGTH						4
+#define SC_DTLS_EXPLICIT_NONCE_LENGTH			8
+#define SC_DTLS_IV_LENGTH						(SC_DTLS_SALT_LENGTH + SC_DTLS_EXPLICIT_NONCE_LENGTH)
+#define SC_DTLS_TAG_LENGTH						16
+#define SC_DTLS_MAX_SEQUENCE					0xffffffffffffULL
+
+/* */
+struct sc_dtls_record {
+	uint8_t type;
+	__be16 version;
+	__be16 epoch;
+	uint8_t sequence[6];
+	__be16 length;
+} __packed;
+
+/* Size added to CAPWAP packet by DTLS preamble and record */
+#define SC_DTLS_OVERHEAD						(sizeof(struct sc_capwap_dtls_header) + sizeof(struct sc_dtls_record) + SC_DTLS_EXPLICIT_NONCE_LENGTH + SC_DTLS_TAG_LENGTH)
+
+/* */
+struct sc_dtls_keys {
+	struct crypto_aead* rx;
+	struct crypto_aead* tx;
+	uint8_t rxsalt[SC_DTLS_SALT_LENGTH];
+	uint8_t txsalt[SC_DTLS_SALT_LENGTH];
+
+	uint16_t epoch;
+	atomic64_t txsequence;
+
+	/* Anti-replay window (RFC 6347 4.1.2.6), records are decrypted by many threads */
+	spinlock_t replaylock;
+	uint64_t rxsequence;
+	uint64_t replaybitmap;
+};
+
+/* */
+struct sc_dtls_keys* sc_dtls_createkeys(uint8_t cipher, uint16_t epoch, uint64_t txsequence, const uint8_t* rxkey, const uint8_t* rxsalt, const uint8_t* txkey, const uint8_t* txsalt, int keylength);
+void sc_dtls_freekeys(struct sc_dtls_keys* keys);
+
+/* */
+int sc_dtls_is_applicationdata(struct sk_buff* skb);
+int sc_dtls_decrypt(struct sc_dtls_keys* keys, struct sk_buff* skb);
+int sc_dtls_encrypt(struct sc_dtls_keys* keys, const struct kvec* vec, int count, uint8_t* buffer, int size);
+
+#endif /* __KMOD_DTLS_HEADER__ */
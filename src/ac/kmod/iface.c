@@ -154,6 +154,9 @@ static void sc_iface_netdev_setup(struct net_device* dev) {
 	spin_lock_init(&devpriv->lock);
 	INIT_LIST_HEAD(&devpriv->list_stations);
 	INIT_LIST_HEAD(&devpriv->list_connections);
+
+	/* Room for IEEE 802.11 header without reallocate the head on transmit */
+	dev->needed_headroom = CAPWAP_8023_TO_80211_HEADROOM;
 }
 
 /* */
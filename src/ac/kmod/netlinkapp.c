@@ -135,6 +135,7 @@ static int sc_netlink_send_data(struct sk_buff* skb, struct genl_info* info) {
 /* */
 static int sc_netlink_new_session(struct sk_buff* skb, struct genl_info* info) {
 	uint16_t mtu = DEFAULT_MTU;
+	uint32_t flags = 0;
 
 	TRACEKMOD("### sc_netlink_new_session\n");
 
@@ -156,8 +157,13 @@ static int sc_netlink_new_session(struct sk_buff* skb, struct genl_info* info) {
 		}
 	}
 
+	/* Get flags */
+	if (info->attrs[NLSMARTCAPWAP_ATTR_FLAGS]) {
+		flags = nla_get_u32(info->attrs[NLSMARTCAPWAP_ATTR_FLAGS]);
+	}
+
 	/* New session */
-	return sc_capwap_newsession((struct sc_capwap_sessionid_element*)nla_data(info->attrs[NLSMARTCAPWAP_ATTR_SESSION_ID]), nla_get_u8(info->attrs[NLSMARTCAPWAP_ATTR_BINDING]), mtu);
+	return sc_capwap_newsession((struct sc_capwap_sessionid_element*)nla_data(info->attrs[NLSMARTCAPWAP_ATTR_SESSION_ID]), nla_get_u8(info->attrs[NLSMARTCAPWAP_ATTR_BINDING]), mtu, flags);
 }
 
 /* */
@@ -285,6 +291,87 @@ static int sc_netlink_deauth_station(struct sk_buff* skb, struct genl_info* info
 	return sc_capwap_deauthstation((struct sc_capwap_sessionid_element*)nla_data(info->attrs[NLSMARTCAPWAP_ATTR_SESSION_ID]), (uint8_t*)nla_data(info->attrs[NLSMARTCAPWAP_ATTR_MACADDRESS]));
 }
 
+/* */
+static int sc_netlink_set_dtls_keys(struct sk_buff* skb, struct genl_info* info) {
+	int ret;
+	int keylength;
+	uint64_t sequence = NLSMARTCAPWAP_DTLS_FIRST_SEQUENCE;
+	union capwap_addr sockaddr;
+	struct sc_dtls_keys* keys;
+
+	TRACEKMOD("### sc_netlink_set_dtls_keys\n");
+
+	/* Check Link */
+	if (!sc_netlink_usermodeid) {
+		return -ENOLINK;
+	}
+
+	/* Check params */
+	if (!info->attrs[NLSMARTCAPWAP_ATTR_SESSION_ID] || !info->attrs[NLSMARTCAPWAP_ATTR_ADDRESS] || !info->attrs[NLSMARTCAPWAP_ATTR_DTLS_CIPHER] || !info->attrs[NLSMARTCAPWAP_ATTR_DTLS_EPOCH] ||
+		!info->attrs[NLSMARTCAPWAP_ATTR_DTLS_RX_KEY] || !info->attrs[NLSMARTCAPWAP_ATTR_DTLS_RX_SALT] || !info->attrs[NLSMARTCAPWAP_ATTR_DTLS_TX_KEY] || !info->attrs[NLSMARTCAPWAP_ATTR_DTLS_TX_SALT]) {
+		return -EINVAL;
+	}
+
+	/* */
+	keylength = nla_len(info->attrs[NLSMARTCAPWAP_ATTR_DTLS_RX_KEY]);
+	if ((keylength != nla_len(info->attrs[NLSMARTCAPWAP_ATTR_DTLS_TX_KEY])) || (nla_len(info->attrs[NLSMARTCAPWAP_ATTR_DTLS_RX_SALT]) != SC_DTLS_SALT_LENGTH) || (nla_len(info->attrs[NLSMARTCAPWAP_ATTR_DTLS_TX_SALT]) != SC_DTLS_SALT_LENGTH)) {
+		return -EINVAL;
+	}
+
+	memcpy(&sockaddr.ss, nla_data(info->attrs[NLSMARTCAPWAP_ATTR_ADDRESS]), sizeof(struct sockaddr_storage));
+	if ((sockaddr.ss.ss_family != AF_INET) && (sockaddr.ss.ss_family != AF_INET6)) {
+		return -EINVAL;
+	}
+
+	/* First sequence number of epoch */
+	if (info->attrs[NLSMARTCAPWAP_ATTR_DTLS_SEQUENCE]) {
+		sequence = nla_get_u64(info->attrs[NLSMARTCAPWAP_ATTR_DTLS_SEQUENCE]);
+	}
+
+	/* */
+	keys = sc_dtls_createkeys(nla_get_u8(info->attrs[NLSMARTCAPWAP_ATTR_DTLS_CIPHER]), nla_get_u16(info->attrs[NLSMARTCAPWAP_ATTR_DTLS_EPOCH]), sequence,
+							  (uint8_t*)nla_data(info->attrs[NLSMARTCAPWAP_ATTR_DTLS_RX_KEY]), (uint8_t*)nla_data(info->attrs[NLSMARTCAPWAP_ATTR_DTLS_RX_SALT]),
+							  (uint8_t*)nla_data(info->attrs[NLSMARTCAPWAP_ATTR_DTLS_TX_KEY]), (uint8_t*)nla_data(info->attrs[NLSMARTCAPWAP_ATTR_DTLS_TX_SALT]), keylength);
+	if (IS_ERR(keys)) {
+		return PTR_ERR(keys);
+	}
+
+	/* */
+	ret = sc_capwap_setdtlskeys((struct sc_capwap_sessionid_element*)nla_data(info->attrs[NLSMARTCAPWAP_ATTR_SESSION_ID]), &sockaddr, keys);
+	if (ret) {
+		sc_dtls_freekeys(keys);
+	}
+
+	return ret;
+}
+
+/* */
+static int sc_netlink_send_dtls(struct sk_buff* skb, struct genl_info* info) {
+	int ret;
+	union capwap_addr sockaddr;
+
+	TRACEKMOD("### sc_netlink_send_dtls\n");
+
+	/* Check Link */
+	if (!sc_netlink_usermodeid) {
+		return -ENOLINK;
+	}
+
+	/* Check params */
+	if (!info->attrs[NLSMARTCAPWAP_ATTR_ADDRESS] || !info->attrs[NLSMARTCAPWAP_ATTR_DATA_FRAME]) {
+		return -EINVAL;
+	}
+
+	memcpy(&sockaddr.ss, nla_data(info->attrs[NLSMARTCAPWAP_ATTR_ADDRESS]), sizeof(struct sockaddr_storage));
+	if ((sockaddr.ss.ss_family != AF_INET) && (sockaddr.ss.ss_family != AF_INET6)) {
+		return -EINVAL;
+	}
+
+	/* Send DTLS record built by userspace */
+	ret = sc_socket_send(SOCKET_UDP, (uint8_t*)nla_data(info->attrs[NLSMARTCAPWAP_ATTR_DATA_FRAME]), nla_len(info->attrs[NLSMARTCAPWAP_ATTR_DATA_FRAME]), &sockaddr);
+	return ((ret < 0) ? ret : 0);
+}
+
 /* */
 static int sc_netlink_link(struct sk_buff* skb, struct genl_info* info) {
 	int ret;
@@ -422,6 +509,13 @@ static const struct nla_policy sc_netlink_policy[NLSMARTCAPWAP_ATTR_MAX + 1] = {
 	[NLSMARTCAPWAP_ATTR_MACADDRESS] = { .type = NLA_BINARY, .len = MACADDRESS_EUI48_LENGTH },
 	[NLSMARTCAPWAP_ATTR_BSSID] = { .type = NLA_BINARY, .len = MACADDRESS_EUI48_LENGTH },
 	[NLSMARTCAPWAP_ATTR_VLAN] = { .type = NLA_U16 },
+	[NLSMARTCAPWAP_ATTR_DTLS_CIPHER] = { .type = NLA_U8 },
+	[NLSMARTCAPWAP_ATTR_DTLS_EPOCH] = { .type = NLA_U16 },
+	[NLSMARTCAPWAP_ATTR_DTLS_SEQUENCE] = { .type = NLA_U64 },
+	[NLSMARTCAPWAP_ATTR_DTLS_RX_KEY] = { .type = NLA_BINARY, .len = SC_DTLS_MAX_KEY_LENGTH },
+	[NLSMARTCAPWAP_ATTR_DTLS_RX_SALT] = { .type = NLA_BINARY, .len = SC_DTLS_SALT_LENGTH },
+	[NLSMARTCAPWAP_ATTR_DTLS_TX_KEY] = { .type = NLA_BINARY, .len = SC_DTLS_MAX_KEY_LENGTH },
+	[NLSMARTCAPWAP_ATTR_DTLS_TX_SALT] = { .type = NLA_BINARY, .len = SC_DTLS_SALT_LENGTH },
 };
 
 /* Netlink Ops */
@@ -498,6 +592,18 @@ static struct genl_ops sc_netlink_ops[] = {
 		.policy = sc_netlink_policy,
 		.flags = GENL_ADMIN_PERM,
 	},
+	{
+		.cmd = NLSMARTCAPWAP_CMD_SET_DTLS_KEYS,
+		.doit = sc_netlink_set_dtls_keys,
+		.policy = sc_netlink_policy,
+		.flags = GENL_ADMIN_PERM,
+	},
+	{
+		.cmd = NLSMARTCAPWAP_CMD_SEND_DTLS,
+		.doit = sc_netlink_send_dtls,
+		.policy = sc_netlink_policy,
+		.flags = GENL_ADMIN_PERM,
+	},
 };
 
 /* Netlink notify */
@@ -576,6 +682,43 @@ error:
 	return -ENOMEM;
 }
 
+/* */
+int sc_netlink_notify_recv_dtls(const union capwap_addr* sockaddr, struct sc_capwap_sessionid_element* sessionid, uint8_t* packet, int length) {
+	void* msg;
+	struct sk_buff* sk_msg;
+
+	TRACEKMOD("### sc_netlink_notify_recv_dtls\n");
+
+	/* Alloc message */
+	sk_msg = nlmsg_new(NLMSG_DEFAULT_SIZE, GFP_ATOMIC);
+	if (!sk_msg) {
+		return -ENOMEM;
+	}
+
+	/* Set command */
+	msg = genlmsg_put(sk_msg, 0, 0, &sc_netlink_family, 0, NLSMARTCAPWAP_CMD_RECV_DTLS);
+	if (!msg) {
+		goto error;
+	}
+
+	/* Session id is known only when the session is bound to peer address */
+	if (nla_put(sk_msg, NLSMARTCAPWAP_ATTR_ADDRESS, sizeof(struct sockaddr_storage), &sockaddr->ss) ||
+		(sessionid && nla_put(sk_msg, NLSMARTCAPWAP_ATTR_SESSION_ID, sizeof(struct sc_capwap_sessionid_element), sessionid)) ||
+		nla_put(sk_msg, NLSMARTCAPWAP_ATTR_DATA_FRAME, length, packet)) {
+		goto error2;
+	}
+
+	/* Send message */
+	genlmsg_end(sk_msg, msg);
+	return genlmsg_unicast(&init_net, sk_msg, sc_netlink_usermodeid);
+
+error2:
+	genlmsg_cancel(sk_msg, msg);
+error:
+	nlmsg_free(sk_msg);
+	return -ENOMEM;
+}
+
 /* */
 int sc_netlink_init(void) {
 	int ret;
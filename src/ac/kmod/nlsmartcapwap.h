@@ -6,6 +6,15 @@
 
 /* */
 #define NLSMARTCAPWAP_FLAGS_TUNNEL_8023			0x00000001
+#define NLSMARTCAPWAP_FLAGS_DTLS_DATA_CHANNEL	0x00000002
+
+/* DTLS data channel cipher */
+#define NLSMARTCAPWAP_DTLS_CIPHER_AES_GCM		1
+
+/* The kernel module write the records of epoch from this sequence number. The records
+   sent by userspace after the handshake, as retransmitted Finished, use the lower sequence
+   numbers and never reuse a nonce of kernel module */
+#define NLSMARTCAPWAP_DTLS_FIRST_SEQUENCE		(1ULL << 32)
 
 /* */
 enum sc_netlink_attrs {
@@ -34,6 +43,14 @@ enum sc_netlink_attrs {
 
 	NLSMARTCAPWAP_ATTR_VLAN,
 
+	NLSMARTCAPWAP_ATTR_DTLS_CIPHER,
+	NLSMARTCAPWAP_ATTR_DTLS_EPOCH,
+	NLSMARTCAPWAP_ATTR_DTLS_SEQUENCE,
+	NLSMARTCAPWAP_ATTR_DTLS_RX_KEY,
+	NLSMARTCAPWAP_ATTR_DTLS_RX_SALT,
+	NLSMARTCAPWAP_ATTR_DTLS_TX_KEY,
+	NLSMARTCAPWAP_ATTR_DTLS_TX_SALT,
+
 	/* Last attribute */
 	__NLSMARTCAPWAP_ATTR_AFTER_LAST,
 	NLSMARTCAPWAP_ATTR_MAX = __NLSMARTCAPWAP_ATTR_AFTER_LAST - 1
@@ -65,6 +82,10 @@ enum sc_netlink_commands {
 	NLSMARTCAPWAP_CMD_AUTH_STATION,
 	NLSMARTCAPWAP_CMD_DEAUTH_STATION,
 
+	NLSMARTCAPWAP_CMD_SET_DTLS_KEYS,
+	NLSMARTCAPWAP_CMD_SEND_DTLS,
+	NLSMARTCAPWAP_CMD_RECV_DTLS,
+
 	/* Last command */
 	__NLSMARTCAPWAP_CMD_AFTER_LAST,
 	NLSMARTCAPWAP_CMD_MAX = __NLSMARTCAPWAP_CMD_AFTER_LAST - 1
@@ -131,7 +131,6 @@ int sc_socket_getpeeraddr(struct sk_buff* skb, union capwap_addr* peeraddr) {
 /* */
 int sc_socket_send(int type, uint8_t* buffer, int length, union capwap_addr* sockaddr) {
 	struct kvec vec;
-	struct msghdr msg;
 
 	TRACEKMOD("### sc_socket_send\n");
 
@@ -139,14 +138,81 @@ int sc_socket_send(int type, uint8_t* buffer, int length, union capwap_addr* soc
 	vec.iov_base = buffer;
 	vec.iov_len = length;
 
+	return sc_socket_sendv(type, &vec, 1, sockaddr);
+}
+
+/* Send a datagram gathered from many buffers */
+int sc_socket_sendv(int type, struct kvec* vec, int count, union capwap_addr* sockaddr) {
+	int i;
+	int length = 0;
+	struct msghdr msg;
+
+	TRACEKMOD("### sc_socket_sendv\n");
+
+	/* */
+	for (i = 0; i < count; i++) {
+		length += vec[i].iov_len;
+	}
+
+	/* */
+	memset(&msg, 0, sizeof(struct msghdr));
+	msg.msg_name = sockaddr;
+	msg.msg_namelen = sizeof(union capwap_addr);
+	msg.msg_flags = MSG_NOSIGNAL | MSG_DONTWAIT;
+
+	/* */
+	return kernel_sendmsg(sc_sockets[type], &msg, vec, count, length);
+}
+
+/* Max number of datagrams of a train, 0 without UDP GSO */
+int sc_socket_maxsegments(void) {
+#if defined(UDP_SEGMENT) && defined(UDP_MAX_SEGMENTS)
+	return UDP_MAX_SEGMENTS;
+#else
+	return 0;
+#endif
+}
+
+/* Send a train of datagrams of segmentsize bytes (the last can be shorter)
+   with a single call, the UDP GSO split it after the routing */
+int sc_socket_sendv_segments(int type, struct kvec* vec, int count, union capwap_addr* sockaddr, uint16_t segmentsize, int segments) {
+#if defined(UDP_SEGMENT) && defined(UDP_MAX_SEGMENTS)
+	int i;
+	int length = 0;
+	struct msghdr msg;
+	struct cmsghdr* cmsg;
+	char control[CMSG_SPACE(sizeof(uint16_t))];
+
+	TRACEKMOD("### sc_socket_sendv_segments\n");
+
+	/* */
+	if ((segments < 2) || (segments > UDP_MAX_SEGMENTS)) {
+		return -EOPNOTSUPP;
+	}
+
+	for (i = 0; i < count; i++) {
+		length += vec[i].iov_len;
+	}
+
 	/* */
 	memset(&msg, 0, sizeof(struct msghdr));
 	msg.msg_name = sockaddr;
 	msg.msg_namelen = sizeof(union capwap_addr);
+	msg.msg_control = control;
+	msg.msg_controllen = sizeof(control);
 	msg.msg_flags = MSG_NOSIGNAL | MSG_DONTWAIT;
 
+	cmsg = CMSG_FIRSTHDR(&msg);
+	cmsg->cmsg_level = SOL_UDP;
+	cmsg->cmsg_type = UDP_SEGMENT;
+	cmsg->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+	*(uint16_t*)CMSG_DATA(cmsg) = segmentsize;
+
 	/* */
-	return kernel_sendmsg(sc_sockets[type], &msg, &vec, 1, length);
+	return kernel_sendmsg(sc_sockets[type], &msg, vec, count, length);
+#else
+	return -EOPNOTSUPP;
+#endif
 }
 
 /* */
@@ -5,6 +5,7 @@
 #include <linux/in.h>
 #include <linux/in6.h>
 #include <linux/skbuff.h>
+#include <linux/uio.h>
 
 /* */
 #define SOCKET_UDP					0
@@ -25,6 +26,9 @@ void sc_socket_close(void);
 /* */
 int sc_socket_bind(union capwap_addr* sockaddr);
 int sc_socket_send(int type, uint8_t* buffer, int length, union capwap_addr* sockaddr);
+int sc_socket_sendv(int type, struct kvec* vec, int count, union capwap_addr* sockaddr);
+int sc_socket_maxsegments(void);
+int sc_socket_sendv_segments(int type, struct kvec* vec, int count, union capwap_addr* sockaddr, uint16_t segmentsize, int segments);
 
 /* */
 int sc_socket_getpeeraddr(struct sk_buff* skb, union capwap_addr* peeraddr);
@@ -0,0 +1,56 @@
+#include "capwap.h"
+#include "bench.h"
+#include <time.h>
+#include <sys/resource.h>
+
+/* */
+uint64_t bench_gettime(void) {
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return ((uint64_t)now.tv_sec * 1000000) + (uint64_t)(now.tv_nsec / 1000);
+}
+
+/* */
+uint64_t bench_getcputime(void) {
+	struct rusage usage;
+
+	getrusage(RUSAGE_SELF, &usage);
+	return ((uint64_t)(usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000000) + (uint64_t)(usage.ru_utime.tv_usec + usage.ru_stime.tv_usec);
+}
+
+/* */
+unsigned long bench_getstatus(const char* name) {
+	FILE* file;
+	char line[256];
+	int length = strlen(name);
+	unsigned long value = 0;
+
+	file = fopen("/proc/self/status", "r");
+	if (!file) {
+		return 0;
+	}
+
+	while (fgets(line, sizeof(line), file)) {
+		if (!strncmp(line, name, length) && (line[length] == ':')) {
+			value = strtoul(&line[length + 1], NULL, 10);
+			break;
+		}
+	}
+
+	fclose(file);
+	return value;
+}
+
+/* */
+void bench_init(void) {
+	capwap_logging_init();
+	capwap_logging_verboselevel(LOG_ERR);
+	capwap_logging_enable_console(1);
+}
+
+/* */
+void bench_free(void) {
+	capwap_check_memory_leak(1);
+	capwap_logging_close();
+}
@@ -0,0 +1,16 @@
+#ifndef __BENCH_HEADER__
+#define __BENCH_HEADER__
+
+/* Helpers of benchmark programs. Build with --enable-bench and, for meaningful
+   memory figures, --with-mem-check=no --disable-debug */
+
+/* */
+uint64_t bench_gettime(void);					/* Monotonic time in microseconds */
+uint64_t bench_getcputime(void);				/* User and system time of process in microseconds */
+unsigned long bench_getstatus(const char* name);	/* Value of /proc/self/status, memory in KB */
+
+/* */
+void bench_init(void);
+void bench_free(void);
+
+#endif /* __BENCH_HEADER__ */
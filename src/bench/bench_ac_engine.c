@@ -0,0 +1,343 @@
+#include "ac.h"
+#include "capwap_dfa.h"
+#include "ac_session.h"
+#include "ac_workers.h"
+#include "ac_timers.h"
+#include "bench.h"
+#include <getopt.h>
+
+/* Load of sessions engines with simulated WTPs in Run state. Every WTP sends an
+   Echo Request each echo interval, the session restarts its Echo timer as the
+   Run state does. The thread engine runs a thread per WTP which waits the packets
+   as ac_network_read(), the workers engine uses ac_workers with the sessions
+   woken up by the timer service of AC.
+
+	bench_ac_engine -e thread|workers -n WTPs [-d seconds] [-i echo interval ms] [-w workers]
+
+   Memory and CPU at 1k, 10k and 50k WTPs:
+
+	for n in 1000 10000 50000; do
+		for e in thread workers; do ./bench_ac_engine -e $e -n $n; done
+	done
+
+   A thread engine with many WTPs can require higher limits of threads and mappings
+   (ulimit -u, vm.max_map_count) as the AC itself. Configure with --with-mem-check=no,
+   the internal memory check is not sized for tens of thousands of allocations */
+
+#define BENCH_TICK							10			/* ms */
+
+/* Simulated session, the session of AC must be the first */
+struct bench_session {
+	struct ac_session_t session;
+
+	pthread_t threadid;
+	unsigned long idtimerecho;
+
+	/* Protected by session lock */
+	unsigned long pending;
+
+	/* */
+	unsigned long echoes;
+	unsigned long expired;
+};
+
+/* */
+struct bench_ac_engine {
+	int engine;
+	unsigned long count;
+	unsigned long interval;
+	unsigned long duration;
+
+	int stop;
+	struct bench_session** sessions;
+};
+
+/* Referenced by AC modules */
+struct ac_t g_ac;
+static struct bench_ac_engine g_bench;
+
+/* Echo Request not received within the dead interval */
+static void bench_echo_timeout(struct capwap_timeout* timeout, unsigned long index, void* context, void* param) {
+	((struct bench_session*)context)->expired++;
+}
+
+/* Execute the pending work of session, as ac_network_read_nowait() */
+static void bench_session_execute(struct bench_session* bsession, char* buffer, int length) {
+	unsigned long pending;
+	struct ac_session_t* session = &bsession->session;
+
+	capwap_lock_enter(&session->sessionlock);
+	pending = bsession->pending;
+	bsession->pending = 0;
+	capwap_lock_exit(&session->sessionlock);
+
+	/* Echo Response and restart Echo timer */
+	while (pending > 0) {
+		memset(buffer, 0, 64);
+		capwap_timeout_set(session->timeout, bsession->idtimerecho, (long)(g_bench.interval * 3), bench_echo_timeout, bsession, NULL);
+
+		bsession->echoes++;
+		pending--;
+	}
+
+	/* */
+	while (capwap_timeout_hasexpired(session->timeout) != CAPWAP_TIMEOUT_INDEX_NO_SET);
+}
+
+/* Wake up session, as AC */
+void ac_session_wakeup(struct ac_session_t* session) {
+	if (session->worker) {
+		ac_workers_schedule_session(session);
+	} else {
+		capwap_event_signal(&session->waitpacket);
+	}
+}
+
+/* Workers engine */
+int ac_session_process(struct ac_session_t* session, char* buffer, int length) {
+	bench_session_execute((struct bench_session*)session, buffer, length);
+	return (g_bench.stop ? 1 : 0);
+}
+
+/* Detach the timers before the workers are stopped */
+void ac_session_finish(struct ac_session_t* session) {
+	capwap_timeout_free(session->timeout);
+	session->timeout = NULL;
+}
+
+/* Thread engine */
+static void* bench_session_thread(void* param) {
+	long waittimeout;
+	char buffer[CAPWAP_MAX_PACKET_SIZE];
+	struct bench_session* bsession = (struct bench_session*)param;
+
+	while (!g_bench.stop) {
+		bench_session_execute(bsession, buffer, sizeof(buffer));
+
+		/* */
+		waittimeout = capwap_timeout_getcoming(bsession->session.timeout);
+		if (waittimeout) {
+			capwap_event_wait_timeout(&bsession->session.waitpacket, waittimeout);
+		}
+	}
+
+	pthread_exit(NULL);
+	return NULL;
+}
+
+/* */
+static struct bench_session* bench_create_session(void) {
+	int result;
+	struct bench_session* bsession;
+	struct ac_session_t* session;
+
+	/* */
+	bsession = (struct bench_session*)capwap_alloc(sizeof(struct bench_session));
+	memset(bsession, 0, sizeof(struct bench_session));
+
+	session = &bsession->session;
+	capwap_lock_init(&session->sessionlock);
+	capwap_event_init(&session->waitpacket);
+	session->timeout = ac_timers_create_timeout(session);
+	bsession->idtimerecho = capwap_timeout_createtimer(session->timeout);
+	capwap_timeout_set(session->timeout, bsession->idtimerecho, (long)(g_bench.interval * 3), bench_echo_timeout, bsession, NULL);
+
+	/* */
+	if (g_bench.engine == AC_SESSIONS_ENGINE_WORKERS) {
+		ac_workers_assign_session(session);
+	} else {
+		result = pthread_create(&bsession->threadid, NULL, bench_session_thread, (void*)bsession);
+		if (result) {
+			log_printf(LOG_ERR, "Unable create WTP thread, error code %d", result);
+			capwap_timeout_free(session->timeout);
+		capwap_event_destroy(&session->waitpacket);
+		capwap_lock_destroy(&session->sessionlock);
+			capwap_free(bsession);
+			return NULL;
+		}
+	}
+
+	return bsession;
+}
+
+/* */
+static void bench_free_session(struct bench_session* bsession) {
+	void* dummy;
+
+	if (g_bench.engine == AC_SESSIONS_ENGINE_THREAD) {
+		capwap_event_signal(&bsession->session.waitpacket);
+		pthread_join(bsession->threadid, &dummy);
+	}
+
+	if (bsession->session.timeout) {
+		capwap_timeout_free(bsession->session.timeout);
+	}
+
+	capwap_event_destroy(&bsession->session.waitpacket);
+	capwap_lock_destroy(&bsession->session.sessionlock);
+	capwap_free(bsession);
+}
+
+/* The WTPs send the Echo Request spread over the echo interval */
+static void bench_send_echo(uint64_t duration) {
+	unsigned long i;
+	unsigned long next = 0;
+	unsigned long count = 0;
+	uint64_t start = bench_gettime();
+	uint64_t now = start;
+	struct bench_session* bsession;
+
+	while ((now - start) < duration) {
+		/* WTPs which send into this tick */
+		count = (unsigned long)(((now - start) * g_bench.count) / (g_bench.interval * 1000));
+		for (i = next; i < count; i++) {
+			bsession = g_bench.sessions[i % g_bench.count];
+
+			capwap_lock_enter(&bsession->session.sessionlock);
+			bsession->pending++;
+			capwap_lock_exit(&bsession->session.sessionlock);
+
+			ac_session_wakeup(&bsession->session);
+		}
+
+		next = count;
+		capwap_timeout_wait(BENCH_TICK);
+		now = bench_gettime();
+	}
+}
+
+/* */
+static void bench_usage(const char* name) {
+	fprintf(stderr, "Usage: %s -e thread|workers -n WTPs [-d seconds] [-i echo interval ms] [-w workers]\n", name);
+}
+
+/* */
+int main(int argc, char** argv) {
+	int opt;
+	unsigned long i;
+	unsigned long created;
+	unsigned long baserss;
+	unsigned long rss = 0;
+	unsigned long threads = 0;
+	unsigned long echoes = 0;
+	unsigned long expired = 0;
+	uint64_t cputime = 0;
+	uint64_t walltime = 1;
+
+	/* */
+	memset(&g_ac, 0, sizeof(struct ac_t));
+	memset(&g_bench, 0, sizeof(struct bench_ac_engine));
+	g_bench.engine = -1;
+	g_bench.interval = 1000;
+	g_bench.duration = 10;
+
+	while ((opt = getopt(argc, argv, "e:n:d:i:w:")) != -1) {
+		switch (opt) {
+			case 'e': {
+				if (!strcmp(optarg, "thread")) {
+					g_bench.engine = AC_SESSIONS_ENGINE_THREAD;
+				} else if (!strcmp(optarg, "workers")) {
+					g_bench.engine = AC_SESSIONS_ENGINE_WORKERS;
+				}
+
+				break;
+			}
+
+			case 'n': {
+				g_bench.count = strtoul(optarg, NULL, 10);
+				break;
+			}
+
+			case 'd': {
+				g_bench.duration = strtoul(optarg, NULL, 10);
+				break;
+			}
+
+			case 'i': {
+				g_bench.interval = strtoul(optarg, NULL, 10);
+				break;
+			}
+
+			case 'w': {
+				g_ac.sessionsworkers = strtoul(optarg, NULL, 10);
+				break;
+			}
+
+			default: {
+				bench_usage(argv[0]);
+				return 1;
+			}
+		}
+	}
+
+	if ((g_bench.engine < 0) || !g_bench.count || !g_bench.interval || !g_bench.duration) {
+		bench_usage(argv[0]);
+		return 1;
+	}
+
+	/* */
+	bench_init();
+	if (!ac_timers_start()) {
+		return 1;
+	}
+
+	if ((g_bench.engine == AC_SESSIONS_ENGINE_WORKERS) && !ac_workers_start()) {
+		ac_timers_stop();
+		return 1;
+	}
+
+	/* Create WTPs */
+	baserss = bench_getstatus("VmRSS");
+	g_bench.sessions = (struct bench_session**)capwap_alloc(sizeof(struct bench_session*) * g_bench.count);
+	for (created = 0; created < g_bench.count; created++) {
+		g_bench.sessions[created] = bench_create_session();
+		if (!g_bench.sessions[created]) {
+			log_printf(LOG_ERR, "Stop at %lu WTPs", created);
+			break;
+		}
+	}
+
+	g_bench.count = created;
+	if (g_bench.count > 0) {
+		/* Warm up of an echo interval, then measure */
+		bench_send_echo((uint64_t)g_bench.interval * 1000);
+
+		cputime = bench_getcputime();
+		walltime = bench_gettime();
+		bench_send_echo((uint64_t)g_bench.duration * 1000000);
+		cputime = bench_getcputime() - cputime;
+		walltime = bench_gettime() - walltime;
+
+		rss = bench_getstatus("VmRSS");
+		threads = bench_getstatus("Threads");
+	}
+
+	/* Terminate WTPs */
+	g_bench.stop = 1;
+	if (g_bench.engine == AC_SESSIONS_ENGINE_WORKERS) {
+		for (i = 0; i < g_bench.count; i++) {
+			ac_session_wakeup(&g_bench.sessions[i]->session);
+		}
+
+		ac_workers_stop();
+	}
+
+	for (i = 0; i < g_bench.count; i++) {
+		echoes += g_bench.sessions[i]->echoes;
+		expired += g_bench.sessions[i]->expired;
+		bench_free_session(g_bench.sessions[i]);
+	}
+
+	capwap_free(g_bench.sessions);
+	ac_timers_stop();
+
+	/* */
+	if (g_bench.count > 0) {
+		printf("engine=%s wtps=%lu threads=%lu rss=%lu KB (%lu bytes/WTP) cpu=%.1f%% echo=%lu expired=%lu\n",
+			((g_bench.engine == AC_SESSIONS_ENGINE_WORKERS) ? "workers" : "thread"), g_bench.count, threads, rss,
+			((rss > baserss) ? ((rss - baserss) * 1024) / g_bench.count : 0), ((double)cputime * 100.0) / (double)walltime, echoes, expired);
+	}
+
+	bench_free();
+	return 0;
+}
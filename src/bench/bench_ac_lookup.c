@@ -0,0 +1,235 @@
+#include "ac.h"
+#include "ac_session.h"
+#include "bench.h"
+#include <getopt.h>
+
+/* Lookup of AC session from WTP address, as ac_execute() for every received
+   control packet. The sessions index g_ac.sessionsaddress, a capwap_hash keyed
+   on address and port, is compared with the walk of g_ac.sessions list which
+   it replaced. Both lookups hold the sessions lock for read as the AC.
+
+	bench_ac_lookup [-n sessions] [-l lookups]
+
+   Without -n the sessions are 100, 1k, 10k and 50k. The lookups are split
+   between known WTPs (hit) and unknown peers (miss, as a Discovery Request).
+   Configure with --with-mem-check=no, the internal memory check is not sized
+   for tens of thousands of allocations */
+
+#define BENCH_DEFAULT_LOOKUPS				1000000
+#define BENCH_LIST_MAX_COMPARES				200000000ULL		/* Bound the time of list walks */
+
+/* */
+static unsigned long g_default_sessions[] = { 100, 1000, 10000, 50000 };
+
+/* */
+struct bench_ac_lookup {
+	struct capwap_list* sessions;
+	struct capwap_hash* sessionsaddress;
+	capwap_rwlock_t sessionslock;
+
+	/* Addresses of lookups */
+	union sockaddr_capwap* hits;
+	union sockaddr_capwap* misses;
+	unsigned long count;
+};
+
+/* */
+static void bench_usage(const char* name) {
+	fprintf(stderr, "Usage: %s [-n sessions] [-l lookups]\n", name);
+}
+
+/* Same callbacks of g_ac.sessionsaddress */
+static unsigned long bench_sessionsaddress_item_gethash(const void* key, unsigned long hashsize) {
+	return (capwap_address_hash((union sockaddr_capwap*)key, 1) % hashsize);
+}
+
+/* */
+static const void* bench_sessionsaddress_item_getkey(const void* data) {
+	return (const void*)&((struct ac_session_t*)data)->dtls.peeraddr;
+}
+
+/* */
+static int bench_sessionsaddress_item_cmp(const void* key1, const void* key2) {
+	return capwap_address_cmp((union sockaddr_capwap*)key1, (union sockaddr_capwap*)key2, 1);
+}
+
+/* WTP address, distinct IPv4 address with a random source port */
+static void bench_make_address(union sockaddr_capwap* address, unsigned long index) {
+	memset(address, 0, sizeof(union sockaddr_capwap));
+	address->sin.sin_family = AF_INET;
+	address->sin.sin_addr.s_addr = htonl(0x0a000001 + (uint32_t)(index * 7));
+	address->sin.sin_port = htons(1024 + capwap_get_rand(64511));
+}
+
+/* Walk of sessions list */
+static struct ac_session_t* bench_search_list(struct bench_ac_lookup* lookup, union sockaddr_capwap* address) {
+	struct ac_session_t* result = NULL;
+	struct capwap_list_item* search;
+
+	capwap_rwlock_rdlock(&lookup->sessionslock);
+
+	search = lookup->sessions->first;
+	while (search != NULL) {
+		struct ac_session_t* session = (struct ac_session_t*)search->item;
+
+		if (!capwap_compare_ip(address, &session->dtls.peeraddr)) {
+			result = session;
+			break;
+		}
+
+		search = search->next;
+	}
+
+	capwap_rwlock_unlock(&lookup->sessionslock);
+
+	return result;
+}
+
+/* Search into sessions index */
+static struct ac_session_t* bench_search_hash(struct bench_ac_lookup* lookup, union sockaddr_capwap* address) {
+	struct ac_session_t* session;
+
+	capwap_rwlock_rdlock(&lookup->sessionslock);
+	session = (struct ac_session_t*)capwap_hash_search(lookup->sessionsaddress, address);
+	capwap_rwlock_unlock(&lookup->sessionslock);
+
+	return session;
+}
+
+/* Nanoseconds for a lookup, the result is checked against the expected one */
+static double bench_run(struct bench_ac_lookup* lookup, int hash, union sockaddr_capwap* addresses, unsigned long lookups, int hit, unsigned long* errors) {
+	unsigned long i;
+	uint64_t walltime;
+	struct ac_session_t* session;
+
+	walltime = bench_gettime();
+	for (i = 0; i < lookups; i++) {
+		session = (hash ? bench_search_hash(lookup, &addresses[i % lookup->count]) : bench_search_list(lookup, &addresses[i % lookup->count]));
+		if ((session != NULL) != (hit != 0)) {
+			(*errors)++;
+		}
+	}
+
+	walltime = bench_gettime() - walltime;
+	return ((double)walltime * 1000.0) / (double)lookups;
+}
+
+/* */
+static int bench_lookup(unsigned long count, unsigned long lookups) {
+	unsigned long i;
+	unsigned long listlookups;
+	unsigned long errors = 0;
+	double listhit, listmiss;
+	double hashhit, hashmiss;
+	struct bench_ac_lookup lookup;
+
+	memset(&lookup, 0, sizeof(struct bench_ac_lookup));
+	lookup.count = count;
+	lookup.sessions = capwap_list_create();
+	lookup.sessionsaddress = capwap_hash_create(AC_SESSIONS_HASH_SIZE);
+	lookup.sessionsaddress->item_gethash = bench_sessionsaddress_item_gethash;
+	lookup.sessionsaddress->item_getkey = bench_sessionsaddress_item_getkey;
+	lookup.sessionsaddress->item_cmp = bench_sessionsaddress_item_cmp;
+	capwap_rwlock_init(&lookup.sessionslock);
+
+	/* Sessions as ac_create_session(), the unknown peers follow the WTPs addresses */
+	lookup.hits = (union sockaddr_capwap*)capwap_alloc(sizeof(union sockaddr_capwap) * count);
+	lookup.misses = (union sockaddr_capwap*)capwap_alloc(sizeof(union sockaddr_capwap) * count);
+	for (i = 0; i < count; i++) {
+		struct capwap_list_item* itemlist = capwap_itemlist_create(sizeof(struct ac_session_t));
+		struct ac_session_t* session = (struct ac_session_t*)itemlist->item;
+
+		memset(session, 0, sizeof(struct ac_session_t));
+		bench_make_address(&session->dtls.peeraddr, i);
+		capwap_itemlist_insert_after(lookup.sessions, NULL, itemlist);
+		capwap_hash_add(lookup.sessionsaddress, (void*)session);
+
+		memcpy(&lookup.hits[i], &session->dtls.peeraddr, sizeof(union sockaddr_capwap));
+		bench_make_address(&lookup.misses[i], count + i);
+	}
+
+	/* Shuffle the hits, the list order is the creation order */
+	for (i = count - 1; i > 0; i--) {
+		union sockaddr_capwap address;
+		unsigned long j = (unsigned long)capwap_get_rand((int)(i + 1));
+
+		memcpy(&address, &lookup.hits[i], sizeof(union sockaddr_capwap));
+		memcpy(&lookup.hits[i], &lookup.hits[j], sizeof(union sockaddr_capwap));
+		memcpy(&lookup.hits[j], &address, sizeof(union sockaddr_capwap));
+	}
+
+	/* The list walk is O(sessions), fewer lookups at large counts */
+	listlookups = (unsigned long)(BENCH_LIST_MAX_COMPARES / count);
+	if (listlookups > lookups) {
+		listlookups = lookups;
+	} else if (!listlookups) {
+		listlookups = 1;
+	}
+
+	listhit = bench_run(&lookup, 0, lookup.hits, listlookups, 1, &errors);
+	listmiss = bench_run(&lookup, 0, lookup.misses, listlookups, 0, &errors);
+	hashhit = bench_run(&lookup, 1, lookup.hits, lookups, 1, &errors);
+	hashmiss = bench_run(&lookup, 1, lookup.misses, lookups, 0, &errors);
+
+	printf("sessions=%lu list hit=%.1f ns miss=%.1f ns (%lu lookups) hash hit=%.1f ns miss=%.1f ns (%lu lookups) speedup=%.0fx errors=%lu\n",
+		count, listhit, listmiss, listlookups, hashhit, hashmiss, lookups, ((hashhit > 0.0) ? listhit / hashhit : 0.0), errors);
+
+	/* */
+	capwap_hash_free(lookup.sessionsaddress);
+	capwap_list_free(lookup.sessions);
+	capwap_rwlock_destroy(&lookup.sessionslock);
+	capwap_free(lookup.hits);
+	capwap_free(lookup.misses);
+
+	return (errors ? 0 : 1);
+}
+
+/* */
+int main(int argc, char** argv) {
+	int opt;
+	int result = 0;
+	unsigned long i;
+	unsigned long count = 0;
+	unsigned long lookups = BENCH_DEFAULT_LOOKUPS;
+
+	while ((opt = getopt(argc, argv, "n:l:")) != -1) {
+		switch (opt) {
+			case 'n': {
+				count = strtoul(optarg, NULL, 10);
+				break;
+			}
+
+			case 'l': {
+				lookups = strtoul(optarg, NULL, 10);
+				break;
+			}
+
+			default: {
+				bench_usage(argv[0]);
+				return 1;
+			}
+		}
+	}
+
+	if (!lookups) {
+		bench_usage(argv[0]);
+		return 1;
+	}
+
+	/* */
+	bench_init();
+	capwap_init_rand();
+
+	if (count) {
+		result = (bench_lookup(count, lookups) ? 0 : 1);
+	} else {
+		for (i = 0; i < (sizeof(g_default_sessions) / sizeof(g_default_sessions[0])); i++) {
+			if (!bench_lookup(g_default_sessions[i], lookups)) {
+				result = 1;
+			}
+		}
+	}
+
+	bench_free();
+	return result;
+}
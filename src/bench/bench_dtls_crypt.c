@@ -0,0 +1,302 @@
+#include "capwap.h"
+#include "capwap_network.h"
+#include "capwap_dtls.h"
+#include "bench.h"
+#include <getopt.h>
+#include <wolfssl/options.h>
+#include <wolfssl/ssl.h>
+
+/* Cost of DTLS records with wolfSSL. A client and a server session of the CAPWAP
+   DTLS layer exchange records over loopback UDP sockets: the handshake is driven
+   by capwap_crypt_open() and capwap_decrypt_packet(), then the client encrypts
+   records with capwap_crypt_sendto() and the server decrypts them with
+   capwap_decrypt_packet(), as the control channel of AC and WTP.
+
+	bench_dtls_crypt [-m psk|x509] [-s any|1.2|1.0] [-c any|1.2|1.0] [-C ciphers]
+	                 [-l record length] [-n records] [-x cert,key,ca]
+
+   Records per second of every AEAD and CBC suite, 128 and 1400 bytes:
+
+	for c in PSK-AES128-GCM-SHA256 PSK-CHACHA20-POLY1305 PSK-AES128-CBC-SHA; do
+		for l in 128 1400; do ./bench_dtls_crypt -C $c -l $l; done
+	done
+
+   The negotiated version is printed, a client with "1.0" against the default
+   server checks the downgrade of version flexible methods */
+
+#define BENCH_HANDSHAKE_TIMEOUT				5000		/* ms */
+
+/* */
+struct bench_dtls_peer {
+	int sock;
+	union sockaddr_capwap localaddr;
+	struct capwap_dtls_context context;
+	struct capwap_dtls dtls;
+};
+
+/* */
+static char g_buffer[CAPWAP_MAX_PACKET_SIZE];
+static char g_plain[CAPWAP_MAX_PACKET_SIZE];
+
+/* */
+static void bench_usage(const char* name) {
+	fprintf(stderr, "Usage: %s [-m psk|x509] [-s any|1.2|1.0] [-c any|1.2|1.0] [-C ciphers] [-l record length] [-n records] [-x cert,key,ca]\n", name);
+}
+
+/* */
+static int bench_parse_version(const char* value) {
+	if (!strcmp(value, "any")) {
+		return CAPWAP_DTLS_VERSION_ANY;
+	} else if (!strcmp(value, "1.2")) {
+		return CAPWAP_DTLS_VERSION_1_2;
+	} else if (!strcmp(value, "1.0")) {
+		return CAPWAP_DTLS_VERSION_1_0;
+	}
+
+	return -1;
+}
+
+/* UDP socket bound to an ephemeral port of loopback */
+static int bench_open_socket(struct bench_dtls_peer* peer) {
+	socklen_t length = sizeof(struct sockaddr_in);
+
+	peer->sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+	if (peer->sock < 0) {
+		return 0;
+	}
+
+	memset(&peer->localaddr, 0, sizeof(union sockaddr_capwap));
+	peer->localaddr.sin.sin_family = AF_INET;
+	peer->localaddr.sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	if (bind(peer->sock, &peer->localaddr.sa, length) || getsockname(peer->sock, &peer->localaddr.sa, &length)) {
+		close(peer->sock);
+		peer->sock = -1;
+		return 0;
+	}
+
+	return 1;
+}
+
+/* Receive a datagram and process it as the network loop of AC and WTP */
+static int bench_receive(struct bench_dtls_peer* peer, int timeout) {
+	int length;
+	struct pollfd fds = { .fd = peer->sock, .events = POLLIN };
+
+	if (poll(&fds, 1, timeout) <= 0) {
+		return CAPWAP_ERROR_AGAIN;
+	}
+
+	length = recv(peer->sock, g_buffer, sizeof(g_buffer), 0);
+	if (length <= 0) {
+		return CAPWAP_ERROR_CLOSE;
+	}
+
+	return capwap_decrypt_packet(&peer->dtls, g_buffer, length, g_plain, sizeof(g_plain));
+}
+
+/* */
+static int bench_handshake(struct bench_dtls_peer* client, struct bench_dtls_peer* server) {
+	uint64_t deadline = bench_gettime() + (uint64_t)BENCH_HANDSHAKE_TIMEOUT * 1000;
+
+	if ((capwap_crypt_open(&server->dtls) == CAPWAP_HANDSHAKE_ERROR) || (capwap_crypt_open(&client->dtls) == CAPWAP_HANDSHAKE_ERROR)) {
+		return 0;
+	}
+
+	while ((client->dtls.action != CAPWAP_DTLS_ACTION_DATA) || (server->dtls.action != CAPWAP_DTLS_ACTION_DATA)) {
+		if ((bench_receive(server, 1) == CAPWAP_ERROR_CLOSE) || (bench_receive(client, 1) == CAPWAP_ERROR_CLOSE)) {
+			return 0;
+		} else if (bench_gettime() > deadline) {
+			log_printf(LOG_ERR, "DTLS handshake timeout");
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+/* */
+static int bench_create_peer(struct bench_dtls_peer* peer, struct capwap_dtls_param* param) {
+	memset(peer, 0, sizeof(struct bench_dtls_peer));
+	if (!bench_open_socket(peer)) {
+		log_printf(LOG_ERR, "Unable to open loopback socket");
+		return 0;
+	} else if (!capwap_crypt_createcontext(&peer->context, param)) {
+		log_printf(LOG_ERR, "Unable to create DTLS context");
+		return 0;
+	} else if (!capwap_crypt_createsession(&peer->dtls, &peer->context)) {
+		log_printf(LOG_ERR, "Unable to create DTLS session");
+		return 0;
+	}
+
+	return 1;
+}
+
+/* */
+static void bench_free_peer(struct bench_dtls_peer* peer) {
+	if (peer->dtls.enable) {
+		capwap_crypt_freesession(&peer->dtls);
+	}
+
+	if (peer->context.sslcontext) {
+		capwap_crypt_freecontext(&peer->context);
+	}
+
+	if (peer->sock >= 0) {
+		close(peer->sock);
+	}
+}
+
+/* */
+int main(int argc, char** argv) {
+	int opt;
+	int result = 1;
+	unsigned long i;
+	unsigned long records = 100000;
+	unsigned long failed = 0;
+	int length = 1400;
+	char* files = NULL;
+	char* ciphers = NULL;
+	char* separator;
+	uint64_t cputime;
+	uint64_t walltime;
+	char* payload;
+	struct capwap_dtls_param param;
+	struct bench_dtls_peer client;
+	struct bench_dtls_peer server;
+	int mode = CAPWAP_DTLS_MODE_PRESHAREDKEY;
+	int clientversion = CAPWAP_DTLS_VERSION_ANY;
+	int serverversion = CAPWAP_DTLS_VERSION_ANY;
+
+	while ((opt = getopt(argc, argv, "m:s:c:C:l:n:x:")) != -1) {
+		switch (opt) {
+			case 'm': {
+				mode = (!strcmp(optarg, "x509") ? CAPWAP_DTLS_MODE_CERTIFICATE : (!strcmp(optarg, "psk") ? CAPWAP_DTLS_MODE_PRESHAREDKEY : CAPWAP_DTLS_MODE_NONE));
+				break;
+			}
+
+			case 's': {
+				serverversion = bench_parse_version(optarg);
+				break;
+			}
+
+			case 'c': {
+				clientversion = bench_parse_version(optarg);
+				break;
+			}
+
+			case 'C': {
+				ciphers = optarg;
+				break;
+			}
+
+			case 'l': {
+				length = atoi(optarg);
+				break;
+			}
+
+			case 'n': {
+				records = strtoul(optarg, NULL, 10);
+				break;
+			}
+
+			case 'x': {
+				files = optarg;
+				break;
+			}
+
+			default: {
+				bench_usage(argv[0]);
+				return 1;
+			}
+		}
+	}
+
+	if ((mode == CAPWAP_DTLS_MODE_NONE) || (serverversion < 0) || (clientversion < 0) || (length <= 0) || (length > (CAPWAP_MAX_PACKET_SIZE - 128)) || !records) {
+		bench_usage(argv[0]);
+		return 1;
+	}
+
+	/* */
+	memset(&param, 0, sizeof(struct capwap_dtls_param));
+	param.mode = mode;
+	param.ciphers = ciphers;
+	if (mode == CAPWAP_DTLS_MODE_CERTIFICATE) {
+		if (!files) {
+			bench_usage(argv[0]);
+			return 1;
+		}
+
+		/* Same certificate for both peers */
+		param.cert.filecert = files;
+		separator = strchr(files, ',');
+		if (!separator || !strchr(separator + 1, ',')) {
+			bench_usage(argv[0]);
+			return 1;
+		}
+
+		*separator = 0;
+		param.cert.filekey = separator + 1;
+		separator = strchr(param.cert.filekey, ',');
+		*separator = 0;
+		param.cert.fileca = separator + 1;
+	} else {
+		param.presharedkey.hint = "bench";
+		param.presharedkey.identity = "bench";
+		param.presharedkey.pskkey = "00112233445566778899aabbccddeeff";
+	}
+
+	/* */
+	bench_init();
+	if (capwap_crypt_init()) {
+		log_printf(LOG_ERR, "Unable to initialize wolfSSL");
+		return 1;
+	}
+
+	payload = (char*)capwap_alloc(length);
+	memset(payload, 0xa5, length);
+
+	param.type = CAPWAP_DTLS_SERVER;
+	param.version = serverversion;
+	if (bench_create_peer(&server, &param)) {
+		param.type = CAPWAP_DTLS_CLIENT;
+		param.version = clientversion;
+		if (bench_create_peer(&client, &param)) {
+			capwap_crypt_setconnection(&server.dtls, server.sock, &server.localaddr, &client.localaddr);
+			capwap_crypt_setconnection(&client.dtls, client.sock, &client.localaddr, &server.localaddr);
+
+			if (bench_handshake(&client, &server)) {
+				/* Encrypt and decrypt in lockstep, the socket buffer never drops a record */
+				cputime = bench_getcputime();
+				walltime = bench_gettime();
+				for (i = 0; i < records; i++) {
+					if ((capwap_crypt_sendto(&client.dtls, payload, length) != length) || (bench_receive(&server, 1000) != length)) {
+						failed++;
+					}
+				}
+
+				cputime = bench_getcputime() - cputime;
+				walltime = bench_gettime() - walltime;
+				if (!walltime) {
+					walltime = 1;
+				}
+
+				printf("version=%s cipher=%s length=%d records=%lu failed=%lu rate=%.0f rec/s throughput=%.1f MB/s cpu=%.1f%%\n",
+					wolfSSL_get_version((WOLFSSL*)client.dtls.sslsession), wolfSSL_get_cipher((WOLFSSL*)client.dtls.sslsession), length, records, failed,
+					((double)records * 1000000.0) / (double)walltime, ((double)records * (double)length) / (double)walltime,
+					((double)cputime * 100.0) / (double)walltime);
+
+				result = (failed ? 1 : 0);
+			} else {
+				log_printf(LOG_ERR, "DTLS handshake failed");
+			}
+		}
+
+		bench_free_peer(&client);
+	}
+
+	bench_free_peer(&server);
+	capwap_free(payload);
+	capwap_crypt_free();
+	bench_free();
+	return result;
+}
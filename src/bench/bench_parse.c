@@ -0,0 +1,343 @@
+#include "capwap.h"
+#include "capwap_protocol.h"
+#include "capwap_element.h"
+#include "bench.h"
+#include <getopt.h>
+#include <arpa/inet.h>
+
+/* Parsing of control messages as the AC and WTP receive them: every iteration
+   parses, validates and frees the message, with the allocations counted.
+
+	bench_parse [-n iterations]
+
+   echo is an Echo Request without message elements, wtpevent is a WTP Event
+   Request with repeated and vendor message elements, types is a message with
+   more message element types than the table into the parsed packet. The parsed
+   message elements are checked before the measure */
+
+#define BENCH_DEFAULT_ITERATIONS			2000000
+#define BENCH_VENDOR_ID						0x00abcdef
+
+/* */
+extern void* __libc_malloc(size_t size);
+static unsigned long g_mallocs;
+
+/* Count the allocations of parser */
+void* malloc(size_t size) {
+	g_mallocs++;
+	return __libc_malloc(size);
+}
+
+/* */
+struct bench_parse_message {
+	const char* name;
+	struct capwap_packet_rxmng* (*create)(void);
+	int (*check)(struct capwap_parsed_packet* packet);
+};
+
+/* */
+static void bench_usage(const char* name) {
+	fprintf(stderr, "Usage: %s [-n iterations]\n", name);
+}
+
+/* Received message from fragments of built message */
+static struct capwap_packet_rxmng* bench_receive_message(struct capwap_packet_txmng* txmngpacket) {
+	struct capwap_list* fragmentlist;
+	struct capwap_packet_rxmng* rxmngpacket;
+
+	fragmentlist = capwap_list_create();
+	capwap_packet_txmng_get_fragment_packets(txmngpacket, fragmentlist, 0);
+	capwap_packet_txmng_free(txmngpacket);
+
+	rxmngpacket = capwap_packet_rxmng_create_from_requestfragmentpacket(fragmentlist);
+	capwap_list_free(fragmentlist);
+
+	return rxmngpacket;
+}
+
+/* */
+static struct capwap_packet_rxmng* bench_create_echo(void) {
+	struct capwap_header_data capwapheader;
+
+	capwap_header_init(&capwapheader, CAPWAP_RADIOID_NONE, CAPWAP_WIRELESS_BINDING_IEEE80211);
+	return bench_receive_message(capwap_packet_txmng_create_ctrl_message(&capwapheader, CAPWAP_ECHO_REQUEST, 1, CAPWAP_MAX_PACKET_SIZE));
+}
+
+/* */
+static struct capwap_packet_rxmng* bench_create_wtpevent(void) {
+	int i;
+	uint8_t macaddress[MACADDRESS_EUI48_LENGTH] = { 0x02, 0x00, 0x00, 0x00, 0x00, 0x01 };
+	struct capwap_header_data capwapheader;
+	struct capwap_packet_txmng* txmngpacket;
+	struct capwap_decrypterrorreportperiod_element reportperiod;
+	struct capwap_duplicateipv4_element duplicateipv4;
+	struct capwap_duplicateipv6_element duplicateipv6;
+	struct capwap_wtpradiostat_element radiostat;
+	struct capwap_wtprebootstat_element rebootstat;
+	struct capwap_deletestation_element deletestation;
+	struct capwap_vendorpayload_element* vendorpayload;
+
+	capwap_header_init(&capwapheader, CAPWAP_RADIOID_NONE, CAPWAP_WIRELESS_BINDING_IEEE80211);
+	txmngpacket = capwap_packet_txmng_create_ctrl_message(&capwapheader, CAPWAP_WTP_EVENT_REQUEST, 1, CAPWAP_MAX_PACKET_SIZE);
+
+	/* Radios */
+	for (i = 1; i <= 2; i++) {
+		memset(&reportperiod, 0, sizeof(struct capwap_decrypterrorreportperiod_element));
+		reportperiod.radioid = (uint8_t)i;
+		reportperiod.interval = 120;
+		capwap_packet_txmng_add_message_element(txmngpacket, CAPWAP_ELEMENT_DECRYPTERRORREPORTPERIOD, &reportperiod);
+	}
+
+	memset(&radiostat, 0, sizeof(struct capwap_wtpradiostat_element));
+	radiostat.radioid = 1;
+	radiostat.resetcount = 1;
+	capwap_packet_txmng_add_message_element(txmngpacket, CAPWAP_ELEMENT_WTPRADIOSTAT, &radiostat);
+
+	memset(&duplicateipv4, 0, sizeof(struct capwap_duplicateipv4_element));
+	duplicateipv4.address.s_addr = htonl(0x0a000001);
+	duplicateipv4.status = 1;
+	duplicateipv4.length = MACADDRESS_EUI48_LENGTH;
+	duplicateipv4.macaddress = macaddress;
+	capwap_packet_txmng_add_message_element(txmngpacket, CAPWAP_ELEMENT_DUPLICATEIPV4, &duplicateipv4);
+
+	memset(&duplicateipv6, 0, sizeof(struct capwap_duplicateipv6_element));
+	duplicateipv6.address.s6_addr[15] = 1;
+	duplicateipv6.status = 1;
+	duplicateipv6.length = MACADDRESS_EUI48_LENGTH;
+	duplicateipv6.macaddress = macaddress;
+	capwap_packet_txmng_add_message_element(txmngpacket, CAPWAP_ELEMENT_DUPLICATEIPV6, &duplicateipv6);
+
+	memset(&rebootstat, 0, sizeof(struct capwap_wtprebootstat_element));
+	rebootstat.rebootcount = 3;
+	capwap_packet_txmng_add_message_element(txmngpacket, CAPWAP_ELEMENT_WTPREBOOTSTAT, &rebootstat);
+
+	/* Station leaving */
+	macaddress[5] = 4;
+	memset(&deletestation, 0, sizeof(struct capwap_deletestation_element));
+	deletestation.radioid = 1;
+	deletestation.length = MACADDRESS_EUI48_LENGTH;
+	deletestation.address = macaddress;
+	capwap_packet_txmng_add_message_element(txmngpacket, CAPWAP_ELEMENT_DELETESTATION, &deletestation);
+
+	/* Unknown vendor */
+	vendorpayload = (struct capwap_vendorpayload_element*)capwap_alloc(sizeof(struct capwap_vendorpayload_element) + 16);
+	vendorpayload->vendorid = BENCH_VENDOR_ID;
+	vendorpayload->elementid = 1;
+	vendorpayload->datalength = 16;
+	memset(vendorpayload->data, 0x5a, 16);
+	capwap_packet_txmng_add_message_element(txmngpacket, CAPWAP_ELEMENT_VENDORPAYLOAD, vendorpayload);
+	capwap_free(vendorpayload);
+
+	return bench_receive_message(txmngpacket);
+}
+
+/* */
+static struct capwap_packet_rxmng* bench_create_types(void) {
+	struct capwap_header_data capwapheader;
+	struct capwap_packet_txmng* txmngpacket;
+	struct capwap_acname_element acname = { .name = (uint8_t*)"bench" };
+	struct capwap_timers_element timers = { .discovery = 5, .echorequest = 30 };
+	struct capwap_idletimeout_element idletimeout = { .timeout = 300 };
+	struct capwap_wtpfallback_element wtpfallback = { .mode = CAPWAP_WTP_FALLBACK_ENABLED };
+	struct capwap_statisticstimer_element statisticstimer = { .timer = 120 };
+	struct capwap_ecnsupport_element ecnsupport = { .flag = CAPWAP_LIMITED_ECN_SUPPORT };
+	struct capwap_transport_element transport = { .type = CAPWAP_UDP_TRANSPORT };
+	struct capwap_maximumlength_element maximumlength = { .length = 1400 };
+	struct capwap_resultcode_element resultcode = { .code = CAPWAP_RESULTCODE_SUCCESS };
+	struct capwap_localipv4_element localipv4;
+	struct capwap_actimestamp_element actimestamp = { .timestamp = 1000 };
+	struct capwap_wtpframetunnelmode_element wtpframetunnelmode = { .mode = CAPWAP_WTP_LOCAL_BRIDGING };
+	struct capwap_wtpmactype_element wtpmactype = { .type = CAPWAP_LOCALMAC };
+	struct capwap_radioadmstate_element radioadmstate = { .radioid = 1, .state = CAPWAP_RADIO_ADMIN_STATE_ENABLED };
+	struct capwap_radiooprstate_element radiooprstate = { .radioid = 1, .state = CAPWAP_RADIO_OPERATIONAL_STATE_ENABLED, .cause = CAPWAP_RADIO_OPERATIONAL_CAUSE_NORMAL };
+	struct capwap_decrypterrorreportperiod_element reportperiod = { .radioid = 1, .interval = 120 };
+	struct capwap_wtprebootstat_element rebootstat;
+	struct capwap_wtpradiostat_element radiostat;
+	struct capwap_80211_antenna_element antenna;
+	struct capwap_80211_directsequencecontrol_element directsequencecontrol = { .radioid = 1, .currentchannel = 6, .currentcca = CAPWAP_DSCONTROL_CCA_EDONLY, .enerydetectthreshold = 10 };
+	struct capwap_80211_macoperation_element macoperation = { .radioid = 1, .rtsthreshold = 2347, .shortretry = 7, .longretry = 4, .fragthreshold = 2346, .txmsdulifetime = 512, .rxmsdulifetime = 512 };
+	struct capwap_80211_txpower_element txpower = { .radioid = 1, .currenttxpower = 20 };
+	struct capwap_80211_wtpradioinformation_element radioinformation = { .radioid = 1, .radiotype = CAPWAP_RADIO_TYPE_80211G };
+
+	capwap_header_init(&capwapheader, CAPWAP_RADIOID_NONE, CAPWAP_WIRELESS_BINDING_IEEE80211);
+	txmngpacket = capwap_packet_txmng_create_ctrl_message(&capwapheader, CAPWAP_CONFIGURATION_STATUS_REQUEST, 1, CAPWAP_MAX_PACKET_SIZE);
+
+	/* */
+	localipv4.address.s_addr = htonl(0x0a000001);
+	memset(&rebootstat, 0, sizeof(struct capwap_wtprebootstat_element));
+	memset(&radiostat, 0, sizeof(struct capwap_wtpradiostat_element));
+	radiostat.radioid = 1;
+	memset(&antenna, 0, sizeof(struct capwap_80211_antenna_element));
+	antenna.radioid = 1;
+	antenna.diversity = CAPWAP_ANTENNA_DIVERSITY_DISABLE;
+	antenna.combiner = CAPWAP_ANTENNA_COMBINER_SECT_OMNI;
+	antenna.selections = capwap_array_create(sizeof(uint8_t), 0, 1);
+	*(uint8_t*)capwap_array_get_item_pointer(antenna.selections, 0) = CAPWAP_ANTENNA_INTERNAL;
+
+	capwap_packet_txmng_add_message_element(txmngpacket, CAPWAP_ELEMENT_ACNAME, &acname);
+	capwap_packet_txmng_add_message_element(txmngpacket, CAPWAP_ELEMENT_TIMERS, &timers);
+	capwap_packet_txmng_add_message_element(txmngpacket, CAPWAP_ELEMENT_IDLETIMEOUT, &idletimeout);
+	capwap_packet_txmng_add_message_element(txmngpacket, CAPWAP_ELEMENT_WTPFALLBACK, &wtpfallback);
+	capwap_packet_txmng_add_message_element(txmngpacket, CAPWAP_ELEMENT_STATISTICSTIMER, &statisticstimer);
+	capwap_packet_txmng_add_message_element(txmngpacket, CAPWAP_ELEMENT_ECNSUPPORT, &ecnsupport);
+	capwap_packet_txmng_add_message_element(txmngpacket, CAPWAP_ELEMENT_TRANSPORT, &transport);
+	capwap_packet_txmng_add_message_element(txmngpacket, CAPWAP_ELEMENT_MAXIMUMLENGTH, &maximumlength);
+	capwap_packet_txmng_add_message_element(txmngpacket, CAPWAP_ELEMENT_RESULTCODE, &resultcode);
+	capwap_packet_txmng_add_message_element(txmngpacket, CAPWAP_ELEMENT_LOCALIPV4, &localipv4);
+	capwap_packet_txmng_add_message_element(txmngpacket, CAPWAP_ELEMENT_ACTIMESTAMP, &actimestamp);
+	capwap_packet_txmng_add_message_element(txmngpacket, CAPWAP_ELEMENT_WTPFRAMETUNNELMODE, &wtpframetunnelmode);
+	capwap_packet_txmng_add_message_element(txmngpacket, CAPWAP_ELEMENT_WTPMACTYPE, &wtpmactype);
+	capwap_packet_txmng_add_message_element(txmngpacket, CAPWAP_ELEMENT_RADIOADMSTATE, &radioadmstate);
+	capwap_packet_txmng_add_message_element(txmngpacket, CAPWAP_ELEMENT_RADIOOPRSTATE, &radiooprstate);
+	capwap_packet_txmng_add_message_element(txmngpacket, CAPWAP_ELEMENT_DECRYPTERRORREPORTPERIOD, &reportperiod);
+	capwap_packet_txmng_add_message_element(txmngpacket, CAPWAP_ELEMENT_WTPREBOOTSTAT, &rebootstat);
+	capwap_packet_txmng_add_message_element(txmngpacket, CAPWAP_ELEMENT_WTPRADIOSTAT, &radiostat);
+	capwap_packet_txmng_add_message_element(txmngpacket, CAPWAP_ELEMENT_80211_ANTENNA, &antenna);
+	capwap_packet_txmng_add_message_element(txmngpacket, CAPWAP_ELEMENT_80211_DIRECTSEQUENCECONTROL, &directsequencecontrol);
+	capwap_packet_txmng_add_message_element(txmngpacket, CAPWAP_ELEMENT_80211_MACOPERATION, &macoperation);
+	capwap_packet_txmng_add_message_element(txmngpacket, CAPWAP_ELEMENT_80211_TXPOWER, &txpower);
+	capwap_packet_txmng_add_message_element(txmngpacket, CAPWAP_ELEMENT_80211_WTPRADIOINFORMATION, &radioinformation);
+
+	capwap_array_free(antenna.selections);
+	return bench_receive_message(txmngpacket);
+}
+
+/* */
+static int bench_check_echo(struct capwap_parsed_packet* packet) {
+	return (!packet->count ? 1 : 0);
+}
+
+/* */
+static int bench_check_wtpevent(struct capwap_parsed_packet* packet) {
+	struct capwap_array* reportperiod;
+	struct capwap_array* vendorpayload;
+	struct capwap_deletestation_element* deletestation;
+
+	reportperiod = (struct capwap_array*)capwap_get_message_element_data(packet, CAPWAP_ELEMENT_DECRYPTERRORREPORTPERIOD);
+	deletestation = (struct capwap_deletestation_element*)capwap_get_message_element_data(packet, CAPWAP_ELEMENT_DELETESTATION);
+	vendorpayload = (struct capwap_array*)capwap_get_message_element_data(packet, CAPWAP_ELEMENT_VENDORPAYLOAD);
+	if (!reportperiod || (reportperiod->count != 2) || !deletestation || (deletestation->address[5] != 4) || !vendorpayload || (vendorpayload->count != 1)) {
+		return 0;
+	} else if (((struct capwap_vendorpayload_element*)*(void**)capwap_array_get_item_pointer(vendorpayload, 0))->vendorid != BENCH_VENDOR_ID) {
+		return 0;
+	}
+
+	return ((((struct capwap_decrypterrorreportperiod_element*)*(void**)capwap_array_get_item_pointer(reportperiod, 1))->radioid == 2) ? 1 : 0);
+}
+
+/* Every type is retrieved after the table moved, the last one too */
+static int bench_check_types(struct capwap_parsed_packet* packet) {
+	struct capwap_array* radioadmstate;
+	struct capwap_timers_element* timers;
+	struct capwap_array* radioinformation;
+
+	if ((packet->count != 23) || (packet->count <= CAPWAP_PARSED_PACKET_INLINE_ELEMENTS) || (packet->elements == packet->inlineelements)) {
+		return 0;
+	}
+
+	timers = (struct capwap_timers_element*)capwap_get_message_element_data(packet, CAPWAP_ELEMENT_TIMERS);
+	radioadmstate = (struct capwap_array*)capwap_get_message_element_data(packet, CAPWAP_ELEMENT_RADIOADMSTATE);
+	radioinformation = (struct capwap_array*)capwap_get_message_element_data(packet, CAPWAP_ELEMENT_80211_WTPRADIOINFORMATION);
+	if (!timers || (timers->echorequest != 30) || !radioadmstate || (radioadmstate->count != 1) || !radioinformation || (radioinformation->count != 1)) {
+		return 0;
+	}
+
+	/* Inline items of arrays moved with the table */
+	if (((struct capwap_radioadmstate_element*)*(void**)capwap_array_get_item_pointer(radioadmstate, 0))->state != CAPWAP_RADIO_ADMIN_STATE_ENABLED) {
+		return 0;
+	}
+
+	return ((((struct capwap_80211_wtpradioinformation_element*)*(void**)capwap_array_get_item_pointer(radioinformation, 0))->radiotype == CAPWAP_RADIO_TYPE_80211G) ? 1 : 0);
+}
+
+/* */
+static struct bench_parse_message g_messages[] = {
+	{ "echo", bench_create_echo, bench_check_echo },
+	{ "wtpevent", bench_create_wtpevent, bench_check_wtpevent },
+	{ "types", bench_create_types, bench_check_types }
+};
+
+/* */
+static int bench_parse(struct bench_parse_message* message, unsigned long iterations) {
+	unsigned long i;
+	unsigned long mallocs;
+	unsigned long errors = 0;
+	uint64_t walltime;
+	struct capwap_parsed_packet packet;
+	struct capwap_packet_rxmng* rxmngpacket;
+
+	rxmngpacket = message->create();
+	if (!rxmngpacket) {
+		log_printf(LOG_ERR, "Unable to build %s message", message->name);
+		return 0;
+	}
+
+	/* */
+	if ((capwap_parsing_packet(rxmngpacket, &packet) != PARSING_COMPLETE) || capwap_validate_parsed_packet(&packet, NULL) || !message->check(&packet)) {
+		log_printf(LOG_ERR, "Wrong parsing of %s message", message->name);
+		errors++;
+	}
+
+	capwap_free_parsed_packet(&packet);
+
+	/* */
+	mallocs = g_mallocs;
+	walltime = bench_gettime();
+	for (i = 0; i < iterations; i++) {
+		if (capwap_parsing_packet(rxmngpacket, &packet) != PARSING_COMPLETE) {
+			errors++;
+		} else if (capwap_validate_parsed_packet(&packet, NULL)) {
+			errors++;
+		}
+
+		capwap_free_parsed_packet(&packet);
+	}
+
+	walltime = bench_gettime() - walltime;
+	mallocs = g_mallocs - mallocs;
+
+	printf("message=%s length=%lu elements=%s %.1f ns mallocs=%.1f errors=%lu\n", message->name, rxmngpacket->packetlength,
+		(errors ? "-" : "ok"), ((double)walltime * 1000.0) / (double)iterations, (double)mallocs / (double)iterations, errors);
+
+	capwap_packet_rxmng_free(rxmngpacket);
+	return (errors ? 0 : 1);
+}
+
+/* */
+int main(int argc, char** argv) {
+	int opt;
+	int result = 0;
+	unsigned long i;
+	unsigned long iterations = BENCH_DEFAULT_ITERATIONS;
+
+	while ((opt = getopt(argc, argv, "n:")) != -1) {
+		switch (opt) {
+			case 'n': {
+				iterations = strtoul(optarg, NULL, 10);
+				break;
+			}
+
+			default: {
+				bench_usage(argv[0]);
+				return 1;
+			}
+		}
+	}
+
+	if (!iterations) {
+		bench_usage(argv[0]);
+		return 1;
+	}
+
+	/* */
+	bench_init();
+
+	for (i = 0; i < (sizeof(g_messages) / sizeof(g_messages[0])); i++) {
+		if (!bench_parse(&g_messages[i], iterations)) {
+			result = 1;
+		}
+	}
+
+	bench_free();
+	return result;
+}
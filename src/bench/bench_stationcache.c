@@ -0,0 +1,210 @@
+#include "ac.h"
+#include "ac_stationcache.h"
+#include "bench.h"
+#include <getopt.h>
+
+/* Cache of station authorizations, as the Station Configuration of AC. The
+   decisions are checked before the measure: two WTPs with the same SSID and
+   station receive different decisions of Backend, each WTP must retrieve its
+   own decision and the invalidation of station must remove both.
+
+	bench_stationcache [-w WTPs] [-s stations] [-l lookups]
+
+   The lookups are split between cached decisions (hit) and stations never
+   authorized (miss, as a new association) */
+
+#define BENCH_DEFAULT_WTPS					100
+#define BENCH_DEFAULT_STATIONS				40
+#define BENCH_DEFAULT_LOOKUPS				1000000
+#define BENCH_SSID							"bench"
+
+/* */
+struct ac_t g_ac;
+
+/* */
+static void bench_usage(const char* name) {
+	fprintf(stderr, "Usage: %s [-w WTPs] [-s stations] [-l lookups]\n", name);
+}
+
+/* */
+static void bench_make_wtpid(char* wtpid, unsigned long index) {
+	uint8_t address[MACADDRESS_EUI48_LENGTH] = { 0x00, 0x1a, 0x2b, 0x00, 0x00, 0x00 };
+
+	address[3] = (uint8_t)(index >> 16);
+	address[4] = (uint8_t)(index >> 8);
+	address[5] = (uint8_t)index;
+	capwap_printf_macaddress(wtpid, address, MACADDRESS_EUI48_LENGTH);
+}
+
+/* */
+static void bench_make_station(uint8_t* address, unsigned long index) {
+	address[0] = 0x02;
+	address[1] = 0x00;
+	address[2] = (uint8_t)(index >> 24);
+	address[3] = (uint8_t)(index >> 16);
+	address[4] = (uint8_t)(index >> 8);
+	address[5] = (uint8_t)index;
+}
+
+/* Same station and SSID on two WTPs */
+static int bench_check(void) {
+	int result = 1;
+	char wtpid1[CAPWAP_MACADDRESS_EUI64_BUFFER];
+	char wtpid2[CAPWAP_MACADDRESS_EUI64_BUFFER];
+	uint8_t address[MACADDRESS_EUI48_LENGTH];
+	struct ac_stationcache_decision decision;
+	struct ac_stationcache_decision decision1;
+	struct ac_stationcache_decision decision2;
+
+	bench_make_wtpid(wtpid1, 1);
+	bench_make_wtpid(wtpid2, 2);
+	bench_make_station(address, 1);
+
+	/* Authorized with VLAN into WTP on the first, denied on the second */
+	memset(&decision1, 0, sizeof(struct ac_stationcache_decision));
+	decision1.authorized = 1;
+	decision1.ifdatachannel = 3;
+	strcpy(decision1.wtpvlan, "guest");
+
+	memset(&decision2, 0, sizeof(struct ac_stationcache_decision));
+
+	ac_stationcache_set(wtpid1, BENCH_SSID, address, &decision1, ac_stationcache_getgeneration());
+	ac_stationcache_set(wtpid2, BENCH_SSID, address, &decision2, ac_stationcache_getgeneration());
+
+	if (!ac_stationcache_get(wtpid1, BENCH_SSID, address, &decision) || !decision.authorized || (decision.ifdatachannel != 3) || strcmp(decision.wtpvlan, "guest")) {
+		log_printf(LOG_ERR, "Wrong decision of first WTP");
+		result = 0;
+	}
+
+	if (!ac_stationcache_get(wtpid2, BENCH_SSID, address, &decision) || decision.authorized || decision.wtpvlan[0]) {
+		log_printf(LOG_ERR, "Wrong decision of second WTP");
+		result = 0;
+	}
+
+	/* The invalidation of station is not bound to WTP */
+	if (ac_stationcache_invalidate(BENCH_SSID, address) != 2) {
+		log_printf(LOG_ERR, "Invalidation of station not applied to every WTP");
+		result = 0;
+	}
+
+	if (ac_stationcache_get(wtpid1, BENCH_SSID, address, &decision) || ac_stationcache_get(wtpid2, BENCH_SSID, address, &decision)) {
+		log_printf(LOG_ERR, "Decision retrieved after invalidation");
+		result = 0;
+	}
+
+	printf("check wtp1=authorized wtp2=denied invalidation=%s\n", (result ? "ok" : "failed"));
+	return result;
+}
+
+/* Nanoseconds for a lookup, the result is checked against the expected one */
+static double bench_run(char* wtpids, unsigned long wtps, unsigned long stations, unsigned long lookups, int hit, unsigned long* errors) {
+	unsigned long i;
+	uint64_t walltime;
+	uint8_t address[MACADDRESS_EUI48_LENGTH];
+	struct ac_stationcache_decision decision;
+
+	walltime = bench_gettime();
+	for (i = 0; i < lookups; i++) {
+		unsigned long wtp = i % wtps;
+		unsigned long station = (i / wtps) % stations;
+
+		bench_make_station(address, (hit ? station : stations + station));
+		if (ac_stationcache_get(&wtpids[wtp * CAPWAP_MACADDRESS_EUI64_BUFFER], BENCH_SSID, address, &decision) != hit) {
+			(*errors)++;
+		} else if (hit && (decision.ifdatachannel != wtp)) {
+			(*errors)++;
+		}
+	}
+
+	walltime = bench_gettime() - walltime;
+	return ((double)walltime * 1000.0) / (double)lookups;
+}
+
+/* */
+static int bench_stationcache(unsigned long wtps, unsigned long stations, unsigned long lookups) {
+	unsigned long i, j;
+	unsigned long errors = 0;
+	double hit, miss;
+	char* wtpids;
+	uint8_t address[MACADDRESS_EUI48_LENGTH];
+	struct ac_stationcache_decision decision;
+
+	/* Every WTP has its own decision, the data channel is the WTP index */
+	wtpids = (char*)capwap_alloc(wtps * CAPWAP_MACADDRESS_EUI64_BUFFER);
+	for (i = 0; i < wtps; i++) {
+		bench_make_wtpid(&wtpids[i * CAPWAP_MACADDRESS_EUI64_BUFFER], i);
+
+		for (j = 0; j < stations; j++) {
+			memset(&decision, 0, sizeof(struct ac_stationcache_decision));
+			decision.authorized = 1;
+			decision.ifdatachannel = i;
+
+			bench_make_station(address, j);
+			ac_stationcache_set(&wtpids[i * CAPWAP_MACADDRESS_EUI64_BUFFER], BENCH_SSID, address, &decision, ac_stationcache_getgeneration());
+		}
+	}
+
+	hit = bench_run(wtpids, wtps, stations, lookups, 1, &errors);
+	miss = bench_run(wtpids, wtps, stations, lookups, 0, &errors);
+
+	printf("wtps=%lu stations=%lu entries=%lu hit=%.1f ns miss=%.1f ns (%lu lookups) errors=%lu\n", wtps, stations, wtps * stations, hit, miss, lookups, errors);
+
+	ac_stationcache_invalidate(NULL, NULL);
+	capwap_free(wtpids);
+
+	return (errors ? 0 : 1);
+}
+
+/* */
+int main(int argc, char** argv) {
+	int opt;
+	int result = 0;
+	unsigned long wtps = BENCH_DEFAULT_WTPS;
+	unsigned long stations = BENCH_DEFAULT_STATIONS;
+	unsigned long lookups = BENCH_DEFAULT_LOOKUPS;
+
+	while ((opt = getopt(argc, argv, "w:s:l:")) != -1) {
+		switch (opt) {
+			case 'w': {
+				wtps = strtoul(optarg, NULL, 10);
+				break;
+			}
+
+			case 's': {
+				stations = strtoul(optarg, NULL, 10);
+				break;
+			}
+
+			case 'l': {
+				lookups = strtoul(optarg, NULL, 10);
+				break;
+			}
+
+			default: {
+				bench_usage(argv[0]);
+				return 1;
+			}
+		}
+	}
+
+	if (!wtps || !stations || !lookups) {
+		bench_usage(argv[0]);
+		return 1;
+	}
+
+	/* The cache holds the decisions of every WTP */
+	bench_init();
+	memset(&g_ac, 0, sizeof(struct ac_t));
+	g_ac.stationcachesize = wtps * stations;
+	g_ac.stationcachetimeout = AC_DEFAULT_STATIONCACHE_TIMEOUT;
+	g_ac.stationcachedeniedtimeout = AC_DEFAULT_STATIONCACHE_DENIED_TIMEOUT;
+	ac_stationcache_init();
+
+	if (!bench_check() || !bench_stationcache(wtps, stations, lookups)) {
+		result = 1;
+	}
+
+	ac_stationcache_free();
+	bench_free();
+	return result;
+}
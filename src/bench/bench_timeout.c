@@ -0,0 +1,473 @@
+#include "capwap.h"
+#include "bench.h"
+#include <getopt.h>
+
+/* Cost of capwap_timeout operations, the timing wheel against the sorted list
+   which it replaced. The list implementation is kept here as reference, only
+   its bitfield of timer indexes is sized for the number of timers.
+
+	bench_timeout [-n timers] [-o operations]
+
+   Without -n the timers are 10k and 100k. With n timers scheduled, random
+   timeouts from 1 s to 10 min, every implementation is measured for:
+	set			schedule a new timer
+	reset		change the timeout of a scheduled timer
+	delete		unschedule and release a timer
+	getcoming	next expiration, as the loop of every timer owner
+
+   The list walks the timers to insert them: its operations are limited so
+   the run is bounded, the populate uses decreasing timeouts which insert in
+   front of list */
+
+#define BENCH_DEFAULT_OPERATIONS			100000
+#define BENCH_LIST_MAX_STEPS				200000000ULL		/* Bound the time of list walks */
+#define BENCH_TIMEOUT_MIN					1000				/* ms */
+#define BENCH_TIMEOUT_MAX					600000				/* ms */
+
+/* */
+static unsigned long g_default_timers[] = { 10000, 100000 };
+
+/* Sorted list of timeouts, the implementation of capwap_timeout before the timing wheel */
+#define BENCH_TIMEOUTLIST_HASH_COUNT		128
+
+struct bench_timeoutlist {
+	uint32_t* timeoutbitfield;
+	unsigned long bitfieldsize;
+	struct capwap_hash* itemsreference;
+	struct capwap_list* itemstimeout;
+};
+
+struct bench_timeoutlist_item {
+	unsigned long index;
+	long durate;
+	struct timeval expire;
+	capwap_timeout_expire callback;
+	void* context;
+	void* param;
+};
+
+/* */
+static unsigned long bench_timeoutlist_hash_item_gethash(const void* key, unsigned long hashsize) {
+	return (*((unsigned long*)key) % hashsize);
+}
+
+/* */
+static const void* bench_timeoutlist_hash_item_getkey(const void* data) {
+	return (const void*)&((struct bench_timeoutlist_item*)((struct capwap_list_item*)data)->item)->index;
+}
+
+/* */
+static int bench_timeoutlist_hash_item_cmp(const void* key1, const void* key2) {
+	unsigned long value1 = *(unsigned long*)key1;
+	unsigned long value2 = *(unsigned long*)key2;
+
+	return ((value1 == value2) ? 0 : ((value1 < value2) ? -1 : 1));
+}
+
+/* */
+static long bench_timeoutlist_getdelta(struct timeval* time1, struct timeval* time2) {
+	return (time1->tv_sec - time2->tv_sec) * 1000 + (time1->tv_usec - time2->tv_usec) / 1000;
+}
+
+/* */
+static unsigned long bench_timeoutlist_set_bitfield(struct bench_timeoutlist* timeout) {
+	int j;
+	unsigned long i;
+
+	/* Search free bitfield */
+	for (i = 0; i < timeout->bitfieldsize; i++) {
+		if (timeout->timeoutbitfield[i] != 0xffffffff) {
+			uint32_t bitfield = timeout->timeoutbitfield[i];
+
+			for (j = 0; j < 32; j++) {
+				if (!(bitfield & (1 << j))) {
+					timeout->timeoutbitfield[i] |= (1 << j);
+					return (i * 32 + j + 1);
+				}
+			}
+		}
+	}
+
+	return CAPWAP_TIMEOUT_INDEX_NO_SET;
+}
+
+/* */
+static void bench_timeoutlist_clear_bitfield(struct bench_timeoutlist* timeout, unsigned long value) {
+	timeout->timeoutbitfield[(value - 1) / 32] &= ~(1 << ((value - 1) % 32));
+}
+
+/* */
+static void bench_timeoutlist_additem(struct capwap_list* itemstimeout, struct capwap_list_item* itemlist) {
+	struct capwap_list_item* search;
+	struct capwap_list_item* last = NULL;
+	struct bench_timeoutlist_item* item = (struct bench_timeoutlist_item*)itemlist->item;
+
+	/* */
+	search = itemstimeout->first;
+	while (search) {
+		struct bench_timeoutlist_item* itemsearch = (struct bench_timeoutlist_item*)search->item;
+
+		if (bench_timeoutlist_getdelta(&item->expire, &itemsearch->expire) < 0) {
+			capwap_itemlist_insert_before(itemstimeout, last, itemlist);
+			break;
+		}
+
+		/* Next */
+		last = search;
+		search = search->next;
+	}
+
+	/* */
+	if (!search) {
+		capwap_itemlist_insert_after(itemstimeout, NULL, itemlist);
+	}
+}
+
+/* */
+static void bench_timeoutlist_setexpire(long durate, struct timeval* now, struct timeval* expire) {
+	expire->tv_sec = now->tv_sec + durate / 1000;
+	expire->tv_usec = now->tv_usec + durate % 1000;
+	if (expire->tv_usec >= 1000000) {
+		expire->tv_sec++;
+		expire->tv_usec -= 1000000;
+	}
+}
+
+/* */
+static struct bench_timeoutlist* bench_timeoutlist_init(unsigned long count) {
+	struct bench_timeoutlist* timeout;
+
+	/* */
+	timeout = (struct bench_timeoutlist*)capwap_alloc(sizeof(struct bench_timeoutlist));
+	memset(timeout, 0, sizeof(struct bench_timeoutlist));
+
+	timeout->bitfieldsize = (count / 32) + 1;
+	timeout->timeoutbitfield = (uint32_t*)capwap_alloc(sizeof(uint32_t) * timeout->bitfieldsize);
+	memset(timeout->timeoutbitfield, 0, sizeof(uint32_t) * timeout->bitfieldsize);
+
+	/* */
+	timeout->itemsreference = capwap_hash_create(BENCH_TIMEOUTLIST_HASH_COUNT);
+	timeout->itemsreference->item_gethash = bench_timeoutlist_hash_item_gethash;
+	timeout->itemsreference->item_getkey = bench_timeoutlist_hash_item_getkey;
+	timeout->itemsreference->item_cmp = bench_timeoutlist_hash_item_cmp;
+
+	timeout->itemstimeout = capwap_list_create();
+
+	return timeout;
+}
+
+/* */
+static void bench_timeoutlist_free(struct bench_timeoutlist* timeout) {
+	capwap_hash_free(timeout->itemsreference);
+	capwap_list_free(timeout->itemstimeout);
+	capwap_free(timeout->timeoutbitfield);
+	capwap_free(timeout);
+}
+
+/* */
+static unsigned long bench_timeoutlist_set(struct bench_timeoutlist* timeout, unsigned long index, long durate, capwap_timeout_expire callback, void* context, void* param) {
+	struct capwap_list_item* itemlist;
+	struct bench_timeoutlist_item* item;
+	struct timeval now;
+
+	gettimeofday(&now, NULL);
+
+	if (index == CAPWAP_TIMEOUT_INDEX_NO_SET) {
+		index = bench_timeoutlist_set_bitfield(timeout);
+	} else {
+		/* Check can update timeout timer */
+		itemlist = (struct capwap_list_item*)capwap_hash_search(timeout->itemsreference, &index);
+		if (itemlist) {
+			/* Remove from timeout list */
+			capwap_itemlist_remove(timeout->itemstimeout, itemlist);
+
+			/* Update timeout */
+			item = (struct bench_timeoutlist_item*)itemlist->item;
+			item->durate = durate;
+			bench_timeoutlist_setexpire(item->durate, &now, &item->expire);
+			item->callback = callback;
+			item->context = context;
+			item->param = param;
+
+			/* Add itemlist into order list */
+			bench_timeoutlist_additem(timeout->itemstimeout, itemlist);
+			return index;
+		}
+	}
+
+	/* Create new timeout timer */
+	itemlist = capwap_itemlist_create(sizeof(struct bench_timeoutlist_item));
+	item = (struct bench_timeoutlist_item*)itemlist->item;
+
+	/* */
+	item->index = index;
+	item->durate = durate;
+	bench_timeoutlist_setexpire(item->durate, &now, &item->expire);
+	item->callback = callback;
+	item->context = context;
+	item->param = param;
+
+	/* Add itemlist into hash for rapid searching */
+	capwap_hash_add(timeout->itemsreference, (void*)itemlist);
+
+	/* Add itemlist into order list */
+	bench_timeoutlist_additem(timeout->itemstimeout, itemlist);
+
+	return item->index;
+}
+
+/* */
+static void bench_timeoutlist_deletetimer(struct bench_timeoutlist* timeout, unsigned long index) {
+	struct capwap_list_item* itemlist;
+
+	if (index != CAPWAP_TIMEOUT_INDEX_NO_SET) {
+		itemlist = (struct capwap_list_item*)capwap_hash_search(timeout->itemsreference, &index);
+		if (itemlist) {
+			capwap_hash_delete(timeout->itemsreference, &index);
+			capwap_itemlist_free(capwap_itemlist_remove(timeout->itemstimeout, itemlist));
+		}
+
+		/* Release timer index */
+		bench_timeoutlist_clear_bitfield(timeout, index);
+	}
+}
+
+/* */
+static long bench_timeoutlist_getcoming(struct bench_timeoutlist* timeout) {
+	long delta;
+	struct timeval now;
+	struct capwap_list_item* search;
+	struct bench_timeoutlist_item* item;
+
+	/* */
+	search = timeout->itemstimeout->first;
+	if (!search) {
+		return CAPWAP_TIMEOUT_INFINITE;
+	}
+
+	/* */
+	gettimeofday(&now, NULL);
+	item = (struct bench_timeoutlist_item*)search->item;
+	delta = bench_timeoutlist_getdelta(&item->expire, &now);
+
+	if (delta <= 0) {
+		return 0;
+	} else if (delta <= item->durate) {
+		return delta;
+	}
+
+	/* Recalculate all timeouts because delta > item->durate */
+	while (search) {
+		struct bench_timeoutlist_item* itemsearch = (struct bench_timeoutlist_item*)search->item;
+
+		bench_timeoutlist_setexpire(itemsearch->durate, &now, &itemsearch->expire);
+		search = search->next;
+	}
+
+	return item->durate;
+}
+
+/* Both implementations with the same operations */
+struct bench_timeout {
+	int wheel;
+	struct capwap_timeout* timeout;
+	struct bench_timeoutlist* timeoutlist;
+};
+
+/* */
+static unsigned long bench_timeout_set(struct bench_timeout* bench, unsigned long index, long durate) {
+	return (bench->wheel ? capwap_timeout_set(bench->timeout, index, durate, NULL, NULL, NULL) : bench_timeoutlist_set(bench->timeoutlist, index, durate, NULL, NULL, NULL));
+}
+
+/* */
+static void bench_timeout_delete(struct bench_timeout* bench, unsigned long index) {
+	if (bench->wheel) {
+		capwap_timeout_deletetimer(bench->timeout, index);
+	} else {
+		bench_timeoutlist_deletetimer(bench->timeoutlist, index);
+	}
+}
+
+/* */
+static long bench_timeout_getcoming(struct bench_timeout* bench) {
+	return (bench->wheel ? capwap_timeout_getcoming(bench->timeout) : bench_timeoutlist_getcoming(bench->timeoutlist));
+}
+
+/* */
+static void bench_usage(const char* name) {
+	fprintf(stderr, "Usage: %s [-n timers] [-o operations]\n", name);
+}
+
+/* */
+static long bench_random_timeout(void) {
+	return BENCH_TIMEOUT_MIN + capwap_get_rand(BENCH_TIMEOUT_MAX - BENCH_TIMEOUT_MIN);
+}
+
+/* */
+static int bench_compare_timeout(const void* value1, const void* value2) {
+	long durate1 = *(const long*)value1;
+	long durate2 = *(const long*)value2;
+
+	return ((durate1 == durate2) ? 0 : ((durate1 > durate2) ? -1 : 1));
+}
+
+/* Nanoseconds for an operation */
+static double bench_elapsed(uint64_t walltime, unsigned long operations) {
+	return ((double)(bench_gettime() - walltime) * 1000.0) / (double)operations;
+}
+
+/* */
+static int bench_timeout_run(int wheel, unsigned long count, unsigned long operations) {
+	unsigned long i;
+	unsigned long errors = 0;
+	long* durates;
+	unsigned long* indexes;
+	unsigned long* added;
+	uint64_t walltime;
+	double set, reset, delete, getcoming;
+	struct bench_timeout bench;
+
+	/* */
+	memset(&bench, 0, sizeof(struct bench_timeout));
+	bench.wheel = wheel;
+	if (wheel) {
+		bench.timeout = capwap_timeout_init();
+	} else {
+		bench.timeoutlist = bench_timeoutlist_init(count + operations);
+
+		/* The list walks up to all timers for every set */
+		if (operations > (BENCH_LIST_MAX_STEPS / count)) {
+			operations = (unsigned long)(BENCH_LIST_MAX_STEPS / count);
+			if (!operations) {
+				operations = 1;
+			}
+		}
+	}
+
+	/* Populate, with decreasing timeouts the list inserts in front */
+	durates = (long*)capwap_alloc(sizeof(long) * count);
+	indexes = (unsigned long*)capwap_alloc(sizeof(unsigned long) * count);
+	added = (unsigned long*)capwap_alloc(sizeof(unsigned long) * operations);
+	for (i = 0; i < count; i++) {
+		durates[i] = bench_random_timeout();
+	}
+
+	qsort(durates, count, sizeof(long), bench_compare_timeout);
+	for (i = 0; i < count; i++) {
+		indexes[i] = bench_timeout_set(&bench, CAPWAP_TIMEOUT_INDEX_NO_SET, durates[i]);
+		if (indexes[i] == CAPWAP_TIMEOUT_INDEX_NO_SET) {
+			errors++;
+		}
+	}
+
+	/* New timers */
+	walltime = bench_gettime();
+	for (i = 0; i < operations; i++) {
+		added[i] = bench_timeout_set(&bench, CAPWAP_TIMEOUT_INDEX_NO_SET, bench_random_timeout());
+		if (added[i] == CAPWAP_TIMEOUT_INDEX_NO_SET) {
+			errors++;
+		}
+	}
+
+	set = bench_elapsed(walltime, operations);
+
+	/* Change timeout of scheduled timers */
+	walltime = bench_gettime();
+	for (i = 0; i < operations; i++) {
+		if (bench_timeout_set(&bench, indexes[capwap_get_rand((int)count)], bench_random_timeout()) == CAPWAP_TIMEOUT_INDEX_NO_SET) {
+			errors++;
+		}
+	}
+
+	reset = bench_elapsed(walltime, operations);
+
+	/* Release the new timers */
+	walltime = bench_gettime();
+	for (i = 0; i < operations; i++) {
+		bench_timeout_delete(&bench, added[i]);
+	}
+
+	delete = bench_elapsed(walltime, operations);
+
+	/* Next expiration */
+	walltime = bench_gettime();
+	for (i = 0; i < operations; i++) {
+		if (bench_timeout_getcoming(&bench) == CAPWAP_TIMEOUT_INFINITE) {
+			errors++;
+		}
+	}
+
+	getcoming = bench_elapsed(walltime, operations);
+
+	printf("timers=%lu impl=%s set=%.0f ns reset=%.0f ns delete=%.0f ns getcoming=%.0f ns (%lu operations) errors=%lu\n",
+		count, (wheel ? "wheel" : "list"), set, reset, delete, getcoming, operations, errors);
+
+	/* */
+	for (i = 0; i < count; i++) {
+		bench_timeout_delete(&bench, indexes[i]);
+	}
+
+	if (wheel) {
+		capwap_timeout_free(bench.timeout);
+	} else {
+		bench_timeoutlist_free(bench.timeoutlist);
+	}
+
+	capwap_free(durates);
+	capwap_free(indexes);
+	capwap_free(added);
+
+	return (errors ? 0 : 1);
+}
+
+/* */
+int main(int argc, char** argv) {
+	int opt;
+	int result = 0;
+	unsigned long i;
+	unsigned long count = 0;
+	unsigned long operations = BENCH_DEFAULT_OPERATIONS;
+
+	while ((opt = getopt(argc, argv, "n:o:")) != -1) {
+		switch (opt) {
+			case 'n': {
+				count = strtoul(optarg, NULL, 10);
+				break;
+			}
+
+			case 'o': {
+				operations = strtoul(optarg, NULL, 10);
+				break;
+			}
+
+			default: {
+				bench_usage(argv[0]);
+				return 1;
+			}
+		}
+	}
+
+	if (!operations) {
+		bench_usage(argv[0]);
+		return 1;
+	}
+
+	/* */
+	bench_init();
+	capwap_init_rand();
+
+	for (i = 0; i < (sizeof(g_default_timers) / sizeof(g_default_timers[0])); i++) {
+		unsigned long timers = (count ? count : g_default_timers[i]);
+
+		if (!bench_timeout_run(0, timers, operations) || !bench_timeout_run(1, timers, operations)) {
+			result = 1;
+		}
+
+		if (count) {
+			break;
+		}
+	}
+
+	bench_free();
+	return result;
+}
@@ -1,9 +1,16 @@
 #include "capwap.h"
 #include "capwap_dtls.h"
+#include "capwap_dtls_cache.h"
 #include "capwap_protocol.h"
 #include <wolfssl/options.h>
 #include <wolfssl/ssl.h>
 #include <wolfssl/wolfcrypt/sha.h>
+#include <wolfssl/wolfcrypt/hmac.h>
+#include <wolfssl/wolfcrypt/random.h>
+
+/* Secret key of the stateless cookies, regenerated at every start */
+#define CAPWAP_DTLS_COOKIE_SECRET_LENGTH						32
+static unsigned char g_cookiesecret[CAPWAP_DTLS_COOKIE_SECRET_LENGTH];
 
 /* */
 static const char g_char2hex[] = {
@@ -47,33 +54,66 @@ static int capwap_bio_method_recv(WOLFSSL* ssl, char* buffer, int length, void*
 		return WOLFSSL_CBIO_ERR_GENERAL;
 	}
 	
-	/* Copy DTLS packet */
+	/* Copy DTLS packet, the only copy of ciphertext: wolfSSL owns its input buffer */
 	memcpy(buffer, dtls->buffer, size);
 	dtls->buffer = NULL;
 
 	return size;
 }
 
+/* The records of a batch are copied into a single arena, wolfSSL reuses its
+   output buffer for every record */
+#define CAPWAP_DTLS_SENDBATCH_ARENA_SIZE		(CAPWAP_MAX_GSO_SIZE + CAPWAP_MAX_PACKET_SIZE)
+
+struct capwap_dtls_sendbatch {
+	int count;
+	struct iovec iov[CAPWAP_SEND_BATCH_SIZE];
+
+	/* */
+	char* arena;
+	size_t used;
+};
+
+/* */
+static struct capwap_dtls_header g_dtlspreamble = {
+	.preamble = {
+		.version = CAPWAP_PROTOCOL_VERSION,
+		.type = CAPWAP_PREAMBLE_DTLS_HEADER
+	}
+};
+
 /* */
 static int capwap_bio_method_send(WOLFSSL* ssl, char* buffer, int length, void* context) {
 	int err;
-	char data[CAPWAP_MAX_PACKET_SIZE];
+	struct iovec iov[2];
 	struct capwap_dtls* dtls = (struct capwap_dtls*)context;
-	struct capwap_dtls_header* dtlspreamble = (struct capwap_dtls_header*)data;
 
 	/* Check for maxium size of packet */
 	if (length > (CAPWAP_MAX_PACKET_SIZE - sizeof(struct capwap_dtls_header))) {
 		return WOLFSSL_CBIO_ERR_GENERAL;
 	}
 
-	/* Create DTLS Capwap Preamble */
-	dtlspreamble->preamble.version = CAPWAP_PROTOCOL_VERSION;
-	dtlspreamble->preamble.type = CAPWAP_PREAMBLE_DTLS_HEADER;
-	dtlspreamble->reserved1 = dtlspreamble->reserved2 = dtlspreamble->reserved3 = 0;
-	memcpy(&data[0] + sizeof(struct capwap_dtls_header), buffer, length);
+	/* Queue packet into send batch */
+	if (dtls->sendbatch && !dtls->sendto && (dtls->sendbatch->count < CAPWAP_SEND_BATCH_SIZE) && ((dtls->sendbatch->used + sizeof(struct capwap_dtls_header) + length) <= CAPWAP_DTLS_SENDBATCH_ARENA_SIZE)) {
+		struct iovec* batchiov = &dtls->sendbatch->iov[dtls->sendbatch->count++];
 
-	/* Send packet */
-	err = capwap_sendto(dtls->sock, data, length + sizeof(struct capwap_dtls_header), &dtls->peeraddr);
+		batchiov->iov_len = length + sizeof(struct capwap_dtls_header);
+		batchiov->iov_base = dtls->sendbatch->arena + dtls->sendbatch->used;
+		dtls->sendbatch->used += batchiov->iov_len;
+
+		memcpy(batchiov->iov_base, &g_dtlspreamble, sizeof(struct capwap_dtls_header));
+		memcpy((char*)batchiov->iov_base + sizeof(struct capwap_dtls_header), buffer, length);
+
+		return length;
+	}
+
+	/* Send DTLS Capwap Preamble and record without join them */
+	iov[0].iov_base = &g_dtlspreamble;
+	iov[0].iov_len = sizeof(struct capwap_dtls_header);
+	iov[1].iov_base = buffer;
+	iov[1].iov_len = length;
+
+	err = (dtls->sendto ? dtls->sendto(dtls, iov, 2) : capwap_sendto_iov(dtls->sock, iov, 2, &dtls->peeraddr));
 	if (err <= 0) {
 		log_printf(LOG_WARNING, "Unable to send crypt packet, sentto return error %d", err);
 		return WOLFSSL_CBIO_ERR_GENERAL;
@@ -86,6 +126,7 @@ static int capwap_bio_method_send(WOLFSSL* ssl, char* buffer, int length, void*
 /* */
 int capwap_crypt_init() {
 	int result;
+	WC_RNG rng;
 
 	/* Init library */
 	result = wolfSSL_Init();
@@ -93,6 +134,19 @@ int capwap_crypt_init() {
 		return -1;
 	}
 
+	/* Cookie secret */
+	if (wc_InitRng(&rng)) {
+		wolfSSL_Cleanup();
+		return -1;
+	}
+
+	result = wc_RNG_GenerateBlock(&rng, g_cookiesecret, CAPWAP_DTLS_COOKIE_SECRET_LENGTH);
+	wc_FreeRng(&rng);
+	if (result) {
+		wolfSSL_Cleanup();
+		return -1;
+	}
+
 	return 0;
 }
 
@@ -187,45 +241,174 @@ static unsigned int capwap_crypt_psk_to_bin(char* pskkey, unsigned char** pskbin
 }
 
 /* */
-static int capwap_crypt_createcookie(WOLFSSL* ssl, unsigned char* buffer, int size, void* context) {
+static int capwap_crypt_peerkey(union sockaddr_capwap* peeraddr, unsigned char* buffer) {
+	/* Create buffer with peer's address and port */
+	if (peeraddr->ss.ss_family == AF_INET) {
+		memcpy(buffer, &peeraddr->sin.sin_port, sizeof(in_port_t));
+		memcpy(buffer + sizeof(in_port_t), &peeraddr->sin.sin_addr, sizeof(struct in_addr));
+		return sizeof(struct in_addr) + sizeof(in_port_t);
+	} else if (peeraddr->ss.ss_family == AF_INET6) {
+		memcpy(buffer, &peeraddr->sin6.sin6_port, sizeof(in_port_t));
+		memcpy(buffer + sizeof(in_port_t), &peeraddr->sin6.sin6_addr, sizeof(struct in6_addr));
+		return sizeof(struct in6_addr) + sizeof(in_port_t);
+	}
+
+	return -1;
+}
+
+/* */
+static int capwap_crypt_cookie(union sockaddr_capwap* peeraddr, unsigned char* cookie) {
 	int length;
 	unsigned char temp[32];
-    Sha sha;
-    byte digest[SHA_DIGEST_SIZE];
-	struct capwap_dtls* dtls = (struct capwap_dtls*)context;
+	Hmac hmac;
 
-	if (size != SHA_DIGEST_SIZE) {
+	length = capwap_crypt_peerkey(peeraddr, temp);
+	if (length < 0) {
 		return -1;
 	}
 
-	/* Create buffer with peer's address and port */
-	if (dtls->peeraddr.ss.ss_family == AF_INET) {
-		length = sizeof(struct in_addr) + sizeof(in_port_t);
-		memcpy(temp, &dtls->peeraddr.sin.sin_port, sizeof(in_port_t));
-		memcpy(temp + sizeof(in_port_t), &dtls->peeraddr.sin.sin_addr, sizeof(struct in_addr));
-	} else if (dtls->peeraddr.ss.ss_family == AF_INET6) {
-		length = sizeof(struct in6_addr) + sizeof(in_port_t);
-		memcpy(temp, &dtls->peeraddr.sin6.sin6_port, sizeof(in_port_t));
-		memcpy(temp + sizeof(in_port_t), &dtls->peeraddr.sin6.sin6_addr, sizeof(struct in6_addr));
-	} else {
+	/* The cookie is keyed with a private secret, a peer can not forge it */
+	if (wc_HmacSetKey(&hmac, SHA, g_cookiesecret, CAPWAP_DTLS_COOKIE_SECRET_LENGTH) ||
+		wc_HmacUpdate(&hmac, temp, length) ||
+		wc_HmacFinal(&hmac, cookie)) {
 		return -1;
 	}
 
-	/* */
-	if (wc_InitSha(&sha)) {
+	return CAPWAP_DTLS_COOKIE_LENGTH;
+}
+
+/* */
+static int capwap_crypt_createcookie(WOLFSSL* ssl, unsigned char* buffer, int size, void* context) {
+	struct capwap_dtls* dtls = (struct capwap_dtls*)context;
+
+	if (size != CAPWAP_DTLS_COOKIE_LENGTH) {
 		return -1;
 	}
 
-	wc_ShaUpdate(&sha, temp, length);
-	wc_ShaFinal(&sha, digest);
+	/* Same cookie of capwap_crypt_verify_clienthello(), peeraddr is already normalized */
+	return capwap_crypt_cookie(&dtls->peeraddr, buffer);
+}
+
+#ifdef HAVE_EXT_CACHE
+/* New server session, stored into capwap session cache */
+static int capwap_crypt_sessioncache_new(WOLFSSL* ssl, WOLFSSL_SESSION* session) {
+	int length;
+	unsigned int idlength;
+	const unsigned char* id;
+	unsigned char* buffer;
+	unsigned char data[CAPWAP_DTLS_CACHE_DATA_LENGTH];
+	struct capwap_dtls* dtls = (struct capwap_dtls*)wolfSSL_GetIOReadCtx(ssl);
+
+	ASSERT(dtls != NULL);
 
 	/* */
-	memcpy(buffer, digest, SHA_DIGEST_SIZE);
-	return SHA_DIGEST_SIZE;
+	length = wolfSSL_i2d_SSL_SESSION(session, NULL);
+	if ((length > 0) && (length <= CAPWAP_DTLS_CACHE_DATA_LENGTH)) {
+		buffer = data;
+		wolfSSL_i2d_SSL_SESSION(session, &buffer);
+
+		id = wolfSSL_SESSION_get_id(session, &idlength);
+		capwap_dtls_cache_add(dtls->dtlscontext->sessioncache, id, (int)idlength, data, length);
+	}
+
+	/* The reference of session is not kept */
+	return 0;
+}
+
+/* Search server session by id */
+static WOLFSSL_SESSION* capwap_crypt_sessioncache_get(WOLFSSL* ssl, const unsigned char* id, int idlength, int* copy) {
+	int length;
+	const unsigned char* buffer;
+	unsigned char data[CAPWAP_DTLS_CACHE_DATA_LENGTH];
+	struct capwap_dtls* dtls = (struct capwap_dtls*)wolfSSL_GetIOReadCtx(ssl);
+
+	ASSERT(dtls != NULL);
+
+	/* The returned session is owned by wolfSSL */
+	*copy = 0;
+
+	length = capwap_dtls_cache_get(dtls->dtlscontext->sessioncache, id, idlength, data, sizeof(data));
+	if (length > 0) {
+		buffer = data;
+		return wolfSSL_d2i_SSL_SESSION(NULL, &buffer, length);
+	}
+
+	return NULL;
+}
+
+/* Resume the last session with the same peer */
+static void capwap_crypt_sessioncache_resume(struct capwap_dtls* dtls) {
+	int length;
+	int keylength;
+	const unsigned char* buffer;
+	unsigned char key[32];
+	unsigned char data[CAPWAP_DTLS_CACHE_DATA_LENGTH];
+	WOLFSSL_SESSION* session;
+
+	keylength = capwap_crypt_peerkey(&dtls->peeraddr, key);
+	length = capwap_dtls_cache_get(dtls->dtlscontext->sessioncache, key, keylength, data, sizeof(data));
+	if (length > 0) {
+		buffer = data;
+		session = wolfSSL_d2i_SSL_SESSION(NULL, &buffer, length);
+		if (session) {
+			wolfSSL_set_session((WOLFSSL*)dtls->sslsession, session);
+			wolfSSL_SESSION_free(session);
+		}
+	}
+}
+
+/* Save the session with peer for the next connection */
+static void capwap_crypt_sessioncache_save(struct capwap_dtls* dtls) {
+	int length;
+	int keylength;
+	unsigned char* buffer;
+	unsigned char key[32];
+	unsigned char data[CAPWAP_DTLS_CACHE_DATA_LENGTH];
+	WOLFSSL_SESSION* session;
+
+	session = wolfSSL_get_session((WOLFSSL*)dtls->sslsession);
+	if (session) {
+		length = wolfSSL_i2d_SSL_SESSION(session, NULL);
+		if ((length > 0) && (length <= CAPWAP_DTLS_CACHE_DATA_LENGTH)) {
+			buffer = data;
+			wolfSSL_i2d_SSL_SESSION(session, &buffer);
+
+			keylength = capwap_crypt_peerkey(&dtls->peeraddr, key);
+			capwap_dtls_cache_add(dtls->dtlscontext->sessioncache, key, keylength, data, length);
+		}
+	}
+}
+#endif
+
+/* */
+static int capwap_crypt_createsessioncache(struct capwap_dtls_context* dtlscontext, struct capwap_dtls_param* param) {
+#ifdef HAVE_EXT_CACHE
+	dtlscontext->sessioncache = capwap_dtls_cache_create(param->sessioncache.size, param->sessioncache.timeout, param->sessioncache.file);
+	if (!dtlscontext->sessioncache) {
+		return 0;
+	}
+
+	/* */
+	wolfSSL_CTX_set_timeout((WOLFSSL_CTX*)dtlscontext->sslcontext, (unsigned int)param->sessioncache.timeout);
+	if (dtlscontext->type == CAPWAP_DTLS_SERVER) {
+		/* Sessions are stored only into capwap cache, it can be shared with others process */
+		wolfSSL_CTX_set_session_cache_mode((WOLFSSL_CTX*)dtlscontext->sslcontext, WOLFSSL_SESS_CACHE_SERVER | WOLFSSL_SESS_CACHE_NO_INTERNAL_STORE);
+		wolfSSL_CTX_sess_set_new_cb((WOLFSSL_CTX*)dtlscontext->sslcontext, capwap_crypt_sessioncache_new);
+		wolfSSL_CTX_sess_set_get_cb((WOLFSSL_CTX*)dtlscontext->sslcontext, capwap_crypt_sessioncache_get);
+	} else {
+		dtlscontext->sessiontickets = param->sessioncache.tickets;
+	}
+#else
+	log_printf(LOG_WARNING, "wolfSSL without external session cache support, DTLS session cache disabled");
+#endif
+
+	return 1;
 }
 
 /* */
 int capwap_crypt_createcontext(struct capwap_dtls_context* dtlscontext, struct capwap_dtls_param* param) {
+	WOLFSSL_METHOD* method;
+
 	ASSERT(dtlscontext != NULL);
 	ASSERT(param != NULL);
 
@@ -233,8 +416,21 @@ int capwap_crypt_createcontext(struct capwap_dtls_context* dtlscontext, struct c
 	dtlscontext->type = param->type;
 	dtlscontext->mode = param->mode;
 
-	/* Alloc context */
-	dtlscontext->sslcontext = (void*)wolfSSL_CTX_new(((param->type == CAPWAP_DTLS_SERVER) ? wolfDTLSv1_server_method() : wolfDTLSv1_client_method()));
+	/* Alloc context, the AEAD cipher suites require DTLS 1.2 */
+	if (param->version == CAPWAP_DTLS_VERSION_1_0) {
+		method = ((param->type == CAPWAP_DTLS_SERVER) ? wolfDTLSv1_server_method() : wolfDTLSv1_client_method());
+	} else if (param->version == CAPWAP_DTLS_VERSION_1_2) {
+		method = ((param->type == CAPWAP_DTLS_SERVER) ? wolfDTLSv1_2_server_method() : wolfDTLSv1_2_client_method());
+	} else {
+#if defined(HAVE_WOLFDTLS_SERVER_METHOD) && defined(HAVE_WOLFDTLS_CLIENT_METHOD)
+		method = ((param->type == CAPWAP_DTLS_SERVER) ? wolfDTLS_server_method() : wolfDTLS_client_method());
+#else
+		log_printf(LOG_WARNING, "wolfSSL without version flexible DTLS method, DTLS 1.0 peers are refused");
+		method = ((param->type == CAPWAP_DTLS_SERVER) ? wolfDTLSv1_2_server_method() : wolfDTLSv1_2_client_method());
+#endif
+	}
+
+	dtlscontext->sslcontext = (void*)wolfSSL_CTX_new(method);
 	if (!dtlscontext->sslcontext) {
 		log_printf(LOG_DEBUG, "Error to initialize dtls context");
 		return 0;
@@ -292,25 +488,15 @@ int capwap_crypt_createcontext(struct capwap_dtls_context* dtlscontext, struct c
 		/* Verify certificate callback */
 		wolfSSL_CTX_set_verify((WOLFSSL_CTX*)dtlscontext->sslcontext, ((param->type == CAPWAP_DTLS_SERVER) ? SSL_VERIFY_PEER | SSL_VERIFY_FAIL_IF_NO_PEER_CERT : SSL_VERIFY_PEER), capwap_crypt_verifycertificate);
 
-		/* 	Cipher list: 
-				TLS_RSA_WITH_AES_128_CBC_SHA
-				TLS_DHE_RSA_WITH_AES_128_CBC_SHA
-				TLS_RSA_WITH_AES_256_CBC_SHA
-				TLS_DHE_RSA_WITH_AES_256_CBC_SHA
-		*/
-		if (!wolfSSL_CTX_set_cipher_list((WOLFSSL_CTX*)dtlscontext->sslcontext, "AES128-SHA:DHE-RSA-AES128-SHA:AES256-SHA:DHE-RSA-AES256-SHA")) {
+		/* Cipher list */
+		if (!wolfSSL_CTX_set_cipher_list((WOLFSSL_CTX*)dtlscontext->sslcontext, (param->ciphers ? param->ciphers : CAPWAP_DTLS_CERTIFICATE_CIPHERS))) {
 			log_printf(LOG_DEBUG, "Error to select cipher list");
 			capwap_crypt_freecontext(dtlscontext);
 			return 0;
 		}
 	} else if (dtlscontext->mode == CAPWAP_DTLS_MODE_PRESHAREDKEY) {
-		/* 	Cipher list: 
-				TLS_PSK_WITH_AES_128_CBC_SHA
-				TLS_DHE_PSK_WITH_AES_128_CBC_SHA
-				TLS_PSK_WITH_AES_256_CBC_SHA
-				TLS_DHE_PSK_WITH_AES_256_CBC_SHA
-		*/
-		if (!wolfSSL_CTX_set_cipher_list((WOLFSSL_CTX*)dtlscontext->sslcontext, "PSK-AES128-CBC-SHA:PSK-AES256-CBC-SHA")) {
+		/* Cipher list */
+		if (!wolfSSL_CTX_set_cipher_list((WOLFSSL_CTX*)dtlscontext->sslcontext, (param->ciphers ? param->ciphers : CAPWAP_DTLS_PRESHAREDKEY_CIPHERS))) {
 			log_printf(LOG_DEBUG, "Error to select cipher list");
 			capwap_crypt_freecontext(dtlscontext);
 			return 0;
@@ -348,6 +534,13 @@ int capwap_crypt_createcontext(struct capwap_dtls_context* dtlscontext, struct c
 		return 0;
 	}
 
+	/* Session resumption */
+	if (param->sessioncache.size && !capwap_crypt_createsessioncache(dtlscontext, param)) {
+		log_printf(LOG_DEBUG, "Error to create session cache");
+		capwap_crypt_freecontext(dtlscontext);
+		return 0;
+	}
+
 	return 1;
 }
 
@@ -366,6 +559,17 @@ void capwap_crypt_freecontext(struct capwap_dtls_context* dtlscontext) {
 		}
 	}
 
+	/* */
+	if (dtlscontext->handshakesfull || dtlscontext->handshakesresumed) {
+		log_printf(LOG_INFO, "DTLS handshakes: %lu full, %lu resumed", dtlscontext->handshakesfull, dtlscontext->handshakesresumed);
+	}
+
+	if (dtlscontext->sessioncache) {
+		log_printf(LOG_INFO, "DTLS session cache: %lu hits, %lu shared hits, %lu misses, %lu evictions",
+			dtlscontext->sessioncache->hits, dtlscontext->sessioncache->sharedhits, dtlscontext->sessioncache->misses, dtlscontext->sessioncache->evictions);
+		capwap_dtls_cache_free(dtlscontext->sessioncache);
+	}
+
 	/* Free context */	
 	if (dtlscontext->sslcontext) {
 		wolfSSL_CTX_free((WOLFSSL_CTX*)dtlscontext->sslcontext);
@@ -396,6 +600,19 @@ int capwap_crypt_createsession(struct capwap_dtls* dtls, struct capwap_dtls_cont
 	/* */
 	dtls->action = CAPWAP_DTLS_ACTION_NONE;
 	dtls->dtlscontext = dtlscontext;
+
+#ifdef HAVE_EXT_CACHE
+	/* Try to resume the last session with AC */
+	if ((dtlscontext->type == CAPWAP_DTLS_CLIENT) && dtlscontext->sessioncache) {
+#ifdef HAVE_SESSION_TICKET
+		if (dtlscontext->sessiontickets) {
+			wolfSSL_UseSessionTicket((WOLFSSL*)dtls->sslsession);
+		}
+#endif
+
+		capwap_crypt_sessioncache_resume(dtls);
+	}
+#endif
 	dtls->enable = 1;
 	dtls->buffer = NULL;
 	dtls->length = 0;
@@ -434,6 +651,19 @@ static int capwap_crypt_handshake(struct capwap_dtls* dtls) {
 
 	/* Handshake complete */
 	dtls->action = CAPWAP_DTLS_ACTION_DATA;
+	if (wolfSSL_session_reused((WOLFSSL*)dtls->sslsession)) {
+		__atomic_add_fetch(&dtls->dtlscontext->handshakesresumed, 1, __ATOMIC_RELAXED);
+		log_printf(LOG_DEBUG, "DTLS session resumed");
+	} else {
+		__atomic_add_fetch(&dtls->dtlscontext->handshakesfull, 1, __ATOMIC_RELAXED);
+	}
+
+#ifdef HAVE_EXT_CACHE
+	if ((dtls->dtlscontext->type == CAPWAP_DTLS_CLIENT) && dtls->dtlscontext->sessioncache) {
+		capwap_crypt_sessioncache_save(dtls);
+	}
+#endif
+
 	return CAPWAP_HANDSHAKE_COMPLETE;
 }
 
@@ -473,6 +703,23 @@ void capwap_crypt_close(struct capwap_dtls* dtls) {
 	}
 }
 
+/* */
+void capwap_crypt_settransport(struct capwap_dtls* dtls, capwap_dtls_sendto sendto, union sockaddr_capwap* peeraddr) {
+	ASSERT(dtls != NULL);
+	ASSERT(sendto != NULL);
+	ASSERT(peeraddr != NULL);
+
+	dtls->sock = -1;
+	dtls->sendto = sendto;
+
+	/* */
+	memset(&dtls->localaddr, 0, sizeof(union sockaddr_capwap));
+	memcpy(&dtls->peeraddr, peeraddr, sizeof(union sockaddr_capwap));
+	if (dtls->peeraddr.ss.ss_family == AF_INET6) {
+		capwap_ipv4_mapped_ipv6(&dtls->peeraddr);
+	}
+}
+
 /* */
 void capwap_crypt_freesession(struct capwap_dtls* dtls) {
 	ASSERT(dtls != NULL);
@@ -512,10 +759,26 @@ int capwap_crypt_sendto(struct capwap_dtls* dtls, void* buffer, int size) {
 	return wolfSSL_write((WOLFSSL*)dtls->sslsession, buffer, size);
 }
 
+/* */
+static int capwap_crypt_flush_sendbatch(struct capwap_dtls* dtls, struct capwap_dtls_sendbatch* sendbatch) {
+	int err = 1;
+
+	if (sendbatch->count > 0) {
+		err = capwap_sendto_batch(dtls->sock, sendbatch->iov, sendbatch->count, &dtls->peeraddr);
+
+		/* */
+		sendbatch->count = 0;
+		sendbatch->used = 0;
+	}
+
+	return err;
+}
+
 /* */
 int capwap_crypt_sendto_fragmentpacket(struct capwap_dtls* dtls, struct capwap_list* fragmentlist) {
 	int err;
 	struct capwap_list_item* item;
+	struct capwap_dtls_sendbatch sendbatch;
 
 	ASSERT(dtls != NULL);
 	ASSERT(dtls->sock >= 0);
@@ -526,23 +789,51 @@ int capwap_crypt_sendto_fragmentpacket(struct capwap_dtls* dtls, struct capwap_l
 		return capwap_sendto_fragmentpacket(dtls->sock, fragmentlist, &dtls->peeraddr);
 	}
 
-	/* */
+	/* Encrypt all fragments and send them with a single batch */
+	sendbatch.count = 0;
+	sendbatch.used = 0;
+	sendbatch.arena = (char*)capwap_alloc(CAPWAP_DTLS_SENDBATCH_ARENA_SIZE);
+	dtls->sendbatch = &sendbatch;
+
 	item = fragmentlist->first;
 	while (item) {
 		struct capwap_fragment_packet_item* fragmentpacket = (struct capwap_fragment_packet_item*)item->item;
 		ASSERT(fragmentpacket != NULL);
 		ASSERT(fragmentpacket->offset > 0);
 
+		/* Flush full batch */
+		if ((sendbatch.count == CAPWAP_SEND_BATCH_SIZE) || ((sendbatch.used + CAPWAP_MAX_PACKET_SIZE) > CAPWAP_DTLS_SENDBATCH_ARENA_SIZE)) {
+			err = capwap_crypt_flush_sendbatch(dtls, &sendbatch);
+			if (err <= 0) {
+				break;
+			}
+		}
+
 		err = capwap_crypt_sendto(dtls, fragmentpacket->buffer, fragmentpacket->offset);
 		if (err <= 0) {
 			log_printf(LOG_WARNING, "Unable to send crypt fragment, sentto return error %d", err);
-			return 0;
+			break;
 		}
 
 		/* */
 		item = item->next;
 	}
 
+	dtls->sendbatch = NULL;
+	if (item) {
+		capwap_crypt_flush_sendbatch(dtls, &sendbatch);
+		capwap_free(sendbatch.arena);
+		return 0;
+	}
+
+	/* */
+	err = capwap_crypt_flush_sendbatch(dtls, &sendbatch);
+	capwap_free(sendbatch.arena);
+	if (err <= 0) {
+		log_printf(LOG_WARNING, "Unable to send crypt fragments, sentto return error %d", err);
+		return 0;
+	}
+
 	return 1;
 }
 
@@ -550,7 +841,6 @@ int capwap_crypt_sendto_fragmentpacket(struct capwap_dtls* dtls, struct capwap_l
 int capwap_decrypt_packet(struct capwap_dtls* dtls, void* encrybuffer, int size, void* plainbuffer, int maxsize) {
 	int sslerror;
 	int result = -1;
-	char* clone = NULL;
 	
 	ASSERT(dtls != NULL);
 	ASSERT(dtls->enable != 0);
@@ -561,12 +851,9 @@ int capwap_decrypt_packet(struct capwap_dtls* dtls, void* encrybuffer, int size,
 	ASSERT(size > 0);
 	ASSERT(maxsize > 0);
 
-	/* */
-	if (!plainbuffer) {
-		clone = capwap_clone(encrybuffer, size);
-	}
-
-	dtls->buffer = (clone ? clone : encrybuffer);
+	/* Without plainbuffer decrypt in place: the BIO copies the record into
+	   the wolfSSL input buffer before any plain data is written */
+	dtls->buffer = encrybuffer;
 	dtls->length = size;
 
 	/* */	
@@ -597,20 +884,62 @@ int capwap_decrypt_packet(struct capwap_dtls* dtls, void* encrybuffer, int size,
 	ASSERT(dtls->buffer == NULL);
 	ASSERT(dtls->length == 0);
 
-	/* Free clone */
-	if (clone) {
-		capwap_free(clone);
-	}
-	
 	return result;
 }
 
+/* Export the keys of completed handshake, only for AES-GCM cipher suites whose
+   record layer is simple enough to be implemented outside of wolfSSL */
+int capwap_crypt_exportkeys(struct capwap_dtls* dtls, struct capwap_dtls_keys* keys) {
+	WOLFSSL* ssl;
+
+	ASSERT(dtls != NULL);
+	ASSERT(dtls->enable != 0);
+	ASSERT(keys != NULL);
+
+	/* */
+	ssl = (WOLFSSL*)dtls->sslsession;
+	if ((dtls->action != CAPWAP_DTLS_ACTION_DATA) || !ssl) {
+		return -1;
+	} else if ((wolfSSL_GetBulkCipher(ssl) != wolfssl_aes_gcm) || (wolfSSL_GetAeadMacSize(ssl) != 16)) {
+		log_printf(LOG_WARNING, "Unable to export DTLS keys, the cipher suite is not AES-GCM");
+		return -1;
+	}
+
+	/* */
+	keys->keylength = wolfSSL_GetKeySize(ssl);
+	if ((keys->keylength <= 0) || (keys->keylength > CAPWAP_DTLS_KEYS_MAX_LENGTH)) {
+		return -1;
+	}
+
+	/* The handshake without renegotiation complete with the epoch 1 */
+	keys->epoch = 1;
+
+	/* The implicit part of nonce is the first bytes of write IV */
+	if (wolfSSL_GetSide(ssl) == WOLFSSL_SERVER_END) {
+		memcpy(keys->readkey, wolfSSL_GetClientWriteKey(ssl), keys->keylength);
+		memcpy(keys->readsalt, wolfSSL_GetClientWriteIV(ssl), CAPWAP_DTLS_KEYS_SALT_LENGTH);
+		memcpy(keys->writekey, wolfSSL_GetServerWriteKey(ssl), keys->keylength);
+		memcpy(keys->writesalt, wolfSSL_GetServerWriteIV(ssl), CAPWAP_DTLS_KEYS_SALT_LENGTH);
+	} else {
+		memcpy(keys->readkey, wolfSSL_GetServerWriteKey(ssl), keys->keylength);
+		memcpy(keys->readsalt, wolfSSL_GetServerWriteIV(ssl), CAPWAP_DTLS_KEYS_SALT_LENGTH);
+		memcpy(keys->writekey, wolfSSL_GetClientWriteKey(ssl), keys->keylength);
+		memcpy(keys->writesalt, wolfSSL_GetClientWriteIV(ssl), CAPWAP_DTLS_KEYS_SALT_LENGTH);
+	}
+
+	return 0;
+}
+
 /* */
 #define SIZEOF_DTLS_LAYERS										14
 #define DTLS_RECORD_LAYER_HANDSHAKE_CONTENT_TYPE				22
 #define DTLS_1_0_VERSION										0xfeff
 #define DTLS_1_2_VERSION										0xfefd
 #define DTLS_HANDSHAKE_LAYER_CLIENT_HELLO						1
+#define DTLS_HANDSHAKE_LAYER_HELLO_VERIFY_REQUEST				3
+#define DTLS_RECORD_LAYER_LENGTH								13
+#define DTLS_HANDSHAKE_LAYER_LENGTH								12
+#define DTLS_HELLO_RANDOM_LENGTH								32
 
 /* */
 int capwap_crypt_has_dtls_clienthello(void* buffer, int buffersize) {
@@ -628,3 +957,114 @@ int capwap_crypt_has_dtls_clienthello(void* buffer, int buffersize) {
 
 	return 0;
 }
+
+/* */
+static unsigned long capwap_crypt_read_uint24(unsigned char* buffer) {
+	return ((unsigned long)buffer[0] << 16) | ((unsigned long)buffer[1] << 8) | (unsigned long)buffer[2];
+}
+
+/* */
+static void capwap_crypt_write_uint24(unsigned char* buffer, unsigned long value) {
+	buffer[0] = (unsigned char)(value >> 16);
+	buffer[1] = (unsigned char)(value >> 8);
+	buffer[2] = (unsigned char)value;
+}
+
+/* Check the cookie of a ClientHello without any per peer state. If the cookie is
+   missing or wrong a HelloVerifyRequest, with CAPWAP DTLS header, is built into
+   response buffer of CAPWAP_DTLS_HELLOVERIFYREQUEST_LENGTH bytes */
+int capwap_crypt_verify_clienthello(void* buffer, int buffersize, union sockaddr_capwap* peeraddr, void* response, int* responselength) {
+	int i;
+	uint8_t diff;
+	unsigned long offset;
+	unsigned long recordlength;
+	unsigned long handshakelength;
+	unsigned long cookielength;
+	union sockaddr_capwap normalizedaddr;
+	unsigned char cookie[CAPWAP_DTLS_COOKIE_LENGTH];
+	unsigned char* dtlsdata = (unsigned char*)buffer;
+	unsigned char* handshake = dtlsdata + DTLS_RECORD_LAYER_LENGTH;
+	unsigned char* hello = handshake + DTLS_HANDSHAKE_LAYER_LENGTH;
+	unsigned char* record;
+	struct capwap_dtls_header* dtlspreamble;
+
+	ASSERT(peeraddr != NULL);
+	ASSERT(response != NULL);
+	ASSERT(responselength != NULL);
+
+	if (!capwap_crypt_has_dtls_clienthello(buffer, buffersize) || (buffersize < (DTLS_RECORD_LAYER_LENGTH + DTLS_HANDSHAKE_LAYER_LENGTH))) {
+		return CAPWAP_DTLS_CLIENTHELLO_INVALID;
+	}
+
+	/* First ClientHello use epoch 0 and it is not fragmented */
+	recordlength = ntohs(*(uint16_t*)(dtlsdata + 11));
+	handshakelength = capwap_crypt_read_uint24(handshake + 1);
+	if (dtlsdata[3] || dtlsdata[4] || ((DTLS_RECORD_LAYER_LENGTH + recordlength) > buffersize) ||
+		((DTLS_HANDSHAKE_LAYER_LENGTH + handshakelength) > recordlength) ||
+		capwap_crypt_read_uint24(handshake + 6) || (capwap_crypt_read_uint24(handshake + 9) != handshakelength)) {
+		return CAPWAP_DTLS_CLIENTHELLO_INVALID;
+	}
+
+	/* Skip client_version, random and session_id */
+	offset = 2 + DTLS_HELLO_RANDOM_LENGTH;
+	if ((offset + 1) > handshakelength) {
+		return CAPWAP_DTLS_CLIENTHELLO_INVALID;
+	}
+
+	offset += 1 + hello[offset];
+	if ((offset + 1) > handshakelength) {
+		return CAPWAP_DTLS_CLIENTHELLO_INVALID;
+	}
+
+	cookielength = hello[offset++];
+	if ((offset + cookielength) > handshakelength) {
+		return CAPWAP_DTLS_CLIENTHELLO_INVALID;
+	}
+
+	/* Expected cookie */
+	memcpy(&normalizedaddr, peeraddr, sizeof(union sockaddr_capwap));
+	if (normalizedaddr.ss.ss_family == AF_INET6) {
+		capwap_ipv4_mapped_ipv6(&normalizedaddr);
+	}
+
+	if (capwap_crypt_cookie(&normalizedaddr, cookie) != CAPWAP_DTLS_COOKIE_LENGTH) {
+		return CAPWAP_DTLS_CLIENTHELLO_INVALID;
+	}
+
+	if (cookielength == CAPWAP_DTLS_COOKIE_LENGTH) {
+		for (diff = 0, i = 0; i < CAPWAP_DTLS_COOKIE_LENGTH; i++) {
+			diff |= hello[offset + i] ^ cookie[i];
+		}
+
+		if (!diff) {
+			return CAPWAP_DTLS_CLIENTHELLO_ACCEPTED;
+		}
+	}
+
+	/* Build HelloVerifyRequest with DTLS Capwap Preamble */
+	dtlspreamble = (struct capwap_dtls_header*)response;
+	dtlspreamble->preamble.version = CAPWAP_PROTOCOL_VERSION;
+	dtlspreamble->preamble.type = CAPWAP_PREAMBLE_DTLS_HEADER;
+	dtlspreamble->reserved1 = dtlspreamble->reserved2 = dtlspreamble->reserved3 = 0;
+
+	record = (unsigned char*)response + sizeof(struct capwap_dtls_header);
+	record[0] = DTLS_RECORD_LAYER_HANDSHAKE_CONTENT_TYPE;
+	*(uint16_t*)(record + 1) = htons(DTLS_1_0_VERSION);
+	memcpy(record + 3, dtlsdata + 3, 8);			/* Epoch and sequence number of ClientHello */
+	*(uint16_t*)(record + 11) = htons(DTLS_HANDSHAKE_LAYER_LENGTH + 3 + CAPWAP_DTLS_COOKIE_LENGTH);
+
+	handshake = record + DTLS_RECORD_LAYER_LENGTH;
+	handshake[0] = DTLS_HANDSHAKE_LAYER_HELLO_VERIFY_REQUEST;
+	capwap_crypt_write_uint24(handshake + 1, 3 + CAPWAP_DTLS_COOKIE_LENGTH);
+	memcpy(handshake + 4, dtlsdata + DTLS_RECORD_LAYER_LENGTH + 4, 2);		/* Message sequence of ClientHello */
+	capwap_crypt_write_uint24(handshake + 6, 0);
+	capwap_crypt_write_uint24(handshake + 9, 3 + CAPWAP_DTLS_COOKIE_LENGTH);
+
+	hello = handshake + DTLS_HANDSHAKE_LAYER_LENGTH;
+	*(uint16_t*)hello = htons(DTLS_1_0_VERSION);
+	hello[2] = CAPWAP_DTLS_COOKIE_LENGTH;
+	memcpy(hello + 3, cookie, CAPWAP_DTLS_COOKIE_LENGTH);
+
+	*responselength = CAPWAP_DTLS_HELLOVERIFYREQUEST_LENGTH;
+	return CAPWAP_DTLS_CLIENTHELLO_VERIFY;
+}
@@ -11,6 +11,20 @@
 #define CAPWAP_DTLS_MODE_CERTIFICATE			1
 #define CAPWAP_DTLS_MODE_PRESHAREDKEY			2
 
+#define CAPWAP_DTLS_VERSION_1_0					0
+#define CAPWAP_DTLS_VERSION_1_2					1
+#define CAPWAP_DTLS_VERSION_ANY					2		/* DTLS 1.2 preferred, downgrade to DTLS 1.0 allowed */
+
+/* Default cipher suites, AEAD with ephemeral key exchange first. The CBC suites
+   of RFC 5415 are kept at the end for the old peers */
+#define CAPWAP_DTLS_CERTIFICATE_CIPHERS			"ECDHE-ECDSA-AES128-GCM-SHA256:ECDHE-RSA-AES128-GCM-SHA256:"		\
+												"ECDHE-ECDSA-CHACHA20-POLY1305:ECDHE-RSA-CHACHA20-POLY1305:"		\
+												"ECDHE-ECDSA-AES256-GCM-SHA384:ECDHE-RSA-AES256-GCM-SHA384:"		\
+												"AES128-SHA:DHE-RSA-AES128-SHA:AES256-SHA:DHE-RSA-AES256-SHA"
+#define CAPWAP_DTLS_PRESHAREDKEY_CIPHERS		"ECDHE-PSK-CHACHA20-POLY1305:DHE-PSK-AES128-GCM-SHA256:"			\
+												"PSK-AES128-GCM-SHA256:PSK-CHACHA20-POLY1305:PSK-AES256-GCM-SHA384:"	\
+												"PSK-AES128-CBC-SHA:PSK-AES256-CBC-SHA"
+
 #define CAPWAP_DTLS_ACTION_NONE					0
 #define CAPWAP_DTLS_ACTION_HANDSHAKE			1
 #define CAPWAP_DTLS_ACTION_DATA					2
@@ -25,8 +39,33 @@
 #define CAPWAP_ERROR_SHUTDOWN					-1
 #define CAPWAP_ERROR_CLOSE						-2
 
+#define CAPWAP_DTLS_CLIENTHELLO_INVALID			-1
+#define CAPWAP_DTLS_CLIENTHELLO_VERIFY			0
+#define CAPWAP_DTLS_CLIENTHELLO_ACCEPTED		1
+
+/* Stateless cookie exchange, HMAC-SHA1 of peer address */
+#define CAPWAP_DTLS_COOKIE_LENGTH				20
+#define CAPWAP_DTLS_HELLOVERIFYREQUEST_LENGTH	(4 + 13 + 12 + 3 + CAPWAP_DTLS_COOKIE_LENGTH)
+
+/* Keys of DTLS 1.2 AES-GCM record layer, exported to process the records outside of wolfSSL */
+#define CAPWAP_DTLS_KEYS_MAX_LENGTH				32
+#define CAPWAP_DTLS_KEYS_SALT_LENGTH			4
+
+struct capwap_dtls_keys {
+	int keylength;
+	uint16_t epoch;
+	uint8_t readkey[CAPWAP_DTLS_KEYS_MAX_LENGTH];
+	uint8_t readsalt[CAPWAP_DTLS_KEYS_SALT_LENGTH];
+	uint8_t writekey[CAPWAP_DTLS_KEYS_MAX_LENGTH];
+	uint8_t writesalt[CAPWAP_DTLS_KEYS_SALT_LENGTH];
+};
+
 /* */
 struct capwap_dtls;
+struct capwap_dtls_cache;
+
+/* Send records without socket, as the data channel owned by kernel module */
+typedef int (*capwap_dtls_sendto)(struct capwap_dtls* dtls, struct iovec* iov, int count);
 
 /* */
 struct capwap_dtls_context {
@@ -42,6 +81,14 @@ struct capwap_dtls_context {
 			unsigned int pskkeylength;
 		} presharedkey;
 	};
+
+	/* Session resumption */
+	struct capwap_dtls_cache* sessioncache;
+	int sessiontickets;
+
+	/* Statistics */
+	unsigned long handshakesfull;
+	unsigned long handshakesresumed;
 };
 
 /* */
@@ -61,12 +108,20 @@ struct capwap_dtls {
 	/* Buffer read */
 	void* buffer;
 	int length;
+
+	/* Encrypted packets waiting to be sent with a single batch */
+	struct capwap_dtls_sendbatch* sendbatch;
+
+	/* Transport without socket */
+	capwap_dtls_sendto sendto;
 };
 
 /* */
 struct capwap_dtls_param {
 	int type;
 	int mode;
+	int version;
+	char* ciphers;							/* NULL for the default cipher suites of mode */
 
 	union {
 		struct {
@@ -82,6 +137,14 @@ struct capwap_dtls_param {
 			char* fileca;
 		} cert;
 	};
+
+	/* Session cache, disabled with size 0 */
+	struct {
+		unsigned long size;
+		long timeout;
+		char* file;							/* Cache shared by the processes which use the same file */
+		int tickets;
+	} sessioncache;
 };
 
 /* */
@@ -92,6 +155,7 @@ int capwap_crypt_createcontext(struct capwap_dtls_context* dtlscontext, struct c
 void capwap_crypt_freecontext(struct capwap_dtls_context* dtlscontext);
 
 void capwap_crypt_setconnection(struct capwap_dtls* dtls, int sock, union sockaddr_capwap* localaddr, union sockaddr_capwap* peeraddr);
+void capwap_crypt_settransport(struct capwap_dtls* dtls, capwap_dtls_sendto sendto, union sockaddr_capwap* peeraddr);
 int capwap_crypt_createsession(struct capwap_dtls* dtls, struct capwap_dtls_context* dtlscontext);
 void capwap_crypt_freesession(struct capwap_dtls* dtls);
 
@@ -102,6 +166,9 @@ int capwap_crypt_sendto(struct capwap_dtls* dtls, void* buffer, int size);
 int capwap_crypt_sendto_fragmentpacket(struct capwap_dtls* dtls, struct capwap_list* fragmentlist);
 int capwap_decrypt_packet(struct capwap_dtls* dtls, void* encrybuffer, int size, void* plainbuffer, int maxsize);
 
+int capwap_crypt_exportkeys(struct capwap_dtls* dtls, struct capwap_dtls_keys* keys);
+
 int capwap_crypt_has_dtls_clienthello(void* buffer, int buffersize);
+int capwap_crypt_verify_clienthello(void* buffer, int buffersize, union sockaddr_capwap* peeraddr, void* response, int* responselength);
 
 #endif /* __CAPWAP_DTLS_HEADER__ */
@@ -0,0 +1,479 @@
+#include "capwap.h"
+#include "capwap_dtls_cache.h"
+#include <sys/mman.h>
+#include <sys/file.h>
+
+/* Shared cache file: header followed by the slots, grouped into sets of
+   CAPWAP_DTLS_CACHE_SHARED_WAYS slots with LRU eviction into the set. The
+   geometry is chosen by the process which creates the file, the others use
+   it whatever their cache size */
+#define CAPWAP_DTLS_CACHE_SHARED_MAGIC			0x43445343
+
+struct capwap_dtls_cache_sharedheader {
+	uint32_t magic;
+	uint32_t slotsize;
+	uint32_t sets;
+	uint32_t ways;
+};
+
+struct capwap_dtls_cache_sharedslot {
+	struct capwap_dtls_cache_key key;
+	uint16_t length;
+	int64_t expire;
+	int64_t lastused;
+	uint8_t data[CAPWAP_DTLS_CACHE_DATA_LENGTH];
+};
+
+/* */
+static unsigned long capwap_dtls_cache_hash(const struct capwap_dtls_cache_key* key) {
+	int i;
+	unsigned long hash = 5381;
+
+	for (i = 0; i < key->length; i++) {
+		hash = ((hash << 5) + hash) + key->key[i];
+	}
+
+	return hash;
+}
+
+/* */
+static unsigned long capwap_dtls_cache_item_gethash(const void* key, unsigned long hashsize) {
+	return capwap_dtls_cache_hash((const struct capwap_dtls_cache_key*)key) % hashsize;
+}
+
+/* */
+static const void* capwap_dtls_cache_item_getkey(const void* data) {
+	return (const void*)&((struct capwap_dtls_cache_entry*)data)->key;
+}
+
+/* */
+static int capwap_dtls_cache_item_cmp(const void* key1, const void* key2) {
+	return memcmp(key1, key2, sizeof(struct capwap_dtls_cache_key));
+}
+
+/* */
+static void capwap_dtls_cache_item_free(void* data) {
+	struct capwap_dtls_cache_entry* entry = (struct capwap_dtls_cache_entry*)data;
+
+	capwap_free(entry->data);
+	capwap_free(entry);
+}
+
+/* */
+static int capwap_dtls_cache_setkey(struct capwap_dtls_cache_key* cachekey, const uint8_t* key, int keylength) {
+	if ((keylength <= 0) || (keylength > CAPWAP_DTLS_CACHE_KEY_LENGTH)) {
+		return 0;
+	}
+
+	memset(cachekey, 0, sizeof(struct capwap_dtls_cache_key));
+	cachekey->length = (uint8_t)keylength;
+	memcpy(cachekey->key, key, keylength);
+	return 1;
+}
+
+/* */
+static void capwap_dtls_cache_unlink(struct capwap_dtls_cache* cache, struct capwap_dtls_cache_entry* entry) {
+	if (entry->prev) {
+		entry->prev->next = entry->next;
+	} else {
+		cache->first = entry->next;
+	}
+
+	if (entry->next) {
+		entry->next->prev = entry->prev;
+	} else {
+		cache->last = entry->prev;
+	}
+
+	entry->prev = NULL;
+	entry->next = NULL;
+}
+
+/* */
+static void capwap_dtls_cache_link(struct capwap_dtls_cache* cache, struct capwap_dtls_cache_entry* entry) {
+	entry->prev = NULL;
+	entry->next = cache->first;
+	if (cache->first) {
+		cache->first->prev = entry;
+	} else {
+		cache->last = entry;
+	}
+
+	cache->first = entry;
+}
+
+/* */
+static void capwap_dtls_cache_delete(struct capwap_dtls_cache* cache, struct capwap_dtls_cache_entry* entry) {
+	struct capwap_dtls_cache_key key;
+
+	/* The entry is released by hash */
+	memcpy(&key, &entry->key, sizeof(struct capwap_dtls_cache_key));
+	capwap_dtls_cache_unlink(cache, entry);
+	capwap_hash_delete(cache->entries, &key);
+}
+
+/* */
+static void capwap_dtls_cache_set(struct capwap_dtls_cache* cache, const struct capwap_dtls_cache_key* key, const uint8_t* data, int length, time_t expire) {
+	struct capwap_dtls_cache_entry* entry;
+
+	entry = (struct capwap_dtls_cache_entry*)capwap_hash_search(cache->entries, key);
+	if (entry) {
+		capwap_dtls_cache_unlink(cache, entry);
+		if (entry->length != length) {
+			capwap_free(entry->data);
+			entry->data = (uint8_t*)capwap_alloc(length);
+		}
+	} else {
+		/* Evict the least recently used */
+		if (cache->entries->count >= cache->size) {
+			capwap_dtls_cache_delete(cache, cache->last);
+			cache->evictions++;
+		}
+
+		entry = (struct capwap_dtls_cache_entry*)capwap_alloc(sizeof(struct capwap_dtls_cache_entry));
+		memset(entry, 0, sizeof(struct capwap_dtls_cache_entry));
+		memcpy(&entry->key, key, sizeof(struct capwap_dtls_cache_key));
+		entry->data = (uint8_t*)capwap_alloc(length);
+		capwap_hash_add(cache->entries, (void*)entry);
+	}
+
+	/* */
+	entry->expire = expire;
+	entry->length = (unsigned short)length;
+	memcpy(entry->data, data, length);
+	capwap_dtls_cache_link(cache, entry);
+}
+
+/* */
+static struct capwap_dtls_cache_sharedslot* capwap_dtls_cache_shared_set(struct capwap_dtls_cache* cache, const struct capwap_dtls_cache_key* key) {
+	struct capwap_dtls_cache_sharedheader* header = (struct capwap_dtls_cache_sharedheader*)cache->shared;
+	struct capwap_dtls_cache_sharedslot* slots = (struct capwap_dtls_cache_sharedslot*)(header + 1);
+
+	return &slots[(capwap_dtls_cache_hash(key) % cache->sharedsets) * CAPWAP_DTLS_CACHE_SHARED_WAYS];
+}
+
+/* */
+static int capwap_dtls_cache_shared_open(struct capwap_dtls_cache* cache, const char* sharedfile) {
+	int create = 0;
+	uint32_t sets;
+	struct stat filestat;
+	struct capwap_dtls_cache_sharedheader header;
+
+	/* */
+	cache->sharedfd = open(sharedfile, O_RDWR | O_CREAT | O_CLOEXEC, S_IRUSR | S_IWUSR);
+	if (cache->sharedfd < 0) {
+		log_printf(LOG_ERR, "Unable to open DTLS session cache file %s, error code %d", sharedfile, errno);
+		return 0;
+	}
+
+	/* */
+	flock(cache->sharedfd, LOCK_EX);
+	if (fstat(cache->sharedfd, &filestat)) {
+		log_printf(LOG_ERR, "Unable to open DTLS session cache file %s, error code %d", sharedfile, errno);
+		flock(cache->sharedfd, LOCK_UN);
+		return 0;
+	}
+
+	/* Without header no process uses the file */
+	memset(&header, 0, sizeof(struct capwap_dtls_cache_sharedheader));
+	if (((size_t)filestat.st_size >= sizeof(struct capwap_dtls_cache_sharedheader)) && (pread(cache->sharedfd, &header, sizeof(struct capwap_dtls_cache_sharedheader), 0) != sizeof(struct capwap_dtls_cache_sharedheader))) {
+		log_printf(LOG_ERR, "Unable to read DTLS session cache file %s, error code %d", sharedfile, errno);
+		flock(cache->sharedfd, LOCK_UN);
+		return 0;
+	}
+
+	if (!header.magic) {
+		/* The first process initializes the file with its geometry */
+		create = 1;
+		sets = (uint32_t)((cache->size + CAPWAP_DTLS_CACHE_SHARED_WAYS - 1) / CAPWAP_DTLS_CACHE_SHARED_WAYS);
+		cache->sharedsize = sizeof(struct capwap_dtls_cache_sharedheader) + sizeof(struct capwap_dtls_cache_sharedslot) * sets * CAPWAP_DTLS_CACHE_SHARED_WAYS;
+		if (ftruncate(cache->sharedfd, 0) || ftruncate(cache->sharedfd, cache->sharedsize)) {
+			log_printf(LOG_ERR, "Unable to resize DTLS session cache file %s, error code %d", sharedfile, errno);
+			flock(cache->sharedfd, LOCK_UN);
+			return 0;
+		}
+	} else {
+		/* The file is used by other processes, it can't be resized or cleared */
+		if ((header.magic != CAPWAP_DTLS_CACHE_SHARED_MAGIC) || (header.slotsize != sizeof(struct capwap_dtls_cache_sharedslot)) || !header.sets || (header.ways != CAPWAP_DTLS_CACHE_SHARED_WAYS) ||
+			((size_t)filestat.st_size != (sizeof(struct capwap_dtls_cache_sharedheader) + sizeof(struct capwap_dtls_cache_sharedslot) * header.sets * header.ways))) {
+			log_printf(LOG_ERR, "Invalid DTLS session cache file %s, the file is incompatible with this cache", sharedfile);
+			flock(cache->sharedfd, LOCK_UN);
+			return 0;
+		}
+
+		sets = header.sets;
+		cache->sharedsize = (size_t)filestat.st_size;
+		if (((unsigned long)sets * CAPWAP_DTLS_CACHE_SHARED_WAYS) != cache->size) {
+			log_printf(LOG_INFO, "DTLS session cache file %s has %lu sessions", sharedfile, (unsigned long)sets * CAPWAP_DTLS_CACHE_SHARED_WAYS);
+		}
+	}
+
+	cache->shared = mmap(NULL, cache->sharedsize, PROT_READ | PROT_WRITE, MAP_SHARED, cache->sharedfd, 0);
+	if (cache->shared == MAP_FAILED) {
+		log_printf(LOG_ERR, "Unable to map DTLS session cache file %s, error code %d", sharedfile, errno);
+		cache->shared = NULL;
+		flock(cache->sharedfd, LOCK_UN);
+		return 0;
+	}
+
+	/* The new file is already filled with zero */
+	if (create) {
+		header.magic = CAPWAP_DTLS_CACHE_SHARED_MAGIC;
+		header.slotsize = sizeof(struct capwap_dtls_cache_sharedslot);
+		header.sets = sets;
+		header.ways = CAPWAP_DTLS_CACHE_SHARED_WAYS;
+		memcpy(cache->shared, &header, sizeof(struct capwap_dtls_cache_sharedheader));
+	}
+
+	cache->sharedsets = sets;
+	flock(cache->sharedfd, LOCK_UN);
+	return 1;
+}
+
+/* Called with cache lock held */
+static void capwap_dtls_cache_shared_add(struct capwap_dtls_cache* cache, const struct capwap_dtls_cache_key* key, const uint8_t* data, int length, time_t now) {
+	uint32_t i;
+	int slotfree = 0;
+	struct capwap_dtls_cache_sharedslot* set;
+	struct capwap_dtls_cache_sharedslot* slot = NULL;
+
+	/* */
+	flock(cache->sharedfd, LOCK_EX);
+
+	/* Same key, otherwise a free or expired slot, otherwise the least recently used */
+	set = capwap_dtls_cache_shared_set(cache, key);
+	for (i = 0; i < CAPWAP_DTLS_CACHE_SHARED_WAYS; i++) {
+		if (!memcmp(&set[i].key, key, sizeof(struct capwap_dtls_cache_key))) {
+			slot = &set[i];
+			break;
+		} else if (!set[i].length || (set[i].expire <= now)) {
+			if (!slotfree) {
+				slot = &set[i];
+				slotfree = 1;
+			}
+		} else if (!slot || (!slotfree && (set[i].lastused < slot->lastused))) {
+			slot = &set[i];
+		}
+	}
+
+	/* */
+	memcpy(&slot->key, key, sizeof(struct capwap_dtls_cache_key));
+	slot->length = (uint16_t)length;
+	slot->expire = (int64_t)now + cache->timeout;
+	slot->lastused = (int64_t)now;
+	memcpy(slot->data, data, length);
+
+	flock(cache->sharedfd, LOCK_UN);
+}
+
+/* Called with cache lock held */
+static int capwap_dtls_cache_shared_get(struct capwap_dtls_cache* cache, const struct capwap_dtls_cache_key* key, uint8_t* data, int maxlength, time_t now, time_t* expire) {
+	uint32_t i;
+	int length = 0;
+	struct capwap_dtls_cache_sharedslot* set;
+
+	/* */
+	flock(cache->sharedfd, LOCK_EX);
+
+	set = capwap_dtls_cache_shared_set(cache, key);
+	for (i = 0; i < CAPWAP_DTLS_CACHE_SHARED_WAYS; i++) {
+		if (set[i].length && !memcmp(&set[i].key, key, sizeof(struct capwap_dtls_cache_key))) {
+			if ((set[i].expire > now) && (set[i].length <= maxlength)) {
+				set[i].lastused = (int64_t)now;
+				*expire = (time_t)set[i].expire;
+				length = set[i].length;
+				memcpy(data, set[i].data, length);
+			}
+
+			break;
+		}
+	}
+
+	flock(cache->sharedfd, LOCK_UN);
+	return length;
+}
+
+/* Called with cache lock held */
+static void capwap_dtls_cache_shared_remove(struct capwap_dtls_cache* cache, const struct capwap_dtls_cache_key* key) {
+	uint32_t i;
+	struct capwap_dtls_cache_sharedslot* set;
+
+	/* */
+	flock(cache->sharedfd, LOCK_EX);
+
+	set = capwap_dtls_cache_shared_set(cache, key);
+	for (i = 0; i < CAPWAP_DTLS_CACHE_SHARED_WAYS; i++) {
+		if (!memcmp(&set[i].key, key, sizeof(struct capwap_dtls_cache_key))) {
+			memset(&set[i], 0, sizeof(struct capwap_dtls_cache_sharedslot));
+			break;
+		}
+	}
+
+	flock(cache->sharedfd, LOCK_UN);
+}
+
+/* */
+struct capwap_dtls_cache* capwap_dtls_cache_create(unsigned long size, long timeout, const char* sharedfile) {
+	struct capwap_dtls_cache* cache;
+
+	ASSERT(size > 0);
+	ASSERT(timeout > 0);
+
+	/* */
+	cache = (struct capwap_dtls_cache*)capwap_alloc(sizeof(struct capwap_dtls_cache));
+	memset(cache, 0, sizeof(struct capwap_dtls_cache));
+
+	cache->size = size;
+	cache->timeout = timeout;
+	cache->sharedfd = -1;
+
+	cache->entries = capwap_hash_create(CAPWAP_DTLS_CACHE_HASH_SIZE);
+	cache->entries->item_gethash = capwap_dtls_cache_item_gethash;
+	cache->entries->item_getkey = capwap_dtls_cache_item_getkey;
+	cache->entries->item_cmp = capwap_dtls_cache_item_cmp;
+	cache->entries->item_free = capwap_dtls_cache_item_free;
+
+#ifdef CAPWAP_MULTITHREADING_ENABLE
+	capwap_lock_init(&cache->lock);
+#endif
+
+	/* */
+	if (sharedfile && !capwap_dtls_cache_shared_open(cache, sharedfile)) {
+		capwap_dtls_cache_free(cache);
+		return NULL;
+	}
+
+	return cache;
+}
+
+/* */
+void capwap_dtls_cache_free(struct capwap_dtls_cache* cache) {
+	ASSERT(cache != NULL);
+
+	if (cache->shared) {
+		munmap(cache->shared, cache->sharedsize);
+	}
+
+	if (cache->sharedfd >= 0) {
+		close(cache->sharedfd);
+	}
+
+#ifdef CAPWAP_MULTITHREADING_ENABLE
+	capwap_lock_destroy(&cache->lock);
+#endif
+
+	capwap_hash_free(cache->entries);
+	capwap_free(cache);
+}
+
+/* */
+int capwap_dtls_cache_add(struct capwap_dtls_cache* cache, const uint8_t* key, int keylength, const uint8_t* data, int length) {
+	time_t now;
+	struct capwap_dtls_cache_key cachekey;
+
+	ASSERT(cache != NULL);
+	ASSERT(data != NULL);
+
+	if (!capwap_dtls_cache_setkey(&cachekey, key, keylength) || (length <= 0) || (length > CAPWAP_DTLS_CACHE_DATA_LENGTH)) {
+		return 0;
+	}
+
+	/* */
+	now = time(NULL);
+
+#ifdef CAPWAP_MULTITHREADING_ENABLE
+	capwap_lock_enter(&cache->lock);
+#endif
+
+	capwap_dtls_cache_set(cache, &cachekey, data, length, now + cache->timeout);
+	if (cache->shared) {
+		capwap_dtls_cache_shared_add(cache, &cachekey, data, length, now);
+	}
+
+#ifdef CAPWAP_MULTITHREADING_ENABLE
+	capwap_lock_exit(&cache->lock);
+#endif
+
+	return 1;
+}
+
+/* */
+int capwap_dtls_cache_get(struct capwap_dtls_cache* cache, const uint8_t* key, int keylength, uint8_t* data, int maxlength) {
+	time_t now;
+	time_t expire;
+	int length = 0;
+	struct capwap_dtls_cache_key cachekey;
+	struct capwap_dtls_cache_entry* entry;
+
+	ASSERT(cache != NULL);
+	ASSERT(data != NULL);
+
+	if (!capwap_dtls_cache_setkey(&cachekey, key, keylength)) {
+		return 0;
+	}
+
+	/* */
+	now = time(NULL);
+
+#ifdef CAPWAP_MULTITHREADING_ENABLE
+	capwap_lock_enter(&cache->lock);
+#endif
+
+	entry = (struct capwap_dtls_cache_entry*)capwap_hash_search(cache->entries, &cachekey);
+	if (entry && (entry->expire <= now)) {
+		capwap_dtls_cache_delete(cache, entry);
+		entry = NULL;
+	}
+
+	if (entry) {
+		if (entry->length <= maxlength) {
+			capwap_dtls_cache_unlink(cache, entry);
+			capwap_dtls_cache_link(cache, entry);
+
+			length = entry->length;
+			memcpy(data, entry->data, length);
+			cache->hits++;
+		}
+	} else if (cache->shared && ((length = capwap_dtls_cache_shared_get(cache, &cachekey, data, maxlength, now, &expire)) > 0)) {
+		/* Session created by another process */
+		capwap_dtls_cache_set(cache, &cachekey, data, length, expire);
+		cache->sharedhits++;
+	} else {
+		cache->misses++;
+	}
+
+#ifdef CAPWAP_MULTITHREADING_ENABLE
+	capwap_lock_exit(&cache->lock);
+#endif
+
+	return length;
+}
+
+/* */
+void capwap_dtls_cache_remove(struct capwap_dtls_cache* cache, const uint8_t* key, int keylength) {
+	struct capwap_dtls_cache_key cachekey;
+	struct capwap_dtls_cache_entry* entry;
+
+	ASSERT(cache != NULL);
+
+	if (!capwap_dtls_cache_setkey(&cachekey, key, keylength)) {
+		return;
+	}
+
+#ifdef CAPWAP_MULTITHREADING_ENABLE
+	capwap_lock_enter(&cache->lock);
+#endif
+
+	entry = (struct capwap_dtls_cache_entry*)capwap_hash_search(cache->entries, &cachekey);
+	if (entry) {
+		capwap_dtls_cache_delete(cache, entry);
+	}
+
+	if (cache->shared) {
+		capwap_dtls_cache_shared_remove(cache, &cachekey);
+	}
+
+#ifdef CAPWAP_MULTITHREADING_ENABLE
+	capwap_lock_exit(&cache->lock);
+#endif
+}
@@ -0,0 +1,66 @@
+#ifndef __CAPWAP_DTLS_CACHE_HEADER__
+#define __CAPWAP_DTLS_CACHE_HEADER__
+
+#include "capwap_hash.h"
+#include "capwap_lock.h"
+
+/* */
+#define CAPWAP_DTLS_CACHE_KEY_LENGTH			32			/* DTLS session id or peer address */
+#define CAPWAP_DTLS_CACHE_DATA_LENGTH			1024		/* Serialized DTLS session */
+#define CAPWAP_DTLS_CACHE_HASH_SIZE				1024
+#define CAPWAP_DTLS_CACHE_SHARED_WAYS			4
+
+/* Bounded cache of serialized DTLS sessions with LRU eviction. The cache can
+   be backed by a file mapped in memory, shared by all the processes which use
+   the same file: a lookup miss into private cache is searched into the file */
+struct capwap_dtls_cache_key {
+	uint8_t length;
+	uint8_t key[CAPWAP_DTLS_CACHE_KEY_LENGTH];
+};
+
+struct capwap_dtls_cache_entry {
+	struct capwap_dtls_cache_key key;
+	time_t expire;
+
+	unsigned short length;
+	uint8_t* data;
+
+	/* LRU list, the first is the most recently used */
+	struct capwap_dtls_cache_entry* prev;
+	struct capwap_dtls_cache_entry* next;
+};
+
+struct capwap_dtls_cache {
+	unsigned long size;
+	long timeout;
+
+	struct capwap_hash* entries;
+	struct capwap_dtls_cache_entry* first;
+	struct capwap_dtls_cache_entry* last;
+
+#ifdef CAPWAP_MULTITHREADING_ENABLE
+	capwap_lock_t lock;
+#endif
+
+	/* Shared cache */
+	int sharedfd;
+	void* shared;
+	size_t sharedsize;
+	unsigned long sharedsets;
+
+	/* Statistics */
+	unsigned long hits;
+	unsigned long sharedhits;
+	unsigned long misses;
+	unsigned long evictions;
+};
+
+/* */
+struct capwap_dtls_cache* capwap_dtls_cache_create(unsigned long size, long timeout, const char* sharedfile);
+void capwap_dtls_cache_free(struct capwap_dtls_cache* cache);
+
+int capwap_dtls_cache_add(struct capwap_dtls_cache* cache, const uint8_t* key, int keylength, const uint8_t* data, int length);
+int capwap_dtls_cache_get(struct capwap_dtls_cache* cache, const uint8_t* key, int keylength, uint8_t* data, int maxlength);
+void capwap_dtls_cache_remove(struct capwap_dtls_cache* cache, const uint8_t* key, int keylength);
+
+#endif /* __CAPWAP_DTLS_CACHE_HEADER__ */
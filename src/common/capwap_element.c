@@ -126,24 +126,148 @@ capwap_get_message_element_ops(const struct capwap_message_element_id id)
 }
 
 /* */
-struct capwap_list_item* capwap_get_message_element(struct capwap_parsed_packet* packet,
-						    const struct capwap_message_element_id id)
+void* capwap_message_elements_storage_alloc(struct capwap_message_elements_storage* storage, unsigned short length) {
+	void* data;
+	unsigned short size;
+
+	ASSERT(storage != NULL);
+
+	/* Keep 64bit alignment */
+	size = (length + 7) & ~7;
+	if (!length || (size > (storage->size - storage->used))) {
+		return NULL;
+	}
+
+	data = (void*)&storage->buffer[storage->used];
+	storage->used += size;
+
+	return data;
+}
+
+/* Reader of a message element contiguous into packet buffer */
+struct capwap_element_reader {
+	const uint8_t* buffer;
+	unsigned short length;
+	unsigned short pos;
+};
+
+/* */
+static unsigned short capwap_element_reader_ready(capwap_message_elements_handle handle) {
+	struct capwap_element_reader* reader = (struct capwap_element_reader*)handle;
+
+	return reader->length - reader->pos;
+}
+
+/* */
+static int capwap_element_reader_block(capwap_message_elements_handle handle, uint8_t* data, unsigned short length) {
+	struct capwap_element_reader* reader = (struct capwap_element_reader*)handle;
+
+	length = min(length, reader->length - reader->pos);
+	if (data && length) {
+		memcpy(data, &reader->buffer[reader->pos], length);
+	}
+
+	reader->pos += length;
+	return length;
+}
+
+/* */
+static int capwap_element_reader_u8(capwap_message_elements_handle handle, uint8_t* data) {
+	if (capwap_element_reader_block(handle, data, sizeof(uint8_t)) != sizeof(uint8_t)) {
+		return -1;
+	}
+
+	return sizeof(uint8_t);
+}
+
+/* */
+static int capwap_element_reader_u16(capwap_message_elements_handle handle, uint16_t* data) {
+	uint16_t temp;
+
+	if (capwap_element_reader_block(handle, (uint8_t*)&temp, sizeof(uint16_t)) != sizeof(uint16_t)) {
+		return -1;
+	}
+
+	if (data) {
+		*data = ntohs(temp);
+	}
+
+	return sizeof(uint16_t);
+}
+
+/* */
+static int capwap_element_reader_u32(capwap_message_elements_handle handle, uint32_t* data) {
+	uint32_t temp;
+
+	if (capwap_element_reader_block(handle, (uint8_t*)&temp, sizeof(uint32_t)) != sizeof(uint32_t)) {
+		return -1;
+	}
+
+	if (data) {
+		*data = ntohl(temp);
+	}
+
+	return sizeof(uint32_t);
+}
+
+/* */
+static const uint8_t* capwap_element_reader_pointer(capwap_message_elements_handle handle, unsigned short length) {
+	const uint8_t* data;
+	struct capwap_element_reader* reader = (struct capwap_element_reader*)handle;
+
+	if (!length || (length > (reader->length - reader->pos))) {
+		return NULL;
+	}
+
+	data = &reader->buffer[reader->pos];
+	reader->pos += length;
+
+	return data;
+}
+
+/* */
+static struct capwap_read_message_elements_ops capwap_element_reader_ops = {
+	.read_ready = capwap_element_reader_ready,
+	.read_u8 = capwap_element_reader_u8,
+	.read_u16 = capwap_element_reader_u16,
+	.read_u32 = capwap_element_reader_u32,
+	.read_block = capwap_element_reader_block,
+	.read_pointer = capwap_element_reader_pointer
+};
+
+/* Position + 1 of message element into direct index, NULL for vendor message element */
+static unsigned short* capwap_parsed_packet_index(struct capwap_parsed_packet* packet, const struct capwap_message_element_id id) {
+	if (IS_MESSAGE_ELEMENTS(id)) {
+		return &packet->index[id.type - CAPWAP_MESSAGE_ELEMENTS_START];
+	} else if (IS_80211_MESSAGE_ELEMENTS(id)) {
+		return &packet->index80211[id.type - CAPWAP_80211_MESSAGE_ELEMENTS_START];
+	}
+
+	return NULL;
+}
+
+/* */
+struct capwap_message_element_itemlist* capwap_get_message_element(struct capwap_parsed_packet* packet,
+								  const struct capwap_message_element_id id)
 {
-	struct capwap_list_item* search;
+	unsigned short i;
+	unsigned short* index;
 
 	ASSERT(packet != NULL);
-	ASSERT(packet->messages != NULL);
 
-	search = packet->messages->first;
-	while (search) {
-		struct capwap_message_element_itemlist* messageelement =
-			(struct capwap_message_element_itemlist*)search->item;
+	/* Direct access */
+	index = capwap_parsed_packet_index(packet, id);
+	if (index) {
+		return (*index ? &packet->elements[*index - 1] : NULL);
+	}
 
-		if (memcmp(&messageelement->id, &id, sizeof(id)) == 0)
-			return search;
+	/* Vendor message elements are few, search into table */
+	for (i = 0; i < packet->count; i++) {
+		struct capwap_message_element_itemlist* messageelement = &packet->elements[i];
 
-		/* */
-		search = search->next;
+		if ((messageelement->id.vendor == id.vendor) && (messageelement->id.type == id.type)) {
+			return messageelement;
+		}
 	}
 
 	return NULL;
@@ -153,22 +277,130 @@ struct capwap_list_item* capwap_get_message_element(struct capwap_parsed_packet*
 void* capwap_get_message_element_data(struct capwap_parsed_packet* packet,
 				      const struct capwap_message_element_id id)
 {
-	struct capwap_list_item* itemlist;
 	struct capwap_message_element_itemlist* messageelement;
 
-	/* Retrieve item list */
-	itemlist = capwap_get_message_element(packet, id);
-	if (!itemlist) {
+	/* Retrieve message element */
+	messageelement = capwap_get_message_element(packet, id);
+	if (!messageelement) {
 		return NULL;
 	}
 
-	/* Get message element info */
-	messageelement = (struct capwap_message_element_itemlist*)itemlist->item;
-	ASSERT(messageelement != NULL);
-
 	return messageelement->data;
 }
 
+/* Double the table of message elements, the inline items of arrays move with the entries */
+static void capwap_parsed_packet_grow(struct capwap_parsed_packet* packet) {
+	unsigned short i;
+	struct capwap_message_element_itemlist* elements;
+
+	elements = (struct capwap_message_element_itemlist*)capwap_alloc(sizeof(struct capwap_message_element_itemlist) * packet->maxcount * 2);
+	memcpy(elements, packet->elements, sizeof(struct capwap_message_element_itemlist) * packet->count);
+
+	for (i = 0; i < packet->count; i++) {
+		if (elements[i].category == CAPWAP_MESSAGE_ELEMENT_ARRAY) {
+			if (packet->elements[i].array.buffer == (void*)packet->elements[i].items) {
+				elements[i].array.buffer = (void*)elements[i].items;
+			}
+
+			elements[i].data = (void*)&elements[i].array;
+		}
+	}
+
+	if (packet->elements != packet->inlineelements) {
+		capwap_free(packet->elements);
+	}
+
+	packet->elements = elements;
+	packet->maxcount *= 2;
+}
+
+/* */
+static struct capwap_message_element_itemlist* capwap_parsed_packet_add(struct capwap_parsed_packet* packet,
+								       const struct capwap_message_element_id id,
+								       int category)
+{
+	unsigned short* index;
+	struct capwap_message_element_itemlist* messageelement;
+
+	if (packet->count >= packet->maxcount) {
+		capwap_parsed_packet_grow(packet);
+	}
+
+	/* */
+	messageelement = &packet->elements[packet->count++];
+	messageelement->id = id;
+	messageelement->category = category;
+	messageelement->data = NULL;
+
+	if (category == CAPWAP_MESSAGE_ELEMENT_ARRAY) {
+		messageelement->array.buffer = (void*)messageelement->items;
+		messageelement->array.itemsize = sizeof(void*);
+		messageelement->array.count = 0;
+		messageelement->array.zeroed = 0;
+		messageelement->data = (void*)&messageelement->array;
+	}
+
+	/* */
+	index = capwap_parsed_packet_index(packet, id);
+	if (index) {
+		*index = packet->count;
+	}
+
+	return messageelement;
+}
+
+/* Append item without capwap_array_resize(), the inline items are used first
+   and the allocated buffer is doubled when full */
+static void capwap_parsed_packet_add_item(struct capwap_message_element_itemlist* messageelement, void* element) {
+	void** buffer;
+	struct capwap_array* array = &messageelement->array;
+
+	if ((array->count >= CAPWAP_PARSED_PACKET_INLINE_ITEMS) && !(array->count & (array->count - 1))) {
+		buffer = (void**)capwap_alloc(sizeof(void*) * array->count * 2);
+		memcpy(buffer, array->buffer, sizeof(void*) * array->count);
+
+		if (array->buffer != (void*)messageelement->items) {
+			capwap_free(array->buffer);
+		}
+
+		array->buffer = (void*)buffer;
+	}
+
+	((void**)array->buffer)[array->count++] = element;
+}
+
+/* */
+static void capwap_parsed_packet_free_element(struct capwap_parsed_packet* packet, const struct capwap_message_elements_ops* msgops, void* data) {
+	/* The message elements into storage point into packet buffer or storage */
+	if (((uint8_t*)data >= packet->storagebuffer) && ((uint8_t*)data < &packet->storagebuffer[CAPWAP_PARSED_PACKET_STORAGE_SIZE])) {
+		return;
+	}
+
+	msgops->free(data);
+}
+
+/* */
+static void* capwap_parsing_element(struct capwap_parsed_packet* packet, const struct capwap_message_elements_ops* read_ops,
+				    capwap_message_elements_handle handle, struct capwap_read_message_elements_ops* func,
+				    struct capwap_element_reader* reader)
+{
+	void* element;
+	unsigned short pos;
+
+	/* Only the contiguous message elements can be rewound */
+	if (reader && read_ops->parse_inplace) {
+		pos = reader->pos;
+		element = read_ops->parse_inplace(handle, func, &packet->storage);
+		if (element) {
+			return element;
+		}
+
+		reader->pos = pos;
+	}
+
+	return read_ops->parse(handle, func);
+}
+
 /* */
 int capwap_parsing_packet(struct capwap_packet_rxmng* rxmngpacket, struct capwap_parsed_packet* packet) {
 	unsigned short binding;
@@ -177,10 +409,14 @@ int capwap_parsing_packet(struct capwap_packet_rxmng* rxmngpacket, struct capwap
 	ASSERT(rxmngpacket != NULL);
 	ASSERT(packet != NULL);
 
-	/* */
-	memset(packet, 0, sizeof(struct capwap_parsed_packet));
+	/* The table of message elements is not cleaned */
+	memset(packet, 0, offsetof(struct capwap_parsed_packet, inlineelements));
 	packet->rxmngpacket = rxmngpacket;
-	packet->messages = capwap_list_create();
+	packet->elements = packet->inlineelements;
+	packet->maxcount = CAPWAP_PARSED_PACKET_INLINE_ELEMENTS;
+	packet->storage.buffer = packet->storagebuffer;
+	packet->storage.size = CAPWAP_PARSED_PACKET_STORAGE_SIZE;
+	packet->storage.used = 0;
 
 	binding = GET_WBID_HEADER(packet->rxmngpacket->header);
 
@@ -192,10 +428,12 @@ int capwap_parsing_packet(struct capwap_packet_rxmng* rxmngpacket, struct capwap
 	while (bodylength > 0) {
 		struct capwap_message_element_id id = { .vendor = 0 };
 		uint16_t msglength;
-		struct capwap_list_item* itemlist;
 		struct capwap_message_element_itemlist* messageelement;
 		void *element;
 		const struct capwap_message_elements_ops* read_ops;
+		struct capwap_element_reader reader;
+		capwap_message_elements_handle handle;
+		struct capwap_read_message_elements_ops* func;
 
 		/* Get type and length */
 		rxmngpacket->readerpacketallowed = sizeof(struct capwap_message_element);
@@ -214,6 +452,18 @@ int capwap_parsing_packet(struct capwap_packet_rxmng* rxmngpacket, struct capwap
 
 		log_printf(LOG_DEBUG, "MESSAGE ELEMENT: %d", id.type);
 
+		/* Message element into a single fragment is read directly from packet buffer */
+		reader.buffer = rxmngpacket->read_ops.read_pointer((capwap_message_elements_handle)rxmngpacket, msglength);
+		if (reader.buffer) {
+			reader.length = msglength;
+			reader.pos = 0;
+			handle = (capwap_message_elements_handle)&reader;
+			func = &capwap_element_reader_ops;
+		} else {
+			handle = (capwap_message_elements_handle)rxmngpacket;
+			func = &rxmngpacket->read_ops;
+		}
+
 		if (id.type == CAPWAP_ELEMENT_VENDORPAYLOAD_TYPE) {
 			struct capwap_message_element_id vendor_id;
 
@@ -226,8 +476,8 @@ int capwap_parsing_packet(struct capwap_packet_rxmng* rxmngpacket, struct capwap
 				return INVALID_MESSAGE_ELEMENT;
 			}
 
-			rxmngpacket->read_ops.read_u32((capwap_message_elements_handle)rxmngpacket, &vendor_id.vendor);
-			rxmngpacket->read_ops.read_u16((capwap_message_elements_handle)rxmngpacket, &vendor_id.type);
+			func->read_u32(handle, &vendor_id.vendor);
+			func->read_u16(handle, &vendor_id.type);
 
 			log_printf(LOG_DEBUG, "VENDOR MESSAGE ELEMENT: %06x:%d", vendor_id.vendor, vendor_id.type);
 
@@ -235,11 +485,18 @@ int capwap_parsing_packet(struct capwap_packet_rxmng* rxmngpacket, struct capwap
 			log_printf(LOG_DEBUG, "vendor read_ops: %p", read_ops);
 			if (read_ops) {
 				id = vendor_id;
-				element = read_ops->parse((capwap_message_elements_handle)rxmngpacket, &rxmngpacket->read_ops);
+				element = capwap_parsing_element(packet, read_ops, handle, func, (reader.buffer ? &reader : NULL));
 			} else {
 				read_ops = capwap_get_message_element_ops(id);
-				element = capwap_unknown_vendorpayload_element_parsing((capwap_message_elements_handle)rxmngpacket,
-										       &rxmngpacket->read_ops, msglength - 6, vendor_id);
+
+				element = NULL;
+				if (reader.buffer) {
+					element = capwap_unknown_vendorpayload_element_parsing_inplace(handle, func, msglength - 6, vendor_id, &packet->storage);
+				}
+
+				if (!element) {
+					element = capwap_unknown_vendorpayload_element_parsing(handle, func, msglength - 6, vendor_id);
+				}
 			}
 		} else {
 			/* Reader function */
@@ -250,56 +507,45 @@ int capwap_parsing_packet(struct capwap_packet_rxmng* rxmngpacket, struct capwap
 				return UNRECOGNIZED_MESSAGE_ELEMENT;
 
 			/* Get message element */
-			element = read_ops->parse((capwap_message_elements_handle)rxmngpacket, &rxmngpacket->read_ops);
+			element = capwap_parsing_element(packet, read_ops, handle, func, (reader.buffer ? &reader : NULL));
 		}
 
 		if (!element)
 			return INVALID_MESSAGE_ELEMENT;
 
 		/* */
-		itemlist = capwap_get_message_element(packet, id);
+		messageelement = capwap_get_message_element(packet, id);
 		if (read_ops->category == CAPWAP_MESSAGE_ELEMENT_SINGLE) {
 			/* Check for multiple message element */
-			if (itemlist) {
+			if (messageelement) {
+				capwap_parsed_packet_free_element(packet, read_ops, element);
 				return INVALID_MESSAGE_ELEMENT;
 			}
 
 			/* Create new message element */
-			itemlist = capwap_itemlist_create(sizeof(struct capwap_message_element_itemlist));
-			messageelement = (struct capwap_message_element_itemlist*)itemlist->item;
-			messageelement->id = id;
-			messageelement->category = CAPWAP_MESSAGE_ELEMENT_SINGLE;
-			messageelement->data = element;
+			messageelement = capwap_parsed_packet_add(packet, id, CAPWAP_MESSAGE_ELEMENT_SINGLE);
+			if (!messageelement) {
+				capwap_parsed_packet_free_element(packet, read_ops, element);
+				return INVALID_MESSAGE_ELEMENT;
+			}
 
-			/* */
-			capwap_itemlist_insert_after(packet->messages, NULL, itemlist);
+			messageelement->data = element;
 		}
 		else if (read_ops->category == CAPWAP_MESSAGE_ELEMENT_ARRAY) {
-			struct capwap_array* arraymessageelement;
-
-			if (itemlist) {
-				messageelement = (struct capwap_message_element_itemlist*)itemlist->item;
-				arraymessageelement = (struct capwap_array*)messageelement->data;
-			} else {
-				arraymessageelement = capwap_array_create(sizeof(void*), 0, 0);
-
-				/* */
-				itemlist = capwap_itemlist_create(sizeof(struct capwap_message_element_itemlist));
-				messageelement = (struct capwap_message_element_itemlist*)itemlist->item;
-				messageelement->id = id;
-				messageelement->category = CAPWAP_MESSAGE_ELEMENT_ARRAY;
-				messageelement->data = (void*)arraymessageelement;
-
-				/* */
-				capwap_itemlist_insert_after(packet->messages, NULL, itemlist);
+			if (!messageelement) {
+				messageelement = capwap_parsed_packet_add(packet, id, CAPWAP_MESSAGE_ELEMENT_ARRAY);
+				if (!messageelement) {
+					capwap_parsed_packet_free_element(packet, read_ops, element);
+					return INVALID_MESSAGE_ELEMENT;
+				}
 			}
 
 			/* */
-			*(void **)capwap_array_get_item_pointer(arraymessageelement, arraymessageelement->count) = element;
+			capwap_parsed_packet_add_item(messageelement, element);
 		}
 
 		/* Check if read all data of message element */
-		if (rxmngpacket->readerpacketallowed) {
+		if (reader.buffer ? (reader.pos != reader.length) : (rxmngpacket->readerpacketallowed != 0)) {
 			return INVALID_MESSAGE_ELEMENT;
 		}
 
@@ -636,41 +882,41 @@ int capwap_validate_parsed_packet(struct capwap_parsed_packet* packet, struct ca
 
 /* */
 void capwap_free_parsed_packet(struct capwap_parsed_packet* packet) {
-	int i;
-	struct capwap_list_item* itemlist;
+	unsigned long i;
+	unsigned short j;
 	struct capwap_message_element_itemlist* messageelement;
 	const struct capwap_message_elements_ops* msgops;
 
 	ASSERT(packet != NULL);
 
-	if (packet->rxmngpacket && packet->messages) {
-		itemlist = packet->messages->first;
-		while (itemlist) {
-			messageelement = (struct capwap_message_element_itemlist*)itemlist->item;
-			if (messageelement->data) {
-				msgops = capwap_get_message_element_ops(messageelement->id);
-
-				if (messageelement->category == CAPWAP_MESSAGE_ELEMENT_SINGLE) {
-					msgops->free(messageelement->data);
-				} else if (messageelement->category == CAPWAP_MESSAGE_ELEMENT_ARRAY) {
-					struct capwap_array* arraymessageelement = (struct capwap_array*)messageelement->data;
+	if (packet->rxmngpacket) {
+		for (j = 0; j < packet->count; j++) {
+			messageelement = &packet->elements[j];
+			msgops = capwap_get_message_element_ops(messageelement->id);
 
-					for (i = 0; i < arraymessageelement->count; i++) {
-						msgops->free(*(void**)capwap_array_get_item_pointer(arraymessageelement, i));
-					}
+			if (messageelement->category == CAPWAP_MESSAGE_ELEMENT_SINGLE) {
+				if (messageelement->data) {
+					capwap_parsed_packet_free_element(packet, msgops, messageelement->data);
+				}
+			} else if (messageelement->category == CAPWAP_MESSAGE_ELEMENT_ARRAY) {
+				for (i = 0; i < messageelement->array.count; i++) {
+					capwap_parsed_packet_free_element(packet, msgops, ((void**)messageelement->array.buffer)[i]);
+				}
 
-					/* */
-					capwap_array_free(arraymessageelement);
+				/* */
+				if (messageelement->array.buffer != (void*)messageelement->items) {
+					capwap_free(messageelement->array.buffer);
 				}
 			}
-
-			/* */
-			itemlist = itemlist->next;
 		}
 
 		/* */
+		if (packet->elements != packet->inlineelements) {
+			capwap_free(packet->elements);
+		}
+
 		packet->rxmngpacket = NULL;
-		capwap_list_free(packet->messages);
-		packet->messages = NULL;
+		packet->elements = packet->inlineelements;
+		packet->count = 0;
 	}
 }
@@ -25,8 +25,20 @@ struct capwap_read_message_elements_ops {
 	int (*read_u16)(capwap_message_elements_handle handle, uint16_t* data);
 	int (*read_u32)(capwap_message_elements_handle handle, uint32_t* data);
 	int (*read_block)(capwap_message_elements_handle handle, uint8_t* data, unsigned short length);
+
+	/* Consume length bytes and return a pointer into the packet buffer, NULL if the data is not contiguous */
+	const uint8_t* (*read_pointer)(capwap_message_elements_handle handle, unsigned short length);
+};
+
+/* Memory of parsed packet for the message elements parsed without allocation */
+struct capwap_message_elements_storage {
+	uint8_t* buffer;
+	unsigned short size;
+	unsigned short used;
 };
 
+void* capwap_message_elements_storage_alloc(struct capwap_message_elements_storage* storage, unsigned short length);
+
 struct capwap_message_elements_ops
 {
 	int category;
@@ -37,6 +49,10 @@ struct capwap_message_elements_ops
 	/* Parsing message element */
 	void* (*parse)(capwap_message_elements_handle handle, struct capwap_read_message_elements_ops* func);
 
+	/* Optional parsing into storage of parsed packet, the element can point into the packet buffer.
+	   Return NULL also when the storage is full, the parser retries with parse() */
+	void* (*parse_inplace)(capwap_message_elements_handle handle, struct capwap_read_message_elements_ops* func, struct capwap_message_elements_storage* storage);
+
 	/* Memory management */
 	void* (*clone)(void*);
 	void (*free)(void*);
@@ -135,16 +151,42 @@ const struct capwap_message_elements_ops *capwap_get_message_element_ops(const s
 #define CAPWAP_MESSAGE_ELEMENT_ARRAY			1
 int capwap_get_message_element_category(uint16_t type);
 
+/* */
+#define CAPWAP_PARSED_PACKET_INLINE_ELEMENTS	16		/* Beyond them the table is allocated */
+#define CAPWAP_PARSED_PACKET_INLINE_ITEMS		4
+#define CAPWAP_PARSED_PACKET_STORAGE_SIZE		1024
+
 struct capwap_message_element_itemlist
 {
 	struct capwap_message_element_id id;
 	int category;
 	void* data;
+
+	/* With CAPWAP_MESSAGE_ELEMENT_ARRAY category data points to array, the first
+	   items are kept into the entry and the buffer is allocated only beyond them */
+	struct capwap_array array;
+	void* items[CAPWAP_PARSED_PACKET_INLINE_ITEMS];
 };
 
+/* Message elements are kept in receive order into a flat table, the standard and
+   IEEE 802.11 types are indexed by type (position + 1, 0 if not present). The table
+   is into parsed packet, a packet with more message element types moves it to an
+   allocated table which doubles when full */
 struct capwap_parsed_packet {
 	struct capwap_packet_rxmng* rxmngpacket;
-	struct capwap_list* messages;
+
+	unsigned short count;
+	unsigned short maxcount;
+	unsigned short index[CAPWAP_MESSAGE_ELEMENTS_COUNT];
+	unsigned short index80211[CAPWAP_80211_MESSAGE_ELEMENTS_COUNT];
+	struct capwap_message_element_itemlist* elements;
+
+	/* Not initialized up to count */
+	struct capwap_message_element_itemlist inlineelements[CAPWAP_PARSED_PACKET_INLINE_ELEMENTS];
+
+	/* */
+	struct capwap_message_elements_storage storage;
+	uint8_t storagebuffer[CAPWAP_PARSED_PACKET_STORAGE_SIZE] __attribute__((aligned(8)));
 };
 
 /* */
@@ -156,8 +198,8 @@ int capwap_parsing_packet(struct capwap_packet_rxmng* rxmngpacket, struct capwap
 int capwap_validate_parsed_packet(struct capwap_parsed_packet* packet, struct capwap_array* returnedmessage);
 void capwap_free_parsed_packet(struct capwap_parsed_packet* packet);
 
-struct capwap_list_item *capwap_get_message_element(struct capwap_parsed_packet *packet,
-				      const struct capwap_message_element_id id);
+struct capwap_message_element_itemlist *capwap_get_message_element(struct capwap_parsed_packet *packet,
+								    const struct capwap_message_element_id id);
 void *capwap_get_message_element_data(struct capwap_parsed_packet *packet,
 				      const struct capwap_message_element_id id);
 
@@ -42,25 +42,49 @@ static void capwap_decrypterrorreportperiod_element_free(void* data) {
 }
 
 /* */
-static void* capwap_decrypterrorreportperiod_element_parsing(capwap_message_elements_handle handle, struct capwap_read_message_elements_ops* func) {
-	struct capwap_decrypterrorreportperiod_element* data;
-
-	ASSERT(handle != NULL);
-	ASSERT(func != NULL);
-
+static int capwap_decrypterrorreportperiod_element_read(capwap_message_elements_handle handle, struct capwap_read_message_elements_ops* func, struct capwap_decrypterrorreportperiod_element* data) {
 	if (func->read_ready(handle) != 3) {
 		log_printf(LOG_DEBUG, "Invalid Decryption Error Report Period element: underbuffer");
-		return NULL;
+		return 0;
 	}
 
 	/* Retrieve data */
-	data = (struct capwap_decrypterrorreportperiod_element*)capwap_alloc(sizeof(struct capwap_decrypterrorreportperiod_element));
 	func->read_u8(handle, &data->radioid);
 	func->read_u16(handle, &data->interval);
 
 	if (!IS_VALID_RADIOID(data->radioid)) {
-		capwap_decrypterrorreportperiod_element_free((void*)data);
 		log_printf(LOG_DEBUG, "Invalid Decryption Error Report Period element: invalid radioid");
+		return 0;
+	}
+
+	return 1;
+}
+
+/* */
+static void* capwap_decrypterrorreportperiod_element_parsing(capwap_message_elements_handle handle, struct capwap_read_message_elements_ops* func) {
+	struct capwap_decrypterrorreportperiod_element* data;
+
+	ASSERT(handle != NULL);
+	ASSERT(func != NULL);
+
+	data = (struct capwap_decrypterrorreportperiod_element*)capwap_alloc(sizeof(struct capwap_decrypterrorreportperiod_element));
+	if (!capwap_decrypterrorreportperiod_element_read(handle, func, data)) {
+		capwap_decrypterrorreportperiod_element_free((void*)data);
+		return NULL;
+	}
+
+	return data;
+}
+
+/* */
+static void* capwap_decrypterrorreportperiod_element_parsing_inplace(capwap_message_elements_handle handle, struct capwap_read_message_elements_ops* func, struct capwap_message_elements_storage* storage) {
+	struct capwap_decrypterrorreportperiod_element* data;
+
+	ASSERT(handle != NULL);
+	ASSERT(func != NULL);
+
+	data = (struct capwap_decrypterrorreportperiod_element*)capwap_message_elements_storage_alloc(storage, sizeof(struct capwap_decrypterrorreportperiod_element));
+	if (!data || !capwap_decrypterrorreportperiod_element_read(handle, func, data)) {
 		return NULL;
 	}
 
@@ -72,6 +96,7 @@ const struct capwap_message_elements_ops capwap_element_decrypterrorreportperiod
 	.category = CAPWAP_MESSAGE_ELEMENT_ARRAY,
 	.create = capwap_decrypterrorreportperiod_element_create,
 	.parse = capwap_decrypterrorreportperiod_element_parsing,
+	.parse_inplace = capwap_decrypterrorreportperiod_element_parsing_inplace,
 	.clone = capwap_decrypterrorreportperiod_element_clone,
 	.free = capwap_decrypterrorreportperiod_element_free
 };
@@ -56,36 +56,43 @@ static void capwap_deletestation_element_free(void* data) {
 }
 
 /* */
-static void* capwap_deletestation_element_parsing(capwap_message_elements_handle handle, struct capwap_read_message_elements_ops* func) {
+static int capwap_deletestation_element_read(capwap_message_elements_handle handle, struct capwap_read_message_elements_ops* func, struct capwap_deletestation_element* data) {
 	unsigned short length;
-	struct capwap_deletestation_element* data;
-
-	ASSERT(handle != NULL);
-	ASSERT(func != NULL);
 
 	length = func->read_ready(handle);
 	if (length < 8) {
 		log_printf(LOG_DEBUG, "Invalid Delete Station element: underbuffer");
-		return NULL;
+		return 0;
 	}
 
 	length -= 2;
 
-	/* */
-	data = (struct capwap_deletestation_element*)capwap_alloc(sizeof(struct capwap_deletestation_element));
-	memset(data, 0, sizeof(struct capwap_deletestation_element));
-
 	/* Retrieve data */
+	memset(data, 0, sizeof(struct capwap_deletestation_element));
 	func->read_u8(handle, &data->radioid);
 	func->read_u8(handle, &data->length);
 
 	if (!IS_VALID_RADIOID(data->radioid)) {
-		capwap_deletestation_element_free((void*)data);
 		log_printf(LOG_DEBUG, "Invalid Delete Station element: invalid radio");
-		return NULL;
+		return 0;
 	} else if (!IS_VALID_MACADDRESS_LENGTH(data->length) || (length != data->length)) {
-		capwap_deletestation_element_free((void*)data);
 		log_printf(LOG_DEBUG, "Invalid Delete Station element: invalid length");
+		return 0;
+	}
+
+	return 1;
+}
+
+/* */
+static void* capwap_deletestation_element_parsing(capwap_message_elements_handle handle, struct capwap_read_message_elements_ops* func) {
+	struct capwap_deletestation_element* data;
+
+	ASSERT(handle != NULL);
+	ASSERT(func != NULL);
+
+	data = (struct capwap_deletestation_element*)capwap_alloc(sizeof(struct capwap_deletestation_element));
+	if (!capwap_deletestation_element_read(handle, func, data)) {
+		capwap_deletestation_element_free((void*)data);
 		return NULL;
 	}
 
@@ -95,11 +102,28 @@ static void* capwap_deletestation_element_parsing(capwap_message_elements_handle
 	return data;
 }
 
+/* The station address points into packet buffer */
+static void* capwap_deletestation_element_parsing_inplace(capwap_message_elements_handle handle, struct capwap_read_message_elements_ops* func, struct capwap_message_elements_storage* storage) {
+	struct capwap_deletestation_element* data;
+
+	ASSERT(handle != NULL);
+	ASSERT(func != NULL);
+
+	data = (struct capwap_deletestation_element*)capwap_message_elements_storage_alloc(storage, sizeof(struct capwap_deletestation_element));
+	if (!data || !capwap_deletestation_element_read(handle, func, data)) {
+		return NULL;
+	}
+
+	data->address = (uint8_t*)func->read_pointer(handle, data->length);
+	return data->address ? data : NULL;
+}
+
 /* */
 const struct capwap_message_elements_ops capwap_element_deletestation_ops = {
 	.category = CAPWAP_MESSAGE_ELEMENT_SINGLE,
 	.create = capwap_deletestation_element_create,
 	.parse = capwap_deletestation_element_parsing,
+	.parse_inplace = capwap_deletestation_element_parsing_inplace,
 	.clone = capwap_deletestation_element_clone,
 	.free = capwap_deletestation_element_free
 };
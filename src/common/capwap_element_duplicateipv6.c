@@ -65,37 +65,44 @@ static void capwap_duplicateipv6_element_free(void* data) {
 }
 
 /* */
-static void* capwap_duplicateipv6_element_parsing(capwap_message_elements_handle handle, struct capwap_read_message_elements_ops* func) {
+static int capwap_duplicateipv6_element_read(capwap_message_elements_handle handle, struct capwap_read_message_elements_ops* func, struct capwap_duplicateipv6_element* data) {
 	unsigned short length;
-	struct capwap_duplicateipv6_element* data;
-
-	ASSERT(handle != NULL);
-	ASSERT(func != NULL);
 
 	length = func->read_ready(handle);
 	if (length < 24) {
 		log_printf(LOG_DEBUG, "Invalid Duplicate IPv6 Address element: underbuffer");
-		return NULL;
+		return 0;
 	}
 
 	length -= 18;
 
-	/* */
-	data = (struct capwap_duplicateipv6_element*)capwap_alloc(sizeof(struct capwap_duplicateipv6_element));
-	memset(data, 0, sizeof(struct capwap_duplicateipv6_element));
-
 	/* Retrieve data */
+	memset(data, 0, sizeof(struct capwap_duplicateipv6_element));
 	func->read_block(handle, (uint8_t*)&data->address, sizeof(struct in6_addr));
 	func->read_u8(handle, &data->status);
 	func->read_u8(handle, &data->length);
 
 	if ((data->status != CAPWAP_DUPLICATEIPv6_CLEARED) && (data->status != CAPWAP_DUPLICATEIPv6_DETECTED)) {
-		capwap_duplicateipv6_element_free((void*)data);
 		log_printf(LOG_DEBUG, "Invalid Duplicate IPv6 Address element: invalid status");
-		return NULL;
+		return 0;
 	} else if (!IS_VALID_MACADDRESS_LENGTH(data->length) || (length != data->length)) {
-		capwap_duplicateipv6_element_free((void*)data);
 		log_printf(LOG_DEBUG, "Invalid Duplicate IPv6 Address element: invalid length");
+		return 0;
+	}
+
+	return 1;
+}
+
+/* */
+static void* capwap_duplicateipv6_element_parsing(capwap_message_elements_handle handle, struct capwap_read_message_elements_ops* func) {
+	struct capwap_duplicateipv6_element* data;
+
+	ASSERT(handle != NULL);
+	ASSERT(func != NULL);
+
+	data = (struct capwap_duplicateipv6_element*)capwap_alloc(sizeof(struct capwap_duplicateipv6_element));
+	if (!capwap_duplicateipv6_element_read(handle, func, data)) {
+		capwap_duplicateipv6_element_free((void*)data);
 		return NULL;
 	}
 
@@ -105,11 +112,28 @@ static void* capwap_duplicateipv6_element_parsing(capwap_message_elements_handle
 	return data;
 }
 
+/* The mac address points into packet buffer */
+static void* capwap_duplicateipv6_element_parsing_inplace(capwap_message_elements_handle handle, struct capwap_read_message_elements_ops* func, struct capwap_message_elements_storage* storage) {
+	struct capwap_duplicateipv6_element* data;
+
+	ASSERT(handle != NULL);
+	ASSERT(func != NULL);
+
+	data = (struct capwap_duplicateipv6_element*)capwap_message_elements_storage_alloc(storage, sizeof(struct capwap_duplicateipv6_element));
+	if (!data || !capwap_duplicateipv6_element_read(handle, func, data)) {
+		return NULL;
+	}
+
+	data->macaddress = (uint8_t*)func->read_pointer(handle, data->length);
+	return data->macaddress ? data : NULL;
+}
+
 /* */
 const struct capwap_message_elements_ops capwap_element_duplicateipv6_ops = {
 	.category = CAPWAP_MESSAGE_ELEMENT_SINGLE,
 	.create = capwap_duplicateipv6_element_create,
 	.parse = capwap_duplicateipv6_element_parsing,
+	.parse_inplace = capwap_duplicateipv6_element_parsing_inplace,
 	.clone = capwap_duplicateipv6_element_clone,
 	.free = capwap_duplicateipv6_element_free
 };
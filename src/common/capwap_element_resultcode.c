@@ -40,6 +40,23 @@ static void capwap_resultcode_element_free(void* data) {
 	capwap_free(data);
 }
 
+/* */
+static int capwap_resultcode_element_read(capwap_message_elements_handle handle, struct capwap_read_message_elements_ops* func, struct capwap_resultcode_element* data) {
+	if (func->read_ready(handle) != 4) {
+		log_printf(LOG_DEBUG, "Invalid Result Code element: underbuffer");
+		return 0;
+	}
+
+	/* Retrieve data */
+	func->read_u32(handle, &data->code);
+	if ((data->code < CAPWAP_RESULTCODE_FIRST) || (data->code > CAPWAP_RESULTCODE_LAST)) {
+		log_printf(LOG_DEBUG, "Invalid Result Code element: invalid code");
+		return 0;
+	}
+
+	return 1;
+}
+
 /* */
 static void* capwap_resultcode_element_parsing(capwap_message_elements_handle handle, struct capwap_read_message_elements_ops* func) {
 	struct capwap_resultcode_element* data;
@@ -47,17 +64,24 @@ static void* capwap_resultcode_element_parsing(capwap_message_elements_handle ha
 	ASSERT(handle != NULL);
 	ASSERT(func != NULL);
 
-	if (func->read_ready(handle) != 4) {
-		log_printf(LOG_DEBUG, "Invalid Result Code element: underbuffer");
+	data = (struct capwap_resultcode_element*)capwap_alloc(sizeof(struct capwap_resultcode_element));
+	if (!capwap_resultcode_element_read(handle, func, data)) {
+		capwap_resultcode_element_free((void*)data);
 		return NULL;
 	}
 
-	/* Retrieve data */
-	data = (struct capwap_resultcode_element*)capwap_alloc(sizeof(struct capwap_resultcode_element));
-	func->read_u32(handle, &data->code);
-	if ((data->code < CAPWAP_RESULTCODE_FIRST) || (data->code > CAPWAP_RESULTCODE_LAST)) {
-		capwap_resultcode_element_free((void*)data);
-		log_printf(LOG_DEBUG, "Invalid Result Code element: invalid code");
+	return data;
+}
+
+/* */
+static void* capwap_resultcode_element_parsing_inplace(capwap_message_elements_handle handle, struct capwap_read_message_elements_ops* func, struct capwap_message_elements_storage* storage) {
+	struct capwap_resultcode_element* data;
+
+	ASSERT(handle != NULL);
+	ASSERT(func != NULL);
+
+	data = (struct capwap_resultcode_element*)capwap_message_elements_storage_alloc(storage, sizeof(struct capwap_resultcode_element));
+	if (!data || !capwap_resultcode_element_read(handle, func, data)) {
 		return NULL;
 	}
 
@@ -69,6 +93,7 @@ const struct capwap_message_elements_ops capwap_element_resultcode_ops = {
 	.category = CAPWAP_MESSAGE_ELEMENT_SINGLE,
 	.create = capwap_resultcode_element_create,
 	.parse = capwap_resultcode_element_parsing,
+	.parse_inplace = capwap_resultcode_element_parsing_inplace,
 	.clone = capwap_resultcode_element_clone,
 	.free = capwap_resultcode_element_free
 };
@@ -71,6 +71,31 @@ capwap_unknown_vendorpayload_element_parsing(capwap_message_elements_handle hand
 	return data;
 }
 
+/* Copy the payload into storage of parsed packet, NULL if the storage is full */
+void *
+capwap_unknown_vendorpayload_element_parsing_inplace(capwap_message_elements_handle handle,
+						     struct capwap_read_message_elements_ops *func,
+						     unsigned short length,
+						     const struct capwap_message_element_id vendor_id,
+						     struct capwap_message_elements_storage *storage)
+{
+	struct capwap_vendorpayload_element* data;
+
+	/* Retrieve data */
+	data = (struct capwap_vendorpayload_element *)capwap_message_elements_storage_alloc(storage,
+											    sizeof(struct capwap_vendorpayload_element)
+											    + length);
+	if (!data)
+		return NULL;
+
+	data->vendorid = vendor_id.vendor;
+	data->elementid = vendor_id.type;
+	data->datalength = length;
+	func->read_block(handle, data->data, length);
+
+	return data;
+}
+
 /* */
 static void *
 capwap_vendorpayload_element_parsing(capwap_message_elements_handle handle,
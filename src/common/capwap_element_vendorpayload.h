@@ -20,6 +20,12 @@ capwap_unknown_vendorpayload_element_parsing(capwap_message_elements_handle hand
 					     struct capwap_read_message_elements_ops *func,
 					     unsigned short length,
 					     const struct capwap_message_element_id vendor_id);
+void *
+capwap_unknown_vendorpayload_element_parsing_inplace(capwap_message_elements_handle handle,
+						     struct capwap_read_message_elements_ops *func,
+						     unsigned short length,
+						     const struct capwap_message_element_id vendor_id,
+						     struct capwap_message_elements_storage *storage);
 
 extern const struct capwap_message_elements_ops capwap_element_vendorpayload_ops;
 
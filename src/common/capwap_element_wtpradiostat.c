@@ -59,24 +59,17 @@ static void capwap_wtpradiostat_element_free(void* data) {
 }
 
 /* */
-static void* capwap_wtpradiostat_element_parsing(capwap_message_elements_handle handle, struct capwap_read_message_elements_ops* func) {
-	struct capwap_wtpradiostat_element* data;
-
-	ASSERT(handle != NULL);
-	ASSERT(func != NULL);
-
+static int capwap_wtpradiostat_element_read(capwap_message_elements_handle handle, struct capwap_read_message_elements_ops* func, struct capwap_wtpradiostat_element* data) {
 	if (func->read_ready(handle) != 20) {
 		log_printf(LOG_DEBUG, "Invalid WTP Radio Statistics element: underbuffer");
-		return NULL;
+		return 0;
 	}
 
 	/* Retrieve data */
-	data = (struct capwap_wtpradiostat_element*)capwap_alloc(sizeof(struct capwap_wtpradiostat_element));
 	func->read_u8(handle, &data->radioid);
 	if (!IS_VALID_RADIOID(data->radioid)) {
-		capwap_wtpradiostat_element_free((void*)data);
 		log_printf(LOG_DEBUG, "Invalid WTP Radio Statistics element: invalid radioid");
-		return NULL;
+		return 0;
 	}
 
 	func->read_u8(handle, &data->lastfailtype);
@@ -90,6 +83,37 @@ static void* capwap_wtpradiostat_element_parsing(capwap_message_elements_handle
 	func->read_u16(handle, &data->bandchangecount);
 	func->read_u16(handle, &data->currentnoisefloor);
 
+	return 1;
+}
+
+/* */
+static void* capwap_wtpradiostat_element_parsing(capwap_message_elements_handle handle, struct capwap_read_message_elements_ops* func) {
+	struct capwap_wtpradiostat_element* data;
+
+	ASSERT(handle != NULL);
+	ASSERT(func != NULL);
+
+	data = (struct capwap_wtpradiostat_element*)capwap_alloc(sizeof(struct capwap_wtpradiostat_element));
+	if (!capwap_wtpradiostat_element_read(handle, func, data)) {
+		capwap_wtpradiostat_element_free((void*)data);
+		return NULL;
+	}
+
+	return data;
+}
+
+/* */
+static void* capwap_wtpradiostat_element_parsing_inplace(capwap_message_elements_handle handle, struct capwap_read_message_elements_ops* func, struct capwap_message_elements_storage* storage) {
+	struct capwap_wtpradiostat_element* data;
+
+	ASSERT(handle != NULL);
+	ASSERT(func != NULL);
+
+	data = (struct capwap_wtpradiostat_element*)capwap_message_elements_storage_alloc(storage, sizeof(struct capwap_wtpradiostat_element));
+	if (!data || !capwap_wtpradiostat_element_read(handle, func, data)) {
+		return NULL;
+	}
+
 	return data;
 }
 
@@ -98,6 +122,7 @@ const struct capwap_message_elements_ops capwap_element_wtpradiostat_ops = {
 	.category = CAPWAP_MESSAGE_ELEMENT_SINGLE,
 	.create = capwap_wtpradiostat_element_create,
 	.parse = capwap_wtpradiostat_element_parsing,
+	.parse_inplace = capwap_wtpradiostat_element_parsing_inplace,
 	.clone = capwap_wtpradiostat_element_clone,
 	.free = capwap_wtpradiostat_element_free
 };
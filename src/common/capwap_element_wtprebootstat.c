@@ -39,19 +39,13 @@ static void capwap_wtprebootstat_element_create(void* data, capwap_message_eleme
 }
 
 /* */
-static void* capwap_wtprebootstat_element_parsing(capwap_message_elements_handle handle, struct capwap_read_message_elements_ops* func) {
-	struct capwap_wtprebootstat_element* data;
-
-	ASSERT(handle != NULL);
-	ASSERT(func != NULL);
-
+static int capwap_wtprebootstat_element_read(capwap_message_elements_handle handle, struct capwap_read_message_elements_ops* func, struct capwap_wtprebootstat_element* data) {
 	if (func->read_ready(handle) != 15) {
 		log_printf(LOG_DEBUG, "Invalid WTP Reboot Statistics element: underbuffer");
-		return NULL;
+		return 0;
 	}
 
 	/* Retrieve data */
-	data = (struct capwap_wtprebootstat_element*)capwap_alloc(sizeof(struct capwap_wtprebootstat_element));
 	func->read_u16(handle, &data->rebootcount);
 	func->read_u16(handle, &data->acinitiatedcount);
 	func->read_u16(handle, &data->linkfailurecount);
@@ -61,6 +55,37 @@ static void* capwap_wtprebootstat_element_parsing(capwap_message_elements_handle
 	func->read_u16(handle, &data->unknownfailurecount);
 	func->read_u8(handle, &data->lastfailuretype);
 
+	return 1;
+}
+
+/* */
+static void* capwap_wtprebootstat_element_parsing(capwap_message_elements_handle handle, struct capwap_read_message_elements_ops* func) {
+	struct capwap_wtprebootstat_element* data;
+
+	ASSERT(handle != NULL);
+	ASSERT(func != NULL);
+
+	data = (struct capwap_wtprebootstat_element*)capwap_alloc(sizeof(struct capwap_wtprebootstat_element));
+	if (!capwap_wtprebootstat_element_read(handle, func, data)) {
+		capwap_free(data);
+		return NULL;
+	}
+
+	return data;
+}
+
+/* */
+static void* capwap_wtprebootstat_element_parsing_inplace(capwap_message_elements_handle handle, struct capwap_read_message_elements_ops* func, struct capwap_message_elements_storage* storage) {
+	struct capwap_wtprebootstat_element* data;
+
+	ASSERT(handle != NULL);
+	ASSERT(func != NULL);
+
+	data = (struct capwap_wtprebootstat_element*)capwap_message_elements_storage_alloc(storage, sizeof(struct capwap_wtprebootstat_element));
+	if (!data || !capwap_wtprebootstat_element_read(handle, func, data)) {
+		return NULL;
+	}
+
 	return data;
 }
 
@@ -83,6 +108,7 @@ const struct capwap_message_elements_ops capwap_element_wtprebootstat_ops = {
 	.category = CAPWAP_MESSAGE_ELEMENT_SINGLE,
 	.create = capwap_wtprebootstat_element_create,
 	.parse = capwap_wtprebootstat_element_parsing,
+	.parse_inplace = capwap_wtprebootstat_element_parsing_inplace,
 	.clone = capwap_wtprebootstat_element_clone,
 	.free = capwap_wtprebootstat_element_free
 };
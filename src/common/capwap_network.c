@@ -6,14 +6,18 @@
 #include <net/if_arp.h>
 #include <arpa/inet.h>
 #include <ifaddrs.h>
+#include <linux/filter.h>
 
 /* */
 #define CAPWAP_ROUTE_NOT_FOUND				0
 #define CAPWAP_ROUTE_LOCAL_ADDRESS			1
 #define CAPWAP_ROUTE_VIA_ADDRESS			2
 
+/* UDP GSO is disabled at the first failure */
+static int g_capwap_udp_gso = 1;
+
 /* Prepare socket to bind */
-static int capwap_configure_socket(int sock, int socketfamily, const char* bindinterface) {
+static int capwap_configure_socket(int sock, int socketfamily, const char* bindinterface, int reuseport) {
 	int flag;
 
 	ASSERT(sock >= 0);
@@ -51,6 +55,15 @@ static int capwap_configure_socket(int sock, int socketfamily, const char* bindi
 		return -1;
 	}
 
+	/* Share the address with the other sockets of group */
+	if (reuseport) {
+		flag = 1;
+		if (setsockopt(sock, SOL_SOCKET, SO_REUSEPORT, &flag, sizeof(int))) {
+			log_printf(LOG_ERR, "Unable set SO_REUSEPORT to socket '%d'", errno);
+			return -1;
+		}
+	}
+
 	/* Broadcast */
 	flag = 1;
 	if (setsockopt(sock, SOL_SOCKET, SO_BROADCAST, &flag, sizeof(int))) {
@@ -92,7 +105,7 @@ static int capwap_prepare_bind_socket(struct capwap_network* net) {
 	}
 
 	/* Prepare binding */
-	if (capwap_configure_socket(sock, net->localaddr.ss.ss_family, net->bindiface)) {
+	if (capwap_configure_socket(sock, net->localaddr.ss.ss_family, net->bindiface, net->reuseport)) {
 		close(sock);
 		return -1;
 	}
@@ -143,6 +156,39 @@ int capwap_bind_sockets(struct capwap_network* net) {
 	return result;
 }
 
+/* Steer the packets of a SO_REUSEPORT group by peer address, the same peer is
+   always received from the same socket. The socket is selected with the
+   IPv4 source address or the low 32 bit of IPv6 source address modulo count */
+int capwap_bind_reuseport_steering(struct capwap_network* net, int count) {
+#ifdef SO_ATTACH_REUSEPORT_CBPF
+	struct sock_filter code[] = {
+		BPF_STMT(BPF_LD | BPF_B | BPF_ABS, SKF_NET_OFF),							/* A = IP version */
+		BPF_STMT(BPF_ALU | BPF_RSH | BPF_K, 4),
+		BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, 6, 0, 2),
+		BPF_STMT(BPF_LD | BPF_W | BPF_ABS, SKF_NET_OFF + 20),						/* A = IPv6 source address low 32 bit */
+		BPF_STMT(BPF_JMP | BPF_JA, 1),
+		BPF_STMT(BPF_LD | BPF_W | BPF_ABS, SKF_NET_OFF + 12),						/* A = IPv4 source address */
+		BPF_STMT(BPF_ALU | BPF_MOD | BPF_K, (uint32_t)count),
+		BPF_STMT(BPF_RET | BPF_A, 0)
+	};
+	struct sock_fprog prog = {
+		.len = sizeof(code) / sizeof(code[0]),
+		.filter = code
+	};
+
+	ASSERT(net != NULL);
+	ASSERT(count > 0);
+
+	if (net->socket < 0) {
+		return -1;
+	}
+
+	return setsockopt(net->socket, SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF, &prog, sizeof(prog));
+#else
+	return -1;
+#endif
+}
+
 /* */
 int capwap_connect_socket(struct capwap_network* net, union sockaddr_capwap *peeraddr)
 {
@@ -235,44 +281,64 @@ int capwap_compare_ip(union sockaddr_capwap* addr1, union sockaddr_capwap* addr2
 	return -1;
 }
 
-/* Receive packet from fd */
-ssize_t capwap_recvfrom(int sock, void* buffer, size_t len,
-		       union sockaddr_capwap* fromaddr,
-		       union sockaddr_capwap* toaddr)
-{
-	ssize_t r = 0;
-	char cbuf[256];
-	struct iovec iov = {
-		.iov_base = buffer,
-		.iov_len = len
-	};
-	struct msghdr msgh = {
-		.msg_control = cbuf,
-		.msg_controllen = sizeof(cbuf),
-		.msg_name = &fromaddr->ss,
-		.msg_namelen = sizeof(struct sockaddr_storage),
-		.msg_iov = &iov,
-		.msg_iovlen = 1,
-		.msg_flags = 0
-	};
-	struct cmsghdr* cmsg;
+/* */
+unsigned long capwap_address_hash(union sockaddr_capwap* addr, int withport) {
+	unsigned long hash;
 
-	ASSERT(sock >= 0);
-	ASSERT(buffer != NULL);
-	ASSERT(len > 0);
-	ASSERT(fromaddr != NULL);
+	ASSERT(addr != NULL);
 
-	/* Receive packet with recvmsg */
-	do {
-		r = recvmsg(sock, &msgh, MSG_DONTWAIT);
-	} while (r < 0 && errno == EINTR);
+	if (addr->ss.ss_family == AF_INET6) {
+		uint32_t* inet6addr = (uint32_t*)&addr->sin6.sin6_addr.s6_addr[0];
 
-	if (r < 0) {
-		if (errno != EAGAIN)
-			log_printf(LOG_WARNING, "Unable to recv packet, recvmsg return %zd with error %d", r, errno);
-		return r;
+		hash = (unsigned long)(inet6addr[0] ^ inet6addr[1] ^ inet6addr[2] ^ inet6addr[3]);
+		if (withport) {
+			hash ^= (unsigned long)addr->sin6.sin6_port << 16;
+		}
+	} else {
+		hash = (unsigned long)addr->sin.sin_addr.s_addr;
+		if (withport) {
+			hash ^= (unsigned long)addr->sin.sin_port << 16;
+		}
+	}
+
+	/* Spread the address bits over all buckets */
+	hash = ((hash ^ (hash >> 16)) * 0x45d9f3b) & 0xffffffff;
+	hash ^= hash >> 16;
+
+	return hash;
+}
+
+/* */
+int capwap_address_cmp(union sockaddr_capwap* addr1, union sockaddr_capwap* addr2, int withport) {
+	int result;
+
+	ASSERT(addr1 != NULL);
+	ASSERT(addr2 != NULL);
+
+	if (addr1->ss.ss_family != addr2->ss.ss_family) {
+		return ((addr1->ss.ss_family < addr2->ss.ss_family) ? -1 : 1);
+	}
+
+	/* */
+	if (addr1->ss.ss_family == AF_INET6) {
+		result = memcmp(&addr1->sin6.sin6_addr, &addr2->sin6.sin6_addr, sizeof(struct in6_addr));
+		if (!result && withport) {
+			result = memcmp(&addr1->sin6.sin6_port, &addr2->sin6.sin6_port, sizeof(in_port_t));
+		}
+	} else {
+		result = memcmp(&addr1->sin.sin_addr, &addr2->sin.sin_addr, sizeof(struct in_addr));
+		if (!result && withport) {
+			result = memcmp(&addr1->sin.sin_port, &addr2->sin.sin_port, sizeof(in_port_t));
+		}
 	}
 
+	return result;
+}
+
+/* Retrieve source and destination address of received packet */
+static int capwap_recvfrom_getaddress(struct msghdr* msgh, union sockaddr_capwap* fromaddr, union sockaddr_capwap* toaddr) {
+	struct cmsghdr* cmsg;
+
 	/* Check if IPv4 is mapped into IPv6 */
 	if (fromaddr->ss.ss_family == AF_INET6) {
 		if (!capwap_ipv4_mapped_ipv6(fromaddr)) {
@@ -283,7 +349,7 @@ ssize_t capwap_recvfrom(int sock, void* buffer, size_t len,
 
 	/* */
 	if (toaddr) {
-		for (cmsg = CMSG_FIRSTHDR(&msgh); cmsg != NULL; cmsg = CMSG_NXTHDR(&msgh, cmsg)) {
+		for (cmsg = CMSG_FIRSTHDR(msgh); cmsg != NULL; cmsg = CMSG_NXTHDR(msgh, cmsg)) {
 #ifdef IP_PKTINFO
 			if ((cmsg->cmsg_level == SOL_IP) && (cmsg->cmsg_type == IP_PKTINFO)) {
 				struct in_pktinfo *pi = (struct in_pktinfo *)CMSG_DATA(cmsg);
@@ -316,6 +382,51 @@ ssize_t capwap_recvfrom(int sock, void* buffer, size_t len,
 		}
 	}
 
+	return 0;
+}
+
+/* Receive packet from fd */
+ssize_t capwap_recvfrom(int sock, void* buffer, size_t len,
+		       union sockaddr_capwap* fromaddr,
+		       union sockaddr_capwap* toaddr)
+{
+	ssize_t r = 0;
+	char cbuf[256];
+	struct iovec iov = {
+		.iov_base = buffer,
+		.iov_len = len
+	};
+	struct msghdr msgh = {
+		.msg_control = cbuf,
+		.msg_controllen = sizeof(cbuf),
+		.msg_name = &fromaddr->ss,
+		.msg_namelen = sizeof(struct sockaddr_storage),
+		.msg_iov = &iov,
+		.msg_iovlen = 1,
+		.msg_flags = 0
+	};
+
+	ASSERT(sock >= 0);
+	ASSERT(buffer != NULL);
+	ASSERT(len > 0);
+	ASSERT(fromaddr != NULL);
+
+	/* Receive packet with recvmsg */
+	do {
+		r = recvmsg(sock, &msgh, MSG_DONTWAIT);
+	} while (r < 0 && errno == EINTR);
+
+	if (r < 0) {
+		if (errno != EAGAIN)
+			log_printf(LOG_WARNING, "Unable to recv packet, recvmsg return %zd with error %d", r, errno);
+		return r;
+	}
+
+	/* */
+	if (capwap_recvfrom_getaddress(&msgh, fromaddr, toaddr)) {
+		return -1;
+	}
+
 #ifdef DEBUG
 	{
 		char strfromaddr[INET6_ADDRSTRLEN];
@@ -330,6 +441,122 @@ ssize_t capwap_recvfrom(int sock, void* buffer, size_t len,
 	return r;
 }
 
+/* */
+struct capwap_recv_batch* capwap_recv_batch_create(int count, size_t buffersize) {
+	int i;
+	struct capwap_recv_batch* batch;
+
+	ASSERT(count > 0);
+	ASSERT(buffersize > 0);
+
+	/* */
+	batch = (struct capwap_recv_batch*)capwap_alloc(sizeof(struct capwap_recv_batch));
+	memset(batch, 0, sizeof(struct capwap_recv_batch));
+
+	batch->size = count;
+	batch->buffersize = buffersize;
+	batch->packets = (struct capwap_recv_packet*)capwap_alloc(sizeof(struct capwap_recv_packet) * count);
+	batch->msgs = (struct mmsghdr*)capwap_alloc(sizeof(struct mmsghdr) * count);
+	batch->iovs = (struct iovec*)capwap_alloc(sizeof(struct iovec) * count);
+	batch->controls = (char*)capwap_alloc(CAPWAP_RECV_BATCH_CONTROL_SIZE * count);
+	batch->buffers = (char*)capwap_alloc(buffersize * count);
+
+	for (i = 0; i < count; i++) {
+		batch->packets[i].buffer = &batch->buffers[buffersize * i];
+		batch->iovs[i].iov_base = batch->packets[i].buffer;
+		batch->iovs[i].iov_len = buffersize;
+	}
+
+	return batch;
+}
+
+/* */
+void capwap_recv_batch_free(struct capwap_recv_batch* batch) {
+	ASSERT(batch != NULL);
+
+	capwap_free(batch->packets);
+	capwap_free(batch->msgs);
+	capwap_free(batch->iovs);
+	capwap_free(batch->controls);
+	capwap_free(batch->buffers);
+	capwap_free(batch);
+}
+
+/* Receive up to batch->size packets from fd with a single system call.
+   Return the number of packets stored into batch->packets, 0 if none is
+   available, or -1 on socket error */
+int capwap_recvfrom_batch(int sock, struct capwap_recv_batch* batch) {
+	int i;
+	int r;
+
+	ASSERT(sock >= 0);
+	ASSERT(batch != NULL);
+
+	/* Prepare message headers, recvmmsg updates the lengths */
+	memset(batch->msgs, 0, sizeof(struct mmsghdr) * batch->size);
+	for (i = 0; i < batch->size; i++) {
+		struct msghdr* msgh = &batch->msgs[i].msg_hdr;
+
+		msgh->msg_name = &batch->packets[i].fromaddr.ss;
+		msgh->msg_namelen = sizeof(struct sockaddr_storage);
+		msgh->msg_iov = &batch->iovs[i];
+		msgh->msg_iovlen = 1;
+		msgh->msg_control = &batch->controls[CAPWAP_RECV_BATCH_CONTROL_SIZE * i];
+		msgh->msg_controllen = CAPWAP_RECV_BATCH_CONTROL_SIZE;
+	}
+
+	/* Receive packets with recvmmsg */
+	batch->count = 0;
+	do {
+		r = recvmmsg(sock, batch->msgs, batch->size, MSG_DONTWAIT, NULL);
+	} while ((r < 0) && (errno == EINTR));
+
+	if (r < 0) {
+		if ((errno == EAGAIN) || (errno == EWOULDBLOCK)) {
+			return 0;
+		}
+
+		log_printf(LOG_WARNING, "Unable to recv packets, recvmmsg return %d with error %d", r, errno);
+		return -1;
+	}
+
+	/* Retrieve address of packets, discard invalid or truncated packets */
+	for (i = 0; i < r; i++) {
+		struct capwap_recv_packet* packet = &batch->packets[batch->count];
+		struct msghdr* msgh = &batch->msgs[i].msg_hdr;
+
+		if (msgh->msg_flags & MSG_TRUNC) {
+			log_printf(LOG_WARNING, "Receive truncated packet, discarded");
+			continue;
+		}
+
+		/* Compact valid packets */
+		if (packet != &batch->packets[i]) {
+			memcpy(&packet->fromaddr, &batch->packets[i].fromaddr, sizeof(union sockaddr_capwap));
+		}
+
+		memset(&packet->toaddr, 0, sizeof(union sockaddr_capwap));
+		if (capwap_recvfrom_getaddress(msgh, &packet->fromaddr, &packet->toaddr)) {
+			continue;
+		}
+
+		/* Swap buffers to keep the packet data with its address */
+		if (packet != &batch->packets[i]) {
+			char* buffer = packet->buffer;
+
+			packet->buffer = batch->packets[i].buffer;
+			batch->packets[i].buffer = buffer;
+			batch->iovs[batch->count].iov_base = packet->buffer;
+			batch->iovs[i].iov_base = buffer;
+		}
+
+		packet->size = (int)batch->msgs[i].msg_len;
+		batch->count++;
+	}
+
+	return batch->count;
+}
+
 /* */
 void capwap_network_init(struct capwap_network* net) {
 	ASSERT(net != NULL);
@@ -391,9 +618,196 @@ int capwap_sendto(int sock, void* buffer, int size, union sockaddr_capwap* toadd
 	return result;
 }
 
+/* Send a packet composed by many buffers with a single sendmsg, without join them */
+int capwap_sendto_iov(int sock, struct iovec* iov, int count, union sockaddr_capwap* toaddr) {
+	int i;
+	int result;
+	size_t size = 0;
+	struct msghdr msgh = {
+		.msg_name = &toaddr->sa,
+		.msg_namelen = sizeof(union sockaddr_capwap),
+		.msg_iov = iov,
+		.msg_iovlen = count,
+		.msg_control = NULL,
+		.msg_controllen = 0,
+		.msg_flags = 0
+	};
+
+	ASSERT(sock >= 0);
+	ASSERT(iov != NULL);
+	ASSERT(count > 0);
+	ASSERT(toaddr != NULL);
+
+	for (i = 0; i < count; i++) {
+		size += iov[i].iov_len;
+	}
+
+	do {
+		result = sendmsg(sock, &msgh, 0);
+		if ((result < 0) && (errno != EAGAIN) && (errno != EINTR)) {
+			log_printf(LOG_WARNING, "Unable to send packet, sendmsg return %d with error %d", result, errno);
+			return -errno;
+		} else if ((result > 0) && (result != size)) {
+			log_printf(LOG_WARNING, "Unable to send packet, mismatch sendmsg size %d - %d", (int)size, result);
+			return -ENETRESET;
+		}
+	} while (result < 0);
+
+#ifdef DEBUG
+	{
+		char strtoaddr[INET6_ADDRSTRLEN];
+		log_printf(LOG_DEBUG, "Sent packet to %s:%d with result %d", capwap_address_to_string(toaddr, strtoaddr, INET6_ADDRSTRLEN), (int)CAPWAP_GET_NETWORK_PORT(toaddr), result);
+	}
+#endif
+
+	return result;
+}
+
+/* Send all packets with a single sendmsg, the kernel splits the payload every segment bytes */
+static int capwap_sendto_gso(int sock, struct iovec* iov, int count, int segment, union sockaddr_capwap* toaddr) {
+#ifdef UDP_SEGMENT
+	int result;
+	char control[CMSG_SPACE(sizeof(uint16_t))];
+	struct cmsghdr* cmsg;
+	struct msghdr msgh = {
+		.msg_name = &toaddr->sa,
+		.msg_namelen = sizeof(union sockaddr_capwap),
+		.msg_iov = iov,
+		.msg_iovlen = count,
+		.msg_control = control,
+		.msg_controllen = sizeof(control),
+		.msg_flags = 0
+	};
+
+	memset(control, 0, sizeof(control));
+	cmsg = CMSG_FIRSTHDR(&msgh);
+	cmsg->cmsg_level = SOL_UDP;
+	cmsg->cmsg_type = UDP_SEGMENT;
+	cmsg->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+	*(uint16_t*)CMSG_DATA(cmsg) = (uint16_t)segment;
+
+	do {
+		result = sendmsg(sock, &msgh, 0);
+	} while ((result < 0) && ((errno == EAGAIN) || (errno == EINTR)));
+
+	return ((result < 0) ? -errno : result);
+#else
+	return -EOPNOTSUPP;
+#endif
+}
+
+/* Send packets with sendmmsg */
+static int capwap_sendto_mmsg(int sock, struct iovec* iov, int count, union sockaddr_capwap* toaddr) {
+	int i;
+	int sent = 0;
+	int result;
+	struct mmsghdr msgs[CAPWAP_SEND_BATCH_SIZE];
+
+	ASSERT(count <= CAPWAP_SEND_BATCH_SIZE);
+
+	memset(msgs, 0, sizeof(struct mmsghdr) * count);
+	for (i = 0; i < count; i++) {
+		msgs[i].msg_hdr.msg_name = &toaddr->sa;
+		msgs[i].msg_hdr.msg_namelen = sizeof(union sockaddr_capwap);
+		msgs[i].msg_hdr.msg_iov = &iov[i];
+		msgs[i].msg_hdr.msg_iovlen = 1;
+	}
+
+	/* sendmmsg can send only a part of the messages */
+	while (sent < count) {
+		result = sendmmsg(sock, &msgs[sent], count - sent, 0);
+		if (result < 0) {
+			if ((errno == EAGAIN) || (errno == EINTR)) {
+				continue;
+			}
+
+			log_printf(LOG_WARNING, "Unable to send packets, sendmmsg return %d with error %d", result, errno);
+			return -errno;
+		}
+
+		/* */
+		for (i = sent; i < (sent + result); i++) {
+			if (msgs[i].msg_len != iov[i].iov_len) {
+				log_printf(LOG_WARNING, "Unable to send packet, mismatch sendmmsg size %d - %d", (int)iov[i].iov_len, (int)msgs[i].msg_len);
+				return -ENETRESET;
+			}
+		}
+
+		sent += result;
+	}
+
+	return sent;
+}
+
+/* Send a list of packets to the same address with the less number of system calls.
+   Use UDP GSO when all packets except the last have the same size, otherwise sendmmsg */
+int capwap_sendto_batch(int sock, struct iovec* iov, int count, union sockaddr_capwap* toaddr) {
+	int i;
+	int err;
+	int sent;
+	int length;
+	size_t total;
+
+	ASSERT(sock >= 0);
+	ASSERT(iov != NULL);
+	ASSERT(count > 0);
+	ASSERT(toaddr != NULL);
+
+	/* Check if the packets can be segmented by kernel */
+	if (g_capwap_udp_gso && (count > 1) && (count <= CAPWAP_SEND_BATCH_SIZE)) {
+		total = iov[0].iov_len;
+		for (i = 1; i < count; i++) {
+			if ((iov[i].iov_len > iov[0].iov_len) || ((i < (count - 1)) && (iov[i].iov_len != iov[0].iov_len))) {
+				break;
+			}
+
+			total += iov[i].iov_len;
+		}
+
+		if ((i == count) && (total <= CAPWAP_MAX_GSO_SIZE)) {
+			err = capwap_sendto_gso(sock, iov, count, (int)iov[0].iov_len, toaddr);
+			if (err >= 0) {
+				return count;
+			} else if ((err == -EOPNOTSUPP) || (err == -ENOPROTOOPT)) {
+				/* Kernel without UDP GSO */
+				log_printf(LOG_INFO, "UDP GSO not available, error %d", -err);
+				g_capwap_udp_gso = 0;
+			} else if ((err == -EINVAL) || (err == -EIO)) {
+				/* Refused for this batch only, as a segment over the MTU of route or
+				   an output device without checksum offload. Send it with sendmmsg */
+				log_printf(LOG_DEBUG, "UDP GSO refused batch of %d packets, error %d", count, -err);
+			} else {
+				log_printf(LOG_WARNING, "Unable to send packets, sendmsg return error %d", -err);
+				return err;
+			}
+		}
+	}
+
+	/* */
+	for (sent = 0; sent < count; sent += length) {
+		length = (((count - sent) > CAPWAP_SEND_BATCH_SIZE) ? CAPWAP_SEND_BATCH_SIZE : (count - sent));
+
+		err = capwap_sendto_mmsg(sock, &iov[sent], length, toaddr);
+		if (err < 0) {
+			return err;
+		}
+	}
+
+#ifdef DEBUG
+	{
+		char strtoaddr[INET6_ADDRSTRLEN];
+		log_printf(LOG_DEBUG, "Sent %d packets to %s:%d", count, capwap_address_to_string(toaddr, strtoaddr, INET6_ADDRSTRLEN), (int)CAPWAP_GET_NETWORK_PORT(toaddr));
+	}
+#endif
+
+	return count;
+}
+
 /* */
 int capwap_sendto_fragmentpacket(int sock, struct capwap_list* fragmentlist, union sockaddr_capwap* toaddr) {
 	int err;
+	int count = 0;
+	struct iovec iov[CAPWAP_SEND_BATCH_SIZE];
 	struct capwap_list_item* item;
 
 	ASSERT(sock >= 0);
@@ -406,14 +820,21 @@ int capwap_sendto_fragmentpacket(int sock, struct capwap_list* fragmentlist, uni
 		ASSERT(fragmentpacket != NULL);
 		ASSERT(fragmentpacket->offset > 0);
 
-		err = capwap_sendto(sock, fragmentpacket->buffer, fragmentpacket->offset, toaddr);
-		if (err <= 0) {
-			log_printf(LOG_WARNING, "Unable to send fragment, sentto return error %d", err);
-			return 0;
-		}
+		iov[count].iov_base = fragmentpacket->buffer;
+		iov[count].iov_len = fragmentpacket->offset;
+		count++;
 
-		/* */
+		/* Send batch */
 		item = item->next;
+		if ((count == CAPWAP_SEND_BATCH_SIZE) || (!item && count)) {
+			err = capwap_sendto_batch(sock, iov, count, toaddr);
+			if (err <= 0) {
+				log_printf(LOG_WARNING, "Unable to send fragment, sentto return error %d", err);
+				return 0;
+			}
+
+			count = 0;
+		}
 	}
 
 	return 1;
@@ -51,6 +51,7 @@ struct addr_capwap {
 struct capwap_network {
 	union sockaddr_capwap localaddr;
 	char bindiface[IFNAMSIZ];
+	int reuseport;								/* Bind with SO_REUSEPORT */
 	int socket;
 };
 
@@ -63,6 +64,7 @@ int capwap_get_macaddress_from_interface(const char* interface, char* macaddress
 int capwap_network_get_localaddress(union sockaddr_capwap* localaddr, union sockaddr_capwap* peeraddr, char* iface);
 
 int capwap_bind_sockets(struct capwap_network* net);
+int capwap_bind_reuseport_steering(struct capwap_network* net, int count);
 int capwap_connect_socket(struct capwap_network* net, union sockaddr_capwap *peeraddr);
 void capwap_close_sockets(struct capwap_network* net);
 
@@ -71,13 +73,51 @@ int capwap_getsockname(struct capwap_network* net, union sockaddr_capwap *addr);
 int capwap_ipv4_mapped_ipv6(union sockaddr_capwap* addr);
 int capwap_compare_ip(union sockaddr_capwap* addr1, union sockaddr_capwap* addr2);
 
+/* Hash and order of addresses, with or without port, for the indexes of peers */
+unsigned long capwap_address_hash(union sockaddr_capwap* addr, int withport);
+int capwap_address_cmp(union sockaddr_capwap* addr1, union sockaddr_capwap* addr2, int withport);
+
 int capwap_sendto(int sock, void* buffer, int size, union sockaddr_capwap* toaddr);
+int capwap_sendto_iov(int sock, struct iovec* iov, int count, union sockaddr_capwap* toaddr);
 int capwap_sendto_fragmentpacket(int sock, struct capwap_list* fragmentlist, union sockaddr_capwap* toaddr);
 
+/* Batched send */
+#define CAPWAP_SEND_BATCH_SIZE				64
+#define CAPWAP_MAX_GSO_SIZE					65000
+
+int capwap_sendto_batch(int sock, struct iovec* iov, int count, union sockaddr_capwap* toaddr);
+
 ssize_t capwap_recvfrom(int sock, void *buffer, size_t len,
 		       union sockaddr_capwap* fromaddr,
 		       union sockaddr_capwap* toaddr);
 
+/* Batched receive */
+#define CAPWAP_RECV_BATCH_CONTROL_SIZE		256
+
+struct capwap_recv_packet {
+	union sockaddr_capwap fromaddr;
+	union sockaddr_capwap toaddr;
+	char* buffer;
+	int size;
+};
+
+struct capwap_recv_batch {
+	int count;									/* Packets received by last capwap_recvfrom_batch */
+	int size;
+	size_t buffersize;
+	struct capwap_recv_packet* packets;
+
+	/* */
+	struct mmsghdr* msgs;
+	struct iovec* iovs;
+	char* controls;
+	char* buffers;
+};
+
+struct capwap_recv_batch* capwap_recv_batch_create(int count, size_t buffersize);
+void capwap_recv_batch_free(struct capwap_recv_batch* batch);
+int capwap_recvfrom_batch(int sock, struct capwap_recv_batch* batch);
+
 int capwap_address_from_string(const char* ip, union sockaddr_capwap* sockaddr);
 const char* capwap_address_to_string(union sockaddr_capwap* sockaddr, char* ip, int len);
 
@@ -684,6 +684,30 @@ static int capwap_fragment_read_u32(capwap_message_elements_handle handle, uint3
 	return sizeof(uint32_t);
 }
 
+/* */
+static const uint8_t* capwap_fragment_read_pointer(capwap_message_elements_handle handle, unsigned short length) {
+	uint8_t* data;
+	struct capwap_fragment_packet_item* packet;
+	struct capwap_packet_rxmng* rxmngpacket = (struct capwap_packet_rxmng*)handle;
+
+	ASSERT(handle != NULL);
+
+	if (!length || !rxmngpacket->readpos.item || (length > rxmngpacket->readerpacketallowed)) {
+		return NULL;
+	}
+
+	/* Data split between fragments */
+	packet = (struct capwap_fragment_packet_item*)rxmngpacket->readpos.item->item;
+	if (length > (packet->size - rxmngpacket->readpos.pos)) {
+		return NULL;
+	}
+
+	data = (uint8_t*)&packet->buffer[rxmngpacket->readpos.pos];
+	capwap_fragment_read_block(handle, NULL, length);
+
+	return data;
+}
+
 /* */
 struct capwap_packet_rxmng* capwap_packet_rxmng_create_message(void) {
 	struct capwap_packet_rxmng* rxmngpacket;
@@ -708,6 +732,7 @@ static void capwap_packet_rxmng_complete(struct capwap_packet_rxmng* rxmngpacket
 	rxmngpacket->read_ops.read_u16 = capwap_fragment_read_u16;
 	rxmngpacket->read_ops.read_u32 = capwap_fragment_read_u32;
 	rxmngpacket->read_ops.read_block = capwap_fragment_read_block;
+	rxmngpacket->read_ops.read_pointer = capwap_fragment_read_pointer;
 
 	/* Set reader value */
 	rxmngpacket->readpos.item = rxmngpacket->fragmentlist->first;
@@ -0,0 +1,153 @@
+#include "capwap.h"
+#include "capwap_ring.h"
+
+#ifndef CAPWAP_MULTITHREADING_ENABLE
+#error "Warning: multithreading is disabled\n"
+#endif
+
+/* Every slot has a sequence number: a slot with sequence equal to position
+   is free for the producers, with sequence equal to position + 1 is ready
+   for the consumer */
+struct capwap_ring_slot {
+	unsigned long sequence;
+	unsigned long position;
+	char item[0];
+};
+
+/* */
+#define CAPWAP_RING_SLOT(ring, pos)				((struct capwap_ring_slot*)&(ring)->slots[((pos) & (ring)->mask) * (ring)->slotsize])
+#define CAPWAP_RING_ITEM_TO_SLOT(item)			((struct capwap_ring_slot*)((char*)(item) - offsetof(struct capwap_ring_slot, item)))
+
+/* */
+struct capwap_ring* capwap_ring_create(unsigned long size, unsigned long itemsize) {
+	unsigned long i;
+	struct capwap_ring* ring;
+
+	ASSERT(size > 0);
+	ASSERT(!(size & (size - 1)));
+	ASSERT(itemsize > 0);
+
+	/* */
+	ring = (struct capwap_ring*)capwap_alloc(sizeof(struct capwap_ring));
+	memset(ring, 0, sizeof(struct capwap_ring));
+
+	ring->size = size;
+	ring->mask = size - 1;
+	ring->slotsize = (sizeof(struct capwap_ring_slot) + itemsize + sizeof(unsigned long) - 1) & ~(sizeof(unsigned long) - 1);
+	ring->slots = (char*)capwap_alloc(ring->slotsize * size);
+
+	for (i = 0; i < size; i++) {
+		CAPWAP_RING_SLOT(ring, i)->sequence = i;
+	}
+
+	return ring;
+}
+
+/* */
+void capwap_ring_free(struct capwap_ring* ring) {
+	ASSERT(ring != NULL);
+
+	capwap_free(ring->slots);
+	capwap_free(ring);
+}
+
+/* Reserve a free slot, return NULL if the ring is full */
+void* capwap_ring_reserve(struct capwap_ring* ring) {
+	long delta;
+	unsigned long pos;
+	unsigned long count;
+	unsigned long highwater;
+	unsigned long sequence;
+	struct capwap_ring_slot* slot;
+
+	ASSERT(ring != NULL);
+
+	pos = __atomic_load_n(&ring->head, __ATOMIC_RELAXED);
+	for (;;) {
+		slot = CAPWAP_RING_SLOT(ring, pos);
+		sequence = __atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE);
+		delta = (long)sequence - (long)pos;
+
+		if (!delta) {
+			if (__atomic_compare_exchange_n(&ring->head, &pos, pos + 1, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+				break;
+			}
+		} else if (delta < 0) {
+			__atomic_add_fetch(&ring->dropped, 1, __ATOMIC_RELAXED);
+			return NULL;
+		} else {
+			pos = __atomic_load_n(&ring->head, __ATOMIC_RELAXED);
+		}
+	}
+
+	/* Update statistics */
+	count = pos + 1 - __atomic_load_n(&ring->tail, __ATOMIC_RELAXED);
+	highwater = __atomic_load_n(&ring->highwater, __ATOMIC_RELAXED);
+	while ((count > highwater) && (count <= ring->size)) {
+		if (__atomic_compare_exchange_n(&ring->highwater, &highwater, count, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+			break;
+		}
+	}
+
+	/* */
+	slot->position = pos;
+	return (void*)slot->item;
+}
+
+/* Reserve a free slot only if less than limit items are queued, the remaining
+   slots are left to the producers without limit. The count is approximate with
+   concurrent producers */
+void* capwap_ring_reserve_limit(struct capwap_ring* ring, unsigned long limit) {
+	unsigned long count;
+
+	ASSERT(ring != NULL);
+	ASSERT(limit <= ring->size);
+
+	count = __atomic_load_n(&ring->head, __ATOMIC_RELAXED) - __atomic_load_n(&ring->tail, __ATOMIC_RELAXED);
+	if (count >= limit) {
+		__atomic_add_fetch(&ring->dropped, 1, __ATOMIC_RELAXED);
+		return NULL;
+	}
+
+	return capwap_ring_reserve(ring);
+}
+
+/* Publish a reserved slot to consumer */
+void capwap_ring_commit(struct capwap_ring* ring, void* item) {
+	struct capwap_ring_slot* slot;
+
+	ASSERT(ring != NULL);
+	ASSERT(item != NULL);
+
+	slot = CAPWAP_RING_ITEM_TO_SLOT(item);
+	__atomic_store_n(&slot->sequence, slot->position + 1, __ATOMIC_RELEASE);
+}
+
+/* Oldest committed item, NULL if the ring is empty */
+void* capwap_ring_peek(struct capwap_ring* ring) {
+	struct capwap_ring_slot* slot;
+
+	ASSERT(ring != NULL);
+
+	slot = CAPWAP_RING_SLOT(ring, ring->tail);
+	if (__atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE) != (ring->tail + 1)) {
+		return NULL;
+	}
+
+	return (void*)slot->item;
+}
+
+/* Give back to producers the item returned by capwap_ring_peek */
+void capwap_ring_release(struct capwap_ring* ring) {
+	unsigned long pos;
+	struct capwap_ring_slot* slot;
+
+	ASSERT(ring != NULL);
+
+	pos = ring->tail;
+	slot = CAPWAP_RING_SLOT(ring, pos);
+	ASSERT(slot->sequence == (pos + 1));
+
+	__atomic_store_n(&ring->tail, pos + 1, __ATOMIC_RELAXED);
+	__atomic_store_n(&slot->sequence, pos + ring->size, __ATOMIC_RELEASE);
+}
@@ -0,0 +1,45 @@
+#ifndef __CAPWAP_RING_HEADER__
+#define __CAPWAP_RING_HEADER__
+
+#ifdef CAPWAP_MULTITHREADING_ENABLE
+
+/* Bounded lock-free ring with multiple producers and a single consumer.
+   The slots are preallocated, producers reserve a slot, fill the item
+   and commit it; the consumer peeks the oldest committed item and
+   releases it when done. */
+struct capwap_ring {
+	unsigned long size;
+	unsigned long mask;
+	unsigned long slotsize;
+	char* slots;
+
+	/* Producers position */
+	unsigned long head __attribute__((aligned(64)));
+
+	/* Consumer position */
+	unsigned long tail __attribute__((aligned(64)));
+
+	/* Statistics */
+	unsigned long dropped;						/* Items refused because the ring was full */
+	unsigned long highwater;					/* Max number of items queued */
+};
+
+struct capwap_ring* capwap_ring_create(unsigned long size, unsigned long itemsize);
+void capwap_ring_free(struct capwap_ring* ring);
+
+/* Producer */
+void* capwap_ring_reserve(struct capwap_ring* ring);
+void* capwap_ring_reserve_limit(struct capwap_ring* ring, unsigned long limit);
+void capwap_ring_commit(struct capwap_ring* ring, void* item);
+
+/* Consumer */
+void* capwap_ring_peek(struct capwap_ring* ring);
+void capwap_ring_release(struct capwap_ring* ring);
+
+/* */
+#define capwap_ring_get_dropped(ring)				__atomic_load_n(&(ring)->dropped, __ATOMIC_RELAXED)
+#define capwap_ring_get_highwater(ring)				__atomic_load_n(&(ring)->highwater, __ATOMIC_RELAXED)
+
+#endif /* CAPWAP_MULTITHREADING_ENABLE */
+
+#endif /* __CAPWAP_RING_HEADER__ */
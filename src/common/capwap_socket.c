@@ -148,7 +148,7 @@ void capwap_socket_crypto_freecontext(void* context) {
 }
 
 /* */
-struct capwap_socket_ssl* capwap_socket_ssl_connect(int sock, void* sslcontext, int timeout) {
+struct capwap_socket_ssl* capwap_socket_ssl_connect(int sock, void* sslcontext, const uint8_t* serverid, int serveridlength, int timeout) {
 	int result;
 	struct pollfd fds;
 	struct capwap_socket_ssl* sslsock;
@@ -160,6 +160,7 @@ struct capwap_socket_ssl* capwap_socket_ssl_connect(int sock, void* sslcontext,
 	sslsock = capwap_alloc(sizeof(struct capwap_socket_ssl));
 	sslsock->sock = sock;
 	sslsock->sslcontext = sslcontext;
+	sslsock->resumed = 0;
 	sslsock->sslsession = (void*)wolfSSL_new((WOLFSSL_CTX*)sslcontext);
 	if (!sslsock->sslsession) {
 		capwap_free(sslsock);
@@ -176,10 +177,18 @@ struct capwap_socket_ssl* capwap_socket_ssl_connect(int sock, void* sslcontext,
 	/* */
 	wolfSSL_set_using_nonblock((WOLFSSL*)sslsock->sslsession, 1);
 
+#ifndef NO_CLIENT_CACHE
+	/* Resume the last session established with the same server */
+	if (serverid && (serveridlength > 0)) {
+		wolfSSL_SetServerID((WOLFSSL*)sslsock->sslsession, serverid, serveridlength, 0);
+	}
+#endif
+
 	/* Establish SSL connection */
 	for (;;) {
 		result = wolfSSL_connect((WOLFSSL*)sslsock->sslsession);
 		if (result == SSL_SUCCESS) {
+			sslsock->resumed = (wolfSSL_session_reused((WOLFSSL*)sslsock->sslsession) ? 1 : 0);
 			break;		/* Connection complete */
 		} else {
 			int error = wolfSSL_get_error((WOLFSSL*)sslsock->sslsession, 0);
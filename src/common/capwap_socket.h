@@ -15,6 +15,7 @@ struct capwap_socket_ssl {
 	int sock;
 	void* sslcontext;
 	void* sslsession;
+	int resumed;
 };
 
 void* capwap_socket_crypto_createcontext(char* calist, char* cert, char* privatekey);
@@ -23,7 +24,7 @@ void capwap_socket_crypto_freecontext(void* context);
 int capwap_socket_crypto_send(struct capwap_socket_ssl* sslsock, void* buffer, size_t length, int timeout);
 int capwap_socket_crypto_recv(struct capwap_socket_ssl* sslsock, void* buffer, size_t length, int timeout);
 
-struct capwap_socket_ssl* capwap_socket_ssl_connect(int sock, void* sslcontext, int timeout);
+struct capwap_socket_ssl* capwap_socket_ssl_connect(int sock, void* sslcontext, const uint8_t* serverid, int serveridlength, int timeout);
 void capwap_socket_ssl_shutdown(struct capwap_socket_ssl* sslsock, int timeout);
 void capwap_socket_ssl_close(struct capwap_socket_ssl* sslsock);
 
@@ -1,100 +1,290 @@
 #include "capwap.h"
+#include <time.h>
 
 /* */
-#define CAPWAP_TIMEOUT_HASH_COUNT				128
+#define CAPWAP_TIMEOUT_ITEMS_INITIAL_SIZE		16
+#define CAPWAP_TIMEOUT_WHEEL_RANGE				((uint64_t)1 << (CAPWAP_TIMEOUT_WHEEL_BITS * CAPWAP_TIMEOUT_WHEEL_LEVELS))
 
 /* */
 /* #define CAPWAP_TIMEOUT_LOGGING_DEBUG			1 */
 
 /* */
-static unsigned long capwap_timeout_hash_item_gethash(const void* key, unsigned long hashsize) {
-	return (*((unsigned long*)key) % hashsize);
+static uint64_t capwap_timeout_gettime(void) {
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return ((uint64_t)now.tv_sec * 1000) + (uint64_t)(now.tv_nsec / 1000000);
 }
 
 /* */
-static const void* capwap_timeout_hash_item_getkey(const void* data) {
-	return (const void*)&((struct capwap_timeout_item*)((struct capwap_list_item*)data)->item)->index;
-}
+#ifdef CAPWAP_MULTITHREADING_ENABLE
+#define capwap_timeout_is_shared(wheel)			((wheel)->shared)
+#else
+#define capwap_timeout_is_shared(wheel)			0
+#endif
 
 /* */
-static int capwap_timeout_hash_item_cmp(const void* key1, const void* key2) {
-	unsigned long value1 = *(unsigned long*)key1;
-	unsigned long value2 = *(unsigned long*)key2;
+static void capwap_timeout_lock(struct capwap_timeout_wheel* wheel) {
+#ifdef CAPWAP_MULTITHREADING_ENABLE
+	if (wheel->shared) {
+		capwap_lock_enter(&wheel->lock);
+	}
+#endif
+}
 
-	return ((value1 == value2) ? 0 : ((value1 < value2) ? -1 : 1));
+/* */
+static void capwap_timeout_unlock(struct capwap_timeout_wheel* wheel) {
+#ifdef CAPWAP_MULTITHREADING_ENABLE
+	if (wheel->shared) {
+		capwap_lock_exit(&wheel->lock);
+	}
+#endif
 }
 
 /* */
-static long capwap_timeout_getdelta(struct timeval* time1, struct timeval* time2) {
-	return (time1->tv_sec - time2->tv_sec) * 1000 + (time1->tv_usec - time2->tv_usec) / 1000;
+static void capwap_timeout_slot_append(struct capwap_timeout_slot* slot, struct capwap_timeout_item* item) {
+	item->next = NULL;
+	item->prev = slot->last;
+	if (slot->last) {
+		slot->last->next = item;
+	} else {
+		slot->first = item;
+	}
+
+	slot->last = item;
 }
 
 /* */
-static unsigned long capwap_timeout_set_bitfield(struct capwap_timeout* timeout) {
-	int i, j;
+static void capwap_timeout_slot_remove(struct capwap_timeout_slot* slot, struct capwap_timeout_item* item) {
+	if (item->prev) {
+		item->prev->next = item->next;
+	} else {
+		slot->first = item->next;
+	}
 
-	ASSERT(timeout != NULL);
+	if (item->next) {
+		item->next->prev = item->prev;
+	} else {
+		slot->last = item->prev;
+	}
 
-	/* Search free bitfield */
-	for (i = 0; i < CAPWAP_TIMEOUT_BITFIELD_SIZE; i++) {
-		if (timeout->timeoutbitfield[i] != 0xffffffff) {
-			uint32_t bitfield = timeout->timeoutbitfield[i];
+	item->prev = NULL;
+	item->next = NULL;
+}
 
-			for (j = 0; j < 32; j++) {
-				if (!(bitfield & (1 << j))) {
-					timeout->timeoutbitfield[i] |= (1 << j);
-					return (i * 32 + j + 1);
-				}
-			}
+/* Move timer into expired list of owner, require wheel lock */
+static void capwap_timeout_expire_item(struct capwap_timeout_item* item) {
+	struct capwap_timeout* owner = item->owner;
+	int notify = !owner->expired.first;
+
+	item->level = CAPWAP_TIMEOUT_ITEM_EXPIRED;
+	capwap_timeout_slot_append(&owner->expired, item);
+
+#ifdef CAPWAP_MULTITHREADING_ENABLE
+	if (notify && owner->notify) {
+		owner->notify(owner, owner->notifyparam);
+	}
+#else
+	(void)notify;
+#endif
+}
+
+/* Put timer into the wheel level which covers its expiration, require wheel lock */
+static void capwap_timeout_schedule(struct capwap_timeout_wheel* wheel, struct capwap_timeout_item* item) {
+	int level;
+	uint64_t delta;
+	uint64_t expire = item->expire;
+
+	/* Tick already processed */
+	if (expire < wheel->current) {
+		capwap_timeout_expire_item(item);
+		return;
+	}
+
+	/* Too far timeout is parked into last level and cascaded again */
+	delta = expire - wheel->current;
+	if (delta >= CAPWAP_TIMEOUT_WHEEL_RANGE) {
+		delta = CAPWAP_TIMEOUT_WHEEL_RANGE - 1;
+		expire = wheel->current + delta;
+	}
+
+	for (level = 0; level < (CAPWAP_TIMEOUT_WHEEL_LEVELS - 1); level++) {
+		if (delta < ((uint64_t)1 << (CAPWAP_TIMEOUT_WHEEL_BITS * (level + 1)))) {
+			break;
 		}
 	}
 
-	return CAPWAP_TIMEOUT_INDEX_NO_SET;
+	/* */
+	item->level = level;
+	item->slot = (int)((expire >> (CAPWAP_TIMEOUT_WHEEL_BITS * level)) & CAPWAP_TIMEOUT_WHEEL_MASK);
+	capwap_timeout_slot_append(&wheel->wheel[level][item->slot], item);
+	wheel->wheelbitmap[level] |= ((uint64_t)1 << item->slot);
+	wheel->scheduled++;
 }
 
-/* */
-static void capwap_timeout_clear_bitfield(struct capwap_timeout* timeout, unsigned long value) {
-	ASSERT(timeout != NULL);
-	ASSERT(value > 0);
+/* Remove timer from wheel or expired list, require wheel lock */
+static void capwap_timeout_unschedule(struct capwap_timeout_wheel* wheel, struct capwap_timeout_item* item) {
+	struct capwap_timeout_slot* slot;
+
+	if (item->level == CAPWAP_TIMEOUT_ITEM_EXPIRED) {
+		capwap_timeout_slot_remove(&item->owner->expired, item);
+	} else if (item->level >= 0) {
+		slot = &wheel->wheel[item->level][item->slot];
+		capwap_timeout_slot_remove(slot, item);
+		if (!slot->first) {
+			wheel->wheelbitmap[item->level] &= ~((uint64_t)1 << item->slot);
+		}
+
+		wheel->scheduled--;
+	}
 
-	timeout->timeoutbitfield[(value - 1) / 32] &= ~(1 << ((value - 1) % 32));
+	item->level = CAPWAP_TIMEOUT_ITEM_IDLE;
 }
 
-/* */
-static void capwap_timeout_additem(struct capwap_list* itemstimeout, struct capwap_list_item* itemlist) {
-	struct capwap_list_item* search;
-	struct capwap_list_item* last = NULL;
-	struct capwap_timeout_item* item = (struct capwap_timeout_item*)itemlist->item;
+/* Move all timers of slot into lower levels */
+static void capwap_timeout_cascade(struct capwap_timeout_wheel* wheel, int level, int index) {
+	struct capwap_timeout_item* item;
+	struct capwap_timeout_slot* slot = &wheel->wheel[level][index];
 
-	/* */
-	search = itemstimeout->first;
-	while (search) {
-		struct capwap_timeout_item* itemsearch = (struct capwap_timeout_item*)search->item;
+	/* Detach slot before schedule again the timers */
+	item = slot->first;
+	slot->first = NULL;
+	slot->last = NULL;
+	wheel->wheelbitmap[level] &= ~((uint64_t)1 << index);
+
+	while (item) {
+		struct capwap_timeout_item* next = item->next;
 
-		if (capwap_timeout_getdelta(&item->expire, &itemsearch->expire) < 0) {
-			capwap_itemlist_insert_before(itemstimeout, last, itemlist);
+		wheel->scheduled--;
+		capwap_timeout_schedule(wheel, item);
+		item = next;
+	}
+}
+
+/* Lower bound of next expiration tick, 0 if the wheel is empty */
+static uint64_t capwap_timeout_nexttick(struct capwap_timeout_wheel* wheel) {
+	int i;
+	int level;
+	int shift;
+	uint64_t block;
+	uint64_t bitmap;
+	uint64_t tick;
+	uint64_t result = 0;
+
+	for (level = 0; level < CAPWAP_TIMEOUT_WHEEL_LEVELS; level++) {
+		bitmap = wheel->wheelbitmap[level];
+		if (!bitmap) {
+			continue;
+		}
+
+		/* First slot block not yet processed */
+		shift = CAPWAP_TIMEOUT_WHEEL_BITS * level;
+		block = wheel->current >> shift;
+		if (wheel->current & (((uint64_t)1 << shift) - 1)) {
+			block++;
+		}
+
+		/* Rotate bitmap to search first busy slot from block */
+		i = (int)(block & CAPWAP_TIMEOUT_WHEEL_MASK);
+		if (i) {
+			bitmap = (bitmap >> i) | (bitmap << (CAPWAP_TIMEOUT_WHEEL_SLOTS - i));
+		}
+
+		tick = (block + (uint64_t)__builtin_ctzll(bitmap)) << shift;
+		if (!result || (tick < result)) {
+			result = tick;
+		}
+	}
+
+	return result;
+}
+
+/* Process the ticks until now, the expired timers are moved into expired list of owner */
+static void capwap_timeout_advance(struct capwap_timeout_wheel* wheel, uint64_t now) {
+	int i;
+	int level;
+	int index;
+	uint64_t next;
+	struct capwap_timeout_item* item;
+	struct capwap_timeout_slot* slot;
+
+	while (wheel->current <= now) {
+		if (!wheel->scheduled) {
+			wheel->current = now + 1;
 			break;
 		}
 
-		/* Next */
-		last = search;
-		search = search->next;
+		/* Cascade the upper levels when the lower level wraps */
+		index = (int)(wheel->current & CAPWAP_TIMEOUT_WHEEL_MASK);
+		if (!index) {
+			for (level = 1; level < CAPWAP_TIMEOUT_WHEEL_LEVELS; level++) {
+				i = (int)((wheel->current >> (CAPWAP_TIMEOUT_WHEEL_BITS * level)) & CAPWAP_TIMEOUT_WHEEL_MASK);
+				if (wheel->wheelbitmap[level] & ((uint64_t)1 << i)) {
+					capwap_timeout_cascade(wheel, level, i);
+				}
+
+				if (i) {
+					break;
+				}
+			}
+		}
+
+		/* Expire current slot */
+		slot = &wheel->wheel[0][index];
+		if (slot->first) {
+			item = slot->first;
+			slot->first = NULL;
+			slot->last = NULL;
+			wheel->wheelbitmap[0] &= ~((uint64_t)1 << index);
+
+			while (item) {
+				struct capwap_timeout_item* nextitem = item->next;
+
+				wheel->scheduled--;
+				capwap_timeout_expire_item(item);
+				item = nextitem;
+			}
+		}
+
+		/* Skip the empty ticks until next busy slot or next cascade */
+		wheel->current++;
+		if (wheel->scheduled && (wheel->current <= now)) {
+			next = capwap_timeout_nexttick(wheel);
+			if (next > wheel->current) {
+				wheel->current = ((next <= now) ? next : now + 1);
+			}
+		}
 	}
+}
 
-	/* */
-	if (!search) {
-		capwap_itemlist_insert_after(itemstimeout, NULL, itemlist);
+#ifdef CAPWAP_MULTITHREADING_ENABLE
+/* Report to the owner of shared wheel the closest expiration, require wheel lock */
+static void capwap_timeout_rearm(struct capwap_timeout_wheel* wheel, uint64_t expire) {
+	if (expire != wheel->armed) {
+		wheel->armed = expire;
+		wheel->arm(wheel, expire, wheel->armparam);
 	}
 }
+#endif
 
 /* */
-static void capwap_timeout_setexpire(long durate, struct timeval* now, struct timeval* expire) {
-	expire->tv_sec = now->tv_sec + durate / 1000;
-	expire->tv_usec = now->tv_usec + durate % 1000;
-	if (expire->tv_usec >= 1000000) {
-		expire->tv_sec++;
-		expire->tv_usec -= 1000000;
+static struct capwap_timeout_item* capwap_timeout_getitem(struct capwap_timeout* timeout, unsigned long index) {
+	if ((index == CAPWAP_TIMEOUT_INDEX_NO_SET) || (index > timeout->itemssize)) {
+		return NULL;
 	}
+
+	return timeout->items[index - 1];
+}
+
+/* */
+static struct capwap_timeout_wheel* capwap_timeout_wheel_init(void) {
+	struct capwap_timeout_wheel* wheel;
+
+	wheel = (struct capwap_timeout_wheel*)capwap_alloc(sizeof(struct capwap_timeout_wheel));
+	memset(wheel, 0, sizeof(struct capwap_timeout_wheel));
+	wheel->current = capwap_timeout_gettime();
+
+	return wheel;
 }
 
 /* */
@@ -106,33 +296,134 @@ struct capwap_timeout* capwap_timeout_init(void) {
 	memset(timeout, 0, sizeof(struct capwap_timeout));
 
 	/* */
-	timeout->itemsreference = capwap_hash_create(CAPWAP_TIMEOUT_HASH_COUNT);
-	timeout->itemsreference->item_gethash = capwap_timeout_hash_item_gethash;
-	timeout->itemsreference->item_getkey = capwap_timeout_hash_item_getkey;
-	timeout->itemsreference->item_cmp = capwap_timeout_hash_item_cmp;
+	timeout->wheel = capwap_timeout_wheel_init();
+	timeout->privatewheel = 1;
 
-	timeout->itemstimeout = capwap_list_create();
+	return timeout;
+}
+
+#ifdef CAPWAP_MULTITHREADING_ENABLE
+/* */
+struct capwap_timeout_wheel* capwap_timeout_wheel_create(capwap_timeout_wheel_arm arm, void* param) {
+	struct capwap_timeout_wheel* wheel;
+
+	ASSERT(arm != NULL);
+
+	wheel = capwap_timeout_wheel_init();
+	wheel->shared = 1;
+	capwap_lock_init(&wheel->lock);
+	wheel->arm = arm;
+	wheel->armparam = param;
+
+	return wheel;
+}
+
+/* */
+void capwap_timeout_wheel_free(struct capwap_timeout_wheel* wheel) {
+	ASSERT(wheel != NULL);
+	ASSERT(wheel->scheduled == 0);
+
+	capwap_lock_destroy(&wheel->lock);
+	capwap_free(wheel);
+}
+
+/* Expire the timers of shared wheel and arm the next expiration */
+void capwap_timeout_wheel_process(struct capwap_timeout_wheel* wheel) {
+	ASSERT(wheel != NULL);
+	ASSERT(wheel->shared);
+
+	capwap_lock_enter(&wheel->lock);
+	capwap_timeout_advance(wheel, capwap_timeout_gettime());
+	capwap_timeout_rearm(wheel, capwap_timeout_nexttick(wheel));
+	capwap_lock_exit(&wheel->lock);
+}
+
+/* */
+struct capwap_timeout* capwap_timeout_init_shared(struct capwap_timeout_wheel* wheel, capwap_timeout_notify notify, void* param) {
+	struct capwap_timeout* timeout;
+
+	ASSERT(wheel != NULL);
+	ASSERT(wheel->shared);
+	ASSERT(notify != NULL);
+
+	/* */
+	timeout = (struct capwap_timeout*)capwap_alloc(sizeof(struct capwap_timeout));
+	memset(timeout, 0, sizeof(struct capwap_timeout));
+
+	timeout->wheel = wheel;
+	timeout->notify = notify;
+	timeout->notifyparam = param;
 
 	return timeout;
 }
+#endif
 
 /* */
 void capwap_timeout_free(struct capwap_timeout* timeout) {
+	unsigned long i;
+
 	ASSERT(timeout != NULL);
 
-	capwap_hash_free(timeout->itemsreference);
-	capwap_list_free(timeout->itemstimeout);
+	/* Remove timers from wheel before release them */
+	capwap_timeout_unsetall(timeout);
+
+	for (i = 0; i < timeout->itemssize; i++) {
+		if (timeout->items[i]) {
+			capwap_free(timeout->items[i]);
+		}
+	}
+
+	if (timeout->items) {
+		capwap_free(timeout->items);
+		capwap_free(timeout->freeindex);
+	}
+
+	if (timeout->privatewheel) {
+		capwap_free(timeout->wheel);
+	}
+
 	capwap_free(timeout);
 }
 
 /* */
 unsigned long capwap_timeout_createtimer(struct capwap_timeout* timeout) {
+	unsigned long i;
 	unsigned long index;
+	struct capwap_timeout_item* item;
 
 	ASSERT(timeout != NULL);
 
+	/* Grow timers table, the table is used only by the owner */
+	if (!timeout->freeindexcount) {
+		unsigned long size = (timeout->itemssize ? timeout->itemssize * 2 : CAPWAP_TIMEOUT_ITEMS_INITIAL_SIZE);
+		struct capwap_timeout_item** items = (struct capwap_timeout_item**)capwap_alloc(sizeof(struct capwap_timeout_item*) * size);
+
+		memset(items, 0, sizeof(struct capwap_timeout_item*) * size);
+		if (timeout->items) {
+			memcpy(items, timeout->items, sizeof(struct capwap_timeout_item*) * timeout->itemssize);
+			capwap_free(timeout->items);
+			capwap_free(timeout->freeindex);
+		}
+
+		/* All the new indexes are free, lower index first */
+		timeout->freeindex = (unsigned long*)capwap_alloc(sizeof(unsigned long) * size);
+		for (i = size; i > timeout->itemssize; i--) {
+			timeout->freeindex[timeout->freeindexcount++] = i;
+		}
+
+		timeout->items = items;
+		timeout->itemssize = size;
+	}
+
 	/* Create new timeout index */
-	index = capwap_timeout_set_bitfield(timeout);
+	index = timeout->freeindex[--timeout->freeindexcount];
+
+	item = (struct capwap_timeout_item*)capwap_alloc(sizeof(struct capwap_timeout_item));
+	memset(item, 0, sizeof(struct capwap_timeout_item));
+	item->index = index;
+	item->owner = timeout;
+	item->level = CAPWAP_TIMEOUT_ITEM_IDLE;
+	timeout->items[index - 1] = item;
 
 #ifdef CAPWAP_TIMEOUT_LOGGING_DEBUG
 	log_printf(LOG_DEBUG, "Create new timer: %lu", index);
@@ -143,67 +434,62 @@ unsigned long capwap_timeout_createtimer(struct capwap_timeout* timeout) {
 
 /* */
 void capwap_timeout_deletetimer(struct capwap_timeout* timeout, unsigned long index) {
+	struct capwap_timeout_item* item;
+
 	ASSERT(timeout != NULL);
 
-	if (index != CAPWAP_TIMEOUT_INDEX_NO_SET) {
+	item = capwap_timeout_getitem(timeout, index);
+	if (item) {
 #ifdef CAPWAP_TIMEOUT_LOGGING_DEBUG
 		log_printf(LOG_DEBUG, "Delete timer: %lu", index);
 #endif
 
 		/* Unset timeout timer */
-		capwap_timeout_unset(timeout, index);
+		capwap_timeout_lock(timeout->wheel);
+		capwap_timeout_unschedule(timeout->wheel, item);
+		capwap_timeout_unlock(timeout->wheel);
 
 		/* Release timer index */
-		capwap_timeout_clear_bitfield(timeout, index);
+		capwap_free(item);
+		timeout->items[index - 1] = NULL;
+		timeout->freeindex[timeout->freeindexcount++] = index;
 	}
 }
 
 /* */
 unsigned long capwap_timeout_set(struct capwap_timeout* timeout, unsigned long index, long durate, capwap_timeout_expire callback, void* context, void* param) {
-	struct capwap_list_item* itemlist;
+	uint64_t now;
 	struct capwap_timeout_item* item;
-	struct timeval now;
+	struct capwap_timeout_wheel* wheel;
 
 	ASSERT(timeout != NULL);
 	ASSERT(durate >= 0);
 
-	gettimeofday(&now, NULL);
-
 	if (index == CAPWAP_TIMEOUT_INDEX_NO_SET) {
 		index = capwap_timeout_createtimer(timeout);
-	} else {
-		/* Check can update timeout timer */
-		itemlist = (struct capwap_list_item*)capwap_hash_search(timeout->itemsreference, &index);
-		if (itemlist) {
-			/* Remove from timeout list */
-			capwap_itemlist_remove(timeout->itemstimeout, itemlist);
-
-			/* Update timeout */
-			item = (struct capwap_timeout_item*)itemlist->item;
-			item->durate = durate;
-			capwap_timeout_setexpire(item->durate, &now, &item->expire);
-			item->callback = callback;
-			item->context = context;
-			item->param = param;
-
-#ifdef CAPWAP_TIMEOUT_LOGGING_DEBUG
-			log_printf(LOG_DEBUG, "Update timeout: %lu %ld", item->index, item->durate);
-#endif
-
-			/* Add itemlist into order list */
-			capwap_timeout_additem(timeout->itemstimeout, itemlist);
-			return index;
-		}
 	}
 
-	/* Create new timeout timer */
-	itemlist = capwap_itemlist_create(sizeof(struct capwap_timeout_item));
-	item = (struct capwap_timeout_item*)itemlist->item;
+	item = capwap_timeout_getitem(timeout, index);
+	if (!item) {
+		return CAPWAP_TIMEOUT_INDEX_NO_SET;
+	}
 
 	/* */
-	item->index = index;
+	wheel = timeout->wheel;
+	now = capwap_timeout_gettime();
+
+	capwap_timeout_lock(wheel);
+
+	/* Update timeout */
+	capwap_timeout_unschedule(wheel, item);
+
+	/* Align private wheel to the current time, the shared wheel is moved only by capwap_timeout_wheel_process */
+	if (!capwap_timeout_is_shared(wheel)) {
+		capwap_timeout_advance(wheel, now);
+	}
+
 	item->durate = durate;
-	capwap_timeout_setexpire(item->durate, &now, &item->expire);
+	item->expire = now + (uint64_t)durate;
 	item->callback = callback;
 	item->context = context;
 	item->param = param;
@@ -212,83 +498,87 @@ unsigned long capwap_timeout_set(struct capwap_timeout* timeout, unsigned long i
 	log_printf(LOG_DEBUG, "Set timeout: %lu %ld", item->index, item->durate);
 #endif
 
-	/* Add itemlist into hash for rapid searching */
-	capwap_hash_add(timeout->itemsreference, (void*)itemlist);
+	/* */
+	capwap_timeout_schedule(wheel, item);
 
-	/* Add itemlist into order list */
-	capwap_timeout_additem(timeout->itemstimeout, itemlist);
+#ifdef CAPWAP_MULTITHREADING_ENABLE
+	if (wheel->shared && (item->level >= 0) && (!wheel->armed || (item->expire < wheel->armed))) {
+		capwap_timeout_rearm(wheel, item->expire);
+	}
+#endif
 
-	return item->index;
+	capwap_timeout_unlock(wheel);
+
+	return index;
 }
 
 /* */
 void capwap_timeout_unset(struct capwap_timeout* timeout, unsigned long index) {
-	struct capwap_list_item* itemlist;
+	struct capwap_timeout_item* item;
 
 	ASSERT(timeout != NULL);
 
-	if (index != CAPWAP_TIMEOUT_INDEX_NO_SET) {
-		itemlist = (struct capwap_list_item*)capwap_hash_search(timeout->itemsreference, &index);
-		if (itemlist) {
+	item = capwap_timeout_getitem(timeout, index);
+	if (item) {
 #ifdef CAPWAP_TIMEOUT_LOGGING_DEBUG
-			log_printf(LOG_DEBUG, "Unset timeout: %lu", index);
+		log_printf(LOG_DEBUG, "Unset timeout: %lu", index);
 #endif
 
-			/* */
-			capwap_hash_delete(timeout->itemsreference, &index);
-			capwap_itemlist_free(capwap_itemlist_remove(timeout->itemstimeout, itemlist));
-		}
+		capwap_timeout_lock(timeout->wheel);
+		capwap_timeout_unschedule(timeout->wheel, item);
+		capwap_timeout_unlock(timeout->wheel);
 	}
 }
 
 /* */
 void capwap_timeout_unsetall(struct capwap_timeout* timeout) {
-	capwap_hash_deleteall(timeout->itemsreference);
-	capwap_list_flush(timeout->itemstimeout);
+	unsigned long i;
+
+	ASSERT(timeout != NULL);
+
+	capwap_timeout_lock(timeout->wheel);
+
+	for (i = 0; i < timeout->itemssize; i++) {
+		if (timeout->items[i]) {
+			capwap_timeout_unschedule(timeout->wheel, timeout->items[i]);
+		}
+	}
+
+	capwap_timeout_unlock(timeout->wheel);
 }
 
 /* */
 long capwap_timeout_getcoming(struct capwap_timeout* timeout) {
-	long delta;
-	struct timeval now;
-	struct capwap_list_item* search;
-	struct capwap_timeout_item* item;
+	uint64_t now;
+	uint64_t tick;
+	struct capwap_timeout_wheel* wheel;
 
 	ASSERT(timeout != NULL);
 
-	/* */
-	search = timeout->itemstimeout->first;
-	if (!search) {
-		return CAPWAP_TIMEOUT_INFINITE;
+	/* The expirations of shared wheel are notified, the check is lockless */
+	wheel = timeout->wheel;
+	if (capwap_timeout_is_shared(wheel)) {
+		return (__atomic_load_n(&timeout->expired.first, __ATOMIC_ACQUIRE) ? 0 : CAPWAP_TIMEOUT_INFINITE);
 	}
 
 	/* */
-	gettimeofday(&now, NULL);
-	item = (struct capwap_timeout_item*)search->item;
-	delta = capwap_timeout_getdelta(&item->expire, &now);
-
-	if (delta <= 0) {
+	now = capwap_timeout_gettime();
+	capwap_timeout_advance(wheel, now);
+	if (timeout->expired.first) {
 		return 0;
-	} else if (delta <= item->durate) {
-		return delta;
-	}
-
-	/* Recalculate all timeouts because delta > item->durate */
-	while (search) {
-		struct capwap_timeout_item* itemsearch = (struct capwap_timeout_item*)search->item;
-
-		capwap_timeout_setexpire(itemsearch->durate, &now, &itemsearch->expire);
-		search = search->next;
+	} else if (!wheel->scheduled) {
+		return CAPWAP_TIMEOUT_INFINITE;
 	}
 
-	return item->durate;
+	/* The timers into upper levels are checked again when cascaded */
+	tick = capwap_timeout_nexttick(wheel);
+	return ((tick > now) ? (long)(tick - now) : 0);
 }
 
 /* */
 unsigned long capwap_timeout_hasexpired(struct capwap_timeout* timeout) {
-	long delta;
 	struct capwap_timeout_item* item;
-	struct capwap_list_item* itemlist;
+	struct capwap_timeout_wheel* wheel;
 	unsigned long index;
 	capwap_timeout_expire callback;
 	void* context;
@@ -297,28 +587,33 @@ unsigned long capwap_timeout_hasexpired(struct capwap_timeout* timeout) {
 	ASSERT(timeout != NULL);
 
 	/* */
-	delta = capwap_timeout_getcoming(timeout);
-	if ((delta > 0) || (delta == CAPWAP_TIMEOUT_INFINITE))  {
+	wheel = timeout->wheel;
+	capwap_timeout_lock(wheel);
+
+	if (!capwap_timeout_is_shared(wheel) && !timeout->expired.first) {
+		capwap_timeout_advance(wheel, capwap_timeout_gettime());
+	}
+
+	item = timeout->expired.first;
+	if (!item) {
+		capwap_timeout_unlock(wheel);
 		return 0;
 	}
 
 	/* */
-	itemlist = capwap_itemlist_remove_head(timeout->itemstimeout);
-	item = (struct capwap_timeout_item*)itemlist->item;
+	capwap_timeout_unschedule(wheel, item);
 
 #ifdef CAPWAP_TIMEOUT_LOGGING_DEBUG
 	log_printf(LOG_DEBUG, "Expired timeout: %lu", item->index);
 #endif
 
-	/* Cache callback before release timeout timer */
+	/* Cache callback, the timer can be changed by callback */
 	index = item->index;
 	callback = item->callback;
 	context = item->context;
 	param = item->param;
 
-	/* Free memory */
-	capwap_hash_delete(timeout->itemsreference, &index);
-	capwap_itemlist_free(itemlist);
+	capwap_timeout_unlock(wheel);
 
 	/* */
 	if (callback) {
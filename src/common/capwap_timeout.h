@@ -3,35 +3,107 @@
 
 #include "capwap_hash.h"
 #include "capwap_list.h"
+#include "capwap_lock.h"
 
 /* */
-#define CAPWAP_TIMEOUT_BITFIELD_SIZE			128
 #define CAPWAP_TIMEOUT_INFINITE					-1
 #define CAPWAP_TIMEOUT_INDEX_NO_SET				0
 
-/* */
-struct capwap_timeout {
-	uint32_t timeoutbitfield[CAPWAP_TIMEOUT_BITFIELD_SIZE];
-	struct capwap_hash* itemsreference;
-	struct capwap_list* itemstimeout;
-};
+/* Hierarchical timing wheel with 1 ms tick, every level has 64 slots.
+   The last level covers 2^30 ms, longer timeouts are cascaded again
+   when the slot is reached */
+#define CAPWAP_TIMEOUT_WHEEL_BITS				6
+#define CAPWAP_TIMEOUT_WHEEL_SLOTS				(1 << CAPWAP_TIMEOUT_WHEEL_BITS)
+#define CAPWAP_TIMEOUT_WHEEL_MASK				(CAPWAP_TIMEOUT_WHEEL_SLOTS - 1)
+#define CAPWAP_TIMEOUT_WHEEL_LEVELS				5
 
 /* */
+struct capwap_timeout;
+struct capwap_timeout_wheel;
 typedef void (*capwap_timeout_expire)(struct capwap_timeout* timeout, unsigned long index, void* context, void* param);
+typedef void (*capwap_timeout_notify)(struct capwap_timeout* timeout, void* param);
+typedef void (*capwap_timeout_wheel_arm)(struct capwap_timeout_wheel* wheel, uint64_t expire, void* param);
+
+/* */
+#define CAPWAP_TIMEOUT_ITEM_IDLE				-1
+#define CAPWAP_TIMEOUT_ITEM_EXPIRED				-2
 
 struct capwap_timeout_item {
 	unsigned long index;
 	long durate;
-	struct timeval expire;
+	uint64_t expire;
 	capwap_timeout_expire callback;
 	void* context;
 	void* param;
+
+	/* Position into wheel, level is CAPWAP_TIMEOUT_ITEM_IDLE when not scheduled */
+	struct capwap_timeout* owner;
+	int level;
+	int slot;
+	struct capwap_timeout_item* prev;
+	struct capwap_timeout_item* next;
+};
+
+struct capwap_timeout_slot {
+	struct capwap_timeout_item* first;
+	struct capwap_timeout_item* last;
+};
+
+/* The wheel can be private of a capwap_timeout or shared by many capwap_timeout.
+   A shared wheel is advanced only by capwap_timeout_wheel_process(), the arm
+   callback is called with the wheel lock held every time the closest expiration
+   changes and the owner of expired timers is notified */
+struct capwap_timeout_wheel {
+	uint64_t current;							/* Next tick to process */
+	unsigned long scheduled;					/* Timers into wheel */
+
+	struct capwap_timeout_slot wheel[CAPWAP_TIMEOUT_WHEEL_LEVELS][CAPWAP_TIMEOUT_WHEEL_SLOTS];
+	uint64_t wheelbitmap[CAPWAP_TIMEOUT_WHEEL_LEVELS];
+
+#ifdef CAPWAP_MULTITHREADING_ENABLE
+	/* Shared wheel */
+	int shared;
+	capwap_lock_t lock;
+	uint64_t armed;								/* Tick passed to arm callback, 0 if disarmed */
+	capwap_timeout_wheel_arm arm;
+	void* armparam;
+#endif
+};
+
+/* */
+struct capwap_timeout {
+	struct capwap_timeout_wheel* wheel;
+	int privatewheel;
+
+	/* Expired timers waiting capwap_timeout_hasexpired() */
+	struct capwap_timeout_slot expired;
+
+#ifdef CAPWAP_MULTITHREADING_ENABLE
+	/* Called when the first timer is expired, with the lock of shared wheel held */
+	capwap_timeout_notify notify;
+	void* notifyparam;
+#endif
+
+	/* Timers by index */
+	struct capwap_timeout_item** items;
+	unsigned long itemssize;
+	unsigned long* freeindex;
+	unsigned long freeindexcount;
 };
 
 /* */
 struct capwap_timeout* capwap_timeout_init(void);
 void capwap_timeout_free(struct capwap_timeout* timeout);
 
+#ifdef CAPWAP_MULTITHREADING_ENABLE
+/* Shared wheel */
+struct capwap_timeout_wheel* capwap_timeout_wheel_create(capwap_timeout_wheel_arm arm, void* param);
+void capwap_timeout_wheel_free(struct capwap_timeout_wheel* wheel);
+void capwap_timeout_wheel_process(struct capwap_timeout_wheel* wheel);
+
+struct capwap_timeout* capwap_timeout_init_shared(struct capwap_timeout_wheel* wheel, capwap_timeout_notify notify, void* param);
+#endif
+
 /* */
 unsigned long capwap_timeout_createtimer(struct capwap_timeout* timeout);
 void capwap_timeout_deletetimer(struct capwap_timeout* timeout, unsigned long index);
@@ -16,8 +16,14 @@ static const unsigned char sc_rfc1042_header[] = { 0xaa, 0xaa, 0x03, 0x00, 0x00,
 /* Bridge-Tunnel header (for EtherTypes ETH_P_AARP and ETH_P_IPX) */
 static const unsigned char sc_bridge_tunnel_header[] = { 0xaa, 0xaa, 0x03, 0x00, 0x00, 0xf8 };
 
+/* Memory of fragments queued by all sessions */
+static atomic_t sc_capwap_fragment_memory = ATOMIC_INIT(0);
+
+/* */
+DEFINE_PER_CPU(struct sc_capwap_defragstats, sc_capwap_defragstats);
+
 /* */
-static void sc_capwap_fragment_free(struct sc_capwap_fragment* fragment)
+static void sc_capwap_fragment_free(struct sc_capwap_fragment_queue* queue, struct sc_capwap_fragment* fragment)
 {
 	TRACEKMOD("### sc_capwap_fragment_free\n");
 
@@ -25,6 +31,11 @@ static void sc_capwap_fragment_free(struct sc_capwap_fragment* fragment)
 	list_del(&fragment->lru_list);
 	fragment->flags = 0;
 
+	/* Release memory */
+	queue->memory -= fragment->truesize;
+	atomic_sub(fragment->truesize, &sc_capwap_fragment_memory);
+	fragment->truesize = 0;
+
 	/* Free socket buffer */
 	while (fragment->fragments) {
 		struct sk_buff* next = fragment->fragments->next;
@@ -34,6 +45,72 @@ static void sc_capwap_fragment_free(struct sc_capwap_fragment* fragment)
 	}
 }
 
+/* Remove the expired reassemblies, the LRU list is ordered by last update */
+static void sc_capwap_defrag_evictor(struct sc_capwap_fragment_queue* queue, ktime_t now)
+{
+	ktime_t delta;
+	struct sc_capwap_fragment* fragment;
+
+	TRACEKMOD("### sc_capwap_defrag_evictor\n");
+
+	while (!list_empty(&queue->lru_list)) {
+		fragment = list_first_entry(&queue->lru_list, struct sc_capwap_fragment, lru_list);
+		delta = ktime_sub(now, fragment->tstamp);
+		if ((delta.tv64 >= -NSEC_PER_SEC) && (delta.tv64 <= NSEC_PER_SEC)) {
+			break;
+		}
+
+		TRACEKMOD("*** Expired fragment %hu (%llu %llu)\n", fragment->fragmentid, now.tv64, fragment->tstamp.tv64);
+		this_cpu_inc(sc_capwap_defragstats.timeouts);
+		sc_capwap_fragment_free(queue, fragment);
+	}
+}
+
+/* Search the reassembly of fragment id, a new reassembly takes any free slot */
+static struct sc_capwap_fragment* sc_capwap_defrag_getfragment(struct sc_capwap_fragment_queue* queue, uint16_t frag_id)
+{
+	int i;
+	struct sc_capwap_fragment* fragment;
+
+	TRACEKMOD("### sc_capwap_defrag_getfragment\n");
+
+	/* Only the active reassemblies are into LRU list */
+	list_for_each_entry(fragment, &queue->lru_list, lru_list) {
+		if (fragment->fragmentid == frag_id) {
+			return fragment;
+		}
+	}
+
+	/* */
+	for (i = 0, fragment = NULL; i < CAPWAP_FRAGMENT_QUEUE; i++) {
+		if (!(queue->queues[i].flags & CAPWAP_FRAGMENT_ENABLE)) {
+			fragment = &queue->queues[i];
+			break;
+		}
+	}
+
+	/* All slots are used, drop the least recently updated reassembly */
+	if (!fragment) {
+		TRACEKMOD("*** All fragment queues are busy\n");
+
+		this_cpu_inc(sc_capwap_defragstats.busy);
+		fragment = list_first_entry(&queue->lru_list, struct sc_capwap_fragment, lru_list);
+		sc_capwap_fragment_free(queue, fragment);
+	}
+
+	/* Init fragment */
+	fragment->flags = CAPWAP_FRAGMENT_ENABLE;
+	fragment->fragmentid = frag_id;
+	fragment->fragments = NULL;
+	fragment->lastfragment = NULL;
+	fragment->recvlength = 0;
+	fragment->totallength = 0;
+	fragment->truesize = 0;
+	list_add_tail(&fragment->lru_list, &queue->lru_list);
+
+	return fragment;
+}
+
 /* */
 static void sc_capwap_freesession(struct sc_capwap_session* session)
 {
@@ -46,7 +123,7 @@ static void sc_capwap_freesession(struct sc_capwap_session* session)
 
 	/* Free socket buffers */
 	list_for_each_entry_safe(fragment, temp, &session->fragments.lru_list, lru_list) {
-		sc_capwap_fragment_free(fragment);
+		sc_capwap_fragment_free(&session->fragments, fragment);
 	}
 
 	for (i = 0; i < STA_HASH_SIZE; i++) {
@@ -57,32 +134,6 @@ static void sc_capwap_freesession(struct sc_capwap_session* session)
 	}
 }
 
-/* */
-static void sc_capwap_defrag_evictor(struct sc_capwap_session* session, ktime_t now) {
-	ktime_t delta;
-	struct sc_capwap_fragment* fragment;
-	struct list_head* list = &session->fragments.lru_list;
-
-	TRACEKMOD("### sc_capwap_defrag_evictor\n");
-
-	/* Light check without lock */
-	if (!list_empty(list)) {
-		spin_lock(&session->fragments.lock);
-
-		/* Remove last old fragment */
-		if (!list_empty(list)) {
-			fragment = list_first_entry(list, struct sc_capwap_fragment, lru_list);
-			delta = ktime_sub(now, fragment->tstamp);
-			if ((delta.tv64 < -NSEC_PER_SEC) || (delta.tv64 > NSEC_PER_SEC)) {
-				TRACEKMOD("*** Expired fragment %hu (%llu %llu)\n", fragment->fragmentid, now.tv64, fragment->tstamp.tv64);
-				sc_capwap_fragment_free(fragment);
-			}
-		}
-
-		spin_unlock(&session->fragments.lock);
-	}
-}
-
 /* */
 static struct sk_buff* sc_capwap_reasm(struct sc_capwap_fragment* fragment) {
 	int len;
@@ -97,8 +148,8 @@ static struct sk_buff* sc_capwap_reasm(struct sc_capwap_fragment* fragment) {
 	skbfrag = fragment->fragments;
 	len = GET_HLEN_HEADER((struct sc_capwap_header*)skbfrag->data) * 4;
 
-	/* Create new packet */
-	skb = alloc_skb(len + fragment->totallength, GFP_KERNEL);
+	/* Create new packet, called with lock of fragment queue */
+	skb = alloc_skb(len + fragment->totallength, GFP_ATOMIC);
 	if (!skb) {
 		return NULL;
 	}
@@ -138,6 +189,7 @@ static struct sk_buff* sc_capwap_defrag(struct sc_capwap_session* session, struc
 	struct sc_capwap_fragment* fragment;
 	struct sc_skb_capwap_cb* cb;
 	struct sk_buff* skb_defrag = NULL;
+	struct sc_capwap_fragment_queue* queue = &session->fragments;
 	struct sc_capwap_header* header = (struct sc_capwap_header*)skb->data;
 
 	TRACEKMOD("### sc_capwap_defrag\n");
@@ -158,26 +210,14 @@ static struct sk_buff* sc_capwap_defrag(struct sc_capwap_session* session, struc
 	cb->frag_length = skb->len - headersize;
 
 	/* */
-	spin_lock(&session->fragments.lock);
+	spin_lock(&queue->lock);
 	TRACEKMOD("*** Fragment info: id %hu offset %hu length %hu\n", frag_id, cb->frag_offset, cb->frag_length);
 
-	/* Get fragment */
-	fragment = &session->fragments.queues[frag_id % CAPWAP_FRAGMENT_QUEUE];
-	if ((fragment->flags & CAPWAP_FRAGMENT_ENABLE) && (fragment->fragmentid != frag_id)) {
-		TRACEKMOD("*** Unable defrag, queue fragment busy\n");
-		goto error2;	/* Queue fragment busy*/
-	}
+	/* Cleaning old fragments */
+	sc_capwap_defrag_evictor(queue, skb->tstamp);
 
-	/* Init fragment */
-	if (!(fragment->flags & CAPWAP_FRAGMENT_ENABLE)) {
-		fragment->flags = CAPWAP_FRAGMENT_ENABLE;
-		fragment->fragmentid = frag_id;
-		fragment->fragments = NULL;
-		fragment->lastfragment = NULL;
-		fragment->recvlength = 0;
-		fragment->totallength = 0;
-		list_add_tail(&fragment->lru_list, &session->fragments.lru_list);
-	}
+	/* Get fragment */
+	fragment = sc_capwap_defrag_getfragment(queue, frag_id);
 
 	/* Search fragment position */
 	prev = fragment->lastfragment;
@@ -187,7 +227,8 @@ static struct sk_buff* sc_capwap_defrag(struct sc_capwap_session* session, struc
 		if ((CAPWAP_SKB_CB(prev)->frag_offset + CAPWAP_SKB_CB(prev)->frag_length) <= cb->frag_offset) {
 			next = NULL;
 		} else {
-			sc_capwap_fragment_free(fragment);
+			this_cpu_inc(sc_capwap_defragstats.overlaps);
+			sc_capwap_fragment_free(queue, fragment);
 			TRACEKMOD("*** Unable defrag, overlap error\n");
 			goto error2;	/* Overlap error */
 		}
@@ -198,12 +239,14 @@ static struct sk_buff* sc_capwap_defrag(struct sc_capwap_session* session, struc
 
 			if (next_cb->frag_offset == cb->frag_offset) {
 				TRACEKMOD("*** Unable defrag, duplicate packet\n");
+				this_cpu_inc(sc_capwap_defragstats.duplicates);
 				goto error2;	/* Duplicate packet */
 			} else if (next_cb->frag_offset > cb->frag_offset) {
 				if ((cb->frag_offset + cb->frag_length) <= next_cb->frag_offset) {
 					break;
 				} else {
-					sc_capwap_fragment_free(fragment);
+					this_cpu_inc(sc_capwap_defragstats.overlaps);
+					sc_capwap_fragment_free(queue, fragment);
 					TRACEKMOD("*** Unable defrag, overlap error\n");
 					goto error2;	/* Overlap error */
 				}
@@ -213,6 +256,19 @@ static struct sk_buff* sc_capwap_defrag(struct sc_capwap_session* session, struc
 		}
 	}
 
+	/* Memory accounting, per session and global */
+	if ((queue->memory + skb->truesize) > CAPWAP_FRAGMENT_SESSION_MEMORY) {
+		TRACEKMOD("*** Unable defrag, session memory limit\n");
+		goto error3;
+	} else if (atomic_add_return(skb->truesize, &sc_capwap_fragment_memory) > CAPWAP_FRAGMENT_MEMORY) {
+		atomic_sub(skb->truesize, &sc_capwap_fragment_memory);
+		TRACEKMOD("*** Unable defrag, global memory limit\n");
+		goto error3;
+	}
+
+	queue->memory += skb->truesize;
+	fragment->truesize += skb->truesize;
+
 	/* Insert fragment */
 	skb->prev = NULL;
 	skb->next = next;
@@ -236,32 +292,47 @@ static struct sk_buff* sc_capwap_defrag(struct sc_capwap_session* session, struc
 	/* Check if receive all fragment */
 	if ((fragment->flags & CAPWAP_FRAGMENT_LAST) && (fragment->recvlength == fragment->totallength)) {
 		skb_defrag = sc_capwap_reasm(fragment);
+		if (skb_defrag) {
+			this_cpu_inc(sc_capwap_defragstats.reassembled);
+		}
 
 		/* Free fragment complete */
-		sc_capwap_fragment_free(fragment);
+		sc_capwap_fragment_free(queue, fragment);
 	} else {
 		/* Update timeout */
 		fragment->tstamp = skb->tstamp;
 		TRACEKMOD("*** Fragment id %hu expire at %llu\n", frag_id, fragment->tstamp.tv64);
 
 		/* Set LRU timeout */
-		if (!list_is_last(&fragment->lru_list, &session->fragments.lru_list)) {
-			list_move_tail(&fragment->lru_list, &session->fragments.lru_list);
+		if (!list_is_last(&fragment->lru_list, &queue->lru_list)) {
+			list_move_tail(&fragment->lru_list, &queue->lru_list);
 		}
 	}
 
-	spin_unlock(&session->fragments.lock);
+	spin_unlock(&queue->lock);
 
 	return skb_defrag;
 
+error3:
+	this_cpu_inc(sc_capwap_defragstats.nomemory);
+	if (!fragment->fragments) {
+		sc_capwap_fragment_free(queue, fragment);
+	}
+
 error2:
-	spin_unlock(&session->fragments.lock);
+	spin_unlock(&queue->lock);
 
 error:
 	kfree_skb(skb);
 	return NULL;
 }
 
+/* */
+int sc_capwap_defrag_memory(void)
+{
+	return atomic_read(&sc_capwap_fragment_memory);
+}
+
 /* */
 static unsigned int sc_capwap_80211_hdrlen(__le16 fc) {
 	unsigned int hdrlen = 24;
@@ -599,15 +670,13 @@ int sc_capwap_parsingpacket(struct sc_capwap_session* session,
 			headersize -= msglength;
 		}
 	} else if (session) {
-		if (!skb->tstamp.tv64) {
-			skb->tstamp = ktime_get();
-		}
-
-		/* Cleaning old fragments */
-		sc_capwap_defrag_evictor(session, skb->tstamp);
-
-		/* */
+		/* Only the fragments use the reassembly queue and its lock, the expired
+		   reassemblies are removed when the next fragment arrives */
 		if (IS_FLAG_F_HEADER(header)) {
+			if (!skb->tstamp.tv64) {
+				skb->tstamp = ktime_get();
+			}
+
 			skb = sc_capwap_defrag(session, skb);
 			if (!skb) {
 				return 0;
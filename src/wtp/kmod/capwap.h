@@ -5,6 +5,7 @@
 #include <linux/in.h>
 #include <linux/in6.h>
 #include <linux/skbuff.h>
+#include <linux/percpu.h>
 
 #include <net/protocol.h>
 #include <net/ip.h>
@@ -22,8 +23,11 @@
 #define MIN_MTU						500
 #define IEEE80211_MTU				7981
 
-/* */
-#define CAPWAP_FRAGMENT_QUEUE		16
+/* Reassembly slots and memory of every session, the memory of all sessions is
+   limited too */
+#define CAPWAP_FRAGMENT_QUEUE				16
+#define CAPWAP_FRAGMENT_SESSION_MEMORY		(256 * 1024)
+#define CAPWAP_FRAGMENT_MEMORY				(4 * 1024 * 1024)
 
 /* */
 #define CAPWAP_FRAGMENT_ENABLE		0x0001
@@ -95,16 +99,31 @@ struct sc_capwap_fragment {
 	struct sk_buff* lastfragment;
 	int recvlength;
 	int totallength;
+	int truesize;
 };
 
 /* */
 struct sc_capwap_fragment_queue {
 	spinlock_t lock;
 
+	/* Active reassemblies, any free slot can be used by a fragment id */
 	struct list_head lru_list;
 	struct sc_capwap_fragment queues[CAPWAP_FRAGMENT_QUEUE];
+	int memory;
+};
+
+/* Reassembly counters */
+struct sc_capwap_defragstats {
+	unsigned long reassembled;
+	unsigned long timeouts;
+	unsigned long overlaps;
+	unsigned long duplicates;
+	unsigned long busy;
+	unsigned long nomemory;
 };
 
+DECLARE_PER_CPU(struct sc_capwap_defragstats, sc_capwap_defragstats);
+
 /* */
 struct sc_capwap_session {
 	struct net *net;
@@ -133,6 +152,8 @@ int sc_capwap_create(struct sc_capwap_session *session);
 int sc_capwap_send(struct sc_capwap_session *session, uint8_t* buffer, int length);
 void sc_capwap_close(struct sc_capwap_session *session);
 
+int sc_capwap_defrag_memory(void);
+
 int sc_capwap_8023_to_80211(struct sk_buff* skb, const uint8_t* bssid);
 int sc_capwap_80211_to_8023(struct sk_buff* skb);
 
@@ -4,6 +4,8 @@
 #include <linux/kthread.h>
 #include <linux/etherdevice.h>
 #include <linux/ieee80211.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
 
 #include <net/net_namespace.h>
 #include <net/mac80211.h>
@@ -14,6 +16,9 @@
 #include "nlsmartcapwap.h"
 #include "netlinkapp.h"
 
+/* Statistics */
+static struct dentry* sc_debugfs_dir;
+
 /* */
 int sc_capwap_init(struct sc_capwap_session *session, struct net *net)
 {
@@ -39,6 +44,62 @@ int sc_capwap_init(struct sc_capwap_session *session, struct net *net)
 	return 0;
 }
 
+/* */
+static int sc_capwap_stats_show(struct seq_file* seq, void* v)
+{
+	int cpu;
+	struct sc_capwap_defragstats* defragstats;
+	struct sc_capwap_defragstats total;
+
+	/* Reassembly of all sessions */
+	memset(&total, 0, sizeof(struct sc_capwap_defragstats));
+	for_each_possible_cpu(cpu) {
+		defragstats = per_cpu_ptr(&sc_capwap_defragstats, cpu);
+		total.reassembled += defragstats->reassembled;
+		total.timeouts += defragstats->timeouts;
+		total.overlaps += defragstats->overlaps;
+		total.duplicates += defragstats->duplicates;
+		total.busy += defragstats->busy;
+		total.nomemory += defragstats->nomemory;
+	}
+
+	seq_printf(seq, "reassembled timeouts overlaps duplicates busy nomemory memory\n");
+	seq_printf(seq, "%lu %lu %lu %lu %lu %lu %d\n", total.reassembled, total.timeouts, total.overlaps, total.duplicates, total.busy, total.nomemory, sc_capwap_defrag_memory());
+
+	return 0;
+}
+
+/* */
+static int sc_capwap_stats_open(struct inode* inode, struct file* file)
+{
+	return single_open(file, sc_capwap_stats_show, NULL);
+}
+
+/* */
+static const struct file_operations sc_capwap_stats_fops = {
+	.owner = THIS_MODULE,
+	.open = sc_capwap_stats_open,
+	.read = seq_read,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+
+/* Statistics of module, debugfs is optional */
+void sc_capwap_debugfs_init(void)
+{
+	sc_debugfs_dir = debugfs_create_dir("smartcapwap_wtp", NULL);
+	if (!IS_ERR_OR_NULL(sc_debugfs_dir)) {
+		debugfs_create_file("stats", S_IRUSR, sc_debugfs_dir, NULL, &sc_capwap_stats_fops);
+	}
+}
+
+/* */
+void sc_capwap_debugfs_exit(void)
+{
+	debugfs_remove_recursive(sc_debugfs_dir);
+	sc_debugfs_dir = NULL;
+}
+
 /* */
 void sc_capwap_resetsession(struct sc_capwap_session *session)
 {
@@ -21,5 +21,9 @@ void sc_capwap_resetsession(struct sc_capwap_session *sc_acsession);
 /* */
 int sc_capwap_sendkeepalive(struct sc_capwap_session *sc_acsession);
 
+/* */
+void sc_capwap_debugfs_init(void);
+void sc_capwap_debugfs_exit(void);
+
 #endif /* __KMOD_CAPWAP_PRIVATE_HEADER__ */
 
@@ -15,6 +15,7 @@ static int __init smartcapwap_wtp_init(void) {
 		return ret;
 	}
 
+	sc_capwap_debugfs_init();
 	return ret;
 }
 module_init(smartcapwap_wtp_init);
@@ -23,6 +24,7 @@ module_init(smartcapwap_wtp_init);
 static void __exit smartcapwap_wtp_exit(void) {
 	TRACEKMOD("### smartcapwap_wtp_exit\n");
 
+	sc_capwap_debugfs_exit();
 	sc_netlink_exit();
 }
 module_exit(smartcapwap_wtp_exit);
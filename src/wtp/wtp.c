@@ -68,6 +68,9 @@ static int wtp_init(void)
 	g_wtp.requestfragmentpacket = capwap_list_create();
 	g_wtp.responsefragmentpacket = capwap_list_create();
 
+	/* Rx packets */
+	g_wtp.recvbatch = capwap_recv_batch_create(WTP_RECV_BATCH_SIZE, CAPWAP_MAX_PACKET_SIZE);
+
 	wtp_reset_state();
 
 	/* AC information */
@@ -115,6 +118,7 @@ static void wtp_destroy(void) {
 	/* Free fragments packet */
 	capwap_list_free(g_wtp.requestfragmentpacket);
 	capwap_list_free(g_wtp.responsefragmentpacket);
+	capwap_recv_batch_free(g_wtp.recvbatch);
 
 	/* Free list AC */
 	capwap_array_free(g_wtp.acdiscoveryarray);
@@ -1078,6 +1082,58 @@ static int wtp_parsing_configuration_1_0(config_t* config) {
 				}
 			}
 
+			/* Set DTLS version and cipher suites of WTP */
+			dtlsparam.version = CAPWAP_DTLS_VERSION_ANY;
+			if (config_lookup_string(config, "application.dtls.version", &configString) == CONFIG_TRUE) {
+				if (!strcmp(configString, "any")) {
+					dtlsparam.version = CAPWAP_DTLS_VERSION_ANY;
+				} else if (!strcmp(configString, "1.2")) {
+					dtlsparam.version = CAPWAP_DTLS_VERSION_1_2;
+				} else if (!strcmp(configString, "1.0")) {
+					dtlsparam.version = CAPWAP_DTLS_VERSION_1_0;
+				} else {
+					log_printf(LOG_ERR, "Invalid configuration file, unknown application.dtls.version value");
+					return 0;
+				}
+			}
+
+			/* Set DTLS session cache of WTP */
+			dtlsparam.sessioncache.size = WTP_DEFAULT_DTLS_SESSIONCACHE_SIZE;
+			dtlsparam.sessioncache.timeout = WTP_DEFAULT_DTLS_SESSIONCACHE_TIMEOUT;
+			if (config_lookup_int(config, "application.dtls.sessioncache.size", &configInt) == CONFIG_TRUE) {
+				if (configInt >= 0) {
+					dtlsparam.sessioncache.size = (unsigned long)configInt;
+				} else {
+					log_printf(LOG_ERR, "Invalid configuration file, invalid application.dtls.sessioncache.size value");
+					return 0;
+				}
+			}
+
+			if (config_lookup_int(config, "application.dtls.sessioncache.timeout", &configInt) == CONFIG_TRUE) {
+				if (configInt > 0) {
+					dtlsparam.sessioncache.timeout = (long)configInt;
+				} else {
+					log_printf(LOG_ERR, "Invalid configuration file, invalid application.dtls.sessioncache.timeout value");
+					return 0;
+				}
+			}
+
+			if (config_lookup_string(config, "application.dtls.sessioncache.file", &configString) == CONFIG_TRUE) {
+				if (strlen(configString) > 0) {
+					dtlsparam.sessioncache.file = capwap_duplicate_string(configString);
+				}
+			}
+
+			if (config_lookup_string(config, "application.dtls.ciphers", &configString) == CONFIG_TRUE) {
+				if (strlen(configString) > 0) {
+					dtlsparam.ciphers = capwap_duplicate_string(configString);
+				}
+			}
+
+			if (config_lookup_bool(config, "application.dtls.sessioncache.tickets", &configBool) == CONFIG_TRUE) {
+				dtlsparam.sessioncache.tickets = (configBool ? 1 : 0);
+			}
+
 			/* Set DTLS configuration of WTP */
 			if (dtlsparam.mode == CAPWAP_DTLS_MODE_CERTIFICATE) {
 				if (config_lookup_string(config, "application.dtls.x509.calist", &configString) == CONFIG_TRUE) {
@@ -1147,6 +1203,14 @@ static int wtp_parsing_configuration_1_0(config_t* config) {
 				}
 			}
 
+			if (dtlsparam.sessioncache.file) {
+				capwap_free(dtlsparam.sessioncache.file);
+			}
+
+			if (dtlsparam.ciphers) {
+				capwap_free(dtlsparam.ciphers);
+			}
+
 			if (!g_wtp.enabledtls) {
 				return 0;
 			}
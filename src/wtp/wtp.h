@@ -32,6 +32,9 @@
 #define WTP_DTLS_SESSION_DELETE					5000
 #define WTP_FAILED_DTLS_SESSION_RETRY			3
 
+#define WTP_DEFAULT_DTLS_SESSIONCACHE_SIZE		4
+#define WTP_DEFAULT_DTLS_SESSIONCACHE_TIMEOUT	3600
+
 #define WTP_RETRANSMIT_INTERVAL					3000
 #define WTP_MAX_RETRANSMIT						5
 
@@ -44,6 +47,8 @@
 
 #define WTP_INIT_REMOTE_SEQUENCE				0xff
 
+#define WTP_RECV_BATCH_SIZE						8
+
 #define WTP_TUNNEL_DATA_FRAME_NONE				0x00000000
 #define WTP_TUNNEL_DATA_FRAME_KERNELMODE		0x00000001
 #define WTP_TUNNEL_DATA_FRAME_USERMODE			0x00000002
@@ -121,6 +126,7 @@ struct wtp_t {
 	/* */
 	unsigned short fragmentid;
 	struct capwap_packet_rxmng* rxmngpacket;
+	struct capwap_recv_batch* recvbatch;
 
 	/* */
 	uint8_t localseqnumber;
@@ -150,7 +150,6 @@ static void wtp_dfa_process_packet(void *buffer, int buffersize,
 				   union sockaddr_capwap *toaddr)
 {
 	int check, res;
-	char plain[CAPWAP_MAX_PACKET_SIZE];
 	struct capwap_packet_rxmng* rxmngpacket;
 	struct capwap_parsed_packet packet;
 
@@ -170,12 +169,10 @@ static void wtp_dfa_process_packet(void *buffer, int buffersize,
 	case CAPWAP_DTLS_PACKET: {
 		int oldaction = g_wtp.dtls.action;
 
-		/* Decrypt packet */
-		buffersize = capwap_decrypt_packet(&g_wtp.dtls, buffer, buffersize, plain, CAPWAP_MAX_PACKET_SIZE);
-		if (buffersize > 0) {
-			buffer = plain;
+		/* Decrypt packet in place */
+		buffersize = capwap_decrypt_packet(&g_wtp.dtls, buffer, buffersize, NULL, buffersize);
+		if (buffersize > 0)
 			break;
-		}
 
 		if (buffersize == CAPWAP_ERROR_AGAIN) {
 			/* Check is handshake complete */
@@ -330,19 +327,15 @@ void wtp_socket_io_stop()
 
 static void capwap_control_cb(EV_P_ ev_io *w, int revents)
 {
-	char buffer[CAPWAP_MAX_PACKET_SIZE];
-	ssize_t r;
-	union sockaddr_capwap fromaddr;
-	union sockaddr_capwap toaddr;
+	int i;
+	int r;
+	struct capwap_recv_packet* packet;
 
 	while (42) {
-		/* If request wait packet from AC */
-		do {
-			log_printf(LOG_DEBUG, "Receive CAPWAP Control Channel message");
-			r = capwap_recvfrom(w->fd, &buffer, sizeof(buffer),
-					    &fromaddr, &toaddr);
-		} while (r < 0 && errno == EINTR);
-		log_printf(LOG_DEBUG, "WTP got data: r: %zd", r);
+		/* If request wait packets from AC */
+		log_printf(LOG_DEBUG, "Receive CAPWAP Control Channel message");
+		r = capwap_recvfrom_batch(w->fd, g_wtp.recvbatch);
+		log_printf(LOG_DEBUG, "WTP got data: r: %d", r);
 
 		if (!g_wtp.running) {
 			log_printf(LOG_DEBUG, "Closing WTP, Teardown connection");
@@ -352,20 +345,23 @@ static void capwap_control_cb(EV_P_ ev_io *w, int revents)
 		}
 
 		if (r < 0) {
-			if (errno != EAGAIN) {
-				log_printf(LOG_DEBUG, "capwap_control_cb I/O error %m, exiting loop");
-				ev_io_stop (EV_A_ w);
-				ev_break (EV_A_ EVBREAK_ONE);
-			}
+			log_printf(LOG_DEBUG, "capwap_control_cb I/O error %m, exiting loop");
+			ev_io_stop (EV_A_ w);
+			ev_break (EV_A_ EVBREAK_ONE);
+			break;
+		} else if (!r) {
 			break;
 		}
 
-		if (g_wtp.teardown) {
-			log_printf(LOG_DEBUG, "WTP is in teardown, drop packet");
-			continue;		/* Drop packet */
-		}
+		for (i = 0; i < g_wtp.recvbatch->count; i++) {
+			if (g_wtp.teardown) {
+				log_printf(LOG_DEBUG, "WTP is in teardown, drop packet");
+				continue;		/* Drop packet */
+			}
 
-		wtp_dfa_process_packet(&buffer, r, &fromaddr, &toaddr);
+			packet = &g_wtp.recvbatch->packets[i];
+			wtp_dfa_process_packet(packet->buffer, packet->size, &packet->fromaddr, &packet->toaddr);
+		}
 	}
 }
 
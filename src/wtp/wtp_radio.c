@@ -182,15 +182,12 @@ static void wtp_radio_setconfiguration_80211(struct capwap_parsed_packet *packet
 					     struct capwap_array *updateitems)
 {
 	int i;
+	unsigned short j;
 	struct wtp_radio* radio;
-	struct capwap_list_item* search;
 
 	/* Set radio configuration and invalidate the old values */
-	for (search = packet->messages->first;
-	     search != NULL;
-	     search = search->next)
-	{
-		struct capwap_message_element_itemlist *messageelement = (struct capwap_message_element_itemlist *)search->item;
+	for (j = 0; j < packet->count; j++) {
+		struct capwap_message_element_itemlist *messageelement = &packet->elements[j];
 		struct capwap_array *messageelements = (struct capwap_array *)messageelement->data;
 
 		/* Parsing only IEEE 802.11 message element */
@@ -246,11 +243,8 @@ static void wtp_radio_setconfiguration_80211(struct capwap_parsed_packet *packet
 	}
 
 	/* Update new values */
-	for (search = packet->messages->first;
-	     search != NULL;
-	     search = search->next)
-	{
-		struct capwap_message_element_itemlist* messageelement = (struct capwap_message_element_itemlist*)search->item;
+	for (j = 0; j < packet->count; j++) {
+		struct capwap_message_element_itemlist *messageelement = &packet->elements[j];
 		struct capwap_array *messageelements = (struct capwap_array *)messageelement->data;
 
 		/* Parsing only IEEE 802.11 message element */
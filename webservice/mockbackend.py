@@ -0,0 +1,170 @@
+#!/usr/bin/env python3
+#
+# Minimal Backend for tests of AC, it implements the operations of smartcapwap.wsdl
+# without logic: every WTP is authorized, no events are sent and every station
+# is authorized on the same data channel interface.
+#
+#	mockbackend.py [--port 8080] [--ifindex 0] [--vlan 0] [--no-batch | --fail-batch]
+#
+# The Backend of AC configuration is http://<host>:<port>/. With --no-batch the
+# authorizeStations operation is unknown as for a Backend that predates it, with
+# --fail-batch it fails with a server fault.
+
+import argparse
+import base64
+import json
+import time
+import uuid
+import xml.etree.ElementTree as ElementTree
+from http.server import BaseHTTPRequestHandler, ThreadingHTTPServer
+
+SOAP_ENVELOPE_URI = "http://schemas.xmlsoap.org/soap/envelope/"
+SOAP_NAMESPACE_URI = "http://smartcapwap/namespace"
+
+# Time waited by waitBackendEvent before an empty list of events
+WAIT_EVENT_TIMEOUT = 5
+
+options = None
+
+
+def encode_json(value):
+	return base64.b64encode(json.dumps(value).encode("utf-8")).decode("ascii")
+
+
+def decode_json(value):
+	return json.loads(base64.b64decode(value).decode("utf-8"))
+
+
+# Result of authorizeStation
+def authorize_station(wtpid, station):
+	result = {"DataChannelInterface": {"Index": options.ifindex}}
+	if options.vlan:
+		result["DataChannelInterface"]["VLAN"] = options.vlan
+
+	print("authorize station %s of WTP %s" % (station.get("Station"), wtpid), flush=True)
+	return result
+
+
+def op_joinBackend(params):
+	return str(uuid.uuid4())
+
+
+def op_waitBackendEvent(params):
+	time.sleep(WAIT_EVENT_TIMEOUT)
+	return encode_json([])
+
+
+def op_authorizeWTPSession(params):
+	return "true"
+
+
+def op_checkWTPSession(params):
+	return "true"
+
+
+def op_authorizeStation(params):
+	return encode_json(authorize_station(params.get("idwtp"), decode_json(params["station"])))
+
+
+def op_authorizeStations(params):
+	if options.no_batch:
+		raise SoapFault("SOAP-ENV:Client", "Procedure 'authorizeStations' not present")
+	elif options.fail_batch:
+		raise SoapFault("SOAP-ENV:Server", "Backend is busy")
+
+	stations = decode_json(params["stations"])["Stations"]
+	print("batch of %d stations" % len(stations), flush=True)
+	return encode_json({"Stations": [authorize_station(item.get("WTPId"), item.get("Station", {})) for item in stations]})
+
+
+def op_json(params):
+	return encode_json({})
+
+
+def op_empty(params):
+	return None
+
+
+OPERATIONS = {
+	"joinBackend": op_joinBackend,
+	"leaveBackend": op_empty,
+	"waitBackendEvent": op_waitBackendEvent,
+	"updateBackendEvent": op_empty,
+	"getConfiguration": op_json,
+	"authorizeWTPSession": op_authorizeWTPSession,
+	"joinWTPSession": op_json,
+	"configureStatusWTPSession": op_json,
+	"changeStateWTPSession": op_json,
+	"runningWTPSession": op_empty,
+	"teardownWTPSession": op_empty,
+	"checkWTPSession": op_checkWTPSession,
+	"getWTPConfiguration": op_json,
+	"authorizeStation": op_authorizeStation,
+	"authorizeStations": op_authorizeStations,
+}
+
+
+class SoapFault(Exception):
+	def __init__(self, faultcode, faultstring):
+		Exception.__init__(self, faultstring)
+		self.faultcode = faultcode
+		self.faultstring = faultstring
+
+
+def envelope(body):
+	return ('<?xml version="1.0" encoding="UTF-8"?>\n'
+		'<SOAP-ENV:Envelope xmlns:SOAP-ENV="%s" xmlns:ns1="%s"><SOAP-ENV:Body>%s</SOAP-ENV:Body></SOAP-ENV:Envelope>' % (SOAP_ENVELOPE_URI, SOAP_NAMESPACE_URI, body))
+
+
+class BackendHandler(BaseHTTPRequestHandler):
+	protocol_version = "HTTP/1.1"
+
+	def do_POST(self):
+		length = int(self.headers.get("Content-Length", 0))
+		request = ElementTree.fromstring(self.rfile.read(length))
+
+		# RPC style, the first element of body is the operation
+		body = request.find("{%s}Body" % SOAP_ENVELOPE_URI)
+		operation = body[0]
+		method = operation.tag.split("}")[-1]
+		params = dict((param.tag.split("}")[-1], param.text or "") for param in operation)
+
+		try:
+			if method not in OPERATIONS:
+				raise SoapFault("SOAP-ENV:Client", "Procedure '%s' not present" % method)
+
+			result = OPERATIONS[method](params)
+			value = ("" if result is None else "<return>%s</return>" % result)
+			self.reply(200, envelope("<ns1:%sResponse>%s</ns1:%sResponse>" % (method, value, method)))
+		except SoapFault as fault:
+			self.reply(500, envelope("<SOAP-ENV:Fault><faultcode>%s</faultcode><faultstring>%s</faultstring></SOAP-ENV:Fault>" % (fault.faultcode, fault.faultstring)))
+
+	def reply(self, code, body):
+		data = body.encode("utf-8")
+		self.send_response(code)
+		self.send_header("Content-Type", "text/xml; charset=utf-8")
+		self.send_header("Content-Length", str(len(data)))
+		self.end_headers()
+		self.wfile.write(data)
+
+	def log_message(self, format, *args):
+		pass
+
+
+def main():
+	global options
+
+	parser = argparse.ArgumentParser(description="Minimal SmartCAPWAP Backend")
+	parser.add_argument("--port", type=int, default=8080)
+	parser.add_argument("--ifindex", type=int, default=0, help="data channel interface index of the stations")
+	parser.add_argument("--vlan", type=int, default=0, help="VLAN of the stations into AC")
+	group = parser.add_mutually_exclusive_group()
+	group.add_argument("--no-batch", action="store_true", help="authorizeStations is an unknown operation")
+	group.add_argument("--fail-batch", action="store_true", help="authorizeStations fails with a server fault")
+	options = parser.parse_args()
+
+	ThreadingHTTPServer(("", options.port), BackendHandler).serve_forever()
+
+
+if __name__ == "__main__":
+	main()